@@ -10,6 +10,13 @@ void UnpackAux(uint data, inout bool is_trim, inout uint edge_flag, inout uint l
     lvl = data >> 3;
 }
 
+//Maps world quad coordinates to texel coordinates of the toroidal height cache
+//Integer modulo is undefined for negative operands in glsl, hence the floor
+ivec2 WrapCacheCoords(ivec2 coords, int res)
+{
+    return coords - res * ivec2(floor(vec2(coords) / float(res)));
+}
+
 //Trim geometry needs to be mirrored along x/z axis
 //during each move. We simulate this with rotations, 
 //since we cannot change orientation as we are using face culling.
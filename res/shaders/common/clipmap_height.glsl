@@ -0,0 +1,101 @@
+//Height sampling shared by the clipmap vertex shaders and the instanced clipmap.
+//Requires clipmap.glsl to be included first.
+
+//Needs to match enum used to generate vertex data
+#define EDGE_FLAG_NONE 0
+#define EDGE_FLAG_HORIZONTAL 1
+#define EDGE_FLAG_VERTICAL 2
+
+bool OffsetSamples(float pos, float quad_size, int id)
+{
+    bool offset_samples = (abs((mod(pos, 2.0*quad_size) - quad_size)) > 0.5*quad_size);
+
+    if (id == 0) offset_samples = !offset_samples;
+
+    return offset_samples;
+}
+
+//Computes world (xz) positions at which height of the given clipmap vertex should be sampled.
+//At the edges between levels two samples are averaged, so that vertices line up with the coarser level.
+//Otherwise both samples are equal to the vertex position.
+void GetClipmapSamples(vec2 vert_pos, vec2 camera_pos, float quad_size, bool trim_flag, uint edge_flag,
+                       inout vec2 world_pos, inout vec2 sample1, inout vec2 sample2)
+{
+    //Base sampling position needs to be calculated after considering
+    //possible movement of trim geometry
+    int id = 0;
+    ivec2 id2 = ivec2(0);
+    vec2 hoffset = vec2(0);
+    vec2 pos2 = GetClipmapPos(vert_pos, camera_pos, quad_size, trim_flag, id, id2, hoffset);
+
+    world_pos = pos2 + hoffset;
+
+    sample1 = world_pos;
+    sample2 = world_pos;
+
+    #define CORRECT_SEAMS
+    #ifdef CORRECT_SEAMS
+
+    if (edge_flag != EDGE_FLAG_NONE)
+    {
+        //At this point the edge flag is either HORIZONTAL or VERTICAL
+        //so we may store this in one bool
+        bool horizontal = (edge_flag == EDGE_FLAG_HORIZONTAL);
+
+        //Depending on the rotation of the trim mesh we may need to change 
+        //the vertical/horizontal orientation of our seam-correction
+        bool swap_axes = (trim_flag && (id == 1 || id == 2));
+
+        if (swap_axes)
+            horizontal = !horizontal;
+
+        vec2 offset = horizontal
+                    ? vec2(quad_size, 0.0)
+                    : vec2(0.0, quad_size);
+
+        bool offset_samples = horizontal
+                            ? OffsetSamples(pos2.x, quad_size, id2.x)
+                            : OffsetSamples(pos2.y, quad_size, id2.y);
+
+        if(offset_samples)
+        {
+            sample1 -= offset;
+            sample2 += offset;
+        }
+    }
+
+    #endif
+}
+
+//Positions are in render space, origin_uv is the heightmap uv of the render origin.
+//Returns unscaled height at the given clipmap vertex sampled directly from the heightmap,
+//world (xz) position is returned via world_pos.
+float GetClipmapHeight(sampler2D hmap, vec2 vert_pos, vec2 camera_pos, float quad_size, float scale_xz, vec2 origin_uv,
+                       bool trim_flag, uint edge_flag, inout vec2 world_pos)
+{
+    vec2 sample1 = vec2(0), sample2 = vec2(0);
+    GetClipmapSamples(vert_pos, camera_pos, quad_size, trim_flag, edge_flag, world_pos, sample1, sample2);
+
+    vec2 uv1 = 0.5 * (2.0/scale_xz) * sample1 + 0.5 + origin_uv;
+    vec2 uv2 = 0.5 * (2.0/scale_xz) * sample2 + 0.5 + origin_uv;
+
+    return 0.5 * (texture(hmap, uv1).r + texture(hmap, uv2).r);
+}
+
+//Same as above, but fetches heights from the toroidal height cache filled by displace.glsl
+float GetClipmapHeightCached(sampler2DArray cache, vec2 vert_pos, vec2 camera_pos, float quad_size, uint lvl,
+                             bool trim_flag, uint edge_flag, inout vec2 world_pos)
+{
+    vec2 sample1 = vec2(0), sample2 = vec2(0);
+    GetClipmapSamples(vert_pos, camera_pos, quad_size, trim_flag, edge_flag, world_pos, sample1, sample2);
+
+    int res = textureSize(cache, 0).x;
+
+    ivec2 texel1 = WrapCacheCoords(ivec2(round(sample1 / quad_size)), res);
+    ivec2 texel2 = WrapCacheCoords(ivec2(round(sample2 / quad_size)), res);
+
+    float height1 = texelFetch(cache, ivec3(texel1, lvl), 0).r;
+    float height2 = texelFetch(cache, ivec3(texel2, lvl), 0).r;
+
+    return 0.5 * (height1 + height2);
+}
@@ -0,0 +1,69 @@
+//Vertex placement for the instanced clipmap. Canonical meshes are stored in local
+//quad coordinates and placed with per-instance offsets/levels, heights are
+//sampled from the heightmap directly.
+//Vertex data comes either from vertex attributes or from clipmap_pulled.glsl.
+//Requires clipmap.glsl and clipmap_height.glsl to be included first.
+
+//Needs to match flags used to generate instance/vertex data
+#define BORDER_LEFT     1u
+#define BORDER_RIGHT    2u
+#define BORDER_TOP      4u
+#define BORDER_BOTTOM   8u
+#define BORDER_START   16u
+#define BORDER_END     32u
+#define BORDER_VERTICAL 64u
+#define BORDER_STRIP  128u
+
+//Reproduces edge flags that the non-instanced clipmap stores per vertex
+uint GetInstancedEdgeFlag(uint border, uint inst_flags, bool trim_flag)
+{
+    if ((border & BORDER_STRIP) == 0u)
+    {
+        uint edge = border & inst_flags;
+
+        if ((edge & (BORDER_LEFT | BORDER_RIGHT)) != 0u)
+            return uint(EDGE_FLAG_VERTICAL);
+
+        if ((edge & (BORDER_TOP | BORDER_BOTTOM)) != 0u)
+            return uint(EDGE_FLAG_HORIZONTAL);
+
+        return uint(EDGE_FLAG_NONE);
+    }
+
+    bool horizontal = ((border & BORDER_VERTICAL) == 0u);
+
+    uint aligned  = horizontal ? uint(EDGE_FLAG_HORIZONTAL) : uint(EDGE_FLAG_VERTICAL);
+    uint opposite = horizontal ? uint(EDGE_FLAG_VERTICAL) : uint(EDGE_FLAG_HORIZONTAL);
+
+    if (trim_flag)
+    {
+        bool at_end = ((border & (BORDER_START | BORDER_END)) != 0u);
+        return at_end ? opposite : aligned;
+    }
+
+    bool at_edge = ((border & inst_flags & (BORDER_START | BORDER_END)) != 0u);
+    return at_edge ? opposite : uint(EDGE_FLAG_NONE);
+}
+
+//Returns world position of the given vertex, with unscaled height in the y component
+vec3 GetInstancedVertex(sampler2D hmap, vec2 camera_pos, float scale_xz, vec2 origin_uv,
+                        ivec2 pos, uint border, ivec2 inst_offset, uint inst_aux, uint inst_flags,
+                        inout uint edge_flag)
+{
+    bool trim_flag = false;
+    uint unused_edge = 0, lvl = 0;
+
+    UnpackAux(inst_aux, trim_flag, unused_edge, lvl);
+
+    edge_flag = GetInstancedEdgeFlag(border, inst_flags, trim_flag);
+
+    float quad_size = QuadSizes[lvl];
+
+    vec2 vert_pos = quad_size * vec2(pos + inst_offset);
+
+    vec2 world_pos = vec2(0);
+    float height = GetClipmapHeight(hmap, vert_pos, camera_pos, quad_size, scale_xz, origin_uv,
+                                    trim_flag, edge_flag, world_pos);
+
+    return vec3(world_pos.x, height, world_pos.y);
+}
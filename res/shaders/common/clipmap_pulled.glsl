@@ -0,0 +1,93 @@
+//Vertex pulling for the instanced clipmap. There are no vertex or index buffers,
+//vertices of the canonical meshes are reconstructed from gl_VertexID
+//and per-instance data is read from a storage buffer.
+//Needs to match PulledHeader and PulledMeshType in the clipmap sources.
+//Requires clipmap_instanced.glsl to be included first.
+
+#define PULLED_MESH_COUNT 7u
+
+#define PULLED_GRID       0u
+#define PULLED_HORIZONTAL 1u
+#define PULLED_VERTICAL   2u
+
+struct PulledMesh {
+    uint First;
+    uint Count;
+    uint VertsPerLine;
+    uint Type;
+};
+
+layout(std430, binding = 4) readonly buffer pulled
+{
+    PulledMesh Meshes[PULLED_MESH_COUNT];
+    uint FirstInstances[PULLED_MESH_COUNT];
+    uint Padding;
+    //Packed ClipmapInstance: x - offset x/z, y - aux data/flags
+    uvec2 Instances[];
+};
+
+//Corners of the two triangles of a quad, in the same order as the index buffers
+const ivec2 GridCorners[6] = ivec2[6](
+    ivec2(0, 0), ivec2(1, 0), ivec2(0, 1),
+    ivec2(1, 0), ivec2(1, 1), ivec2(0, 1)
+);
+
+//Strip vertices alternate between the two sides, so corners are offsets from the first one
+const uint HorizontalCorners[6] = uint[6](0u, 2u, 1u, 1u, 2u, 3u);
+const uint VerticalCorners[6]   = uint[6](0u, 1u, 2u, 1u, 3u, 2u);
+
+void PullVertex(out ivec2 pos, out uint border, out ivec2 inst_offset, out uint inst_aux, out uint inst_flags)
+{
+    uint vertex_id = uint(gl_VertexID);
+
+    //Mesh ranges are consecutive and ordered by id
+    uint mesh_id = 0u;
+
+    for (uint i = 1u; i < PULLED_MESH_COUNT; i++)
+    {
+        if (vertex_id >= Meshes[i].First)
+            mesh_id = i;
+    }
+
+    PulledMesh mesh = Meshes[mesh_id];
+
+    uint local_id = vertex_id - mesh.First;
+    uint quad = local_id / 6u;
+    uint corner = local_id % 6u;
+
+    uint n = mesh.VertsPerLine;
+
+    if (mesh.Type == PULLED_GRID)
+    {
+        pos = ivec2(quad % (n - 1u), quad / (n - 1u)) + GridCorners[corner];
+
+        border = 0u;
+
+        if (pos.x == 0)          border |= BORDER_LEFT;
+        if (pos.x == int(n) - 1) border |= BORDER_RIGHT;
+        if (pos.y == 0)          border |= BORDER_BOTTOM;
+        if (pos.y == int(n) - 1) border |= BORDER_TOP;
+    }
+
+    else
+    {
+        bool vertical = (mesh.Type == PULLED_VERTICAL);
+
+        uint id = 2u * quad + (vertical ? VerticalCorners[corner] : HorizontalCorners[corner]);
+
+        pos = vertical ? ivec2(id % 2u, id / 2u) : ivec2(id / 2u, id % 2u);
+
+        border = BORDER_STRIP;
+
+        if (vertical)          border |= BORDER_VERTICAL;
+        if (id < 2u)           border |= BORDER_START;
+        if (id >= 2u * n - 2u) border |= BORDER_END;
+    }
+
+    //gl_InstanceID doesn't include the base instance
+    uvec2 inst = Instances[FirstInstances[mesh_id] + uint(gl_InstanceID)];
+
+    inst_offset = ivec2(bitfieldExtract(int(inst.x), 0, 16), bitfieldExtract(int(inst.x), 16, 16));
+    inst_aux = inst.y & 0xFFFFu;
+    inst_flags = inst.y >> 16;
+}
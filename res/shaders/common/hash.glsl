@@ -1,3 +1,6 @@
+#ifndef HASH_GLSL
+#define HASH_GLSL
+
 //High-quality hash function by nojima:
 //https://www.shadertoy.com/view/ttc3zr
 uint murmurHash12(uvec2 src) {
@@ -44,4 +47,6 @@ vec2 hash22(vec2 src, float scale) {
 
     uvec2 h = murmurHash22(floatBitsToUint(src));
     return uintBitsToFloat(h & 0x007fffffu | 0x3f800000u) - 1.0;
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,32 @@
+//Min/max height pyramid, see MapGenerator::GenMinMaxPyramid.
+//Level l has (res >> (l+1))^2 texels, each storing (min, max) of the heightmap texels it covers.
+//Levels are packed row-major one after another, starting with the finest one.
+
+//Needs to match MapGenerator::s_MinMaxBinding
+layout(std430, binding = 6) coherent buffer minMaxPyramid
+{
+    vec2 MinMax[];
+};
+
+//Resolution of the source heightmap
+uniform int uPyramidRes;
+
+int PyramidSize(int level)
+{
+    return uPyramidRes >> (level + 1);
+}
+
+//Sum of (res >> (k+1))^2 over all finer levels k
+int PyramidOffset(int level)
+{
+    int coarse = uPyramidRes >> level;
+    return (uPyramidRes * uPyramidRes - coarse * coarse) / 3;
+}
+
+vec2 LoadMinMax(ivec2 coord, int level)
+{
+    int size = PyramidSize(level);
+    coord = clamp(coord, ivec2(0), ivec2(size - 1));
+
+    return MinMax[PyramidOffset(level) + coord.y * size + coord.x];
+}
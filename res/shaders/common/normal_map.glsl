@@ -0,0 +1,33 @@
+//Sampling of the terrain normal map, see MapGenerator::BindNormalmap.
+//Normals are either stored as rgb with ao in alpha, or hemi-octahedral in rg
+//with ao in a separate map. Terrain normals always point up, so the upper half
+//of the octahedron is enough and filtering never crosses a fold.
+
+uniform sampler2D normalmap;
+uniform sampler2D aomap;
+
+uniform bool uOctNormals;
+
+//Inverse of OctEncode in map/normal.glsl, e in [-1,1]^2
+vec3 OctDecode(vec2 e)
+{
+    return normalize(vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y));
+}
+
+vec3 SampleMapNormal(vec2 uv)
+{
+    vec4 res = texture(normalmap, uv);
+
+    if (uOctNormals)
+        return OctDecode(2.0*res.xy - 1.0);
+
+    return 2.0*res.xyz - 1.0;
+}
+
+float SampleMapAO(vec2 uv)
+{
+    if (uOctNormals)
+        return texture(aomap, uv).r;
+
+    return texture(normalmap, uv).a;
+}
@@ -0,0 +1,65 @@
+//Sampling of the virtual heightmap, see VirtualHeightmap.h.
+//Page table entries are (atlas slot, page x, page y, unused), tables of all lods are
+//toroidal, so the page coords are compared to detect entries owned by other pages.
+
+uniform sampler2DArray virtualAtlas;
+uniform isampler2DArray virtualTable;
+
+uniform int uVirtualLods;
+//Heightmap uv distance between texels of the finest lod
+uniform float uVirtualTexelSize;
+
+//Need to match VirtualHeightmap::PageTexels and VirtualHeightmap::PageBorder
+#define VIRTUAL_PAGE_TEXELS 128
+#define VIRTUAL_PAGE_BORDER 1
+
+bool SampleVirtualPage(vec2 uv, int lod, out float height)
+{
+    float texel_size = uVirtualTexelSize * exp2(float(lod));
+    float page_size = float(VIRTUAL_PAGE_TEXELS) * texel_size;
+
+    ivec2 page = ivec2(floor(uv / page_size));
+
+    ivec2 table_size = textureSize(virtualTable, 0).xy;
+    ivec4 entry = texelFetch(virtualTable, ivec3(page & (table_size - 1), lod), 0);
+
+    if (entry.x < 0 || entry.yz != page)
+        return false;
+
+    //Texel i of the slot is located at page origin + (i - border) texels
+    const float slot_texels = float(VIRTUAL_PAGE_TEXELS + 2 * VIRTUAL_PAGE_BORDER);
+
+    vec2 local = (uv - vec2(page) * page_size) / texel_size;
+    vec2 atlas_uv = (local + float(VIRTUAL_PAGE_BORDER) + 0.5) / slot_texels;
+
+    height = textureLod(virtualAtlas, vec3(atlas_uv, float(entry.x)), 0.0).r;
+
+    return true;
+}
+
+//Falls back to coarser lods if the requested page is not resident (yet)
+float SampleVirtualHeight(vec2 uv, float lod)
+{
+    float height = 0.0;
+
+    for (int l = clamp(int(lod), 0, uVirtualLods - 1); l < uVirtualLods; l++)
+    {
+        if (SampleVirtualPage(uv, l, height))
+            break;
+    }
+
+    return height;
+}
+
+//Same construction as in map/normal.glsl, with texel spacing of the given lod
+vec3 GetVirtualNormal(vec2 uv, float lod, float scale_xz, float scale_y)
+{
+    float t = uVirtualTexelSize * exp2(clamp(floor(lod), 0.0, float(uVirtualLods - 1)));
+    vec2 h = vec2(0.0, t);
+
+    return normalize(vec3(
+        scale_y*0.5*(SampleVirtualHeight(uv+h.yx, lod) - SampleVirtualHeight(uv-h.yx, lod))/t,
+        scale_xz,
+        scale_y*0.5*(SampleVirtualHeight(uv+h.xy, lod) - SampleVirtualHeight(uv-h.xy, lod))/t
+    ));
+}
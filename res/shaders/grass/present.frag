@@ -18,6 +18,10 @@ uniform float uSkySpec;
 uniform int uShadow;
 
 uniform float uTilingFactor;
+//Tiling phases of the render origin, computed in double on the cpu,
+//so that patterns stay fixed in the world when the origin is rebased
+uniform vec2 uTilingOffset;
+uniform vec2 uNoiseOffset;
 uniform float uStrength;
 uniform float uSway;
 uniform float uTime;
@@ -33,13 +37,13 @@ uniform float uTranslucent;
 uniform sampler3D raycast_res;
 uniform sampler2D noise;
 
-uniform sampler2D normalmap;
 uniform sampler2D shadowmap;
 
 uniform samplerCube irradiance;
 uniform samplerCube prefiltered;
 
 #include "../common/pbr.glsl"
+#include "../common/normal_map.glsl"
 
 float angleFromViewDir(vec3 dir) {
     const float fANGLES = 64.0;
@@ -61,11 +65,11 @@ void main() {
     vec3 view = normalize(frag_pos - uPos);
 
     //Retrieve noise
-    vec3 uSlant = uStrength * texture(noise, uNoiseTiling*frag_pos.xz + uTime*uScrollVel).rgb;
+    vec3 uSlant = uStrength * texture(noise, uNoiseTiling*frag_pos.xz + uNoiseOffset + uTime*uScrollVel).rgb;
     uSlant.y = 1.0;
 
     vec2 uv = frag_pos.xz + uSway*uSlant.xz;
-    uv = fract(uTilingFactor * uv);
+    uv = fract(uTilingFactor * uv + uTilingOffset);
 
     //Consider slant
     mat3 non_ortho = mat3(vec3(1,0,0), uSlant, vec3(0,0,1));
@@ -99,8 +103,7 @@ void main() {
     norm *= inverted;
 
     //Read world normal and AO
-    vec4 world_res = texture(normalmap, world_uv);
-    vec3 world_norm = world_res.rgb; float amb = world_res.a;
+    float amb = SampleMapAO(world_uv);
 
     //Do pbr lighting
     float shadow = 1.0;
@@ -1,23 +1,30 @@
 #version 450 core
 
-layout (location = 0) in vec3 aPos;
+//Position in units of the quad size of vertex's lod level
+layout (location = 0) in ivec2 aPos;
 layout (location = 1) in uint aAuxData;
 
+uniform sampler2DArray heightCache;
+
 uniform vec3 uPos;
 uniform mat4 uMVP;
+uniform float uScaleY;
 uniform float uScaleXZ;
+//Heightmap uv of the render origin
+uniform vec2 uOriginUV;
 uniform float uGrassHeight;
 
 out vec2 world_uv;
 out vec3 frag_pos;
 
-#define MAX_LEVELS 10
+#define MAX_LEVELS 16
 layout(std140, binding = 2) uniform ubo
 {
     float QuadSizes[MAX_LEVELS];
 };
 
 #include "../common/clipmap.glsl"
+#include "../common/clipmap_height.glsl"
 
 void main() {
     bool trim_flag = false;
@@ -27,11 +34,13 @@ void main() {
 
     float quad_size = QuadSizes[lvl];
 
-    vec2 pos2 = GetClipmapPos(aPos.xz, uPos.xz, quad_size, trim_flag);
-    vec3 pos3 = vec3(pos2.x, aPos.y + uGrassHeight, pos2.y);
+    vec2 pos2 = vec2(0);
+    float height = GetClipmapHeightCached(heightCache, quad_size * vec2(aPos), uPos.xz, quad_size, lvl,
+                                          trim_flag, edge_flag, pos2);
+    vec3 pos3 = vec3(pos2.x, 0.5 * uScaleY * height + uGrassHeight, pos2.y);
 
     world_uv = (2.0/uScaleXZ) * pos2;
-    world_uv = 0.5*world_uv + 0.5;
+    world_uv = 0.5*world_uv + 0.5 + uOriginUV;
     
     frag_pos = pos3;
 
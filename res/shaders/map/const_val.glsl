@@ -6,10 +6,18 @@ layout(r32f, binding = 0) uniform image2D heightmap;
 
 uniform float uValue;
 
+//Same step is used by the fused procedure kernel
+#include "steps/const_val.glsl"
+
 void main() {
     ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
 
-    vec4 res = vec4(uValue, vec3(0.0));
+    float prev = float(imageLoad(heightmap, texelCoord));
+
+    //Pointwise, doesn't depend on position
+    vec2 uv = vec2(0.0);
+
+    float h = ConstValueStep(prev, uv, uValue);
 
-    imageStore(heightmap, texelCoord, res);
+    imageStore(heightmap, texelCoord, vec4(h));
 }
@@ -6,12 +6,18 @@ layout(r32f, binding = 0) uniform image2D heightmap;
 
 uniform float uExponent;
 
+//Same step is used by the fused procedure kernel
+#include "steps/curves.glsl"
+
 void main() {
     ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
 
-    float height = float(imageLoad(heightmap, texelCoord));
+    float prev = float(imageLoad(heightmap, texelCoord));
+
+    //Pointwise, doesn't depend on position
+    vec2 uv = vec2(0.0);
 
-    height = pow(height, uExponent);
+    float h = CurvesStep(prev, uv, uExponent);
 
-    imageStore(heightmap, texelCoord, vec4(height));
-}
\ No newline at end of file
+    imageStore(heightmap, texelCoord, vec4(h));
+}
@@ -0,0 +1,88 @@
+#version 450 core
+
+#define PI 3.1415926535
+
+//Need to match MapGenerator::m_HorizonDirections, 4 directions per layer
+#define HORIZON_DIRECTIONS 16
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+//Horizon slope (height/uv distance) for azimuth k is stored in layer k/4, channel k%4
+layout(rgba16f, binding = 0) uniform writeonly image2DArray horizonmap;
+
+//Maps are generated in tiles, see MapGenerator::RunStage
+uniform ivec2 uTileOffset;
+
+uniform sampler2D heightmap;
+
+#include "../common/min_max.glsl"
+
+uniform int uSteps;
+uniform int uMaxLod;
+uniform bool uWrap;
+
+//Lod 0 is the heightmap itself, lod l > 0 is level l-1 of the min/max pyramid
+float MaxHeight(vec2 uv, int lod)
+{
+    if (lod == 0)
+    {
+        ivec2 size = textureSize(heightmap, 0);
+        return texelFetch(heightmap, ivec2(floor(uv * vec2(size))), 0).r;
+    }
+
+    float size = float(PyramidSize(lod - 1));
+    return LoadMinMax(ivec2(floor(uv * size)), lod - 1).y;
+}
+
+//Steps grow geometrically from one heightmap texel up to the whole map,
+//coarser pyramid levels are used for longer steps, so the horizon is conservative
+float HorizonSlope(vec2 uv, float h0, vec2 dir)
+{
+    float texel = 1.0 / float(textureSize(heightmap, 0).x);
+
+    float growth = pow(1.0 / texel, 1.0 / float(uSteps));
+
+    float slope = 0.0;
+    float dist = texel;
+
+    for (int i = 0; i < uSteps; i++)
+    {
+        vec2 p = uv + dist * dir;
+
+        if (uWrap)
+            p = fract(p);
+
+        else if (any(lessThan(p, vec2(0.0))) || any(greaterThanEqual(p, vec2(1.0))))
+            break;
+
+        float step_size = dist * (growth - 1.0);
+        int lod = clamp(int(log2(step_size / texel)), 0, uMaxLod);
+
+        slope = max(slope, (MaxHeight(p, lod) - h0) / dist);
+
+        dist *= growth;
+    }
+
+    return slope;
+}
+
+void main() {
+    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy) + uTileOffset;
+
+    //Same convention as shadow.glsl
+    vec2 uv = vec2(texelCoord) / vec2(imageSize(horizonmap).xy);
+    float h0 = texture(heightmap, uv).r;
+
+    for (int layer = 0; layer < HORIZON_DIRECTIONS / 4; layer++)
+    {
+        vec4 slopes;
+
+        for (int c = 0; c < 4; c++)
+        {
+            float azimuth = 2.0 * PI * float(4 * layer + c) / float(HORIZON_DIRECTIONS);
+            slopes[c] = HorizonSlope(uv, h0, vec2(cos(azimuth), sin(azimuth)));
+        }
+
+        imageStore(horizonmap, ivec3(texelCoord, layer), slopes);
+    }
+}
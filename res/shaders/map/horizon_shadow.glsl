@@ -0,0 +1,61 @@
+#version 450 core
+
+#define PI 3.1415926535
+
+//Need to match MapGenerator::m_HorizonDirections
+#define HORIZON_DIRECTIONS 16
+
+#define saturate(x) clamp(x, 0.0, 1.0)
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+layout(r8, binding = 0) uniform image2D shadowmap;
+
+//Maps are generated in tiles, see MapGenerator::RunStage
+uniform ivec2 uTileOffset;
+
+//See horizon.glsl
+uniform sampler2DArray horizonmap;
+
+uniform float uScaleXZ;
+uniform float uScaleY;
+uniform vec3 uSunDir;
+
+uniform bool uSoftShadows;
+uniform float uSharpness;
+
+float HorizonSlope(vec2 uv, int k)
+{
+    k = k % HORIZON_DIRECTIONS;
+
+    vec4 slopes = texture(horizonmap, vec3(uv, float(k / 4)));
+    return slopes[k % 4];
+}
+
+void main() {
+    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy) + uTileOffset;
+
+    //Horizon texels are stored at i/res, offset to hit their centers
+    vec2 horizon_res = vec2(textureSize(horizonmap, 0).xy);
+    vec2 uv = vec2(texelCoord) / vec2(imageSize(shadowmap)) + 0.5 / horizon_res;
+
+    //Interpolate between the two closest azimuths
+    float azimuth = atan(uSunDir.z, uSunDir.x);
+    float f = fract(azimuth / (2.0 * PI)) * float(HORIZON_DIRECTIONS);
+
+    int k = int(floor(f));
+
+    float horizon = mix(HorizonSlope(uv, k), HorizonSlope(uv, k + 1), fract(f));
+
+    //Sun slope in the same units (height/uv distance) as in shadow.glsl
+    float sun = uScaleXZ * uSunDir.y / max(uScaleY * length(uSunDir.xz), 1e-6);
+
+    float shadow = 1.0;
+
+    if (uSoftShadows)
+        shadow = 1.0 - saturate(uSharpness * (horizon - sun));
+    else
+        shadow = float(horizon <= sun);
+
+    imageStore(shadowmap, texelCoord, vec4(shadow, 0.0, 0.0, 1.0));
+}
@@ -0,0 +1,146 @@
+#version 450 core
+
+//Builds the whole min/max pyramid (common/min_max.glsl) in a single dispatch.
+//Every workgroup reduces a 64x64 block of the source into the next 6 levels through shared memory,
+//the last group to finish then reduces the remaining (up to 6) tail levels on its own.
+
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+//Source of the first level of the pyramid, a sampler since the heightmap format may vary
+uniform sampler2D heightmap;
+
+#include "../common/min_max.glsl"
+
+//Needs to match MapGenerator::s_MinMaxCounterBinding, reset by the last group
+layout(std430, binding = 7) coherent buffer pyramidCounter
+{
+    uint FinishedGroups;
+};
+
+//Finest level read by the groups, -1 means the heightmap itself
+uniform int uSourceLevel;
+uniform int uLevels;
+
+#define BLOCK 64
+#define LEVELS_PER_PASS 6
+
+shared vec2 Tile[(BLOCK/2) * (BLOCK/2)];
+shared bool IsLastGroup;
+
+vec2 LoadSource(ivec2 coord, int level)
+{
+    //Blocks may be larger than small sources, duplicates don't change min/max
+    if (level < 0)
+        return vec2(texelFetch(heightmap, min(coord, ivec2(uPyramidRes - 1)), 0).r);
+
+    return LoadMinMax(coord, level);
+}
+
+vec2 Reduce(vec2 a, vec2 b, vec2 c, vec2 d)
+{
+    return vec2(min(min(a.x, b.x), min(c.x, d.x)),
+                max(max(a.y, b.y), max(c.y, d.y)));
+}
+
+void StoreMinMax(ivec2 coord, int level, vec2 value)
+{
+    int size = PyramidSize(level);
+
+    if (all(lessThan(coord, ivec2(size))))
+        MinMax[PyramidOffset(level) + coord.y * size + coord.x] = value;
+}
+
+//Reduces the 64x64 block of the source level into the next LEVELS_PER_PASS levels,
+//needs to be called in uniform control flow
+void ReduceBlock(int source, ivec2 block)
+{
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+    //Each invocation covers 4x4 source texels, i.e. 2x2 texels of the first level
+    for (int j = 0; j < 2; j++)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            ivec2 dst = 2 * local + ivec2(i, j);
+            ivec2 src = BLOCK * block + 2 * dst;
+
+            vec2 value = Reduce(LoadSource(src + ivec2(0, 0), source),
+                                LoadSource(src + ivec2(1, 0), source),
+                                LoadSource(src + ivec2(0, 1), source),
+                                LoadSource(src + ivec2(1, 1), source));
+
+            Tile[dst.y * (BLOCK/2) + dst.x] = value;
+            StoreMinMax((BLOCK/2) * block + dst, source + 1, value);
+        }
+    }
+
+    barrier();
+
+    int tile = BLOCK/2;
+
+    for (int k = 1; k < LEVELS_PER_PASS; k++)
+    {
+        int level = source + 1 + k;
+
+        if (level >= uLevels)
+            break;
+
+        int half_tile = tile / 2;
+        bool active = all(lessThan(local, ivec2(half_tile)));
+
+        vec2 value = vec2(0.0);
+
+        if (active)
+        {
+            ivec2 src = 2 * local;
+
+            value = Reduce(Tile[(src.y + 0) * tile + src.x + 0],
+                           Tile[(src.y + 0) * tile + src.x + 1],
+                           Tile[(src.y + 1) * tile + src.x + 0],
+                           Tile[(src.y + 1) * tile + src.x + 1]);
+        }
+
+        //All reads of the previous level need to be done before it is overwritten
+        barrier();
+
+        if (active)
+        {
+            Tile[local.y * half_tile + local.x] = value;
+            StoreMinMax(half_tile * block + local, level, value);
+        }
+
+        barrier();
+
+        tile = half_tile;
+    }
+}
+
+void main() {
+    ReduceBlock(uSourceLevel, ivec2(gl_WorkGroupID.xy));
+
+    //Tail levels are reduced from the last level of this pass, if it fits in one block
+    int last_level = uSourceLevel + LEVELS_PER_PASS;
+    uint num_groups = gl_NumWorkGroups.x * gl_NumWorkGroups.y;
+
+    if (num_groups == 1 || last_level + 1 >= uLevels || PyramidSize(last_level) > BLOCK)
+        return;
+
+    //Writes of this group need to be visible to the last one before it is counted as finished
+    memoryBarrierBuffer();
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0)
+        IsLastGroup = (atomicAdd(FinishedGroups, 1) == num_groups - 1);
+
+    barrier();
+
+    if (!IsLastGroup)
+        return;
+
+    memoryBarrierBuffer();
+
+    ReduceBlock(last_level, ivec2(0));
+
+    if (gl_LocalInvocationIndex == 0)
+        FinishedGroups = 0;
+}
@@ -5,9 +5,20 @@
 
 layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
 
-layout(rgba8, binding = 0) uniform image2D normalmap;
+//Format is chosen in MapGenerator::Init, see common/normal_map.glsl
+layout(binding = 0) uniform writeonly image2D normalmap;
+//Only bound for octahedral normals
+layout(binding = 1) uniform writeonly image2D aomap;
 
 uniform sampler2D heightmap;
+//Height difference per texel, written by the fused height kernels
+uniform sampler2D gradientmap;
+uniform bool uAnalyticNormals;
+
+uniform bool uOctNormals;
+
+//Maps are generated in tiles, see MapGenerator::RunStage
+uniform ivec2 uTileOffset;
 
 uniform float uScaleXZ;
 uniform float uScaleY;
@@ -15,6 +26,15 @@ uniform float uScaleY;
 uniform int uAOSamples;
 uniform float uAOR;
 
+#include "../common/min_max.glsl"
+
+//Horizon based AO marches the min/max pyramid instead of taking random heightmap taps
+uniform bool uHorizonAO;
+uniform int uAODirections;
+uniform int uAOSteps;
+uniform int uMaxLod;
+uniform bool uWrap;
+
 float getHeight(vec2 p) {
     return texture(heightmap, p).r;
 }
@@ -29,6 +49,12 @@ vec3 getNorm(vec2 p) {
     ));
 }
 
+vec3 getAnalyticNorm(ivec2 coord) {
+    vec2 g = texelFetch(gradientmap, coord, 0).xy * float(textureSize(heightmap, 0).x);
+
+    return normalize(vec3(uScaleY*g.x, uScaleXZ, uScaleY*g.y));
+}
+
 float getAO(vec2 p) {
     const float dt = 1.0/float(uAOSamples);
     const float A = 2*PI*float(uAOSamples)/GOLDEN_RATIO;
@@ -56,13 +82,86 @@ float getAO(vec2 p) {
     return res;
 }
 
+//Lod 0 is the heightmap itself, lod l > 0 is level l-1 of the min/max pyramid, same as in horizon.glsl
+float MaxHeight(vec2 uv, int lod) {
+    if (lod == 0)
+    {
+        ivec2 size = textureSize(heightmap, 0);
+        return texelFetch(heightmap, ivec2(floor(uv * vec2(size))), 0).r;
+    }
+
+    float size = float(PyramidSize(lod - 1));
+    return LoadMinMax(ivec2(floor(uv * size)), lod - 1).y;
+}
+
+//Steps grow geometrically from one texel up to uAOR, with coarser pyramid levels for longer steps,
+//so the cost is uAODirections*uAOSteps taps regardless of the radius
+float getHorizonAO(vec2 p) {
+    const float texel = 1.0/float(textureSize(heightmap, 0).x);
+    const float h_0 = getHeight(p);
+    const float C = uScaleY/uScaleXZ;
+
+    if (uAOR <= texel) return 1.0;
+
+    const float growth = pow(uAOR/texel, 1.0/float(uAOSteps));
+
+    //Per texel rotation of the direction set, avoids banding with few directions
+    const vec2 pixel = floor(p/texel);
+    const float jitter = fract(52.9829189*fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+
+    float res = 0.0;
+
+    for (int d=0; d<uAODirections; d++) {
+        float azimuth = 2.0*PI*(float(d) + jitter)/float(uAODirections);
+        vec2 dir = vec2(cos(azimuth), sin(azimuth));
+
+        float max_slope = 0.0;
+        float dist = texel;
+
+        for (int i=0; i<uAOSteps; i++) {
+            vec2 q = p + dist*dir;
+
+            if (uWrap)
+                q = fract(q);
+
+            else if (any(lessThan(q, vec2(0.0))) || any(greaterThanEqual(q, vec2(1.0))))
+                break;
+
+            float step_size = dist*(growth - 1.0);
+            int lod = clamp(int(log2(step_size/texel)), 0, uMaxLod);
+
+            max_slope = max(max_slope, C*(MaxHeight(q, lod) - h_0)/dist);
+
+            dist *= growth;
+        }
+
+        //1 - sin(horizon elevation), matches the per sample term of getAO
+        res += 1.0 - max_slope*inversesqrt(1.0 + max_slope*max_slope);
+    }
+
+    return res/float(uAODirections);
+}
+
+//Upper half of the octahedron, result in [-1,1]^2
+vec2 OctEncode(vec3 n) {
+    return n.xz / (abs(n.x) + abs(n.y) + abs(n.z));
+}
+
 void main() {
-    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy) + uTileOffset;
 
     vec2 uv = vec2(texelCoord)/imageSize(normalmap);
     
-    float ao = getAO(uv);
-    vec3 norm = 0.5*getNorm(uv) + 0.5;
+    float ao = uHorizonAO ? getHorizonAO(uv) : getAO(uv);
+    vec3 n = uAnalyticNormals ? getAnalyticNorm(texelCoord) : getNorm(uv);
+
+    if (uOctNormals) {
+        imageStore(normalmap, texelCoord, vec4(0.5*OctEncode(n) + 0.5, 0.0, 0.0));
+        imageStore(aomap, texelCoord, vec4(ao));
+        return;
+    }
+
+    vec3 norm = 0.5*n + 0.5;
 
     imageStore(normalmap, texelCoord, vec4(norm, ao));
 }
@@ -4,18 +4,25 @@ layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
 
 layout(r32f, binding = 0) uniform image2D heightmap;
 
+//Heightmap uv of texel (0,0) and uv distance between texels,
+//virtual heightmap pages are generated by offsetting this domain
+uniform vec2 uTexelOrigin;
+uniform float uTexelSize;
+
 uniform float uBias;
 uniform float uSlope;
 
+//Same step is used by the fused procedure kernel
+#include "steps/radial_cutoff.glsl"
+
 void main() {
     ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
 
-    float height = float(imageLoad(heightmap, texelCoord));
+    float prev = float(imageLoad(heightmap, texelCoord));
 
-    vec2 uv = vec2(texelCoord)/imageSize(heightmap);
-    float hoffset = uBias + uSlope * dot(uv-0.5, uv-0.5);
+    vec2 uv = uTexelOrigin + uTexelSize*vec2(texelCoord);
 
-    height = max(height - hoffset, 0.0);
+    float h = RadialCutoffStep(prev, uv, uBias, uSlope);
 
-    imageStore(heightmap, texelCoord, vec4(height));
-}
\ No newline at end of file
+    imageStore(heightmap, texelCoord, vec4(h));
+}
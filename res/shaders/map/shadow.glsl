@@ -12,8 +12,13 @@ layout(r8, binding = 0) uniform image2D shadowmap;
 
 uniform int uResolution;
 
+//Maps are generated in tiles, see MapGenerator::RunStage
+uniform ivec2 uTileOffset;
+
 uniform sampler2D heightmap;
 
+#include "../common/min_max.glsl"
+
 uniform float uScaleXZ;
 uniform float uScaleY;
 uniform vec3 uSunDir;
@@ -80,7 +85,7 @@ bool IntersectTerrain(vec2 org2, vec2 dir2, vec3 org3, vec3 dir3,
 }
 
 void main() {
-    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy) + uTileOffset;
     
     //Not normalized (from 0 to uResolution)
     vec2 uv = vec2(texelCoord);
@@ -145,7 +150,11 @@ void main() {
 
         else
         {
-            float h = texelFetch(heightmap, current_texel, mip + uMipOffset).r;
+            //Maximal heights of coarser cells come from the min/max pyramid
+            int level = mip + uMipOffset;
+
+            float h = (level <= 0) ? texelFetch(heightmap, current_texel, 0).r
+                                   : LoadMinMax(current_texel, level - 1).y;
             
             vec3 tmp = texel_size*(org3 + proj_fac*t*dir3);
             float H = tmp.y;
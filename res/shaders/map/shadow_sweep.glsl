@@ -0,0 +1,82 @@
+#version 450 core
+
+#define saturate(x) clamp(x, 0.0, 1.0)
+
+//One invocation per line parallel to the sun azimuth, line setup is computed
+//on the cpu, see SweepLines in cpu/CpuShadowSweep.h
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(r8, binding = 0) uniform image2D shadowmap;
+
+uniform int uResolution;
+
+uniform sampler2D heightmap;
+
+uniform bool uMajorX;
+uniform int uMajorStart;
+uniform int uMajorStep;
+uniform float uMinorStep;
+uniform int uFirstMinor;
+uniform float uStepLength;
+uniform float uSlope;
+
+//Maps are generated in bundles of lines, see MapGenerator::RunStage
+uniform int uFirstLine;
+uniform int uNumLines;
+
+uniform bool uSoftShadows;
+uniform float uSharpness;
+
+float Shade(float occlusion, float dist)
+{
+    if (!uSoftShadows)
+        return (occlusion > 0.0) ? 0.0 : 1.0;
+
+    //Height difference over distance, both normalized, as in map/shadow.glsl
+    float tangent = (occlusion / uResolution) / max(dist / uResolution, 0.01);
+
+    return 1.0 - saturate(uSharpness * tangent);
+}
+
+void main() {
+    int line = int(gl_GlobalInvocationID.x);
+
+    if (line >= uNumLines) return;
+
+    line += uFirstLine;
+
+    float texel_size = 1.0/uResolution;
+    float decay = uSlope * uStepLength;
+
+    //Height of the highest sun ray blocked so far, at the current texel, and distance to its occluder
+    float horizon = -1e30;
+    float dist = 0.0;
+
+    for (int k=0; k<uResolution; k++)
+    {
+        int major = uMajorStart + k*uMajorStep;
+        int minor = uFirstMinor + line + int(floor(float(k)*uMinorStep + 0.5));
+
+        //Minor coordinate is monotonic, so the line never comes back once it leaves the map
+        if (minor < 0 || minor >= uResolution)
+            continue;
+
+        ivec2 texelCoord = uMajorX ? ivec2(major, minor) : ivec2(minor, major);
+
+        //Same height lookup as the ray origin in map/shadow.glsl
+        float h = uResolution * texture(heightmap, texel_size*vec2(texelCoord)).r;
+
+        float shadow = Shade(horizon - h, dist);
+
+        imageStore(shadowmap, texelCoord, vec4(shadow, 0.0, 0.0, 1.0));
+
+        if (h >= horizon)
+        {
+            horizon = h;
+            dist = 0.0;
+        }
+
+        horizon -= decay;
+        dist += uStepLength;
+    }
+}
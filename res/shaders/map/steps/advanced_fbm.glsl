@@ -0,0 +1,208 @@
+//Based on this article by Inigo Quilez:
+//https://iquilezles.org/articles/morenoise/
+//Also referenced this paper:
+//https://www.sbgames.org/sbgames2018/files/papers/ComputacaoShort/188264.pdf
+
+#include "../../common/hash.glsl"
+#include "blend.glsl"
+
+#define NOISE_VALUE 0
+#define NOISE_PERLIN 1
+
+//Returns noise function (value, [gradient], laplacian), the gradient is an approximation
+//used to drive erosion, exact gradient w.r.t. p is returned in the last argument
+vec4 AdvancedNoised(vec2 p, int noise_type, out vec2 gradient) {
+    vec2 id = floor(p);
+    vec2 u = fract(p);
+    vec2 f = u;
+
+    float a,b,c,d;
+    vec2 va, vb, vc, vd;
+
+    if (noise_type == NOISE_PERLIN)
+    {
+        va = 2.0*hash22(id+vec2(0,0)) - 1.0;
+        vb = 2.0*hash22(id+vec2(1,0)) - 1.0;
+        vc = 2.0*hash22(id+vec2(0,1)) - 1.0;
+        vd = 2.0*hash22(id+vec2(1,1)) - 1.0;
+
+        a = dot(va, u - vec2(0,0)) + 0.5;
+        b = dot(vb, u - vec2(1,0)) + 0.5;
+        c = dot(vc, u - vec2(0,1)) + 0.5;
+        d = dot(vd, u - vec2(1,1)) + 0.5;
+    }
+    
+    else
+    {
+        a = hash12(id+vec2(0,0));
+        b = hash12(id+vec2(1,0));
+        c = hash12(id+vec2(0,1));
+        d = hash12(id+vec2(1,1));
+    }
+
+    u = u*u*u*(u*(6.0*u-15.0)+10.0);
+    vec2 du = 30.0*u*u*(u*u-2.0*u+1.0);
+    vec2 ddu = 60.0*u*(2.0*u*u - 3.0*u + 1.0);
+
+    float k0 = a;
+    float k1 = b-a;
+    float k2 = c-a;
+    float k3 = a-b-c+d;
+
+    //Derivative of the quintic interpolant at the unsmoothed fraction
+    vec2 df = 30.0*f*f*(f*(f-2.0)+1.0);
+
+    gradient = vec2(k1 + k3*u.y, k2 + k3*u.x) * df;
+
+    if (noise_type == NOISE_PERLIN)
+    {
+        vec2 vk0 = va;
+        vec2 vk1 = vb - va;
+        vec2 vk2 = vc - va;
+        vec2 vk3 = va - vb - vc + vd;
+
+        gradient += vk0 + vk1*u.x + vk2*u.y + vk3*u.x*u.y;
+
+        return vec4(
+            k0 + k1*u.x + k2*u.y + k3*u.x*u.y,
+
+            vec2(vk0.x + vk1.x*u.x + vk2.x*u.y + vk3.x*u.x*u.y, vk0.y + vk1.y*u.x + vk2.y*u.y + vk3.y*u.x*u.y) 
+                + vec2(k1 + k3*u.y, k2 + k3*u.x) * du,
+
+            dot(vec2(1,1), (
+                vec2(vk1.x + vk3.x*u.y, vk2.y + vk3.y*u.x) * du
+                + vec2(vk1.x + vk3.x*u.y, vk2.y + vk3.y*u.x) * du
+                + vec2(k1 + k3*u.y, k2 + k3*u.x) * ddu
+            ))
+        );
+    }
+    
+    else
+    {
+        return vec4(
+            k0 + k1*u.x + k2*u.y + k3*u.x*u.y,
+            vec2(k1 + k3*u.y, k2 + k3*u.x) * du,
+            dot(vec2(1,1), (vec2(k1 + k3*u.y, k2 + k3*u.x) * ddu))
+        );
+    }
+}
+
+vec4 AdvancedNoised(vec2 p, int noise_type) {
+    vec2 gradient;
+    return AdvancedNoised(p, noise_type, gradient);
+}
+
+float AdvancedFBM(in vec2 p, int octaves, float prev_height, int noise_type, float roughness,
+                  float lacunarity, float altitude_erosion, float slope_erosion, float concave_erosion) {
+    const float scale_y = 1.0;
+    const float scale_xz = 0.5;
+    const mat2 rot = mat2(0.8, 0.6, -0.6, 0.8);
+
+    p *= scale_xz;
+
+    mat2 M = mat2(1.0);
+    float A = 1.0, a = 1.0;
+
+    float value = 0.0, normalization = 0.0;
+    vec2 grad = vec2(0.0);
+    float laplacian = 0.0;
+
+    for (int i=0; i<octaves; i++) {
+        const vec4 n = AdvancedNoised(a*M*p, noise_type);
+        
+        //This can also be treated differently depending on the blend mode,
+        //but it's debatable if it makes the behaviour more natural
+        float actual_height = value + prev_height;
+
+        float xi = (i==0) ? A : mix(A, A/(1.0 + dot(grad, grad)), slope_erosion);
+        xi = (i==0) ? A : mix(xi, xi*max(0.0, actual_height), altitude_erosion);
+        xi = (i==0) ? A : mix(xi, xi/(1.0 + abs(min(0.5*laplacian, 0))), concave_erosion);
+
+        value += xi*n.x;
+        grad += xi*a*M*n.yz;
+        laplacian += xi*a*a*n.w;
+
+        normalization += A;
+
+        a *= lacunarity;
+        A *= roughness;
+
+        if (noise_type == NOISE_VALUE)
+            M *= rot;
+    }
+
+    return scale_y * value/normalization;
+}
+
+float AdvancedFBMStep(float prev, vec2 uv, int noise_type, int octaves, float scale, float roughness, float lacunarity,
+                      float altitude_erosion, float slope_erosion, float concave_erosion, int blend_mode, float weight)
+{
+    float h = AdvancedFBM(scale*uv, octaves, prev, noise_type, roughness,
+                          lacunarity, altitude_erosion, slope_erosion, concave_erosion);
+
+    return BlendHeight(prev, h, blend_mode, weight);
+}
+
+//Same as AdvancedFBM, also returns the gradient w.r.t. p, prev_gradient is the gradient of prev_height w.r.t. p.
+//Altitude erosion is differentiated through the running height. Slope and concave erosion weights would
+//need higher noise derivatives and are treated as constant, so the step is only used while they are zero.
+vec3 AdvancedFBMD(in vec2 p, vec2 prev_gradient, int octaves, float prev_height, int noise_type, float roughness,
+                  float lacunarity, float altitude_erosion, float slope_erosion, float concave_erosion) {
+    const float scale_y = 1.0;
+    const float scale_xz = 0.5;
+    const mat2 rot = mat2(0.8, 0.6, -0.6, 0.8);
+
+    p *= scale_xz;
+
+    //Gradients below are w.r.t. the scaled p
+    vec2 dprev = prev_gradient/scale_xz;
+
+    mat2 M = mat2(1.0);
+    float A = 1.0, a = 1.0;
+
+    float value = 0.0, normalization = 0.0;
+    vec2 grad = vec2(0.0), dvalue = vec2(0.0);
+    float laplacian = 0.0;
+
+    for (int i=0; i<octaves; i++) {
+        vec2 gradient;
+        const vec4 n = AdvancedNoised(a*M*p, noise_type, gradient);
+
+        float actual_height = value + prev_height;
+
+        float xi = (i==0) ? A : mix(A, A/(1.0 + dot(grad, grad)), slope_erosion);
+
+        //Gradient of mix(xi, xi*max(0, h), e) is xi*e*grad(h) where the height is positive
+        vec2 dxi = (i==0 || actual_height <= 0.0) ? vec2(0.0) : xi*altitude_erosion*(dvalue + dprev);
+
+        xi = (i==0) ? A : mix(xi, xi*max(0.0, actual_height), altitude_erosion);
+        dxi *= (i==0) ? 1.0 : mix(1.0, 1.0/(1.0 + abs(min(0.5*laplacian, 0))), concave_erosion);
+        xi = (i==0) ? A : mix(xi, xi/(1.0 + abs(min(0.5*laplacian, 0))), concave_erosion);
+
+        value += xi*n.x;
+        grad += xi*a*M*n.yz;
+        laplacian += xi*a*a*n.w;
+
+        //Chain rule, gradient of n(a*M*p) is a*transpose(M)*grad(n)
+        dvalue += xi*a*(gradient*M) + dxi*n.x;
+
+        normalization += A;
+
+        a *= lacunarity;
+        A *= roughness;
+
+        if (noise_type == NOISE_VALUE)
+            M *= rot;
+    }
+
+    return scale_y * vec3(value, scale_xz*dvalue)/normalization;
+}
+
+vec3 AdvancedFBMStepD(vec3 prev, vec2 uv, int noise_type, int octaves, float scale, float roughness, float lacunarity,
+                      float altitude_erosion, float slope_erosion, float concave_erosion, int blend_mode, float weight)
+{
+    vec3 h = AdvancedFBMD(scale*uv, prev.yz/scale, octaves, prev.x, noise_type, roughness,
+                          lacunarity, altitude_erosion, slope_erosion, concave_erosion);
+
+    return BlendHeight(prev, vec3(h.x, scale*h.yz), blend_mode, weight);
+}
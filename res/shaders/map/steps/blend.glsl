@@ -0,0 +1,55 @@
+#ifndef BLEND_GLSL
+#define BLEND_GLSL
+
+#define BLEND_AVERAGE  0
+#define BLEND_ADD      1
+#define BLEND_SUBTRACT 2
+
+float BlendHeight(float prev, float h, int blend_mode, float weight)
+{
+    switch(blend_mode) {
+        case BLEND_AVERAGE:
+        {
+            h = mix(prev, h, weight);
+            break;
+        }
+        case BLEND_ADD:
+        {
+            h = prev + weight*h;
+            break;
+        }
+        case BLEND_SUBTRACT:
+        {
+            h = prev - weight*h;
+            break;
+        }
+    }
+
+    return h;
+}
+
+//Same blend of (height, d/du, d/dv), all modes are linear so the gradients blend the same way
+vec3 BlendHeight(vec3 prev, vec3 h, int blend_mode, float weight)
+{
+    switch(blend_mode) {
+        case BLEND_AVERAGE:
+        {
+            h = mix(prev, h, weight);
+            break;
+        }
+        case BLEND_ADD:
+        {
+            h = prev + weight*h;
+            break;
+        }
+        case BLEND_SUBTRACT:
+        {
+            h = prev - weight*h;
+            break;
+        }
+    }
+
+    return h;
+}
+
+#endif
@@ -0,0 +1,9 @@
+float ConstValueStep(float prev, vec2 uv, float value)
+{
+    return value;
+}
+
+vec3 ConstValueStepD(vec3 prev, vec2 uv, float value)
+{
+    return vec3(value, 0.0, 0.0);
+}
@@ -0,0 +1,12 @@
+float CurvesStep(float prev, vec2 uv, float exponent)
+{
+    return pow(prev, exponent);
+}
+
+vec3 CurvesStepD(vec3 prev, vec2 uv, float exponent)
+{
+    //Derivative is unbounded at zero height for exponents below 1
+    float slope = exponent * pow(max(prev.x, 1e-4), exponent - 1.0);
+
+    return vec3(pow(prev.x, exponent), slope * prev.yz);
+}
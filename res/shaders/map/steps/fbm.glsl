@@ -0,0 +1,107 @@
+#include "../../common/hash.glsl"
+#include "blend.glsl"
+
+float FBMNoise(vec2 p) {
+    vec2 id = floor(p);
+    vec2 u = fract(p);
+
+    float a = hash12(id+vec2(0,0));
+    float b = hash12(id+vec2(1,0));
+    float c = hash12(id+vec2(0,1));
+    float d = hash12(id+vec2(1,1));
+
+    u = u*u*u*(u*(6.0*u-15.0)+10.0);
+
+    float k0 = a;
+    float k1 = b-a;
+    float k2 = c-a;
+    float k3 = a-b-c+d;
+
+    return k0 + k1*u.x + k2*u.y + k3*u.x*u.y;
+}
+
+//Noise value with its gradient (value, d/dx, d/dy)
+vec3 FBMNoiseD(vec2 p) {
+    vec2 id = floor(p);
+    vec2 f = fract(p);
+
+    float a = hash12(id+vec2(0,0));
+    float b = hash12(id+vec2(1,0));
+    float c = hash12(id+vec2(0,1));
+    float d = hash12(id+vec2(1,1));
+
+    vec2 u = f*f*f*(f*(6.0*f-15.0)+10.0);
+    vec2 du = 30.0*f*f*(f*(f-2.0)+1.0);
+
+    float k0 = a;
+    float k1 = b-a;
+    float k2 = c-a;
+    float k3 = a-b-c+d;
+
+    return vec3(k0 + k1*u.x + k2*u.y + k3*u.x*u.y,
+                du*vec2(k1 + k3*u.y, k2 + k3*u.x));
+}
+
+float FBM(in vec2 p, int octaves, float roughness) {
+    const float scale_y = 1.0;
+    const float scale_xz = 0.5;
+    const mat2 rot = mat2(0.8, 0.6, -0.6, 0.8);
+
+    p *= scale_xz;
+
+    float res = 0.0;
+    mat2 M = mat2(1.0);
+
+    float A = 1.0, a = 1.0;
+
+    for (int i=0; i<octaves; i++) {
+        res += A*FBMNoise(a*M*p);
+
+        a *= 2.0;
+        A *= roughness;
+        M *= rot;
+    }
+
+    return scale_y * res;
+}
+
+float FBMStep(float prev, vec2 uv, int octaves, float scale, float roughness, int blend_mode, float weight)
+{
+    float h = FBM(scale*uv, octaves, roughness);
+
+    return BlendHeight(prev, h, blend_mode, weight);
+}
+
+//Same as FBM, also returns the gradient w.r.t. p
+vec3 FBMD(in vec2 p, int octaves, float roughness) {
+    const float scale_y = 1.0;
+    const float scale_xz = 0.5;
+    const mat2 rot = mat2(0.8, 0.6, -0.6, 0.8);
+
+    p *= scale_xz;
+
+    vec3 res = vec3(0.0);
+    mat2 M = mat2(1.0);
+
+    float A = 1.0, a = 1.0;
+
+    for (int i=0; i<octaves; i++) {
+        vec3 n = FBMNoiseD(a*M*p);
+
+        //Chain rule, gradient of n(a*M*p) is a*transpose(M)*grad(n)
+        res += A*vec3(n.x, a*(n.yz*M));
+
+        a *= 2.0;
+        A *= roughness;
+        M *= rot;
+    }
+
+    return scale_y * vec3(res.x, scale_xz*res.yz);
+}
+
+vec3 FBMStepD(vec3 prev, vec2 uv, int octaves, float scale, float roughness, int blend_mode, float weight)
+{
+    vec3 h = FBMD(scale*uv, octaves, roughness);
+
+    return BlendHeight(prev, vec3(h.x, scale*h.yz), blend_mode, weight);
+}
@@ -0,0 +1,17 @@
+float RadialCutoffStep(float prev, vec2 uv, float bias, float slope)
+{
+    float hoffset = bias + slope * dot(uv-0.5, uv-0.5);
+
+    return max(prev - hoffset, 0.0);
+}
+
+vec3 RadialCutoffStepD(vec3 prev, vec2 uv, float bias, float slope)
+{
+    float hoffset = bias + slope * dot(uv-0.5, uv-0.5);
+    float h = prev.x - hoffset;
+
+    if (h <= 0.0)
+        return vec3(0.0);
+
+    return vec3(h, prev.yz - 2.0*slope*(uv-0.5));
+}
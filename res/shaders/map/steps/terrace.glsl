@@ -0,0 +1,43 @@
+float TerraceSineStep(float x)
+{
+    const float pi = 3.1415926535;
+
+    if (x<0.0) return 0.0;
+    else if (x>1.0) return 1.0;
+    else return 0.5*sin(pi*(x-0.5)) + 0.5;
+}
+
+float TerraceSineSlope(float x)
+{
+    const float pi = 3.1415926535;
+
+    if (x<0.0 || x>1.0) return 0.0;
+    else return 0.5*pi*cos(pi*(x-0.5));
+}
+
+float Terrace(float height, float flatness)
+{
+    const float t = 1.0 - flatness;
+    const float r = height - floor(height);
+    const float g = t * TerraceSineStep(r/t);
+
+    return t * floor(height) + g;
+}
+
+float TerraceStep(float prev, vec2 uv, int num_terrace, float flatness, float strength)
+{
+    float terraced = Terrace(float(num_terrace)*prev, flatness)/float(num_terrace);
+
+    return mix(prev, terraced, strength);
+}
+
+vec3 TerraceStepD(vec3 prev, vec2 uv, int num_terrace, float flatness, float strength)
+{
+    float x = float(num_terrace)*prev.x;
+    float r = x - floor(x);
+
+    //Floor part is piecewise constant, so d/dh of Terrace(n*h)/n is just the slope of the sine step
+    float slope = TerraceSineSlope(r/(1.0 - flatness));
+
+    return vec3(TerraceStep(prev.x, uv, num_terrace, flatness, strength), mix(1.0, slope, strength) * prev.yz);
+}
@@ -0,0 +1,125 @@
+#include "../../common/hash.glsl"
+#include "blend.glsl"
+
+#define VORONOI_F1    0
+#define VORONOI_F2    1
+#define VORONOI_F2_F1 2
+
+vec2 Voronoi(vec2 x, float randomness){
+    vec2 p = floor(x);
+    vec2 q = fract(x);
+
+    vec2 res = vec2(2.25);
+
+    for (int i=-1; i<=1; i++) {
+        for (int j=-1; j<=1; j++) {
+            vec2 v = p + vec2(i,j);
+            vec2 r = v + randomness*hash22(v);
+
+            float d2 = dot(x-r, x-r);
+
+            if (d2 < res.x) {
+                res.y = res.x;
+                res.x = d2;
+            }
+
+            else if (d2 < res.y) {
+                res.t = d2;
+            }
+        }
+    }
+
+    return sqrt(res);
+}
+
+//Same as Voronoi, also returns gradients of both distances w.r.t. x (F1 in xy, F2 in zw)
+vec2 VoronoiD(vec2 x, float randomness, out vec4 gradients){
+    vec2 p = floor(x);
+    vec2 q = fract(x);
+
+    vec2 res = vec2(2.25);
+    vec2 r1 = x, r2 = x;
+
+    for (int i=-1; i<=1; i++) {
+        for (int j=-1; j<=1; j++) {
+            vec2 v = p + vec2(i,j);
+            vec2 r = v + randomness*hash22(v);
+
+            float d2 = dot(x-r, x-r);
+
+            if (d2 < res.x) {
+                res.y = res.x;
+                res.x = d2;
+
+                r2 = r1;
+                r1 = r;
+            }
+
+            else if (d2 < res.y) {
+                res.t = d2;
+                r2 = r;
+            }
+        }
+    }
+
+    res = sqrt(res);
+
+    //Gradient of |x - r| is the unit vector from r, zero if no point was found
+    gradients.xy = (res.x > 0.0) ? (x - r1)/res.x : vec2(0.0);
+    gradients.zw = (res.y > 0.0) ? (x - r2)/res.y : vec2(0.0);
+
+    return res;
+}
+
+float VoronoiStep(float prev, vec2 uv, float scale, float randomness, int voronoi_type, int blend_mode, float weight)
+{
+    vec2 voro = Voronoi(scale*uv, randomness);
+    float h = 0.0;
+
+    switch(voronoi_type) {
+        case VORONOI_F1:
+        {
+            h = voro.x;
+            break;
+        }
+        case VORONOI_F2:
+        {
+            h = voro.y;
+            break;
+        }
+        case VORONOI_F2_F1:
+        {
+            h = voro.y - voro.x;
+            break;
+        }
+    }
+
+    return BlendHeight(prev, h, blend_mode, weight);
+}
+
+vec3 VoronoiStepD(vec3 prev, vec2 uv, float scale, float randomness, int voronoi_type, int blend_mode, float weight)
+{
+    vec4 gradients;
+    vec2 voro = VoronoiD(scale*uv, randomness, gradients);
+    vec3 h = vec3(0.0);
+
+    switch(voronoi_type) {
+        case VORONOI_F1:
+        {
+            h = vec3(voro.x, gradients.xy);
+            break;
+        }
+        case VORONOI_F2:
+        {
+            h = vec3(voro.y, gradients.zw);
+            break;
+        }
+        case VORONOI_F2_F1:
+        {
+            h = vec3(voro.y - voro.x, gradients.zw - gradients.xy);
+            break;
+        }
+    }
+
+    return BlendHeight(prev, vec3(h.x, scale*h.yz), blend_mode, weight);
+}
@@ -8,32 +8,18 @@ uniform int uNumTerrace;
 uniform float uFlatness;
 uniform float uStrength;
 
-float SineStep(float x)
-{
-    const float pi = 3.1415926535;
-
-    if (x<0.0) return 0.0;
-    else if (x>1.0) return 1.0;
-    else return 0.5*sin(pi*(x-0.5)) + 0.5;
-}
-
-float Terrace(float height)
-{
-    const float t = 1.0 - uFlatness;
-    const float r = height - floor(height);
-    const float g = t * SineStep(r/t);
-
-    return t * floor(height) + g;
-}
+//Same step is used by the fused procedure kernel
+#include "steps/terrace.glsl"
 
 void main() {
     ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
 
-    float height = float(imageLoad(heightmap, texelCoord));
+    float prev = float(imageLoad(heightmap, texelCoord));
 
-    float terraced = Terrace(float(uNumTerrace)*height)/float(uNumTerrace);
+    //Pointwise, doesn't depend on position
+    vec2 uv = vec2(0.0);
 
-    height = mix(height, terraced, uStrength);
+    float h = TerraceStep(prev, uv, uNumTerrace, uFlatness, uStrength);
 
-    imageStore(heightmap, texelCoord, vec4(height));
-}
\ No newline at end of file
+    imageStore(heightmap, texelCoord, vec4(h));
+}
@@ -21,6 +21,8 @@ uniform vec3 uTopRight;
 
 uniform float uScaleY;
 uniform float uScaleXZ;
+//Heightmap uv of the render origin
+uniform vec2 uOriginUV;
 
 vec2 getShadowUV(vec3 pos)
 {
@@ -32,7 +34,7 @@ vec2 getShadowUV(vec3 pos)
     
     //Translate to uv coordinates
     vec2 shadow_uv = (2.0/uScaleXZ)*hit_point.xz;
-    shadow_uv = 0.5*shadow_uv + 0.5;
+    shadow_uv = 0.5*shadow_uv + 0.5 + uOriginUV;
 
     return shadow_uv;
 }
@@ -1,20 +1,29 @@
 #version 450 core
 
-struct Vert {
-    float PosX;
-    float PosY;
-    float PosZ;
-    uint AuxData;
+//Resamples the toroidal height cache of the clipmap from the heightmap.
+//Only texels in the listed rectangles are written, invocations are packed tightly
+//across all of them. Each rectangle stores its origin (in world quad coordinates
+//of its level), width, level and the number of texels in all preceding rectangles.
+struct Rect {
+    ivec2 Origin;
+    int Width;
+    int Level;
+    int Offset;
+    int Padding;
 };
 
-layout(std430, binding = 1) buffer vertexBuffer
+layout(std430, binding = 3) readonly buffer rectBuffer
 {
-    Vert verts[];
+    int NumRects;
+    int NumTexels;
+    Rect Rects[];
 };
 
-layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+layout(r32f, binding = 0) uniform writeonly image2DArray heightCache;
 
-#define MAX_LEVELS 10
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define MAX_LEVELS 16
 layout(std140, binding = 2) uniform ubo
 {
     float QuadSizes[MAX_LEVELS];
@@ -22,98 +31,66 @@ layout(std140, binding = 2) uniform ubo
 
 uniform sampler2D heightmap;
 
-uniform vec2 uPos;
-uniform float uScaleY;
 uniform float uScaleXZ;
-
-//Needs to match enum used to generate vertex data
-#define EDGE_FLAG_NONE 0
-#define EDGE_FLAG_HORIZONTAL 1
-#define EDGE_FLAG_VERTICAL 2
+//Heightmap uv of the render origin
+uniform vec2 uOriginUV;
+//Samples streamed pages instead of the heightmap
+uniform int uVirtualHeight;
 
 #include "../common/clipmap.glsl"
+#include "../common/virtual_height.glsl"
 
-float getHeight(vec2 uv)
+//Finds rectangle corresponding to given invocation, by binary search over the rect list
+int GetRectID(int invocation)
 {
-    return 0.5 * uScaleY * texture(heightmap, uv).r;
-}
+    int lo = 0, hi = NumRects - 1;
 
-bool OffsetSamples(float pos, float quad_size, int id)
-{
-    bool offset_samples = (abs((mod(pos, 2.0*quad_size) - quad_size)) > 0.5*quad_size);
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
 
-    if (id == 0) offset_samples = !offset_samples;
+        if (Rects[mid].Offset <= invocation)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
 
-    return offset_samples;
+    return lo;
 }
 
 void main() {
-    uint i = gl_GlobalInvocationID.x;
+    int invocation = int(gl_GlobalInvocationID.x);
 
-    vec2 vert_pos = vec2(verts[i].PosX, verts[i].PosZ);
+    if (invocation >= NumTexels)
+        return;
 
-    bool trim_flag = false;
-    uint edge_flag = 0, lvl = 0;
+    int r = GetRectID(invocation);
 
-    UnpackAux(verts[i].AuxData, trim_flag, edge_flag, lvl);
+    int local_id = invocation - Rects[r].Offset;
+    int width = Rects[r].Width;
+    int lvl = Rects[r].Level;
 
-    float quad_size = QuadSizes[lvl];
+    ivec2 texel = Rects[r].Origin + ivec2(local_id % width, local_id / width);
 
-    //Base texture coordinate needs to be calculated after considering
-    //possible movement of trim geometry
-    int id = 0;
-    ivec2 id2 = ivec2(0);
-    vec2 hoffset = vec2(0);
-    vec2 pos2 = GetClipmapPos(vert_pos, uPos, quad_size, trim_flag, id, id2, hoffset);
+    vec2 world_pos = QuadSizes[lvl] * vec2(texel);
 
-    vec2 uv = (2.0/uScaleXZ) * (pos2 + hoffset);
-    uv = 0.5*uv + 0.5;
-
-    #define CORRECT_SEAMS
-    #ifdef CORRECT_SEAMS
+    vec2 uv = (2.0/uScaleXZ) * world_pos;
+    uv = 0.5*uv + 0.5 + uOriginUV;
 
+    //Height is stored unscaled, vertex shaders multiply it by uScaleY
     float height = 0.0;
 
-    if (edge_flag == EDGE_FLAG_NONE)
+    if (uVirtualHeight == 1)
     {
-        height = getHeight(uv);
+        //Page lod with texels closest to the quad size of this level
+        float quad_uv = QuadSizes[lvl] / uScaleXZ;
+        height = SampleVirtualHeight(uv, log2(max(quad_uv / uVirtualTexelSize, 1.0)));
     }
-    
-    else 
-    {
-        //At this point the edge flag is either HORIZONTAL or VERTICAL
-        //so we may store this in one bool
-        bool horizontal = (edge_flag == EDGE_FLAG_HORIZONTAL);
 
-        //Depending on the rotation of the trim mesh we may need to change 
-        //the vertical/horizontal orientation of our seam-correction
-        bool swap_axes = (trim_flag && (id == 1 || id == 2));
-
-        if (swap_axes)
-            horizontal = !horizontal;
-
-        vec2 offset = horizontal
-                    ? vec2(quad_size/uScaleXZ, 0.0)
-                    : vec2(0.0, quad_size/uScaleXZ);
-
-        bool offset_samples = horizontal
-                            ? OffsetSamples(pos2.x, quad_size, id2.x)
-                            : OffsetSamples(pos2.y, quad_size, id2.y);
-
-        vec2 sample1 = uv, sample2 = uv;
-
-        if(offset_samples)
-        {
-            sample1 -= offset;
-            sample2 += offset;
-        }
-
-        height = 0.5*(getHeight(sample1)+getHeight(sample2));
-    }
+    else
+        height = texture(heightmap, uv).r;
 
-    #else
-    float height = getHeight(uv);
-    #endif
+    ivec2 cache_coord = WrapCacheCoords(texel, imageSize(heightCache).x);
 
-    verts[i].PosY = height;
+    imageStore(heightCache, ivec3(cache_coord, lvl), vec4(height));
 }
@@ -7,7 +7,6 @@ in vec4 fog_data;
 
 out vec4 frag_col;
 
-uniform sampler2D normalmap;
 uniform sampler2D shadowmap;
 uniform sampler2D materialmap;
 
@@ -20,10 +19,15 @@ uniform samplerCube prefiltered;
 uniform vec3 uPos;
 uniform vec3 uLightDir;
 
+uniform float uScaleXZ;
+uniform float uScaleY;
+
 uniform int uShadow;
 uniform int uMaterial;
 uniform int uFixTiling;
 uniform int uFog;
+//Normal and shadow maps only cover the base tile, normals are derived from streamed pages instead
+uniform int uVirtualHeight;
 
 uniform vec3 uSunCol;
 
@@ -36,6 +40,8 @@ uniform float uTilingFactor;
 uniform float uNormalStrength;
 
 #include "../common/pbr.glsl"
+#include "../common/normal_map.glsl"
+#include "../common/virtual_height.glsl"
 
 #define SUM_COMPONENTS(v) (v.x + v.y + v.z + v.w)
 
@@ -139,14 +145,32 @@ vec4 getMatNormal(vec2 uv) {
         return getMaterialTexture(normal, uv, uTilingFactor*uv);    
 }
 
+//Same as in shaded.vert
+mat3 rotation(vec3 N){
+    vec3 T = vec3(1.0, 0.0, 0.0);
+    T = normalize(T - dot(N,T)*N);
+    vec3 B = cross(T, N);
+    return mat3(T, N, B);
+}
+
 //======================================================================
 
 void main() {
     const vec3 up = vec3(0.0, 1.0, 0.0);  
 
-    vec4 res = texture(normalmap, uv);
-    vec3 norm = 2.0*res.xyz - 1.0;
-    float amb = res.w;
+    vec3 norm = SampleMapNormal(uv);
+    float amb = SampleMapAO(uv);
+    mat3 tangent_frame = norm_rot;
+
+    if (uVirtualHeight == 1) {
+        //Lod with texels matching the pixel footprint
+        float footprint = max(length(dFdx(uv)), length(dFdy(uv)));
+        float lod = log2(max(footprint / uVirtualTexelSize, 1.0));
+
+        norm = GetVirtualNormal(uv, lod, uScaleXZ, uScaleY);
+        amb = 1.0;
+        tangent_frame = rotation(norm);
+    }
 
     float mat_amb = 1.0;
     float roughness = 0.7;
@@ -155,7 +179,7 @@ void main() {
     if (uMaterial == 1) {
         vec4 mat_res = getMatNormal(uv);
         vec3 mat_norm = 2.0*mat_res.rgb-1.0;
-        norm = mix(norm, norm_rot*mat_norm, uNormalStrength);
+        norm = mix(norm, tangent_frame*mat_norm, uNormalStrength);
         norm = normalize(norm);
         mat_amb = mat_res.a;
 
@@ -172,7 +196,7 @@ void main() {
     
     //Do pbr lighting
     float shadow = 1.0;
-    if(uShadow == 1) shadow = texture(shadowmap, uv).r;
+    if(uShadow == 1 && uVirtualHeight == 0) shadow = texture(shadowmap, uv).r;
 
     vec3 sun_col = uSunStr * uSunCol;
     vec3 ref_col = uRefStr * uSunCol;
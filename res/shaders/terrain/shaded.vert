@@ -1,20 +1,24 @@
 #version 450 core
 
-layout (location = 0) in vec3 aPos;
+//Position in units of the quad size of vertex's lod level
+layout (location = 0) in ivec2 aPos;
 layout (location = 1) in uint aAuxData;
 
-#define MAX_LEVELS 10
+#define MAX_LEVELS 16
 layout(std140, binding = 2) uniform ubo
 {
     float QuadSizes[MAX_LEVELS];
 };
 
-uniform sampler2D normalmap;
+uniform sampler2DArray heightCache;
 uniform sampler3D aerial;
 
 uniform vec3 uPos;
 uniform mat4 uMVP;
+uniform float uScaleY;
 uniform float uScaleXZ;
+//Heightmap uv of the render origin
+uniform vec2 uOriginUV;
 
 uniform int uFog;
 uniform float uAerialDist;
@@ -25,6 +29,8 @@ out vec3 frag_pos;
 out vec4 fog_data;
 
 #include "../common/clipmap.glsl"
+#include "../common/normal_map.glsl"
+#include "../common/clipmap_height.glsl"
 
 mat3 rotation(vec3 N){
     vec3 T = vec3(1.0, 0.0, 0.0);
@@ -41,13 +47,15 @@ void main() {
 
     float quad_size = QuadSizes[lvl];
 
-    vec2 pos2 = GetClipmapPos(aPos.xz, uPos.xz, quad_size, trim_flag);
-    vec3 pos3 = vec3(pos2.x, aPos.y, pos2.y);
+    vec2 pos2 = vec2(0);
+    float height = GetClipmapHeightCached(heightCache, quad_size * vec2(aPos), uPos.xz, quad_size, lvl,
+                                          trim_flag, edge_flag, pos2);
+    vec3 pos3 = vec3(pos2.x, 0.5 * uScaleY * height, pos2.y);
 
     uv = (2.0/uScaleXZ) * pos2;
-    uv = 0.5*uv + 0.5;
+    uv = 0.5*uv + 0.5 + uOriginUV;
 
-    vec3 norm = 2.0*texture(normalmap, uv).rgb - 1.0;
+    vec3 norm = SampleMapNormal(uv);
     norm_rot = rotation(normalize(norm));
 
     frag_pos = pos3;
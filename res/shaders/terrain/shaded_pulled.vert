@@ -0,0 +1,76 @@
+#version 450 core
+
+#define MAX_LEVELS 16
+layout(std140, binding = 2) uniform ubo
+{
+    float QuadSizes[MAX_LEVELS];
+};
+
+uniform sampler2D heightmap;
+uniform sampler3D aerial;
+
+uniform vec3 uPos;
+uniform mat4 uMVP;
+uniform float uScaleY;
+uniform float uScaleXZ;
+//Heightmap uv of the render origin
+uniform vec2 uOriginUV;
+
+uniform int uFog;
+uniform float uAerialDist;
+
+out vec2 uv;
+out mat3 norm_rot;
+out vec3 frag_pos;
+out vec4 fog_data;
+
+#include "../common/clipmap.glsl"
+#include "../common/normal_map.glsl"
+#include "../common/clipmap_height.glsl"
+#include "../common/clipmap_instanced.glsl"
+#include "../common/clipmap_pulled.glsl"
+
+mat3 rotation(vec3 N){
+    vec3 T = vec3(1.0, 0.0, 0.0);
+    T = normalize(T - dot(N,T)*N);
+    vec3 B = cross(T, N);
+    return mat3(T, N, B);
+}
+
+void main() {
+    uint edge_flag = 0;
+
+    ivec2 vert_pos, inst_offset;
+    uint border, inst_aux, inst_flags;
+
+    PullVertex(vert_pos, border, inst_offset, inst_aux, inst_flags);
+
+    vec3 pos3 = GetInstancedVertex(heightmap, uPos.xz, uScaleXZ, uOriginUV,
+                                   vert_pos, border, inst_offset, inst_aux, inst_flags, edge_flag);
+    pos3.y *= 0.5 * uScaleY;
+
+    vec2 pos2 = pos3.xz;
+
+    uv = (2.0/uScaleXZ) * pos2;
+    uv = 0.5*uv + 0.5 + uOriginUV;
+
+    vec3 norm = SampleMapNormal(uv);
+    norm_rot = rotation(normalize(norm));
+
+    frag_pos = pos3;
+
+    vec4 pos = uMVP * vec4(pos3, 1.0);
+
+    if (uFog == 1) {
+        //normalized device coordinates should be from [-1, 1], to sample fog we need [0,1]
+        vec3 sampling_point = pos.xyz;
+        sampling_point.xy = 0.5*sampling_point.xy/pos.w + 0.5; 
+        sampling_point.z = sampling_point.z/1000;
+
+        sampling_point.z = min(1.0, uAerialDist * sampling_point.z);
+        
+        fog_data = texture(aerial, sampling_point);
+    }
+
+    gl_Position = pos;
+}
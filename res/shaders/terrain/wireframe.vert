@@ -1,20 +1,25 @@
 #version 450 core
 
-layout (location = 0) in vec3 aPos;
+//Position in units of the quad size of vertex's lod level
+layout (location = 0) in ivec2 aPos;
 layout (location = 1) in uint aAuxData;
 
-#define MAX_LEVELS 10
+#define MAX_LEVELS 16
 layout(std140, binding = 2) uniform ubo
 {
     float QuadSizes[MAX_LEVELS];
 };
 
+uniform sampler2DArray heightCache;
+
 uniform vec2 uPos;
 uniform mat4 uMVP;
+uniform float uScaleY;
 
 out vec3 EdgeColor;
 
 #include "../common/clipmap.glsl"
+#include "../common/clipmap_height.glsl"
 
 void main() 
 {
@@ -25,18 +30,15 @@ void main()
 
     float quad_size = QuadSizes[lvl];
 
-    vec2 pos2 = GetClipmapPos(aPos.xz, uPos, quad_size, trim_flag);
-    vec3 pos3 = vec3(pos2.x, aPos.y, pos2.y);
+    vec2 pos2 = vec2(0);
+    float height = GetClipmapHeightCached(heightCache, quad_size * vec2(aPos), uPos, quad_size, lvl,
+                                          trim_flag, edge_flag, pos2);
+    vec3 pos3 = vec3(pos2.x, 0.5 * uScaleY * height, pos2.y);
 
     gl_Position = uMVP * vec4(pos3, 1.0);
 
     //Debug visualization of edge flags
 
-    //Needs to match enum used to generate vertex data
-    #define EDGE_FLAG_NONE 0
-    #define EDGE_FLAG_HORIZONTAL 1
-    #define EDGE_FLAG_VERTICAL 2
-
     if (edge_flag == EDGE_FLAG_NONE)
         EdgeColor = vec3(1.0);
     else if (edge_flag == EDGE_FLAG_HORIZONTAL)
@@ -0,0 +1,48 @@
+#version 450 core
+
+layout (location = 0) in ivec2 aPos;
+layout (location = 1) in uint aBorder;
+layout (location = 2) in ivec2 aInstOffset;
+layout (location = 3) in uint aInstAux;
+layout (location = 4) in uint aInstFlags;
+
+#define MAX_LEVELS 16
+layout(std140, binding = 2) uniform ubo
+{
+    float QuadSizes[MAX_LEVELS];
+};
+
+uniform sampler2D heightmap;
+
+uniform vec2 uPos;
+uniform float uScaleXZ;
+//Heightmap uv of the render origin
+uniform vec2 uOriginUV;
+uniform mat4 uMVP;
+uniform float uScaleY;
+
+out vec3 EdgeColor;
+
+#include "../common/clipmap.glsl"
+#include "../common/clipmap_height.glsl"
+#include "../common/clipmap_instanced.glsl"
+
+void main() 
+{
+    uint edge_flag = 0;
+
+    vec3 pos3 = GetInstancedVertex(heightmap, uPos, uScaleXZ, uOriginUV,
+                                   aPos, aBorder, aInstOffset, aInstAux, aInstFlags, edge_flag);
+    pos3.y *= 0.5 * uScaleY;
+
+    gl_Position = uMVP * vec4(pos3, 1.0);
+
+    //Debug visualization of edge flags
+
+    if (edge_flag == EDGE_FLAG_NONE)
+        EdgeColor = vec3(1.0);
+    else if (edge_flag == EDGE_FLAG_HORIZONTAL)
+        EdgeColor = vec3(0.0, 1.0, 0.0);
+    else if (edge_flag == EDGE_FLAG_VERTICAL)
+        EdgeColor = vec3(0.0, 0.0, 1.0);
+}
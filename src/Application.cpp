@@ -15,10 +15,15 @@
 #include "glad/glad.h"
 
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
-Application::Application(const std::string& title, uint32_t width, uint32_t height)
-    : m_Window(title, width, height), m_Renderer(width, height)
+Application::Application(const std::string& title, uint32_t width, uint32_t height, bool headless)
+    : m_Headless(headless), m_Window(title, width, height, headless), m_Renderer(width, height)
 {
+    //Redirect window callbacks to application's on event function
+    m_Window.setEventCallback(std::bind(&Application::OnEvent, this, std::placeholders::_1));
+
     //Initialize ImGui:
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -26,6 +31,14 @@ Application::Application(const std::string& title, uint32_t width, uint32_t heig
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
 
+    //Headless runs never draw the gui, context is only kept
+    //so that nothing else needs to special-case it
+    if (m_Headless)
+    {
+        io.IniFilename = nullptr;
+        return;
+    }
+
     ImGui_ImplGlfw_InitForOpenGL(m_Window.getGLFWPointer(), true);
     ImGui_ImplOpenGL3_Init("#version 450");
     ImGui::StyleColorsDark();
@@ -52,15 +65,16 @@ Application::Application(const std::string& title, uint32_t width, uint32_t heig
 
     //Setup handler for additional data in imgui.ini
     m_Renderer.InitImGuiIniHandler();
-
-    //Redirect window callbacks to application's on event function
-    m_Window.setEventCallback(std::bind(&Application::OnEvent, this, std::placeholders::_1));
 }
 
 Application::~Application()
 {
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
+    if (!m_Headless)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+    }
+
     ImGui::DestroyContext();
 }
 
@@ -106,10 +120,19 @@ void Application::StartMenu()
 
         ImGui::Columns(2, "###col");
         ImGuiUtils::ColSliderInt("Grid subdivisions", &m_StartSettings.Subdivisions, 16, 96);
-        ImGuiUtils::ColSliderInt("Lod levels", &m_StartSettings.LodLevels, 1, 10);
+        ImGuiUtils::ColSliderInt("Lod levels", &m_StartSettings.LodLevels, 1, static_cast<int>(ClipmapMaxLevels));
+
+        //Clipmap geometry mode selection
+        std::vector<std::string> clipmap_modes{ "displaced", "instanced", "pulled" };
+
+        size_t clipmap_mode = static_cast<size_t>(m_StartSettings.ClipmapMode);
+
+        ImGuiUtils::ColCombo("Clipmap mode", clipmap_modes, clipmap_mode);
+
+        m_StartSettings.ClipmapMode = static_cast<GeometryMode>(clipmap_mode);
 
         //World type selection
-        std::vector<std::string> options{ "finite", "tiling" };
+        std::vector<std::string> options{ "finite", "tiling", "unbounded" };
 
         static size_t selected_id = 1;
 
@@ -118,9 +141,12 @@ void Application::StartMenu()
 
         if (selected_id == 0)
             m_StartSettings.WrapType = GL_CLAMP_TO_BORDER;
-        else if (selected_id == 1)
+        else
             m_StartSettings.WrapType = GL_REPEAT;
 
+        //Unbounded worlds stream heightmap pages around the camera
+        m_StartSettings.VirtualHeightmap = (selected_id == 2);
+
         ImGui::Columns(1, "###col");
 
         ImGuiUtils::EndGroupPanel();
@@ -131,8 +157,8 @@ void Application::StartMenu()
 
         ImGui::Columns(2, "###col");
 
-        ImGuiUtils::ColSliderIntLog("Heightmap resolution", &m_StartSettings.HeightRes, 256, 4096);
-        ImGuiUtils::ColSliderIntLog("Shadowmap resolution", &m_StartSettings.ShadowRes, 256, 4096);
+        ImGuiUtils::ColSliderIntLog("Heightmap resolution", &m_StartSettings.HeightRes, 256, 8192);
+        ImGuiUtils::ColSliderIntLog("Shadowmap resolution", &m_StartSettings.ShadowRes, 256, 8192);
         ImGuiUtils::ColSliderIntLog("Material resolution", &m_StartSettings.MaterialRes, 256, 4096);
 
         ImGui::Spacing(); ImGui::NextColumn(); ImGui::Spacing(); ImGui::NextColumn();
@@ -150,8 +176,27 @@ void Application::StartMenu()
         m_StartSettings.ShadowRes   = RoundToPowerOf2(m_StartSettings.ShadowRes);
         m_StartSettings.MaterialRes = RoundToPowerOf2(m_StartSettings.MaterialRes);
 
+        //Storage formats, compact ones let larger maps fit in vram
+        std::vector<std::string> height_formats{ "R32F", "R16 (clamped to [0,1])" };
+        std::vector<std::string> normal_formats{ "RGBA8", "Octahedral RG8", "Octahedral RG16" };
+
+        size_t height_format = static_cast<size_t>(m_StartSettings.HeightStorage);
+        size_t normal_format = static_cast<size_t>(m_StartSettings.NormalStorage);
+
+        //Virtual heightmap pages always use R32F
+        if (!m_StartSettings.VirtualHeightmap)
+            ImGuiUtils::ColCombo("Heightmap format", height_formats, height_format);
+
+        ImGuiUtils::ColCombo("Normalmap format", normal_formats, normal_format);
+
+        m_StartSettings.HeightStorage = static_cast<HeightFormat>(height_format);
+        m_StartSettings.NormalStorage = static_cast<NormalFormat>(normal_format);
+
         ImGui::Columns(1, "###col");
 
+        const float map_memory = static_cast<float>(Renderer::EstimateMapMemory(m_StartSettings));
+        ImGui::Text("Map memory: %.1f MiB", map_memory / (1024.0f * 1024.0f));
+
         ImGuiUtils::EndGroupPanel();
 
         //RENDERING-----------------------------------------------------------------------------
@@ -216,6 +261,66 @@ void Application::Run()
     }
 }
 
+void Application::RunHeadless(const HeadlessSettings& settings)
+{
+    Profiler::OnInit();
+
+    m_Renderer.Init(settings.Start);
+
+    if (!settings.WorldPath.empty() && !m_Renderer.LoadWorld(settings.WorldPath))
+        throw std::runtime_error("Failed to load world: " + settings.WorldPath.string());
+
+    if (settings.CrossCheckHeight)
+    {
+        std::string result;
+        const bool passed = m_Renderer.CrossCheckHeight(result);
+
+        std::cout << "Cpu/gpu height cross-check: " << result << '\n';
+
+        if (!passed)
+            throw std::runtime_error("Cpu/gpu height cross-check failed");
+    }
+
+    CameraPath path;
+
+    if (!settings.CameraPathPath.empty() && !path.LoadFromFile(settings.CameraPathPath))
+        throw std::runtime_error("Failed to load camera path: " + settings.CameraPathPath.string());
+
+    const float dt = settings.TimeStep;
+
+    const int num_frames = (settings.NumFrames > 0)
+        ? settings.NumFrames
+        : static_cast<int>(std::ceil(path.getDuration() / dt)) + 1;
+
+    for (int frame = -settings.WarmupFrames; frame < num_frames; frame++)
+    {
+        if (frame == 0)
+            Profiler::StartRecording();
+
+        Profiler::NextFrame();
+
+        if (!path.Empty())
+            m_Renderer.SetCameraPose(path.Sample(std::max(frame, 0) * dt));
+
+        m_Renderer.OnUpdate(dt);
+        m_Renderer.OnRender();
+
+        m_Window.OnUpdate();
+
+        Profiler::SwapBuffers();
+    }
+
+    //Retrieve gpu timings of the last frame
+    Profiler::NextFrame();
+    Profiler::StopRecording();
+
+    if (!Profiler::WriteReport(settings.ReportPath))
+        throw std::runtime_error("Failed to write report: " + settings.ReportPath.string());
+
+    std::cout << "Benchmark report written to " << settings.ReportPath << '\n';
+    std::cout << "Terrain geometry memory: " << m_Renderer.getTerrainGeometryMemory() / 1024 << " KiB\n";
+}
+
 void Application::OnEvent(Event& e)
 {
    EventType type = e.getEventType();
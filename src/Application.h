@@ -4,20 +4,41 @@
 #include "Renderer.h"
 #include "Timer.h"
 
+#include <filesystem>
+
 class Application{
 public:
-    Application(const std::string& title, uint32_t width, uint32_t height);
+    //Settings for running without display/gui, with a scripted camera flythrough
+    struct HeadlessSettings {
+        Renderer::StartSettings Start;
+        std::filesystem::path WorldPath;
+        std::filesystem::path CameraPathPath;
+        std::filesystem::path ReportPath = "benchmark_report.json";
+        //Frames rendered before recording (absorb initial map generation etc.)
+        int WarmupFrames = 60;
+        //If not positive, the whole camera path is replayed
+        int NumFrames = 0;
+        //Fixed timestep, so that runs are reproducible
+        float TimeStep = 1.0f / 60.0f;
+        //Compares cpu and gpu heightmap backends before the flythrough, the run fails on mismatch
+        bool CrossCheckHeight = false;
+    };
+
+    Application(const std::string& title, uint32_t width, uint32_t height, bool headless = false);
     ~Application();
 
     void StartMenu();
     void Init();
     void Run();
 
+    void RunHeadless(const HeadlessSettings& settings);
+
     void OnEvent(Event& e);
 private:
     void StartFrame();
     void EndFrame();
 
+    bool m_Headless;
     bool m_ShowMenu = true;
 
     bool m_ShowStartMenu = true;
@@ -2,10 +2,15 @@
 
 #include "Keycodes.h"
 
+#include "cpu/Simd.h"
+
 #include "imgui.h"
 #include "ImGuiUtils.h"
 #include "ImGuiIcons.h"
 
+#include <algorithm>
+#include <cmath>
+
 //=====Frustum culling primitives=========================================
 
 bool Plane::IsInFront(const AABB& aabb, float scale_y) const {
@@ -34,10 +39,92 @@ bool Frustum::IsInFrustum(const AABB& aabb, float scale_y) const {
         && Far.IsInFront(aabb, scale_y);
 }
 
+void AABBBatch::Clear()
+{
+    CenterX.clear(); CenterY.clear(); CenterZ.clear();
+    ExtentsX.clear(); ExtentsY.clear(); ExtentsZ.clear();
+
+    Count = 0;
+}
+
+void AABBBatch::Push(const AABB& aabb)
+{
+    //Fill the next padding slot, or append a new block of 8 slots
+    if (Count == CenterX.size())
+    {
+        const size_t padded = Count + 8;
+
+        CenterX.resize(padded, 0.0f); CenterY.resize(padded, 0.0f); CenterZ.resize(padded, 0.0f);
+        ExtentsX.resize(padded, 0.0f); ExtentsY.resize(padded, 0.0f); ExtentsZ.resize(padded, 0.0f);
+    }
+
+    CenterX[Count] = aabb.Center.x; CenterY[Count] = aabb.Center.y; CenterZ[Count] = aabb.Center.z;
+    ExtentsX[Count] = aabb.Extents.x; ExtentsY[Count] = aabb.Extents.y; ExtentsZ[Count] = aabb.Extents.z;
+
+    Count++;
+}
+
+void Frustum::IsInFrustum(const AABBBatch& boxes, float scale_y, std::vector<uint32_t>& visible) const
+{
+    using simd::Float8;
+    using simd::Mask8;
+
+    visible.assign((boxes.Count + 31) / 32, 0u);
+
+    //Same test as in Plane::IsInFront, with plane data hoisted out of the loop:
+    //box is outside if dot(scaled center, N) - dot(origin, N) + dot(scaled extents, |N|) < 0
+    struct PlaneData {
+        Float8 NX, NY, NZ, AbsNX, AbsNY, AbsNZ, D;
+    };
+
+    const Plane* planes[6] = { &Top, &Bottom, &Left, &Right, &Near, &Far };
+    PlaneData data[6];
+
+    for (int p = 0; p < 6; p++)
+    {
+        const glm::vec3 n = planes[p]->Normal;
+
+        data[p] = PlaneData{
+            n.x, scale_y * n.y, n.z,
+            std::abs(n.x), scale_y * std::abs(n.y), std::abs(n.z),
+            glm::dot(planes[p]->Origin, n)
+        };
+    }
+
+    for (size_t i = 0; i < boxes.Count; i += 8)
+    {
+        const Float8 cx = Float8::Load(&boxes.CenterX[i]);
+        const Float8 cy = Float8::Load(&boxes.CenterY[i]);
+        const Float8 cz = Float8::Load(&boxes.CenterZ[i]);
+        const Float8 ex = Float8::Load(&boxes.ExtentsX[i]);
+        const Float8 ey = Float8::Load(&boxes.ExtentsY[i]);
+        const Float8 ez = Float8::Load(&boxes.ExtentsZ[i]);
+
+        //All lanes false
+        Mask8 outside = Float8(0.0f) > Float8(0.0f);
+
+        for (const auto& p : data)
+        {
+            const Float8 sd = cx * p.NX + cy * p.NY + cz * p.NZ - p.D;
+            const Float8 r = ex * p.AbsNX + ey * p.AbsNY + ez * p.AbsNZ;
+
+            outside = outside || (sd + r < Float8(0.0f));
+        }
+
+        const uint32_t bits = ~simd::MoveMask(outside) & 0xFFu;
+
+        visible[i / 32] |= bits << (i % 32);
+    }
+
+    //Clear bits of padding boxes
+    if (boxes.Count % 32 != 0)
+        visible.back() &= (1u << (boxes.Count % 32)) - 1u;
+}
+
 //=====Base camera class================================================
 
 Camera::Camera(glm::vec3 pos, glm::vec3 wup, float pitch, float yaw)
-    : m_Pos(pos), m_PrevPos(pos), m_WorldUp(wup), m_Pitch(pitch), m_Yaw(yaw)
+    : m_Pos(pos), m_PrevPos(pos), m_WorldPos(pos), m_WorldUp(wup), m_Pitch(pitch), m_Yaw(yaw)
 {
     updateVectors();
 }
@@ -58,11 +145,55 @@ void Camera::updateVectors()
    m_Up = glm::normalize(glm::cross(m_Right, m_Front));
 }
 
+void Camera::updateRenderPos()
+{
+    m_Pos = glm::vec3(m_WorldPos - m_Origin);
+}
+
+void Camera::setPose(glm::dvec3 world_pos, float yaw, float pitch)
+{
+    m_WorldPos = world_pos;
+    m_Yaw = yaw;
+    m_Pitch = pitch;
+
+    updateRenderPos();
+    updateVectors();
+}
+
+bool Camera::RebaseOrigin(double granularity, double max_distance)
+{
+    const glm::dvec3 rel = m_WorldPos - m_Origin;
+
+    if (std::max(std::abs(rel.x), std::abs(rel.z)) <= max_distance)
+        return false;
+
+    //Height is bounded by the terrain scale, so only xz are rebased
+    const glm::dvec3 shift{
+        granularity * std::round(rel.x / granularity), 0.0,
+        granularity * std::round(rel.z / granularity)
+    };
+
+    if (shift.x == 0.0 && shift.z == 0.0)
+        return false;
+
+    m_Origin += shift;
+    m_PrevPos -= glm::vec3(shift);
+
+    updateRenderPos();
+
+    return true;
+}
+
 bool Camera::IsInFrustum(const AABB& aabb, float scale_y) const
 {
     return m_Frustum.IsInFrustum(aabb, scale_y);
 }
 
+void Camera::IsInFrustum(const AABBBatch& boxes, float scale_y, std::vector<uint32_t>& visible) const
+{
+    m_Frustum.IsInFrustum(boxes, scale_y, visible);
+}
+
 //=====Perspective camera class===================================================
 
 glm::mat4 PerspectiveCamera::getProjMatrix() const
@@ -132,6 +263,8 @@ void PerspectiveCamera::OnImGui(bool& open)
     ImGui::Columns(2, "###col");
     ImGuiUtils::ColSliderFloat("Fov", &m_Fov, 0.0f, 90.0f);
     ImGui::Columns(1, "###col");
+    ImGui::Text("World position: %.2f, %.2f, %.2f", m_WorldPos.x, m_WorldPos.y, m_WorldPos.z);
+    ImGui::Text("Render origin: %.0f, %.0f", m_Origin.x, m_Origin.z);
     ImGui::End();
 }
 
@@ -168,17 +301,20 @@ void FPCamera::ProcessKeyboard(float deltatime)
 {
     float velocity = deltatime * m_Speed;
 
+    //Movement is accumulated in world space, in double precision
     if ((m_Movement & Forward) != None)
-        m_Pos += velocity * m_Front;
+        m_WorldPos += glm::dvec3(velocity * m_Front);
 
     if ((m_Movement & Backward) != None)
-        m_Pos -= velocity * m_Front;
+        m_WorldPos -= glm::dvec3(velocity * m_Front);
 
     if ((m_Movement & Left) != None)
-        m_Pos -= velocity * m_Right;
+        m_WorldPos -= glm::dvec3(velocity * m_Right);
 
     if ((m_Movement & Right) != None)
-        m_Pos += velocity * m_Right;
+        m_WorldPos += glm::dvec3(velocity * m_Right);
+
+    updateRenderPos();
 }
 
 void FPCamera::ProcessMouse(float xoffset, float yoffset)
@@ -4,6 +4,9 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include <vector>
+#include <cstdint>
+
 //Frustum culling setup based on
 //https://learnopengl.com/Guest-Articles/2021/Scene/Frustum-Culling
 
@@ -11,6 +14,18 @@ struct AABB {
     glm::vec3 Center, Extents;
 };
 
+//Bounding boxes in structure-of-arrays layout, used for batch culling.
+//Arrays are padded with empty boxes to a multiple of 8.
+struct AABBBatch {
+    std::vector<float> CenterX, CenterY, CenterZ;
+    std::vector<float> ExtentsX, ExtentsY, ExtentsZ;
+
+    size_t Count = 0;
+
+    void Clear();
+    void Push(const AABB& aabb);
+};
+
 class Plane {
 public:
     glm::vec3 Origin = { 0.0f, 0.0f, 0.0f };
@@ -26,6 +41,10 @@ public:
 
     bool IsInFrustum(const AABB& aabb, float scale_y) const;
 
+    //Tests 8 boxes per iteration, bit i of visible[i/32] is set if box i is in the frustum.
+    //Equivalent to calling IsInFrustum on each box.
+    void IsInFrustum(const AABBBatch& boxes, float scale_y, std::vector<uint32_t>& visible) const;
+
     Plane Top, Bottom, Left, Right, Near, Far;
 };
 
@@ -50,23 +69,41 @@ public:
     virtual glm::mat4 getProjMatrix() const = 0;
     virtual glm::mat4 getViewProjMatrix() const = 0;
 
+    //Position in render space, i.e. relative to the render origin
     glm::vec3 getPos() const {return m_Pos;}
     glm::vec3 getPrevPos() const { return m_PrevPos; }
+
+    //World position, kept in double precision
+    glm::dvec3 getWorldPos() const { return m_WorldPos; }
+    glm::dvec3 getOrigin() const { return m_Origin; }
     glm::vec3 getFront() const {return m_Front;}
     glm::vec3 getRight() const { return m_Right; }
     glm::vec3 getUp() const { return m_Up; }
 
+    float getYaw() const { return m_Yaw; }
+    float getPitch() const { return m_Pitch; }
+
+    //Directly places the camera (in world space), used when replaying recorded camera paths
+    void setPose(glm::dvec3 world_pos, float yaw, float pitch);
+
+    //Floating origin: if the camera got further than max_distance from the render origin (in xz),
+    //moves the origin next to it. The shift is a multiple of granularity, so that geometry snapped
+    //to such a grid stays at the same world positions. Returns true if the origin moved.
+    bool RebaseOrigin(double granularity, double max_distance);
+
     float getNearPlane() const { return m_NearPlane; }
     float getFarPlane() const { return m_FarPlane; }
 
     //This is the same for all cameras as only construction of
     //frustum planes is assumed to differ (this is definitely the case for ortho and perspective)
     bool IsInFrustum(const AABB& aabb, float scale_y) const;
+    void IsInFrustum(const AABBBatch& boxes, float scale_y, std::vector<uint32_t>& visible) const;
 
     virtual void OnImGui(bool& open) = 0;
 
 protected:
     glm::vec3 m_Pos, m_PrevPos;
+    glm::dvec3 m_WorldPos, m_Origin{ 0.0 };
     glm::vec3 m_Front, m_Up, m_Right, m_WorldUp;
     float m_Pitch, m_Yaw;
 
@@ -74,6 +111,9 @@ protected:
 
     void updateVectors();
 
+    //Recomputes render space position from the world position
+    void updateRenderPos();
+
     Frustum m_Frustum;
     virtual void updateFrustum(float aspect) = 0; //Frustum construction depends on projection type
 };
@@ -0,0 +1,135 @@
+#include "CameraPath.h"
+
+#include "nlohmann/json.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+void CameraPath::Clear()
+{
+    m_Keyframes.clear();
+}
+
+void CameraPath::AddKeyframe(const CameraKeyframe& keyframe)
+{
+    //Keep keyframes sorted by time
+    auto it = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), keyframe,
+        [](const CameraKeyframe& lhs, const CameraKeyframe& rhs) {return lhs.Time < rhs.Time; }
+    );
+
+    m_Keyframes.insert(it, keyframe);
+}
+
+float CameraPath::getDuration() const
+{
+    if (m_Keyframes.empty())
+        return 0.0f;
+
+    return m_Keyframes.back().Time - m_Keyframes.front().Time;
+}
+
+CameraKeyframe CameraPath::Sample(float time) const
+{
+    if (m_Keyframes.empty())
+        return CameraKeyframe{ time, glm::dvec3(0.0), -90.0f, 0.0f };
+
+    time += m_Keyframes.front().Time;
+
+    if (time <= m_Keyframes.front().Time)
+        return m_Keyframes.front();
+
+    if (time >= m_Keyframes.back().Time)
+        return m_Keyframes.back();
+
+    auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), time,
+        [](float t, const CameraKeyframe& k) {return t < k.Time; }
+    );
+
+    auto prev = std::prev(next);
+
+    const float span = next->Time - prev->Time;
+    const float t = (span > 0.0f) ? (time - prev->Time) / span : 0.0f;
+
+    //Yaw turns the short way, also across +-180 degrees
+    float yaw_delta = std::fmod(next->Yaw - prev->Yaw, 360.0f);
+
+    if (yaw_delta > 180.0f)
+        yaw_delta -= 360.0f;
+    else if (yaw_delta < -180.0f)
+        yaw_delta += 360.0f;
+
+    return CameraKeyframe{
+        time,
+        glm::mix(prev->Pos, next->Pos, static_cast<double>(t)),
+        prev->Yaw + t * yaw_delta,
+        glm::mix(prev->Pitch, next->Pitch, t)
+    };
+}
+
+bool CameraPath::LoadFromFile(const std::filesystem::path& filepath)
+{
+    std::ifstream input(filepath);
+
+    if (!input)
+    {
+        std::cerr << "CameraPath Error: Failed to open file " << filepath << '\n';
+        return false;
+    }
+
+    auto json = nlohmann::ordered_json::parse(input, nullptr, false);
+
+    if (json.is_discarded() || !json.contains("Keyframes"))
+    {
+        std::cerr << "CameraPath Error: " << filepath << " is not a valid camera path\n";
+        return false;
+    }
+
+    m_Keyframes.clear();
+
+    for (auto& entry : json["Keyframes"])
+    {
+        CameraKeyframe keyframe;
+        keyframe.Time  = entry["Time"];
+        keyframe.Pos   = glm::dvec3(entry["Pos"][0].get<double>(), entry["Pos"][1].get<double>(), entry["Pos"][2].get<double>());
+        keyframe.Yaw   = entry["Yaw"];
+        keyframe.Pitch = entry["Pitch"];
+
+        AddKeyframe(keyframe);
+    }
+
+    return true;
+}
+
+bool CameraPath::SaveToFile(const std::filesystem::path& filepath) const
+{
+    nlohmann::ordered_json json;
+
+    json["Keyframes"] = nlohmann::ordered_json::array();
+
+    for (auto& keyframe : m_Keyframes)
+    {
+        nlohmann::ordered_json entry;
+        entry["Time"]  = keyframe.Time;
+        entry["Pos"]   = { keyframe.Pos.x, keyframe.Pos.y, keyframe.Pos.z };
+        entry["Yaw"]   = keyframe.Yaw;
+        entry["Pitch"] = keyframe.Pitch;
+
+        json["Keyframes"].push_back(entry);
+    }
+
+    std::ofstream output(filepath, std::ios::trunc);
+
+    if (!output)
+    {
+        std::cerr << "CameraPath Error: Failed to open file " << filepath << '\n';
+        return false;
+    }
+
+    const int indent = 4;
+
+    output << json.dump(indent);
+
+    return true;
+}
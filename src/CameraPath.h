@@ -0,0 +1,37 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <filesystem>
+
+//Camera pose at a given point in time
+struct CameraKeyframe {
+    float Time;
+    //World position, double precision to support flying far from the origin
+    glm::dvec3 Pos;
+    float Yaw, Pitch;
+};
+
+//Sequence of camera keyframes, used to record a flythrough
+//and replay it deterministically (e.g. for benchmarking)
+class CameraPath {
+public:
+    CameraPath() = default;
+    ~CameraPath() = default;
+
+    void Clear();
+    void AddKeyframe(const CameraKeyframe& keyframe);
+
+    //Keyframes are linearly interpolated, time is clamped to the path duration
+    CameraKeyframe Sample(float time) const;
+
+    bool LoadFromFile(const std::filesystem::path& filepath);
+    bool SaveToFile(const std::filesystem::path& filepath) const;
+
+    bool Empty() const { return m_Keyframes.empty(); }
+    float getDuration() const;
+
+private:
+    std::vector<CameraKeyframe> m_Keyframes;
+};
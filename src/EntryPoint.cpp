@@ -1,12 +1,68 @@
 #include "Application.h"
 
 #include <iostream>
+#include <string>
 
-int main() 
+//Usage for benchmarking without a display:
+//LofiLandscapes --headless --world examples/Island.world --camera-path path.json
+//               [--report report.json] [--frames N] [--warmup N] [--dt seconds]
+//               [--width W] [--height H] [--cpu-heightmap] [--instanced-clipmap | --pulled-clipmap]
+//               [--virtual-heightmap] [--cross-check-height]
+//With --cross-check-height the process exits with an error if cpu and gpu heights disagree
+static bool ParseHeadlessArgs(int argc, char** argv, uint32_t& width, uint32_t& height,
+                              Application::HeadlessSettings& settings)
+{
+    bool headless = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+
+        auto NextArg = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for argument " + arg);
+
+            return argv[++i];
+        };
+
+        if      (arg == "--headless")    headless = true;
+        else if (arg == "--world")       settings.WorldPath = NextArg();
+        else if (arg == "--camera-path") settings.CameraPathPath = NextArg();
+        else if (arg == "--report")      settings.ReportPath = NextArg();
+        else if (arg == "--frames")      settings.NumFrames = std::stoi(NextArg());
+        else if (arg == "--warmup")      settings.WarmupFrames = std::stoi(NextArg());
+        else if (arg == "--dt")          settings.TimeStep = std::stof(NextArg());
+        else if (arg == "--width")       width = static_cast<uint32_t>(std::stoul(NextArg()));
+        else if (arg == "--height")      height = static_cast<uint32_t>(std::stoul(NextArg()));
+        else if (arg == "--cpu-heightmap") settings.Start.CpuHeightmap = true;
+        else if (arg == "--instanced-clipmap") settings.Start.ClipmapMode = GeometryMode::Instanced;
+        else if (arg == "--pulled-clipmap")    settings.Start.ClipmapMode = GeometryMode::Pulled;
+        else if (arg == "--virtual-heightmap") settings.Start.VirtualHeightmap = true;
+        else if (arg == "--cross-check-height") settings.CrossCheckHeight = true;
+        else
+            std::cerr << "Unknown argument: " << arg << '\n';
+    }
+
+    return headless;
+}
+
+int main(int argc, char** argv) 
 {
     try 
     {
-        Application app("LofiLandscapes", 800, 600);
+        uint32_t width = 800, height = 600;
+        Application::HeadlessSettings headless_settings;
+
+        const bool headless = ParseHeadlessArgs(argc, argv, width, height, headless_settings);
+
+        Application app("LofiLandscapes", width, height, headless);
+
+        if (headless)
+        {
+            app.RunHeadless(headless_settings);
+            return 0;
+        }
 
         app.StartMenu();
         app.Init();
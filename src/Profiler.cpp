@@ -6,7 +6,12 @@
 
 #include "ImGuiUtils.h"
 
+#include "nlohmann/json.hpp"
+
 #include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
 
 FrameData::FrameData()
 {
@@ -30,6 +35,14 @@ std::vector<uint32_t> Profiler::s_QueryIDs1, Profiler::s_QueryIDs2;
 std::vector<uint32_t>* Profiler::s_FrontBuffer = &s_QueryIDs1;
 std::vector<uint32_t>* Profiler::s_BackBuffer = &s_QueryIDs2;
 
+bool Profiler::s_Recording = false;
+bool Profiler::s_RecordCurrentFrame = false;
+
+std::vector<FrameData> Profiler::s_RecordedCPUFrames, Profiler::s_RecordedGPUFrames;
+std::vector<float> Profiler::s_RecordedFrameTimes;
+
+std::chrono::time_point<std::chrono::high_resolution_clock> Profiler::s_FrameStart;
+
 //===================================================
 
 size_t FindOrInsert(std::vector<std::string>& vec, const std::string& name)
@@ -58,6 +71,28 @@ size_t Profiler::GetGPUEventID(const std::string& name)
 	return FindOrInsert(s_GPUEventLabels, name);
 }
 
+float Profiler::GetLastGPUTime(const std::string& name)
+{
+	auto label = std::find(s_GPUEventLabels.begin(), s_GPUEventLabels.end(), name);
+
+	//Back of the deque is the frame in progress
+	if (s_StopProfiling || label == s_GPUEventLabels.end() || s_GPUFrames.size() < 2)
+		return -1.0f;
+
+	const size_t id = std::distance(s_GPUEventLabels.begin(), label);
+	const auto& frame = s_GPUFrames[s_GPUFrames.size() - 2];
+
+	float time = -1.0f;
+
+	for (size_t idx = 0; idx < std::min(frame.Ids.size(), frame.Timings.size()); idx++)
+	{
+		if (frame.Ids[idx] == id)
+			time = std::max(time, 0.0f) + frame.Timings[idx];
+	}
+
+	return time;
+}
+
 void Profiler::SubmitCpuEvent(size_t idx, float time)
 {
 	if (s_StopProfiling) return;
@@ -102,6 +137,22 @@ void Profiler::NextFrame()
 		}
 	}
 
+	//Frame is now complete, store it if it was started during recording
+	const auto frame_end = std::chrono::high_resolution_clock::now();
+
+	if (s_RecordCurrentFrame && !s_CPUFrames.empty() && !s_GPUFrames.empty())
+	{
+		using namespace std::chrono;
+		const float frame_ms = duration_cast<nanoseconds>(frame_end - s_FrameStart).count() * 1e-6f;
+
+		s_RecordedCPUFrames.push_back(s_CPUFrames.back());
+		s_RecordedGPUFrames.push_back(s_GPUFrames.back());
+		s_RecordedFrameTimes.push_back(frame_ms);
+	}
+
+	s_RecordCurrentFrame = s_Recording;
+	s_FrameStart = frame_end;
+
 	//Cycle frames
 	if (s_CPUFrames.size() >= s_NumFrames)
 		s_CPUFrames.pop_front();
@@ -127,6 +178,116 @@ void Profiler::OnInit()
 	glGenQueries(s_MaxGPUQueries, &s_QueryIDs2[0]);
 }
 
+void Profiler::StartRecording()
+{
+	s_RecordedCPUFrames.clear();
+	s_RecordedGPUFrames.clear();
+	s_RecordedFrameTimes.clear();
+
+	s_Recording = true;
+}
+
+void Profiler::StopRecording()
+{
+	s_Recording = false;
+	s_RecordCurrentFrame = false;
+}
+
+bool Profiler::WriteReport(const std::filesystem::path& filepath)
+{
+	nlohmann::ordered_json json;
+
+	const size_t num_frames = s_RecordedFrameTimes.size();
+
+	auto FrameToJson = [](const FrameData& frame, const std::vector<std::string>& labels)
+	{
+		nlohmann::ordered_json res = nlohmann::ordered_json::object();
+
+		//Events with the same label may be submitted more than once per frame
+		for (size_t idx = 0; idx < std::min(frame.Ids.size(), frame.Timings.size()); idx++)
+		{
+			const std::string& label = labels.at(frame.Ids[idx]);
+
+			if (res.contains(label))
+				res[label] = res[label].get<float>() + frame.Timings[idx];
+			else
+				res[label] = frame.Timings[idx];
+		}
+
+		return res;
+	};
+
+	//Per event statistics over the frames in which the event occurred,
+	//MeanPerFrame spreads its total time over all recorded frames instead
+	auto Summarize = [num_frames](const nlohmann::ordered_json& frames, const std::string& key)
+	{
+		std::map<std::string, std::vector<float>> samples;
+
+		for (auto& frame : frames)
+		{
+			for (auto& [label, time] : frame[key].items())
+				samples[label].push_back(time.get<float>());
+		}
+
+		nlohmann::ordered_json res = nlohmann::ordered_json::object();
+
+		for (auto& [label, times] : samples)
+		{
+			std::sort(times.begin(), times.end());
+
+			float sum = 0.0f;
+			for (float t : times) sum += t;
+
+			const size_t p95_id = std::min(times.size() - 1, size_t(0.95f * float(times.size())));
+
+			res[label]["Frames"] = times.size();
+			res[label]["Mean"] = sum / float(times.size());
+			res[label]["MeanPerFrame"] = sum / float(num_frames);
+			res[label]["Median"] = times[times.size() / 2];
+			res[label]["P95"] = times[p95_id];
+			res[label]["Max"] = times.back();
+		}
+
+		return res;
+	};
+
+	nlohmann::ordered_json frames = nlohmann::ordered_json::array();
+
+	for (size_t frame_id = 0; frame_id < num_frames; frame_id++)
+	{
+		nlohmann::ordered_json frame;
+		frame["Frame"] = frame_id;
+		frame["FrameTime"] = s_RecordedFrameTimes[frame_id];
+		frame["CPU"] = FrameToJson(s_RecordedCPUFrames[frame_id], s_CPUEventLabels);
+		frame["GPU"] = FrameToJson(s_RecordedGPUFrames[frame_id], s_GPUEventLabels);
+
+		frames.push_back(frame);
+	}
+
+	float total_time = 0.0f;
+	for (float t : s_RecordedFrameTimes) total_time += t;
+
+	json["Summary"]["NumFrames"] = num_frames;
+	json["Summary"]["MeanFrameTime"] = (num_frames > 0) ? total_time / float(num_frames) : 0.0f;
+	json["Summary"]["CPU"] = Summarize(frames, "CPU");
+	json["Summary"]["GPU"] = Summarize(frames, "GPU");
+	json["Frames"] = frames;
+
+	std::ofstream output(filepath, std::ios::trunc);
+
+	if (!output)
+	{
+		std::cerr << "Profiler Error: Failed to open report file " << filepath << '\n';
+		return false;
+	}
+
+	const int indent = 4;
+
+	output << json.dump(indent);
+
+	return true;
+}
+
 uint32_t Profiler::GetFrontbufferQueryID(size_t id)
 {
 	return s_FrontBuffer->at(id);
@@ -9,6 +9,7 @@
 #include <vector>
 #include <deque>
 #include <chrono>
+#include <filesystem>
 
 #include "imgui.h"
 
@@ -30,12 +31,23 @@ public:
 	static void NextFrame();
 	static void SwapBuffers();
 
+	//Gpu time (ms) of the event in the last completed frame, summed over all submissions.
+	//Negative if it wasn't submitted or profiling is stopped.
+	static float GetLastGPUTime(const std::string& name);
+
 	static void SubmitCpuEvent(size_t idx, float time);
 	static void SubmitGpuEvent(size_t idx);
 
 	static void OnInit();
 	static void OnImGui(bool& open);
 
+	//Recording keeps every frame completed between start and stop
+	//(not just the last s_NumFrames), to be dumped into a json report.
+	//Gpu timings of a frame are only known after the following NextFrame call.
+	static void StartRecording();
+	static void StopRecording();
+	static bool WriteReport(const std::filesystem::path& filepath);
+
 private:
 	static void DrawGraph(std::deque<FrameData>& frames, const ImU32* color_palette, int palette_size);
 	static void DrawLegend(std::deque<FrameData>& frames, std::vector<std::string>& labels,
@@ -54,6 +66,11 @@ private:
 
 	static std::vector<uint32_t> s_QueryIDs1, s_QueryIDs2;
 	static std::vector<uint32_t> *s_FrontBuffer, *s_BackBuffer;
+
+	static bool s_Recording, s_RecordCurrentFrame;
+	static std::vector<FrameData> s_RecordedCPUFrames, s_RecordedGPUFrames;
+	static std::vector<float> s_RecordedFrameTimes;
+	static std::chrono::time_point<std::chrono::high_resolution_clock> s_FrameStart;
 };
 
 
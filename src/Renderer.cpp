@@ -14,6 +14,8 @@
 #include "ImGuiIcons.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 Renderer::Renderer(uint32_t width, uint32_t height)
     : m_WindowWidth(width), m_WindowHeight(height)
@@ -61,12 +63,66 @@ Renderer::Renderer(uint32_t width, uint32_t height)
 
 Renderer::~Renderer() {}
 
+Renderer::StartSettings Renderer::ResolveSettings(StartSettings settings)
+{
+    if (settings.VirtualHeightmap)
+    {
+        //Only the displaced clipmap reads heights through its cache, which samples virtual pages
+        settings.ClipmapMode = GeometryMode::Displaced;
+        //Materials are tiled past the base tile
+        settings.WrapType = GL_REPEAT;
+        //Pages are generated by the same kernels into an r32f atlas
+        settings.HeightStorage = HeightFormat::R32F;
+    }
+
+    return settings;
+}
+
+glm::ivec2 Renderer::MapResolutions(const StartSettings& settings)
+{
+    int map_res = settings.HeightRes, shadow_res = settings.ShadowRes;
+
+    if (settings.VirtualHeightmap)
+    {
+        map_res = std::min(map_res, m_VirtualBaseRes);
+        shadow_res = std::min(shadow_res, map_res);
+    }
+
+    return glm::ivec2(map_res, shadow_res);
+}
+
+size_t Renderer::EstimateMapMemory(const StartSettings& start_settings)
+{
+    const auto settings = ResolveSettings(start_settings);
+
+    const glm::ivec2 res = MapResolutions(settings);
+    const int map_res = res.x, shadow_res = res.y;
+
+    //Materialmap is rgba8 with a full mip chain
+    const size_t material_map = size_t(map_res) * size_t(map_res) * 4 * 4 / 3;
+
+    return MapGenerator::EstimateMemory(map_res, shadow_res, settings.HeightStorage, settings.NormalStorage)
+         + material_map;
+}
+
 void Renderer::Init(StartSettings settings)
 {
+    settings = ResolveSettings(settings);
+
+    const glm::ivec2 res = MapResolutions(settings);
+    const int map_res = res.x, shadow_res = res.y;
+
+    m_TerrainRenderer.setGeometryMode(settings.ClipmapMode);
     m_TerrainRenderer.Init(settings.Subdivisions, settings.LodLevels);
-    m_Map.Init(settings.HeightRes, settings.ShadowRes, settings.WrapType);
+    m_Map.Init(map_res, shadow_res, settings.WrapType, settings.HeightStorage, settings.NormalStorage);
+
+    if (settings.VirtualHeightmap)
+        m_Map.InitVirtualHeightmap(settings.HeightRes, settings.VirtualLods);
+
+    if (settings.CpuHeightmap)
+        m_Map.setHeightBackend(HeightBackend::CPU);
     m_Material.Init(settings.MaterialRes);
-    m_MaterialMap.Init(settings.HeightRes, settings.WrapType);
+    m_MaterialMap.Init(map_res, settings.WrapType);
 
     if (settings.IncludeGrass)
     {
@@ -90,7 +146,8 @@ void Renderer::Init(StartSettings settings)
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
     //Update Maps
-    m_Map.Update(m_SkyRenderer.getSunDir());
+    m_Map.FinishUpdates(m_SkyRenderer.getSunDir());
+    m_Map.UpdateVirtualHeightmap(m_Camera.getPos());
 
     //Update Material
     m_Material.Update();
@@ -146,9 +203,30 @@ void Renderer::OnUpdate(float deltatime)
 
     m_ResourceManager.OnUpdate();
 
+    //Floating origin, keeps render space coordinates small to avoid precision loss
+    if (m_Camera.RebaseOrigin(getOriginGranularity(), m_RebaseDistance))
+    {
+        m_Map.setRenderOrigin(m_Camera.getOrigin());
+
+        //Height caches are addressed by render space coordinates
+        m_TerrainRenderer.RequestFullUpdate();
+        m_GrassRenderer.RequestGeometryUpdate();
+    }
+
     m_Camera.Update(m_Aspect, deltatime);
 
+    if (m_RecordingCameraPath)
+        RecordCameraPath(deltatime);
+
     m_Map.Update(m_SkyRenderer.getSunDir());
+    m_Map.UpdateHeightReadback(m_Camera.getPos());
+
+    //Height caches need to pick up newly streamed pages
+    if (m_Map.UpdateVirtualHeightmap(m_Camera.getPos()))
+    {
+        m_TerrainRenderer.RequestFullUpdate();
+        m_GrassRenderer.RequestGeometryUpdate();
+    }
 
     m_MaterialMap.OnUpdate();
 
@@ -273,6 +351,19 @@ void Renderer::OnImGuiRender()
             ImGui::MenuItem("Show Profiler", NULL, &m_ShowProfiler);
             ImGui::MenuItem("Show Frustum Culling", NULL, &m_ShowCulling);
 
+            if (!m_RecordingCameraPath && ImGui::MenuItem("Record Camera Path"))
+            {
+                m_RecordedCameraPath.Clear();
+                m_RecordingTime = 0.0f;
+                m_RecordingCameraPath = true;
+            }
+
+            if (m_RecordingCameraPath && ImGui::MenuItem("Stop Recording Camera Path"))
+            {
+                m_RecordingCameraPath = false;
+                m_RecordedCameraPath.SaveToFile(std::filesystem::current_path() / "camera_path.json");
+            }
+
             ImGui::EndMenu();
         }
 
@@ -394,6 +485,70 @@ void Renderer::RestartMouse()
     m_Camera.setMouseInit(true);
 }
 
+bool Renderer::CrossCheckHeight(std::string& result)
+{
+    const bool passed = m_Map.CrossCheckHeight();
+    result = m_Map.getCrossCheckResult();
+
+    return passed;
+}
+
+bool Renderer::LoadWorld(const std::filesystem::path& filepath)
+{
+    if (!m_Serializer.LoadFromFile(filepath))
+        return false;
+
+    //Loaded world is complete before the first frame
+    m_Map.FinishUpdates(m_SkyRenderer.getSunDir());
+
+    return true;
+}
+
+void Renderer::SetCameraPose(const CameraKeyframe& keyframe)
+{
+    m_Camera.setPose(keyframe.Pos, keyframe.Yaw, keyframe.Pitch);
+}
+
+void Renderer::RecordCameraPath(float deltatime)
+{
+    //Keyframes are stored at a fixed rate, replay interpolates between them
+    const float keyframe_interval = 0.1f;
+
+    const bool first = m_RecordedCameraPath.Empty();
+
+    m_RecordingTime += deltatime;
+
+    if (first || m_RecordingTime - m_RecordedCameraPath.getDuration() >= keyframe_interval)
+    {
+        m_RecordedCameraPath.AddKeyframe(CameraKeyframe{
+            first ? 0.0f : m_RecordingTime,
+            m_Camera.getWorldPos(), m_Camera.getYaw(), m_Camera.getPitch()
+        });
+    }
+}
+
+double Renderer::getOriginGranularity() const
+{
+    const double terrain = m_TerrainRenderer.getOriginGranularity();
+    const double grass = m_GrassRenderer.getOriginGranularity();
+
+    const double coarse = std::max(terrain, grass), fine = std::min(terrain, grass);
+
+    //Quad sizes are the base grid size over the subdivisions, times powers of two,
+    //so one of the first few multiples of the coarser one fits the finer one too
+    for (int k = 1; k <= 64; k++)
+    {
+        const double multiple = k * coarse;
+        const double ratio = multiple / fine;
+
+        if (std::abs(ratio - std::round(ratio)) < 1e-6 * ratio)
+            return multiple;
+    }
+
+    //No common multiple in range, grass snapping may then shift when the origin moves
+    return coarse;
+}
+
 void Renderer::InitImGuiIniHandler()
 {
     auto MyUserData_ReadOpen = [](ImGuiContext* /*ctx*/, ImGuiSettingsHandler* /*handler*/, const char* /*name*/)
@@ -10,6 +10,7 @@
 #include "subrenderers/PostProcessor.h"
 
 #include "Camera.h"
+#include "CameraPath.h"
 #include "Serializer.h"
 #include "ResourceManager.h"
 #include "Framebuffer.h"
@@ -30,11 +31,21 @@ public:
         int WrapType = GL_CLAMP_TO_BORDER;
         float InternalResScale = 1.0f;
         bool IncludeGrass = false;
+        bool CpuHeightmap = false;
+        GeometryMode ClipmapMode = GeometryMode::Displaced;
+        //Streams heightmap pages around the camera instead, see VirtualHeightmap
+        bool VirtualHeightmap = false;
+        int VirtualLods = 8;
+        HeightFormat HeightStorage = HeightFormat::R32F;
+        NormalFormat NormalStorage = NormalFormat::RGBA8;
     };
 
     void InitImGuiIniHandler();
     void Init(StartSettings settings);
 
+    //Vram in bytes of the height derived maps and the material map Init would allocate
+    static size_t EstimateMapMemory(const StartSettings& settings);
+
     void OnUpdate(float deltatime);
     void OnRender();
     void OnImGuiRender();
@@ -44,7 +55,17 @@ public:
     void OnKeyReleased(int keycode);
     void OnMouseMoved(float x, float y);
     void RestartMouse();
+
+    bool LoadWorld(const std::filesystem::path& filepath);
+    //See MapGenerator::CrossCheckHeight, result is a human readable summary
+    bool CrossCheckHeight(std::string& result);
+    void SetCameraPose(const CameraKeyframe& keyframe);
+
+    size_t getTerrainGeometryMemory() const { return m_TerrainRenderer.getGeometryMemory(); }
 private:
+    void RecordCameraPath(float deltatime);
+    //Common multiple of the terrain and grass clipmap granularities
+    double getOriginGranularity() const;
 
     bool m_Wireframe = false;
     bool m_IncludeGrass = false;
@@ -62,6 +83,21 @@ private:
 
     bool m_ShowHelpPopup = true;
 
+    //Render origin is moved next to the camera once it gets this far away
+    static constexpr double m_RebaseDistance = 1024.0;
+
+    //Resolution cap of the monolithic maps when heightmap is virtual, they then only cover the base tile
+    static constexpr int m_VirtualBaseRes = 1024;
+
+    //Adjusts the settings to what the virtual heightmap supports
+    static StartSettings ResolveSettings(StartSettings settings);
+    //Heightmap and shadowmap resolution of the monolithic maps
+    static glm::ivec2 MapResolutions(const StartSettings& settings);
+
+    bool m_RecordingCameraPath = false;
+    float m_RecordingTime = 0.0f;
+    CameraPath m_RecordedCameraPath;
+
     uint32_t m_WindowWidth, m_WindowHeight;
     float m_Aspect, m_InvAspect;
 
@@ -31,6 +31,12 @@ std::shared_ptr<ComputeShader> ResourceManager::RequestComputeShader(const std::
 	return std::dynamic_pointer_cast<ComputeShader>(m_ShaderCache.back());
 }
 
+std::shared_ptr<ComputeShader> ResourceManager::RequestComputeShader(const std::string& name, const std::string& source)
+{
+	m_ShaderCache.push_back(std::make_shared<ComputeShader>(name, source));
+	return std::dynamic_pointer_cast<ComputeShader>(m_ShaderCache.back());
+}
+
 void ResourceManager::ReloadShaders()
 {
 	m_ReloadShaders = true;
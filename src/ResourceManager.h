@@ -11,6 +11,7 @@ public:
 
 	std::shared_ptr<VertFragShader> RequestVertFragShader(const std::string& v_path, const std::string& f_path);
 	std::shared_ptr<ComputeShader>  RequestComputeShader(const std::string& path);
+	std::shared_ptr<ComputeShader>  RequestComputeShader(const std::string& name, const std::string& source);
 
 	std::shared_ptr<Texture2D>    RequestTexture2D(const std::string& name);
 	std::shared_ptr<Texture3D>    RequestTexture3D(const std::string& name);
@@ -211,21 +211,28 @@ void Serializer::Serialize()
 
 void Serializer::Deserialize()
 {
-    ProfilerCPUEvent we("Serializer::Deserialize");
+    LoadFromFile(m_CurrentPath / m_Filename);
+}
 
-    auto path = m_CurrentPath / m_Filename;
+bool Serializer::LoadFromFile(const std::filesystem::path& filepath)
+{
+    ProfilerCPUEvent we("Serializer::Deserialize");
 
-    std::ifstream input(path);
+    std::ifstream input(filepath);
 
-    if (input)
+    if (!input)
     {
-        auto json = nlohmann::ordered_json::parse(input);
+        std::cerr << "Serializer Error: Failed to open file " << filepath << '\n';
+        return false;
+    }
 
-        for (auto& [key, value] : json.items())
-        {
-            if (m_LoadCallbacks.count(key))
-                m_LoadCallbacks[key](value); 
-        }
+    auto json = nlohmann::ordered_json::parse(input);
+
+    for (auto& [key, value] : json.items())
+    {
+        if (m_LoadCallbacks.count(key))
+            m_LoadCallbacks[key](value); 
     }
 
+    return true;
 }
\ No newline at end of file
@@ -15,6 +15,9 @@ public:
 	void TriggerSave();
 	void TriggerLoad();
 
+	//Loads world directly, without going through the file dialog
+	bool LoadFromFile(const std::filesystem::path& filepath);
+
 	void OnImGui();
 
 	void RegisterLoadCallback(const std::string& token, std::function<void(nlohmann::ordered_json&)> callback);
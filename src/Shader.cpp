@@ -155,19 +155,15 @@ static void getUniformNames(const std::string& current_line, std::vector<std::st
 
 static std::string loadSource(std::filesystem::path filepath,
         std::vector<std::string>& uniform_names,
-        bool recursive_call = false)
+        bool recursive_call = false);
+
+//Includes are resolved relative to filepath
+static std::string loadSource(std::istream& input, std::filesystem::path filepath,
+        std::vector<std::string>& uniform_names,
+        bool recursive_call)
 {
     const std::string include_token{"#include"};
 
-    std::ifstream input{ filepath };
-
-    if (!input)
-    {
-        throw std::runtime_error(
-            "Could not open shader source file:\n" + filepath.string()
-        );
-    }
-
     std::string full_source, current_line;
 
     while (std::getline(input, current_line))
@@ -203,6 +199,22 @@ static std::string loadSource(std::filesystem::path filepath,
     return full_source;
 }
 
+static std::string loadSource(std::filesystem::path filepath,
+        std::vector<std::string>& uniform_names,
+        bool recursive_call)
+{
+    std::ifstream input{ filepath };
+
+    if (!input)
+    {
+        throw std::runtime_error(
+            "Could not open shader source file:\n" + filepath.string()
+        );
+    }
+
+    return loadSource(input, filepath, uniform_names, recursive_call);
+}
+
 //Program type is assumed to be gl enum: {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_COMPUTE_SHADER}
 static void compileShaderCode(const std::string& source, uint32_t& id, int program_type)
 {
@@ -313,7 +325,17 @@ void ComputeShader::Build()
 
     try
     {
-        std::string compute_code = loadSource(current_path / m_ComputePath, uniform_names);
+        std::string compute_code;
+
+        //Generated sources resolve includes relative to the working directory
+        if (m_GeneratedSource.empty())
+            compute_code = loadSource(current_path / m_ComputePath, uniform_names);
+        else
+        {
+            std::istringstream input{ m_GeneratedSource };
+            compute_code = loadSource(input, current_path / m_ComputePath, uniform_names, false);
+        }
+
         RetrieveLocalSizes(compute_code);
         compileShaderCode(compute_code, compute_id, GL_COMPUTE_SHADER);
     }
@@ -360,6 +382,12 @@ ComputeShader::ComputeShader(const std::string& compute_path)
     Build();
 }
 
+ComputeShader::ComputeShader(const std::string& name, const std::string& source)
+    : m_ComputePath(name), m_GeneratedSource(source)
+{
+    Build();
+}
+
 ComputeShader::~ComputeShader()
 {
     glDeleteProgram(m_ID);
@@ -377,6 +405,11 @@ void ComputeShader::Dispatch(uint32_t size_x, uint32_t size_y, uint32_t size_z)
     glDispatchCompute(disp_x, disp_y, disp_z);
 }
 
+void ComputeShader::DispatchIndirect(intptr_t offset) const
+{
+    glDispatchComputeIndirect(offset);
+}
+
 void ComputeShader::RetrieveLocalSizes(const std::string& source_code)
 {
     auto retrieveInt = [source_code](const std::string& name) -> int
@@ -516,6 +549,12 @@ void Shader::setUniformSampler2DArray(const std::string& name, int x)
     glUniform1i(location, x);
 }
 
+void Shader::setUniformISampler2DArray(const std::string& name, int x)
+{
+    const int location = getUniformLocation(name, GL_INT_SAMPLER_2D_ARRAY);
+    glUniform1i(location, x);
+}
+
 void Shader::setUniformSamplerCube(const std::string& name, int x)
 {
     const int location = getUniformLocation(name, GL_SAMPLER_CUBE);
@@ -584,6 +623,7 @@ static std::string_view StrUniformType(uint32_t type)
         case GL_SAMPLER_2D: return "sampler2D";
         case GL_SAMPLER_3D: return "sampler3D";
         case GL_SAMPLER_2D_ARRAY: return "sampler2DArray";
+        case GL_INT_SAMPLER_2D_ARRAY: return "isampler2DArray";
         case GL_SAMPLER_CUBE: return "samplerCube";
         default: return "Unknown type";
     }
@@ -4,6 +4,7 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -31,6 +32,7 @@ public:
     void setUniformSampler2D(const std::string& name, int x);
     void setUniformSampler3D(const std::string& name, int x);
     void setUniformSampler2DArray(const std::string& name, int x);
+    void setUniformISampler2DArray(const std::string& name, int x);
     void setUniformSamplerCube(const std::string& name, int x);
 
     //Overrides using glm
@@ -41,6 +43,9 @@ public:
     void setUniform3f(const std::string& name, glm::vec3 v);
     void setUniform4f(const std::string& name, glm::vec4 v);
     void setUniformMatrix4fv(const std::string& name, glm::mat4 mat);
+
+    //For optional uniforms, which would otherwise be reported missing by debug logging
+    bool HasUniform(const std::string& name) const { return m_UniformCache.count(name) != 0; }
 protected:
     virtual void Build() = 0;
     virtual void LogFilepaths() = 0;
@@ -73,12 +78,21 @@ private:
 class ComputeShader : public Shader {
 public:
     ComputeShader(const std::string& compute_path);
+    //Source generated at runtime, name is only used in logs
+    ComputeShader(const std::string& name, const std::string& source);
     ~ComputeShader();
 
     //Parameters are total numbers of invocations needed.
     //They will be automatically divided by local group sizes defined in the shader source
     void Dispatch(uint32_t size_x, uint32_t size_y, uint32_t size_z) const;
 
+    //Group counts are read from the currently bound dispatch indirect buffer
+    void DispatchIndirect(intptr_t offset = 0) const;
+
+    uint32_t getLocalSizeX() const { return m_LocalSizeX; }
+    uint32_t getLocalSizeY() const { return m_LocalSizeY; }
+    uint32_t getLocalSizeZ() const { return m_LocalSizeZ; }
+
 private:
     void Build() override;
     void LogFilepaths() override;
@@ -86,5 +100,6 @@ private:
     void RetrieveLocalSizes(const std::string& source_code);
 
     std::string m_ComputePath;
+    std::string m_GeneratedSource;
     uint32_t m_LocalSizeX = 1, m_LocalSizeY = 1, m_LocalSizeZ = 1;
 };
\ No newline at end of file
@@ -83,6 +83,33 @@ void Texture2D::Resize(int width, int height)
         m_Spec.Format, m_Spec.Type, NULL);
 }
 
+void Texture2D::ReadToPackBuffer(int x, int y, int width, int height) const
+{
+    const int bytes = width * height * static_cast<int>(sizeof(float));
+
+    glGetTextureSubImage(m_ID, 0, x, y, 0, width, height, 1, GL_RED, GL_FLOAT, bytes, nullptr);
+}
+
+void Texture2D::CopyFrom(const Texture2D& other)
+{
+    glCopyImageSubData(other.m_ID, GL_TEXTURE_2D, 0, 0, 0, 0,
+                       m_ID, GL_TEXTURE_2D, 0, 0, 0, 0,
+                       m_Spec.ResolutionX, m_Spec.ResolutionY, 1);
+}
+
+void Texture2D::CopyFrom(const Texture2D& other, int offset_x, int offset_y)
+{
+    glCopyImageSubData(other.m_ID, GL_TEXTURE_2D, 0, 0, 0, 0,
+                       m_ID, GL_TEXTURE_2D, 0, offset_x, offset_y, 0,
+                       other.m_Spec.ResolutionX, other.m_Spec.ResolutionY, 1);
+}
+
+void Texture2D::Release()
+{
+    glDeleteTextures(1, &m_ID);
+    m_ID = 0;
+}
+
 void Texture2D::DrawToImGui(float width, float height)
 {
     ImGui::Image((void*)(intptr_t)m_ID, ImVec2(width, height));
@@ -93,7 +120,7 @@ TextureArray::TextureArray(const std::string& name)
     m_Name = name;
 }
 
-void TextureArray::Initialize(Texture2DSpec spec, int layers)
+void TextureArray::Initialize(Texture2DSpec spec, int layers, int mips)
 {
 
     auto log2 = [](int value) {
@@ -102,7 +129,8 @@ void TextureArray::Initialize(Texture2DSpec spec, int layers)
         return result;
     };
 
-    int mips = log2(spec.ResolutionX);
+    if (mips == 0)
+        mips = log2(spec.ResolutionX);
 
     glGenTextures(1, &m_ID);
     glBindTexture(GL_TEXTURE_2D_ARRAY, m_ID);
@@ -151,6 +179,13 @@ void TextureArray::BindImage(int id, int layer, int mip) const
     glBindImageTexture(id, m_ID, mip, GL_FALSE, layer, GL_READ_WRITE, format);
 }
 
+void TextureArray::BindImageLayered(int id, int mip) const
+{
+    int format = m_Spec.InternalFormat;
+
+    glBindImageTexture(id, m_ID, mip, GL_TRUE, 0, GL_READ_WRITE, format);
+}
+
 Texture3D::Texture3D(const std::string& name)
 {
     m_Name = name;
@@ -39,6 +39,17 @@ public:
 
     void Resize(int width, int height);
 
+    //Copies mip 0, both textures need the same size and format
+    void CopyFrom(const Texture2D& other);
+    //Copies mip 0 of a smaller texture of the same format to the given texel offset
+    void CopyFrom(const Texture2D& other, int offset_x, int offset_y);
+    //Frees gpu memory, texture needs to be initialized again before use
+    void Release();
+
+    //Copies the red channel of a region of mip 0 as floats to the start of the bound
+    //pixel pack buffer, the copy completes asynchronously
+    void ReadToPackBuffer(int x, int y, int width, int height) const;
+
     void DrawToImGui(float width, float height);
 
     int getResolutionX() const { return m_Spec.ResolutionX; }
@@ -46,7 +57,7 @@ public:
 
     const Texture2DSpec& getSpec() const { return m_Spec; }
 private:
-    uint32_t m_ID;
+    uint32_t m_ID = 0;
     Texture2DSpec m_Spec;
 };
 
@@ -54,11 +65,14 @@ class TextureArray : public Texture {
 public:
     TextureArray(const std::string& name);
 
-    void Initialize(Texture2DSpec spec, int layers);
+    //Zero mips allocates the full mip chain
+    void Initialize(Texture2DSpec spec, int layers, int mips = 0);
 
     void Bind(int id = 0) const;
     void BindLayer(int id, int layer) const;
     void BindImage(int id, int layer, int mip) const;
+    //Binds all layers, for image2DArray in shaders
+    void BindImageLayered(int id, int mip) const;
 
     int getResolutionX() const { return m_Spec.ResolutionX; }
     int getResolutionY() const { return m_Spec.ResolutionY; }
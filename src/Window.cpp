@@ -4,18 +4,41 @@
 
 #include <iostream>
 
-Window::Window(const std::string& title, uint32_t width, uint32_t height)
+Window::Window(const std::string& title, uint32_t width, uint32_t height, bool headless)
+    : m_Headless(headless)
 {
     m_WindowData.Title  = title;
     m_WindowData.Width  = width;
     m_WindowData.Height = height;
 
     //Initialize GLFW:
-    glfwInit();
+    if (m_Headless)
+    {
+#ifdef GLFW_PLATFORM_NULL
+        //Glfw >= 3.4: no display connection at all
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    }
+
+    if (!glfwInit())
+        throw std::runtime_error("Failed to initialize glfw!");
+
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    if (m_Headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLFW_PLATFORM_NULL
+        //Null platform can only create contexts through OSMesa,
+        //which with Mesa's llvmpipe gives a software 4.5 core context
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#else
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+    }
+
     //Immediately set error callback:
     glfwSetErrorCallback([](int code, const char* message) {
         std::cerr << "Glfw Error: \n"
@@ -126,8 +149,8 @@ Window::Window(const std::string& title, uint32_t width, uint32_t height)
         }
     );
 
-    //Enable vsync
-    glfwSwapInterval(1);
+    //Enable vsync (disabled when headless, frame times should not be capped)
+    glfwSwapInterval(m_Headless ? 0 : 1);
 
     //Set initial viewport dimensions
     glViewport(0, 0, m_WindowData.Width, m_WindowData.Height);
@@ -17,7 +17,9 @@ struct WindowData {
 
 class Window{
 public:
-    Window(const std::string& title, uint32_t width, uint32_t height);
+    //Headless windows use a surfaceless context (OSMesa/EGL through the glfw null platform),
+    //so they can run on machines without a display
+    Window(const std::string& title, uint32_t width, uint32_t height, bool headless = false);
     ~Window();
 
     void OnUpdate();
@@ -26,6 +28,7 @@ public:
     void FreeCursor();
 
     bool ShouldClose();
+    bool IsHeadless() const {return m_Headless;}
     GLFWwindow* getGLFWPointer() {return m_Window;}
 
     uint32_t getWidth()  const {return m_WindowData.Width;}
@@ -34,5 +37,6 @@ public:
     void setEventCallback(std::function<void(Event&)> callback);
 private:
     GLFWwindow* m_Window;
+    bool m_Headless;
     WindowData m_WindowData;
 };
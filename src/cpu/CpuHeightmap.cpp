@@ -0,0 +1,566 @@
+#include "CpuHeightmap.h"
+
+#include "Simd.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+using simd::Float8;
+using simd::UInt8;
+
+//=====Parameter access=========================================================
+
+static float GetFloat(const ProcedureParams& params, const std::string& name)
+{
+    return std::get<float>(params.Values.at(name));
+}
+
+static int GetInt(const ProcedureParams& params, const std::string& name)
+{
+    return std::get<int>(params.Values.at(name));
+}
+
+static int GetEnum(const ProcedureParams& params, const std::string& name)
+{
+    return static_cast<int>(std::get<size_t>(params.Values.at(name)));
+}
+
+//=====Hash (common/hash.glsl)==================================================
+
+static inline UInt8 MurmurMix(UInt8 src)
+{
+    const UInt8 M(0x5bd1e995u);
+
+    src = src * M; src = src ^ (src >> 24); src = src * M;
+    return src;
+}
+
+static inline UInt8 MurmurFinish(UInt8 h, UInt8 sx, UInt8 sy)
+{
+    const UInt8 M(0x5bd1e995u);
+
+    h = h * M; h = h ^ sx; h = h * M; h = h ^ sy;
+    h = h ^ (h >> 13); h = h * M; h = h ^ (h >> 15);
+    return h;
+}
+
+static inline Float8 ToUnitFloat(UInt8 h)
+{
+    return simd::AsFloat((h & UInt8(0x007fffffu)) | UInt8(0x3f800000u)) - Float8(1.0f);
+}
+
+static inline Float8 Hash12(Float8 x, Float8 y)
+{
+    const UInt8 sx = MurmurMix(simd::AsUInt(x));
+    const UInt8 sy = MurmurMix(simd::AsUInt(y));
+
+    return ToUnitFloat(MurmurFinish(UInt8(1190494759u), sx, sy));
+}
+
+static inline void Hash22(Float8 x, Float8 y, Float8& hx, Float8& hy)
+{
+    const UInt8 sx = MurmurMix(simd::AsUInt(x));
+    const UInt8 sy = MurmurMix(simd::AsUInt(y));
+
+    hx = ToUnitFloat(MurmurFinish(UInt8(1190494759u), sx, sy));
+    hy = ToUnitFloat(MurmurFinish(UInt8(2147483647u), sx, sy));
+}
+
+//=====Shared helpers===========================================================
+
+#define BLEND_AVERAGE  0
+#define BLEND_ADD      1
+#define BLEND_SUBTRACT 2
+
+static inline Float8 Blend(int mode, Float8 prev, Float8 h, float weight)
+{
+    switch (mode)
+    {
+        case BLEND_AVERAGE:  return simd::Mix(prev, h, Float8(weight));
+        case BLEND_ADD:      return prev + Float8(weight) * h;
+        case BLEND_SUBTRACT: return prev - Float8(weight) * h;
+    }
+
+    return h;
+}
+
+//Calls func(x, y, uv_x, uv_y, data_ptr) for every 8-wide batch in the tile
+template<typename Func>
+static inline void ForEachBatch(CpuHeightmapGenerator::Tile& tile, Func func)
+{
+    const int size = CpuHeightmapGenerator::TileSize;
+    const float res = float(tile.Res);
+
+    for (int j = 0; j < size; j++)
+    {
+        const Float8 uv_y = Float8(float(tile.Y0 + j)) / Float8(res);
+
+        for (int i = 0; i < size; i += 8)
+        {
+            const Float8 uv_x = Float8::Ramp(float(tile.X0 + i)) / Float8(res);
+
+            func(uv_x, uv_y, tile.Data + j * size + i);
+        }
+    }
+}
+
+//2x2 matrix in glsl (column-major) convention
+struct Mat2 {
+    float c0x, c0y, c1x, c1y;
+
+    Mat2 operator*(const Mat2& o) const
+    {
+        return Mat2{
+            c0x * o.c0x + c1x * o.c0y, c0y * o.c0x + c1y * o.c0y,
+            c0x * o.c1x + c1x * o.c1y, c0y * o.c1x + c1y * o.c1y
+        };
+    }
+
+    Mat2 operator*(float s) const
+    {
+        return Mat2{ s * c0x, s * c0y, s * c1x, s * c1y };
+    }
+
+    void Apply(Float8 x, Float8 y, Float8& rx, Float8& ry) const
+    {
+        rx = Float8(c0x) * x + Float8(c1x) * y;
+        ry = Float8(c0y) * x + Float8(c1y) * y;
+    }
+};
+
+static const Mat2 s_Identity{ 1.0f, 0.0f, 0.0f, 1.0f };
+static const Mat2 s_Rot{ 0.8f, 0.6f, -0.6f, 0.8f };
+
+static inline Float8 Quintic(Float8 u)
+{
+    return u * u * u * (u * (Float8(6.0f) * u - Float8(15.0f)) + Float8(10.0f));
+}
+
+//=====Procedures===============================================================
+
+//map/const_val.glsl
+static void ConstValue(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const float value = GetFloat(params, "uValue");
+
+    std::fill(tile.Data, tile.Data + CpuHeightmapGenerator::TileSize * CpuHeightmapGenerator::TileSize, value);
+}
+
+//map/fbm.glsl
+static inline Float8 ValueNoise(Float8 px, Float8 py)
+{
+    const Float8 idx = simd::Floor(px), idy = simd::Floor(py);
+    const Float8 zero(0.0f), one(1.0f);
+
+    const Float8 a = Hash12(idx + zero, idy + zero);
+    const Float8 b = Hash12(idx + one, idy + zero);
+    const Float8 c = Hash12(idx + zero, idy + one);
+    const Float8 d = Hash12(idx + one, idy + one);
+
+    const Float8 ux = Quintic(simd::Fract(px));
+    const Float8 uy = Quintic(simd::Fract(py));
+
+    const Float8 k0 = a;
+    const Float8 k1 = b - a;
+    const Float8 k2 = c - a;
+    const Float8 k3 = a - b - c + d;
+
+    return k0 + k1 * ux + k2 * uy + k3 * ux * uy;
+}
+
+static void FBM(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const int octaves = GetInt(params, "uOctaves");
+    const float scale = GetFloat(params, "uScale");
+    const float roughness = GetFloat(params, "uRoughness");
+    const int blend_mode = GetEnum(params, "uBlendMode");
+    const float weight = GetFloat(params, "uWeight");
+
+    ForEachBatch(tile, [&](Float8 uv_x, Float8 uv_y, float* data)
+    {
+        const Float8 scale_xz(0.5f);
+
+        const Float8 px = Float8(scale) * uv_x * scale_xz;
+        const Float8 py = Float8(scale) * uv_y * scale_xz;
+
+        Float8 res(0.0f);
+        Mat2 M = s_Identity;
+        float A = 1.0f, a = 1.0f;
+
+        for (int i = 0; i < octaves; i++)
+        {
+            Float8 qx, qy;
+            (M * a).Apply(px, py, qx, qy);
+
+            res = res + Float8(A) * ValueNoise(qx, qy);
+
+            a *= 2.0f;
+            A *= roughness;
+            M = M * s_Rot;
+        }
+
+        const Float8 prev = Float8::Load(data);
+        Blend(blend_mode, prev, res, weight).Store(data);
+    });
+}
+
+//map/advanced_fbm.glsl
+#define NOISE_VALUE 0
+#define NOISE_PERLIN 1
+
+struct Noised {
+    Float8 Value, GradX, GradY, Laplacian;
+};
+
+static inline Noised NoiseD(Float8 px, Float8 py, int noise_type)
+{
+    const Float8 idx = simd::Floor(px), idy = simd::Floor(py);
+    const Float8 zero(0.0f), one(1.0f), half(0.5f), two(2.0f);
+
+    Float8 ux = simd::Fract(px), uy = simd::Fract(py);
+
+    Float8 a, b, c, d;
+    Float8 vax, vay, vbx, vby, vcx, vcy, vdx, vdy;
+
+    if (noise_type == NOISE_PERLIN)
+    {
+        Hash22(idx + zero, idy + zero, vax, vay);
+        Hash22(idx + one, idy + zero, vbx, vby);
+        Hash22(idx + zero, idy + one, vcx, vcy);
+        Hash22(idx + one, idy + one, vdx, vdy);
+
+        vax = two * vax - one; vay = two * vay - one;
+        vbx = two * vbx - one; vby = two * vby - one;
+        vcx = two * vcx - one; vcy = two * vcy - one;
+        vdx = two * vdx - one; vdy = two * vdy - one;
+
+        a = vax * ux + vay * uy + half;
+        b = vbx * (ux - one) + vby * uy + half;
+        c = vcx * ux + vcy * (uy - one) + half;
+        d = vdx * (ux - one) + vdy * (uy - one) + half;
+    }
+
+    else
+    {
+        a = Hash12(idx + zero, idy + zero);
+        b = Hash12(idx + one, idy + zero);
+        c = Hash12(idx + zero, idy + one);
+        d = Hash12(idx + one, idy + one);
+    }
+
+    ux = Quintic(ux);
+    uy = Quintic(uy);
+
+    //Evaluated at the smoothed fraction, as in the glsl version
+    const Float8 dux = Float8(30.0f) * ux * ux * (ux * ux - two * ux + one);
+    const Float8 duy = Float8(30.0f) * uy * uy * (uy * uy - two * uy + one);
+    const Float8 ddux = Float8(60.0f) * ux * (two * ux * ux - Float8(3.0f) * ux + one);
+    const Float8 dduy = Float8(60.0f) * uy * (two * uy * uy - Float8(3.0f) * uy + one);
+
+    const Float8 k0 = a;
+    const Float8 k1 = b - a;
+    const Float8 k2 = c - a;
+    const Float8 k3 = a - b - c + d;
+
+    const Float8 gx = k1 + k3 * uy;
+    const Float8 gy = k2 + k3 * ux;
+
+    Noised res;
+    res.Value = k0 + k1 * ux + k2 * uy + k3 * ux * uy;
+
+    if (noise_type == NOISE_PERLIN)
+    {
+        const Float8 vk1x = vbx - vax, vk1y = vby - vay;
+        const Float8 vk2x = vcx - vax, vk2y = vcy - vay;
+        const Float8 vk3x = vax - vbx - vcx + vdx, vk3y = vay - vby - vcy + vdy;
+
+        res.GradX = vax + vk1x * ux + vk2x * uy + vk3x * ux * uy + gx * dux;
+        res.GradY = vay + vk1y * ux + vk2y * uy + vk3y * ux * uy + gy * duy;
+
+        const Float8 hx = vk1x + vk3x * uy;
+        const Float8 hy = vk2y + vk3y * ux;
+
+        res.Laplacian = (hx * dux + hx * dux + gx * ddux) + (hy * duy + hy * duy + gy * dduy);
+    }
+
+    else
+    {
+        res.GradX = gx * dux;
+        res.GradY = gy * duy;
+        res.Laplacian = gx * ddux + gy * dduy;
+    }
+
+    return res;
+}
+
+static void AdvancedFBM(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const int noise_type = GetEnum(params, "uNoiseType");
+    const int octaves = GetInt(params, "uOctaves");
+    const float scale = GetFloat(params, "uScale");
+    const float roughness = GetFloat(params, "uRoughness");
+    const float lacunarity = GetFloat(params, "uLacunarity");
+    const float altitude_erosion = GetFloat(params, "uAltitudeErosion");
+    const float slope_erosion = GetFloat(params, "uSlopeErosion");
+    const float concave_erosion = GetFloat(params, "uConcaveErosion");
+    const int blend_mode = GetEnum(params, "uBlendMode");
+    const float weight = GetFloat(params, "uWeight");
+
+    ForEachBatch(tile, [&](Float8 uv_x, Float8 uv_y, float* data)
+    {
+        const Float8 zero(0.0f), one(1.0f);
+        const Float8 scale_xz(0.5f);
+
+        const Float8 prev = Float8::Load(data);
+
+        const Float8 px = Float8(scale) * uv_x * scale_xz;
+        const Float8 py = Float8(scale) * uv_y * scale_xz;
+
+        Mat2 M = s_Identity;
+        float A = 1.0f, a = 1.0f;
+
+        Float8 value(0.0f), grad_x(0.0f), grad_y(0.0f), laplacian(0.0f);
+        float normalization = 0.0f;
+
+        for (int i = 0; i < octaves; i++)
+        {
+            Float8 qx, qy;
+            (M * a).Apply(px, py, qx, qy);
+
+            const Noised n = NoiseD(qx, qy, noise_type);
+
+            const Float8 actual_height = value + prev;
+
+            Float8 xi(A);
+
+            if (i != 0)
+            {
+                xi = simd::Mix(xi, Float8(A) / (one + grad_x * grad_x + grad_y * grad_y), Float8(slope_erosion));
+                xi = simd::Mix(xi, xi * simd::Max(zero, actual_height), Float8(altitude_erosion));
+                xi = simd::Mix(xi, xi / (one + simd::Abs(simd::Min(Float8(0.5f) * laplacian, zero))), Float8(concave_erosion));
+            }
+
+            Float8 gx, gy;
+            M.Apply(n.GradX, n.GradY, gx, gy);
+
+            value = value + xi * n.Value;
+            grad_x = grad_x + xi * Float8(a) * gx;
+            grad_y = grad_y + xi * Float8(a) * gy;
+            laplacian = laplacian + xi * Float8(a * a) * n.Laplacian;
+
+            normalization += A;
+
+            a *= lacunarity;
+            A *= roughness;
+
+            if (noise_type == NOISE_VALUE)
+                M = M * s_Rot;
+        }
+
+        const Float8 h = value / Float8(normalization);
+
+        Blend(blend_mode, prev, h, weight).Store(data);
+    });
+}
+
+//map/voronoi.glsl
+#define VORONOI_F1    0
+#define VORONOI_F2    1
+#define VORONOI_F2_F1 2
+
+static void Voronoi(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const float scale = GetFloat(params, "uScale");
+    const float randomness = GetFloat(params, "uRandomness");
+    const int voronoi_type = GetEnum(params, "uVoronoiType");
+    const int blend_mode = GetEnum(params, "uBlendMode");
+    const float weight = GetFloat(params, "uWeight");
+
+    ForEachBatch(tile, [&](Float8 uv_x, Float8 uv_y, float* data)
+    {
+        const Float8 x = Float8(scale) * uv_x;
+        const Float8 y = Float8(scale) * uv_y;
+
+        const Float8 px = simd::Floor(x), py = simd::Floor(y);
+
+        Float8 res_x(2.25f), res_y(2.25f);
+
+        for (int i = -1; i <= 1; i++)
+        {
+            for (int j = -1; j <= 1; j++)
+            {
+                const Float8 vx = px + Float8(float(i));
+                const Float8 vy = py + Float8(float(j));
+
+                Float8 hx, hy;
+                Hash22(vx, vy, hx, hy);
+
+                const Float8 dx = x - (vx + Float8(randomness) * hx);
+                const Float8 dy = y - (vy + Float8(randomness) * hy);
+
+                const Float8 d2 = dx * dx + dy * dy;
+
+                const simd::Mask8 closest = d2 < res_x;
+                const simd::Mask8 second = (!closest) && (d2 < res_y);
+
+                res_y = simd::Select(closest, res_x, simd::Select(second, d2, res_y));
+                res_x = simd::Select(closest, d2, res_x);
+            }
+        }
+
+        res_x = simd::Sqrt(res_x);
+        res_y = simd::Sqrt(res_y);
+
+        Float8 h(0.0f);
+
+        switch (voronoi_type)
+        {
+            case VORONOI_F1:    h = res_x; break;
+            case VORONOI_F2:    h = res_y; break;
+            case VORONOI_F2_F1: h = res_y - res_x; break;
+        }
+
+        const Float8 prev = Float8::Load(data);
+        Blend(blend_mode, prev, h, weight).Store(data);
+    });
+}
+
+//map/curves.glsl
+static void Curves(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const float exponent = GetFloat(params, "uExponent");
+
+    ForEachBatch(tile, [&](Float8, Float8, float* data)
+    {
+        const Float8 h = simd::Map(Float8::Load(data), [exponent](float x) {return std::pow(x, exponent); });
+        h.Store(data);
+    });
+}
+
+//map/terrace.glsl
+static void Terrace(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const int num_terrace = GetInt(params, "uNumTerrace");
+    const float flatness = GetFloat(params, "uFlatness");
+    const float strength = GetFloat(params, "uStrength");
+
+    auto SineStep = [](float x)
+    {
+        const float pi = 3.1415926535f;
+
+        if (x < 0.0f) return 0.0f;
+        else if (x > 1.0f) return 1.0f;
+        else return 0.5f * std::sin(pi * (x - 0.5f)) + 0.5f;
+    };
+
+    auto TerraceFn = [&](float height)
+    {
+        const float t = 1.0f - flatness;
+        const float r = height - std::floor(height);
+        const float g = t * SineStep(r / t);
+
+        return t * std::floor(height) + g;
+    };
+
+    const float n = float(num_terrace);
+
+    ForEachBatch(tile, [&](Float8, Float8, float* data)
+    {
+        const Float8 h = Float8::Load(data);
+        const Float8 terraced = simd::Map(h, [&](float x) {return TerraceFn(n * x) / n; });
+
+        simd::Mix(h, terraced, Float8(strength)).Store(data);
+    });
+}
+
+//map/radial_cutoff.glsl
+static void RadialCutoff(CpuHeightmapGenerator::Tile& tile, const ProcedureParams& params)
+{
+    const float bias = GetFloat(params, "uBias");
+    const float slope = GetFloat(params, "uSlope");
+
+    ForEachBatch(tile, [&](Float8 uv_x, Float8 uv_y, float* data)
+    {
+        const Float8 dx = uv_x - Float8(0.5f), dy = uv_y - Float8(0.5f);
+        const Float8 offset = Float8(bias) + Float8(slope) * (dx * dx + dy * dy);
+
+        const Float8 h = simd::Max(Float8::Load(data) - offset, Float8(0.0f));
+        h.Store(data);
+    });
+}
+
+//==============================================================================
+
+CpuHeightmapGenerator::CpuHeightmapGenerator()
+{
+    //Keys are procedure names registered in MapGenerator::Init
+    m_Kernels["Const Value"] = ConstValue;
+    m_Kernels["FBM"] = FBM;
+    m_Kernels["Advanced FBM"] = AdvancedFBM;
+    m_Kernels["Voronoi"] = Voronoi;
+    m_Kernels["Curves"] = Curves;
+    m_Kernels["Terrace"] = Terrace;
+    m_Kernels["Radial cutoff"] = RadialCutoff;
+}
+
+bool CpuHeightmapGenerator::Supports(const std::vector<ProcedureParams>& stack) const
+{
+    return std::all_of(stack.begin(), stack.end(),
+        [this](const ProcedureParams& p) {return m_Kernels.count(p.Name) != 0; }
+    );
+}
+
+void CpuHeightmapGenerator::Generate(int res, const std::vector<ProcedureParams>& stack, std::vector<float>& output)
+{
+    ProfilerCPUEvent we("CpuHeightmap::Generate");
+
+    output.assign(size_t(res) * size_t(res), 0.0f);
+
+    std::vector<const Kernel*> kernels;
+
+    for (auto& params : stack)
+    {
+        if (m_Kernels.count(params.Name))
+            kernels.push_back(&m_Kernels.at(params.Name));
+        else
+        {
+            std::cerr << "CpuHeightmap Error: No cpu implementation of procedure " << params.Name << '\n';
+            kernels.push_back(nullptr);
+        }
+    }
+
+    const int tiles_per_side = (res + TileSize - 1) / TileSize;
+    const size_t num_tiles = size_t(tiles_per_side) * size_t(tiles_per_side);
+
+    //All procedures are point-wise, so each tile runs through the whole stack
+    //while its data stays in cache
+    m_Pool.ParallelFor(num_tiles, [&](size_t tile_id)
+    {
+        alignas(32) float buffer[TileSize * TileSize] = {};
+
+        Tile tile{
+            buffer,
+            int(tile_id % tiles_per_side) * TileSize,
+            int(tile_id / tiles_per_side) * TileSize,
+            res
+        };
+
+        for (size_t idx = 0; idx < stack.size(); idx++)
+        {
+            if (kernels[idx])
+                (*kernels[idx])(tile, stack[idx]);
+        }
+
+        //Tiles at the border may be only partially inside the texture
+        const int width = std::min(TileSize, res - tile.X0);
+        const int height = std::min(TileSize, res - tile.Y0);
+
+        for (int j = 0; j < height; j++)
+        {
+            std::copy(buffer + j * TileSize, buffer + j * TileSize + width,
+                      output.data() + size_t(tile.Y0 + j) * size_t(res) + tile.X0);
+        }
+    });
+}
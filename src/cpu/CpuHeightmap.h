@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include "subrenderers/TextureEditor.h"
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <functional>
+
+//Cpu backend for the heightmap procedure stack.
+//Mirrors res/shaders/map/*.glsl (including the hash from common/hash.glsl),
+//evaluated in 8-wide simd batches over square tiles distributed across a work-stealing pool.
+class CpuHeightmapGenerator {
+public:
+    CpuHeightmapGenerator();
+
+    //Evaluates the stack at res x res texels, output is row-major
+    void Generate(int res, const std::vector<ProcedureParams>& stack, std::vector<float>& output);
+
+    //Returns false if some procedure in the stack has no cpu implementation
+    bool Supports(const std::vector<ProcedureParams>& stack) const;
+
+    size_t getNumWorkers() const { return m_Pool.getNumWorkers(); }
+
+    static constexpr int TileSize = 64;
+
+    //Tile-local buffer (TileSize x TileSize) and its position in the full texture
+    struct Tile {
+        float* Data;
+        int X0, Y0, Res;
+    };
+
+    using Kernel = std::function<void(Tile&, const ProcedureParams&)>;
+
+private:
+    ThreadPool m_Pool;
+    std::unordered_map<std::string, Kernel> m_Kernels;
+};
@@ -0,0 +1,133 @@
+#include "CpuShadowSweep.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+SweepLines SweepLines::Setup(int res, glm::vec3 sun_dir, float scale_xz, float scale_y)
+{
+    SweepLines lines;
+    lines.Res = res;
+    lines.NumLines = res;
+
+    //Degenerate sun would propagate NaNs into the line setup, silently treated as no shadows
+    //since this runs every frame of the shadow stage
+    const float sun_length = glm::length(sun_dir);
+
+    if (!std::isfinite(sun_length) || sun_length < 1e-6f)
+    {
+        lines.Slope = 1e6f;
+        return lines;
+    }
+
+    //Same ray direction as in map/shadow.glsl
+    const glm::vec3 dir3 = glm::normalize(glm::vec3(scale_y  * sun_dir.x,
+                                                    scale_xz * sun_dir.y,
+                                                    scale_y  * sun_dir.z));
+
+    const float horizontal = glm::length(glm::vec2(dir3.x, dir3.z));
+
+    //Sun in zenith, nothing casts shadows
+    if (horizontal < 1e-6f)
+    {
+        lines.Slope = 1e6f;
+        return lines;
+    }
+
+    //Lines go away from the sun, so occluders are always visited first
+    const glm::vec2 dir2 = -glm::vec2(dir3.x, dir3.z) / horizontal;
+
+    lines.MajorX = std::abs(dir2.x) >= std::abs(dir2.y);
+
+    const float major = lines.MajorX ? dir2.x : dir2.y;
+    const float minor = lines.MajorX ? dir2.y : dir2.x;
+
+    lines.MajorStep = (major >= 0.0f) ? 1 : -1;
+    lines.MajorStart = (major >= 0.0f) ? 0 : res - 1;
+
+    lines.MinorStep = minor / std::abs(major);
+    lines.StepLength = 1.0f / std::abs(major);
+    lines.Slope = dir3.y / horizontal;
+
+    //Minor offset at the last step, same rounding as in the sweep,
+    //lines start far enough outside so that the offsets still cover the whole map
+    const int drift = static_cast<int>(std::floor(float(res - 1) * lines.MinorStep + 0.5f));
+
+    lines.FirstMinor = std::min(0, -drift);
+    lines.NumLines = res + std::abs(drift);
+
+    return lines;
+}
+
+static inline float Shade(float occlusion, float dist, float res, bool soft, float sharpness)
+{
+    if (!soft)
+        return (occlusion > 0.0f) ? 0.0f : 1.0f;
+
+    //Height difference over distance, both normalized, as in map/shadow.glsl
+    const float tangent = (occlusion / res) / std::max(dist / res, 0.01f);
+
+    return 1.0f - std::clamp(sharpness * tangent, 0.0f, 1.0f);
+}
+
+static void SweepLine(const SweepLines& lines, int line, const float* heights,
+                      bool soft, float sharpness, float* output)
+{
+    const int res = lines.Res;
+    const float scale = static_cast<float>(res);
+    const float decay = lines.Slope * lines.StepLength;
+
+    //Height of the highest sun ray blocked so far, at the current texel, and distance to its occluder
+    float horizon = -1e30f;
+    float dist = 0.0f;
+
+    for (int k = 0; k < res; k++)
+    {
+        const int major = lines.MajorStart + k * lines.MajorStep;
+        const int minor = lines.FirstMinor + line + static_cast<int>(std::floor(float(k) * lines.MinorStep + 0.5f));
+
+        //Minor coordinate is monotonic, so the line never comes back once it leaves the map
+        if (minor < 0 || minor >= res)
+            continue;
+
+        const size_t idx = lines.MajorX ? size_t(minor) * size_t(res) + size_t(major)
+                                        : size_t(major) * size_t(res) + size_t(minor);
+
+        const float h = scale * heights[idx];
+
+        output[idx] = Shade(horizon - h, dist, scale, soft, sharpness);
+
+        if (h >= horizon)
+        {
+            horizon = h;
+            dist = 0.0f;
+        }
+
+        horizon -= decay;
+        dist += lines.StepLength;
+    }
+}
+
+CpuShadowSweep::CpuShadowSweep()
+{}
+
+void CpuShadowSweep::Generate(const SweepLines& lines, const std::vector<float>& heights,
+                              bool soft, float sharpness, std::vector<float>& output)
+{
+    ProfilerCPUEvent we("CpuShadowSweep::Generate");
+
+    output.resize(size_t(lines.Res) * size_t(lines.Res));
+
+    const size_t num_tasks = (lines.NumLines + LinesPerTask - 1) / LinesPerTask;
+
+    //Lines write disjoint texels, no synchronization needed
+    m_Pool.ParallelFor(num_tasks, [&](size_t task_id)
+    {
+        const int first = static_cast<int>(task_id) * LinesPerTask;
+        const int last = std::min(first + LinesPerTask, lines.NumLines);
+
+        for (int line = first; line < last; line++)
+            SweepLine(lines, line, heights.data(), soft, sharpness, output.data());
+    });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//Lines parallel to the sun azimuth, together covering every texel of a res x res shadowmap exactly once.
+//Each line steps one texel along the major axis of the sun direction, away from the sun,
+//texels along the minor axis are picked by rounding. Shared by the gpu sweep (map/shadow_sweep.glsl)
+//and CpuShadowSweep, so that both walk the same texels.
+struct SweepLines {
+    int Res = 0;
+    //Major axis is texel x if set, texel y otherwise
+    bool MajorX = true;
+    //Major coordinate of the first texel of every line, and step (+1 or -1)
+    int MajorStart = 0, MajorStep = 1;
+    //Minor coordinate change per step, in [-1, 1]
+    float MinorStep = 0.0f;
+    //Minor coordinate of line 0 at its first texel
+    int FirstMinor = 0;
+    int NumLines = 0;
+    //Horizontal distance between consecutive texels of a line, in texels
+    float StepLength = 1.0f;
+    //Rise of the sun ray per texel of horizontal distance, heights are scaled by res (as in map/shadow.glsl)
+    float Slope = 0.0f;
+
+    static SweepLines Setup(int res, glm::vec3 sun_dir, float scale_xz, float scale_y);
+};
+
+//Cpu version of map/shadow_sweep.glsl. Every texel only compares against the running horizon
+//of its line, so the whole map costs O(res^2) instead of a raymarch per texel.
+//Lines are independent and distributed across a work-stealing pool.
+class CpuShadowSweep {
+public:
+    CpuShadowSweep();
+
+    //Heights are unscaled, res x res row-major at the shadowmap texels,
+    //output is row-major with 1 meaning lit, same as the gpu shadowmap
+    void Generate(const SweepLines& lines, const std::vector<float>& heights,
+                  bool soft, float sharpness, std::vector<float>& output);
+
+    size_t getNumWorkers() const { return m_Pool.getNumWorkers(); }
+
+    static constexpr int LinesPerTask = 16;
+
+private:
+    ThreadPool m_Pool;
+};
@@ -0,0 +1,109 @@
+#include "HeightPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Integer division rounding towards negative infinity
+static int FloorDiv(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static int WrapIndex(int a, int res)
+{
+    const int m = a % res;
+    return (m < 0) ? m + res : m;
+}
+
+void HeightPyramid::Reset(int heightmap_res, bool repeat)
+{
+    m_Levels.clear();
+    m_HeightmapRes = heightmap_res;
+    m_Repeat = repeat;
+}
+
+void HeightPyramid::PushLevel(std::vector<glm::vec2>&& data)
+{
+    const int res = static_cast<int>(std::lround(std::sqrt(static_cast<double>(data.size()))));
+
+    m_Levels.push_back(Level{res, std::move(data)});
+}
+
+glm::vec2 HeightPyramid::QueryRange(glm::vec2 uv_min, glm::vec2 uv_max) const
+{
+    if (m_Levels.empty())
+        return glm::vec2(0.0f);
+
+    const float res = static_cast<float>(m_HeightmapRes);
+
+    //Heightmap texels touched by bilinear filtering anywhere inside the rectangle
+    const glm::ivec2 t_min{
+        static_cast<int>(std::floor(uv_min.x * res - 0.5f)),
+        static_cast<int>(std::floor(uv_min.y * res - 0.5f))
+    };
+
+    const glm::ivec2 t_max{
+        static_cast<int>(std::floor(uv_max.x * res - 0.5f)) + 1,
+        static_cast<int>(std::floor(uv_max.y * res - 0.5f)) + 1
+    };
+
+    //Pick the finest level at which the rectangle spans at most MaxTexels texels per axis
+    size_t lvl = 0;
+
+    for (; lvl + 1 < m_Levels.size(); lvl++)
+    {
+        const int texel_size = m_HeightmapRes / m_Levels[lvl].Res;
+
+        const int span_x = FloorDiv(t_max.x, texel_size) - FloorDiv(t_min.x, texel_size) + 1;
+        const int span_y = FloorDiv(t_max.y, texel_size) - FloorDiv(t_min.y, texel_size) + 1;
+
+        if (std::max(span_x, span_y) <= MaxTexels)
+            break;
+    }
+
+    const auto& level = m_Levels[lvl];
+    const int texel_size = m_HeightmapRes / level.Res;
+
+    glm::ivec2 start{ FloorDiv(t_min.x, texel_size), FloorDiv(t_min.y, texel_size) };
+    glm::ivec2 end{ FloorDiv(t_max.x, texel_size), FloorDiv(t_max.y, texel_size) };
+
+    //With repeat there is no point in visiting a texel twice
+    if (m_Repeat)
+    {
+        end.x = std::min(end.x, start.x + level.Res - 1);
+        end.y = std::min(end.y, start.y + level.Res - 1);
+    }
+
+    glm::vec2 range{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+
+    for (int y = start.y; y <= end.y; y++)
+    {
+        for (int x = start.x; x <= end.x; x++)
+        {
+            glm::ivec2 coord{ x, y };
+
+            if (m_Repeat)
+            {
+                coord.x = WrapIndex(coord.x, level.Res);
+                coord.y = WrapIndex(coord.y, level.Res);
+            }
+
+            //Border color of the heightmap is zero
+            else if (coord.x < 0 || coord.y < 0 || coord.x >= level.Res || coord.y >= level.Res)
+            {
+                range.x = std::min(range.x, 0.0f);
+                range.y = std::max(range.y, 0.0f);
+
+                coord = glm::clamp(coord, glm::ivec2(0), glm::ivec2(level.Res - 1));
+            }
+
+            const glm::vec2 texel = level.Data[coord.y * level.Res + coord.x];
+
+            range.x = std::min(range.x, texel.x);
+            range.y = std::max(range.y, texel.y);
+        }
+    }
+
+    return range;
+}
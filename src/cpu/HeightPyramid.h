@@ -0,0 +1,42 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//Cpu copy of the min/max height pyramid generated in MapGenerator::GenMinMaxPyramid.
+//Each texel stores (min, max) of the heightmap texels it covers, each next level halves the resolution.
+//Only the coarser part of the gpu pyramid is read back, so the finest level may cover more than 2x2 texels.
+//Used for conservative height range queries, e.g. for tight culling bounds of clipmap grids.
+class HeightPyramid {
+public:
+    //Drops all levels, heightmap_res is resolution of the source heightmap.
+    //Repeat selects wrapping of out-of-range texels, otherwise the heightmap is
+    //assumed to be surrounded by zero height (clamp to border)
+    void Reset(int heightmap_res, bool repeat);
+
+    //Levels need to be pushed in order, from the finest one,
+    //each with res x res texels (res needs to divide the heightmap resolution)
+    void PushLevel(std::vector<glm::vec2>&& data);
+
+    //Returns (min, max) of unscaled heights inside the given uv rectangle,
+    //including texels reachable by bilinear filtering at its border.
+    //Returns (0, 0) if the pyramid is empty.
+    glm::vec2 QueryRange(glm::vec2 uv_min, glm::vec2 uv_max) const;
+
+    bool Empty() const { return m_Levels.empty(); }
+
+    //Query looks at no more than MaxTexels x MaxTexels texels of the chosen level
+    static constexpr int MaxTexels = 4;
+
+private:
+    struct Level {
+        int Res;
+        std::vector<glm::vec2> Data;
+    };
+
+    std::vector<Level> m_Levels;
+
+    int m_HeightmapRes = 0;
+    bool m_Repeat = false;
+};
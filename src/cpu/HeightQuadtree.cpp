@@ -0,0 +1,471 @@
+#include "HeightQuadtree.h"
+
+#include "Simd.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//Stands in for infinite ray parameters, so that no lane ever computes inf - inf
+static constexpr float s_Far = 1e30f;
+
+//Integer division by 2 rounding towards negative infinity
+static int ParentIndex(int a)
+{
+    return (a >= 0) ? a / 2 : -((1 - a) / 2);
+}
+
+//Narrows [t0, t1] to the part of the rays inside slab [lo, hi] along one axis
+static void ClipSlab(simd::Float8 o, simd::Float8 d, float lo, float hi, simd::Float8& t0, simd::Float8& t1)
+{
+    using namespace simd;
+
+    const Mask8 parallel = Abs(d) < Float8(1e-12f);
+    const Float8 inv = Float8(1.0f) / Select(parallel, Float8(1.0f), d);
+
+    const Float8 ta = (Float8(lo) - o) * inv;
+    const Float8 tb = (Float8(hi) - o) * inv;
+
+    //Parallel rays are either inside for the whole range or never
+    const Mask8 outside = (o < Float8(lo)) || (o > Float8(hi));
+
+    const Float8 enter = Select(parallel, Select(outside, Float8(s_Far), Float8(-s_Far)), Min(ta, tb));
+    const Float8 exit  = Select(parallel, Select(outside, Float8(-s_Far), Float8(s_Far)), Max(ta, tb));
+
+    t0 = Max(t0, enter);
+    t1 = Min(t1, exit);
+}
+
+//Smallest s in [0, s_max] with a*s^2 + b*s + c = 0, given c > 0
+static bool SmallestRoot(float a, float b, float c, float s_max, float& s)
+{
+    if (a == 0.0f)
+    {
+        if (b >= 0.0f)
+            return false;
+
+        s = -c / b;
+        return s <= s_max;
+    }
+
+    const float disc = b * b - 4.0f * a * c;
+
+    if (disc < 0.0f)
+        return false;
+
+    //Numerically stable form, avoids cancellation when a is small
+    const float q = -0.5f * (b + std::copysign(std::sqrt(disc), b));
+
+    if (q == 0.0f)
+        return false;
+
+    const float r1 = q / a, r2 = c / q;
+
+    s = s_Far;
+
+    if (r1 >= 0.0f && r1 <= s_max)
+        s = r1;
+
+    if (r2 >= 0.0f && r2 <= s_max)
+        s = std::min(s, r2);
+
+    return s <= s_max;
+}
+
+HeightQuadtree::HeightQuadtree()
+{}
+
+void HeightQuadtree::Build(const std::vector<float>& heights, int res, bool repeat)
+{
+    ProfilerCPUEvent we("HeightQuadtree::Build");
+
+    m_Res = 0;
+    m_Levels.clear();
+
+    if (res < 2 || (res & (res - 1)) != 0 || heights.size() != size_t(res) * size_t(res))
+    {
+        std::cerr << "Height quadtree needs a power of two heightmap, got resolution " << res << '\n';
+        return;
+    }
+
+    m_Res = res;
+    m_Repeat = repeat;
+    m_Heights = heights;
+
+    //Finest level, every node covers 2x2 cells, i.e. 3x3 texels
+    {
+        const int level_res = res / 2;
+        Level level{level_res, std::vector<float>(size_t(level_res) * size_t(level_res)),
+                    std::vector<float>(size_t(level_res) * size_t(level_res))};
+
+        const size_t num_tasks = (level_res + RowsPerTask - 1) / RowsPerTask;
+
+        m_Pool.ParallelFor(num_tasks, [&](size_t task_id)
+        {
+            const int first = static_cast<int>(task_id) * RowsPerTask;
+            const int last = std::min(first + RowsPerTask, level_res);
+
+            for (int z = first; z < last; z++)
+            {
+                for (int x = 0; x < level_res; x++)
+                {
+                    float lo = Fetch(2 * x, 2 * z), hi = lo;
+
+                    for (int dz = 0; dz < 3; dz++)
+                    {
+                        for (int dx = 0; dx < 3; dx++)
+                        {
+                            const float h = Fetch(2 * x + dx, 2 * z + dz);
+
+                            lo = std::min(lo, h);
+                            hi = std::max(hi, h);
+                        }
+                    }
+
+                    const size_t idx = size_t(z) * size_t(level_res) + size_t(x);
+                    level.Min[idx] = lo;
+                    level.Max[idx] = hi;
+                }
+            }
+        });
+
+        m_Levels.push_back(std::move(level));
+    }
+
+    //Coarser levels are small enough to reduce on this thread
+    while (m_Levels.back().Res > 1)
+    {
+        const Level& prev = m_Levels.back();
+        const int level_res = prev.Res / 2;
+
+        Level level{level_res, std::vector<float>(size_t(level_res) * size_t(level_res)),
+                    std::vector<float>(size_t(level_res) * size_t(level_res))};
+
+        for (int z = 0; z < level_res; z++)
+        {
+            for (int x = 0; x < level_res; x++)
+            {
+                const size_t c00 = size_t(2 * z) * size_t(prev.Res) + size_t(2 * x);
+                const size_t c01 = c00 + size_t(prev.Res);
+
+                const size_t idx = size_t(z) * size_t(level_res) + size_t(x);
+
+                level.Min[idx] = std::min(std::min(prev.Min[c00], prev.Min[c00 + 1]),
+                                          std::min(prev.Min[c01], prev.Min[c01 + 1]));
+                level.Max[idx] = std::max(std::max(prev.Max[c00], prev.Max[c00 + 1]),
+                                          std::max(prev.Max[c01], prev.Max[c01 + 1]));
+            }
+        }
+
+        m_Levels.push_back(std::move(level));
+    }
+
+    m_MaxHeight = m_Levels.back().Max[0];
+}
+
+void HeightQuadtree::Raycast(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits)
+{
+    ProfilerCPUEvent we("HeightQuadtree::Raycast");
+
+    TraceBatch(rays, hits, false, 0.0f);
+}
+
+void HeightQuadtree::RaycastBruteForce(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, float step)
+{
+    ProfilerCPUEvent we("HeightQuadtree::RaycastBruteForce");
+
+    TraceBatch(rays, hits, true, step);
+}
+
+void HeightQuadtree::TraceBatch(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits,
+                                bool brute_force, float step)
+{
+    hits.assign(rays.size(), TerrainHit{});
+
+    if (Empty() || rays.empty())
+        return;
+
+    const size_t num_packets = (rays.size() + PacketSize - 1) / PacketSize;
+    const size_t num_tasks = (num_packets + PacketsPerTask - 1) / PacketsPerTask;
+
+    //Rays write disjoint hits, no synchronization needed
+    auto task = [&](size_t task_id)
+    {
+        const size_t first = task_id * PacketsPerTask;
+        const size_t last = std::min(first + PacketsPerTask, num_packets);
+
+        for (size_t packet = first; packet < last; packet++)
+            TracePacket(rays, hits, packet * PacketSize, brute_force, step);
+    };
+
+    //Waking the workers costs more than a few packets
+    if (num_tasks == 1)
+        task(0);
+    else
+        m_Pool.ParallelFor(num_tasks, task);
+}
+
+void HeightQuadtree::TracePacket(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits,
+                                 size_t first, bool brute_force, float step) const
+{
+    using namespace simd;
+
+    const size_t count = std::min(size_t(PacketSize), rays.size() - first);
+
+    alignas(32) float ox[PacketSize], oy[PacketSize], oz[PacketSize];
+    alignas(32) float dx[PacketSize], dy[PacketSize], dz[PacketSize];
+    alignas(32) float t0[PacketSize], t1[PacketSize];
+
+    //Transposed to one array per component, the tail is padded with copies of the last ray
+    for (size_t i = 0; i < PacketSize; i++)
+    {
+        const TerrainRay& ray = rays[first + std::min(i, count - 1)];
+
+        ox[i] = ray.Origin.x; oy[i] = ray.Origin.y; oz[i] = ray.Origin.z;
+        dx[i] = ray.Dir.x;    dy[i] = ray.Dir.y;    dz[i] = ray.Dir.z;
+        t1[i] = ray.MaxT;
+    }
+
+    //Uv to cells between texel centers, the ray parameter stays the same
+    const float res = static_cast<float>(m_Res);
+
+    const Float8 o_x = Float8::Load(ox) * res - 0.5f, o_z = Float8::Load(oz) * res - 0.5f;
+    const Float8 d_x = Float8::Load(dx) * res,        d_z = Float8::Load(dz) * res;
+    const Float8 o_y = Float8::Load(oy), d_y = Float8::Load(dy);
+
+    Float8 t_min(0.0f), t_max = Float8::Load(t1);
+
+    //Between texel centers, the half texel border ramping to zero height is ignored
+    if (!m_Repeat)
+    {
+        ClipSlab(o_x, d_x, 0.0f, res - 1.0f, t_min, t_max);
+        ClipSlab(o_z, d_z, 0.0f, res - 1.0f, t_min, t_max);
+    }
+
+    //Above the highest node nothing can be hit, this alone rejects most rays which miss
+    const Float8 top(m_MaxHeight);
+    const Mask8 falling = d_y < Float8(-1e-12f), rising = d_y > Float8(1e-12f);
+    const Mask8 level = !(falling || rising);
+
+    const Float8 t_top = (top - o_y) / Select(level, Float8(1.0f), d_y);
+
+    t_min = Select(falling, Max(t_min, t_top), t_min);
+    t_max = Select(rising, Min(t_max, t_top), t_max);
+    t_min = Select(level && (o_y > top), Float8(s_Far), t_min);
+
+    const uint32_t active = MoveMask(!(t_min > t_max));
+
+    if (!active)
+        return;
+
+    o_x.Store(ox); o_z.Store(oz);
+    d_x.Store(dx); d_z.Store(dz);
+    t_min.Store(t0); t_max.Store(t1);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!(active & (1u << i)))
+            continue;
+
+        const CellRay ray{glm::vec3(ox[i], oy[i], oz[i]), glm::vec3(dx[i], dy[i], dz[i]), t0[i], t1[i]};
+
+        const float t = brute_force ? TraceMarch(ray, step) : TraceQuadtree(ray);
+
+        if (t >= 0.0f)
+            hits[first + i] = TerrainHit{true, t};
+    }
+}
+
+float HeightQuadtree::TraceQuadtree(const CellRay& ray) const
+{
+    const int top = static_cast<int>(m_Levels.size());
+
+    const glm::vec3 o = ray.Origin, d = ray.Dir;
+
+    const bool parallel_x = std::abs(d.x) < 1e-12f, parallel_z = std::abs(d.z) < 1e-12f;
+    const float inv_x = parallel_x ? 0.0f : 1.0f / d.x;
+    const float inv_z = parallel_z ? 0.0f : 1.0f / d.z;
+    const int step_x = (d.x >= 0.0f) ? 1 : -1;
+    const int step_z = (d.z >= 0.0f) ? 1 : -1;
+
+    //Traversal level 0 are single cells, level l > 0 is m_Levels[l-1] with nodes of 2^l x 2^l cells.
+    //Node indices aren't wrapped, so that they keep moving monotonically along the ray.
+    int level = top;
+    float t = ray.T0;
+
+    const float top_size = static_cast<float>(1 << top);
+    int ix = static_cast<int>(std::floor((o.x + t * d.x) / top_size));
+    int iz = static_cast<int>(std::floor((o.z + t * d.z) / top_size));
+
+    while (true)
+    {
+        const int level_res = m_Res >> level;
+        const float size = static_cast<float>(1 << level);
+
+        if (!m_Repeat && (ix < 0 || iz < 0 || ix >= level_res || iz >= level_res))
+            return -1.0f;
+
+        const float exit_x = parallel_x ? s_Far : (float(ix + (step_x > 0)) * size - o.x) * inv_x;
+        const float exit_z = parallel_z ? s_Far : (float(iz + (step_z > 0)) * size - o.z) * inv_z;
+
+        const float exit = std::max(std::min(exit_x, exit_z), t);
+        const float t_end = std::min(exit, ray.T1);
+
+        if (level == 0)
+        {
+            float t_hit;
+
+            if (IntersectCell(ray, ix, iz, t, t_end, t_hit))
+                return t_hit;
+        }
+
+        else
+        {
+            const Level& nodes = m_Levels[level - 1];
+            const int nx = m_Repeat ? (ix & (level_res - 1)) : ix;
+            const int nz = m_Repeat ? (iz & (level_res - 1)) : iz;
+
+            //Lowest point of the ray inside the node
+            const float ray_min = o.y + d.y * ((d.y < 0.0f) ? t_end : t);
+
+            if (ray_min <= nodes.Max[size_t(nz) * size_t(level_res) + size_t(nx)])
+            {
+                const float child_size = 0.5f * size;
+
+                ix = 2 * ix + ((o.x + t * d.x >= float(2 * ix + 1) * child_size) ? 1 : 0);
+                iz = 2 * iz + ((o.z + t * d.z >= float(2 * iz + 1) * child_size) ? 1 : 0);
+                level--;
+
+                continue;
+            }
+        }
+
+        if (exit >= ray.T1)
+            return -1.0f;
+
+        //Step into the neighbour the ray leaves through
+        t = exit;
+
+        const bool along_x = exit_x < exit_z;
+
+        int& idx = along_x ? ix : iz;
+        int& other = along_x ? iz : ix;
+
+        int prev = idx;
+        idx += along_x ? step_x : step_z;
+
+        //Climb while the step also leaves the parent, the new parent wasn't tested yet
+        while (level < top && ParentIndex(idx) != ParentIndex(prev))
+        {
+            idx = ParentIndex(idx);
+            prev = ParentIndex(prev);
+            other = ParentIndex(other);
+            level++;
+        }
+    }
+}
+
+bool HeightQuadtree::IntersectCell(const CellRay& ray, int x, int z, float t_start, float t_end, float& t_hit) const
+{
+    const float h00 = Fetch(x, z),     h10 = Fetch(x + 1, z);
+    const float h01 = Fetch(x, z + 1), h11 = Fetch(x + 1, z + 1);
+
+    //Bilinear patch h00 + a*u + b*v + c*u*v, in coordinates relative to the cell corner
+    const float a = h10 - h00, b = h01 - h00, c = h11 - h10 - h01 + h00;
+
+    const glm::vec3 p = ray.Origin + t_start * ray.Dir;
+    const glm::vec3 d = ray.Dir;
+
+    const float u = p.x - float(x), v = p.z - float(z);
+
+    //Ray height minus surface height is quadratic in s = t - t_start
+    const float qa = -c * d.x * d.z;
+    const float qb = d.y - (a * d.x + b * d.z + c * (u * d.z + v * d.x));
+    const float qc = p.y - (h00 + a * u + b * v + c * u * v);
+
+    if (qc <= 0.0f)
+    {
+        t_hit = t_start;
+        return true;
+    }
+
+    float s;
+
+    if (!SmallestRoot(qa, qb, qc, t_end - t_start, s))
+        return false;
+
+    t_hit = t_start + s;
+    return true;
+}
+
+float HeightQuadtree::TraceMarch(const CellRay& ray, float step) const
+{
+    auto Above = [&](float t) {
+        const glm::vec3 p = ray.Origin + t * ray.Dir;
+        return p.y - SampleCell(p.x, p.z);
+    };
+
+    if (Above(ray.T0) <= 0.0f)
+        return ray.T0;
+
+    const float horizontal = std::sqrt(ray.Dir.x * ray.Dir.x + ray.Dir.z * ray.Dir.z);
+    //Vertical rays cross a single height, so one step is enough
+    const float dt = (horizontal > 1e-6f) ? step / horizontal : std::max(ray.T1 - ray.T0, 1e-6f);
+    const int num_steps = std::max(1, static_cast<int>(std::ceil((ray.T1 - ray.T0) / dt)));
+
+    float prev = ray.T0;
+
+    for (int i = 1; i <= num_steps; i++)
+    {
+        const float t = std::min(ray.T0 + float(i) * dt, ray.T1);
+
+        if (Above(t) <= 0.0f)
+        {
+            float lo = prev, hi = t;
+
+            for (int k = 0; k < BisectionSteps; k++)
+            {
+                const float mid = 0.5f * (lo + hi);
+
+                if (Above(mid) <= 0.0f)
+                    hi = mid;
+                else
+                    lo = mid;
+            }
+
+            return hi;
+        }
+
+        prev = t;
+    }
+
+    return -1.0f;
+}
+
+float HeightQuadtree::Fetch(int x, int z) const
+{
+    if (m_Repeat)
+    {
+        x &= m_Res - 1;
+        z &= m_Res - 1;
+    }
+
+    else if (x < 0 || z < 0 || x >= m_Res || z >= m_Res)
+        return 0.0f;
+
+    return m_Heights[size_t(z) * size_t(m_Res) + size_t(x)];
+}
+
+float HeightQuadtree::SampleCell(float x, float z) const
+{
+    const int x0 = static_cast<int>(std::floor(x));
+    const int z0 = static_cast<int>(std::floor(z));
+
+    const float fx = x - float(x0), fz = z - float(z0);
+
+    const float top    = (1.0f - fx) * Fetch(x0, z0)     + fx * Fetch(x0 + 1, z0);
+    const float bottom = (1.0f - fx) * Fetch(x0, z0 + 1) + fx * Fetch(x0 + 1, z0 + 1);
+
+    return (1.0f - fz) * top + fz * bottom;
+}
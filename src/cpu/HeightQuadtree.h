@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//Ray in heightmap space: x and z are heightmap uv, y is unscaled height.
+//Points along the ray are Origin + t * Dir for t in [0, MaxT].
+struct TerrainRay {
+    glm::vec3 Origin;
+    glm::vec3 Dir;
+    //Needs to be finite for tiling heightmaps, rays could wrap around forever otherwise
+    float MaxT;
+};
+
+struct TerrainHit {
+    bool Hit = false;
+    //Ray parameter of the first intersection, rays starting below the surface hit at their start
+    float T = 0.0f;
+};
+
+//Cpu min/max quadtree over the bilinearly filtered heightmap, for ray-terrain intersections in tools
+//(picking, object placement, line of sight). Same layout as the gpu pyramid from MapGenerator::GenMinMaxPyramid:
+//level i has (res >> (i+1))^2 nodes, each storing (min, max) of the heights it covers. Footprints are
+//dilated by one texel, so that the nodes bound the bilinear patches between texel centers.
+//Rays descend only into nodes their height range overlaps and climb back up after leaving a parent,
+//only the cells at the bottom are intersected exactly. Rays are set up and clipped in packets of 8,
+//while the traversal of each lane is scalar, since rays diverge quickly.
+class HeightQuadtree {
+public:
+    HeightQuadtree();
+
+    //Heights are unscaled, res x res row-major, res needs to be a power of two.
+    //Repeat selects wrapping of out-of-range texels, otherwise the heightmap is
+    //assumed to be surrounded by zero height (clamp to border)
+    void Build(const std::vector<float>& heights, int res, bool repeat);
+
+    //Batches are split across the pool, so calls must not overlap
+    void Raycast(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits);
+    //Reference which marches every ray with fixed steps (in texels) and refines crossings by bisection
+    void RaycastBruteForce(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, float step = 0.5f);
+
+    bool Empty() const { return m_Res == 0; }
+    size_t getNumWorkers() const { return m_Pool.getNumWorkers(); }
+
+    static constexpr int PacketSize = 8;
+    static constexpr int PacketsPerTask = 64;
+    static constexpr int RowsPerTask = 16;
+    static constexpr int BisectionSteps = 16;
+
+private:
+    //Ray transformed to cells between texel centers, clipped to [T0, T1]
+    struct CellRay {
+        glm::vec3 Origin, Dir;
+        float T0, T1;
+    };
+
+    struct Level {
+        int Res;
+        std::vector<float> Min, Max;
+    };
+
+    void TraceBatch(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, bool brute_force, float step);
+    void TracePacket(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, size_t first,
+                     bool brute_force, float step) const;
+
+    //Both return the hit parameter, or a negative value for a miss
+    float TraceQuadtree(const CellRay& ray) const;
+    float TraceMarch(const CellRay& ray, float step) const;
+
+    //Exact intersection with the bilinear patch of cell (x, z) for t in [t_start, t_end]
+    bool IntersectCell(const CellRay& ray, int x, int z, float t_start, float t_end, float& t_hit) const;
+
+    float Fetch(int x, int z) const;
+    float SampleCell(float x, float z) const;
+
+    int m_Res = 0;
+    bool m_Repeat = false;
+    float m_MaxHeight = 0.0f;
+
+    std::vector<float> m_Heights;
+    //From the finest level, the last one has a single node
+    std::vector<Level> m_Levels;
+
+    ThreadPool m_Pool;
+};
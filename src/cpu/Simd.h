@@ -0,0 +1,163 @@
+#pragma once
+
+//Minimal 8-wide float/uint wrappers used by cpu kernels.
+//With AVX2 enabled these map directly to 256-bit registers,
+//otherwise they fall back to plain loops (which compilers can still vectorize).
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+#ifdef __AVX2__
+
+struct Float8 {
+    __m256 v;
+
+    Float8() : v(_mm256_setzero_ps()) {}
+    Float8(__m256 x) : v(x) {}
+    Float8(float x) : v(_mm256_set1_ps(x)) {}
+
+    static Float8 Load(const float* ptr) { return _mm256_loadu_ps(ptr); }
+    void Store(float* ptr) const { _mm256_storeu_ps(ptr, v); }
+
+    //Values start, start+1, ..., start+7
+    static Float8 Ramp(float start)
+    {
+        return _mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+};
+
+struct UInt8 {
+    __m256i v;
+
+    UInt8() : v(_mm256_setzero_si256()) {}
+    UInt8(__m256i x) : v(x) {}
+    UInt8(uint32_t x) : v(_mm256_set1_epi32(static_cast<int>(x))) {}
+};
+
+struct Mask8 {
+    __m256 v;
+};
+
+inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.v, b.v); }
+inline Float8 operator-(Float8 a) { return _mm256_sub_ps(_mm256_setzero_ps(), a.v); }
+
+inline Mask8 operator<(Float8 a, Float8 b) { return Mask8{ _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mask8 operator>(Float8 a, Float8 b) { return Mask8{ _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask8 operator&&(Mask8 a, Mask8 b) { return Mask8{ _mm256_and_ps(a.v, b.v) }; }
+inline Mask8 operator!(Mask8 a) { return Mask8{ _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+inline Mask8 operator||(Mask8 a, Mask8 b) { return Mask8{ _mm256_or_ps(a.v, b.v) }; }
+
+//Bit i is set if lane i of the mask is set
+inline uint32_t MoveMask(Mask8 m) { return static_cast<uint32_t>(_mm256_movemask_ps(m.v)); }
+
+inline Float8 Select(Mask8 m, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+inline Float8 Floor(Float8 a) { return _mm256_floor_ps(a.v); }
+inline Float8 Min(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+inline Float8 Max(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+inline Float8 Sqrt(Float8 a) { return _mm256_sqrt_ps(a.v); }
+inline Float8 Abs(Float8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+inline UInt8 operator*(UInt8 a, UInt8 b) { return _mm256_mullo_epi32(a.v, b.v); }
+inline UInt8 operator^(UInt8 a, UInt8 b) { return _mm256_xor_si256(a.v, b.v); }
+inline UInt8 operator&(UInt8 a, UInt8 b) { return _mm256_and_si256(a.v, b.v); }
+inline UInt8 operator|(UInt8 a, UInt8 b) { return _mm256_or_si256(a.v, b.v); }
+inline UInt8 operator>>(UInt8 a, int s) { return _mm256_srli_epi32(a.v, s); }
+
+inline UInt8 AsUInt(Float8 a) { return _mm256_castps_si256(a.v); }
+inline Float8 AsFloat(UInt8 a) { return _mm256_castsi256_ps(a.v); }
+
+#else
+
+#define LOFI_SIMD_LANEWISE(expr) for (int i = 0; i < 8; i++) { expr; }
+
+struct Float8 {
+    float v[8];
+
+    Float8() { LOFI_SIMD_LANEWISE(v[i] = 0.0f) }
+    Float8(float x) { LOFI_SIMD_LANEWISE(v[i] = x) }
+
+    static Float8 Load(const float* ptr) { Float8 r; LOFI_SIMD_LANEWISE(r.v[i] = ptr[i]) return r; }
+    void Store(float* ptr) const { LOFI_SIMD_LANEWISE(ptr[i] = v[i]) }
+
+    //Values start, start+1, ..., start+7
+    static Float8 Ramp(float start) { Float8 r; LOFI_SIMD_LANEWISE(r.v[i] = start + float(i)) return r; }
+};
+
+struct UInt8 {
+    uint32_t v[8];
+
+    UInt8() { LOFI_SIMD_LANEWISE(v[i] = 0u) }
+    UInt8(uint32_t x) { LOFI_SIMD_LANEWISE(v[i] = x) }
+};
+
+struct Mask8 {
+    bool v[8];
+};
+
+inline Float8 operator+(Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] += b.v[i]) return a; }
+inline Float8 operator-(Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] -= b.v[i]) return a; }
+inline Float8 operator*(Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] *= b.v[i]) return a; }
+inline Float8 operator/(Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] /= b.v[i]) return a; }
+inline Float8 operator-(Float8 a) { LOFI_SIMD_LANEWISE(a.v[i] = -a.v[i]) return a; }
+
+inline Mask8 operator<(Float8 a, Float8 b) { Mask8 m; LOFI_SIMD_LANEWISE(m.v[i] = a.v[i] < b.v[i]) return m; }
+inline Mask8 operator>(Float8 a, Float8 b) { Mask8 m; LOFI_SIMD_LANEWISE(m.v[i] = a.v[i] > b.v[i]) return m; }
+inline Mask8 operator&&(Mask8 a, Mask8 b) { LOFI_SIMD_LANEWISE(a.v[i] = a.v[i] && b.v[i]) return a; }
+inline Mask8 operator!(Mask8 a) { LOFI_SIMD_LANEWISE(a.v[i] = !a.v[i]) return a; }
+inline Mask8 operator||(Mask8 a, Mask8 b) { LOFI_SIMD_LANEWISE(a.v[i] = a.v[i] || b.v[i]) return a; }
+
+//Bit i is set if lane i of the mask is set
+inline uint32_t MoveMask(Mask8 m) { uint32_t r = 0; LOFI_SIMD_LANEWISE(r |= uint32_t(m.v[i]) << i) return r; }
+
+inline Float8 Select(Mask8 m, Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] = m.v[i] ? a.v[i] : b.v[i]) return a; }
+
+inline Float8 Floor(Float8 a) { LOFI_SIMD_LANEWISE(a.v[i] = std::floor(a.v[i])) return a; }
+inline Float8 Min(Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] = (a.v[i] < b.v[i]) ? a.v[i] : b.v[i]) return a; }
+inline Float8 Max(Float8 a, Float8 b) { LOFI_SIMD_LANEWISE(a.v[i] = (a.v[i] > b.v[i]) ? a.v[i] : b.v[i]) return a; }
+inline Float8 Sqrt(Float8 a) { LOFI_SIMD_LANEWISE(a.v[i] = std::sqrt(a.v[i])) return a; }
+inline Float8 Abs(Float8 a) { LOFI_SIMD_LANEWISE(a.v[i] = std::abs(a.v[i])) return a; }
+
+inline UInt8 operator*(UInt8 a, UInt8 b) { LOFI_SIMD_LANEWISE(a.v[i] *= b.v[i]) return a; }
+inline UInt8 operator^(UInt8 a, UInt8 b) { LOFI_SIMD_LANEWISE(a.v[i] ^= b.v[i]) return a; }
+inline UInt8 operator&(UInt8 a, UInt8 b) { LOFI_SIMD_LANEWISE(a.v[i] &= b.v[i]) return a; }
+inline UInt8 operator|(UInt8 a, UInt8 b) { LOFI_SIMD_LANEWISE(a.v[i] |= b.v[i]) return a; }
+inline UInt8 operator>>(UInt8 a, int s) { LOFI_SIMD_LANEWISE(a.v[i] >>= s) return a; }
+
+inline UInt8 AsUInt(Float8 a) { UInt8 r; std::memcpy(r.v, a.v, sizeof(r.v)); return r; }
+inline Float8 AsFloat(UInt8 a) { Float8 r; std::memcpy(r.v, a.v, sizeof(r.v)); return r; }
+
+#undef LOFI_SIMD_LANEWISE
+
+#endif
+
+//Common helpers, same semantics as their glsl counterparts:
+
+inline Float8 Fract(Float8 a) { return a - Floor(a); }
+inline Float8 Mix(Float8 a, Float8 b, Float8 t) { return a + t * (b - a); }
+inline Float8 Clamp(Float8 a, Float8 lo, Float8 hi) { return Min(Max(a, lo), hi); }
+
+//Applies scalar function to every lane (for things like pow/sin that have no cheap vector form)
+template<typename Func>
+inline Float8 Map(Float8 a, Func func)
+{
+    alignas(32) float tmp[8];
+    a.Store(tmp);
+
+    for (int i = 0; i < 8; i++)
+        tmp[i] = func(tmp[i]);
+
+    return Float8::Load(tmp);
+}
+
+}
@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t num_threads)
+{
+    if (num_threads == 0)
+    {
+        const size_t hw = std::thread::hardware_concurrency();
+        num_threads = (hw > 1) ? hw - 1 : 0;
+    }
+
+    //Last queue belongs to the thread calling ParallelFor
+    for (size_t i = 0; i < num_threads + 1; i++)
+        m_Queues.push_back(std::make_unique<WorkQueue>());
+
+    for (size_t i = 0; i < num_threads; i++)
+        m_Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+
+    m_WakeCondition.notify_all();
+
+    for (auto& thread : m_Threads)
+        thread.join();
+}
+
+void ThreadPool::ParallelFor(size_t num_tasks, const std::function<void(size_t)>& func)
+{
+    if (num_tasks == 0) return;
+
+    const size_t caller_id = m_Queues.size() - 1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        m_Job = &func;
+        m_Remaining = num_tasks;
+
+        //Contiguous chunks keep neighbouring tasks on the same worker
+        //as long as nothing needs to be stolen
+        const size_t num_queues = m_Queues.size();
+
+        for (size_t q = 0; q < num_queues; q++)
+        {
+            const size_t begin = (q * num_tasks) / num_queues;
+            const size_t end = ((q + 1) * num_tasks) / num_queues;
+
+            std::lock_guard<std::mutex> queue_lock(m_Queues[q]->Mutex);
+
+            for (size_t task = begin; task < end; task++)
+                m_Queues[q]->Tasks.push_back(task);
+        }
+
+        m_Generation++;
+    }
+
+    m_WakeCondition.notify_all();
+
+    while (TryRunTask(caller_id)) {}
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_DoneCondition.wait(lock, [this]() {return m_Remaining == 0; });
+
+    m_Job = nullptr;
+}
+
+bool ThreadPool::TryRunTask(size_t worker_id)
+{
+    size_t task = 0;
+    bool found = false;
+
+    //Own queue first (LIFO end)
+    {
+        auto& own = *m_Queues[worker_id];
+        std::lock_guard<std::mutex> lock(own.Mutex);
+
+        if (!own.Tasks.empty())
+        {
+            task = own.Tasks.back();
+            own.Tasks.pop_back();
+            found = true;
+        }
+    }
+
+    //Then try to steal from other workers (FIFO end)
+    for (size_t offset = 1; !found && offset < m_Queues.size(); offset++)
+    {
+        auto& victim = *m_Queues[(worker_id + offset) % m_Queues.size()];
+        std::lock_guard<std::mutex> lock(victim.Mutex);
+
+        if (!victim.Tasks.empty())
+        {
+            task = victim.Tasks.front();
+            victim.Tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) return false;
+
+    (*m_Job)(task);
+
+    if (--m_Remaining == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_DoneCondition.notify_all();
+    }
+
+    return true;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_id)
+{
+    size_t last_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+
+            m_WakeCondition.wait(lock, [&]() {return m_Stop || m_Generation != last_generation; });
+
+            if (m_Stop) return;
+
+            last_generation = m_Generation;
+        }
+
+        while (TryRunTask(worker_id)) {}
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+//Simple work-stealing pool for data-parallel loops.
+//Every worker has its own task queue, initially filled with a contiguous range of tasks,
+//it pops from the back of its own queue and steals from the front of others when empty.
+//The calling thread participates as an additional worker.
+class ThreadPool {
+public:
+    //Zero means one thread per hardware core (minus the calling thread)
+    ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    //Runs func(task_id) for every task_id in [0, num_tasks), blocks until all are done.
+    //Not reentrant - func must not call ParallelFor on the same pool.
+    void ParallelFor(size_t num_tasks, const std::function<void(size_t)>& func);
+
+    size_t getNumWorkers() const { return m_Queues.size(); }
+
+private:
+    struct WorkQueue {
+        std::mutex Mutex;
+        std::deque<size_t> Tasks;
+    };
+
+    void WorkerLoop(size_t worker_id);
+    bool TryRunTask(size_t worker_id);
+
+    std::vector<std::thread> m_Threads;
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+
+    const std::function<void(size_t)>* m_Job = nullptr;
+    std::atomic<size_t> m_Remaining{0};
+
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCondition, m_DoneCondition;
+    size_t m_Generation = 0;
+    bool m_Stop = false;
+};
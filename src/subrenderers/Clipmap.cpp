@@ -4,7 +4,11 @@
 #include "glad/glad.h"
 
 #include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <random>
 
 #include "ImGuiUtils.h"
 
@@ -28,6 +32,51 @@ void Drawable::BindBufferRange(uint32_t vertex_buffer, uint32_t binding) const
     glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, vertex_buffer, start, size);
 }
 
+DrawElementsIndirectCommand Drawable::getCommand() const
+{
+    return DrawElementsIndirectCommand{
+        IndexCount, InstanceCount, FirstIndex, BaseVertex, BaseInstance
+    };
+}
+
+//Default vertical bounds, used until the height pyramid is available
+static constexpr float DefaultBoundsCenter = 0.45f;
+static constexpr float DefaultBoundsExtents = 0.55f;
+
+//Sets vertical extents of a grid bounding box (centered around the camera, as used in culling)
+//to the height range of terrain under it. Offset moves the box to world space.
+//Horizontal rect is extended by margin_xz, since trims/sub-quad snapping may shift the vertices.
+static void FitBoundsToTerrain(AABB& aabb, const MapGenerator& map, glm::vec2 offset,
+                               float margin_xz, float margin_y)
+{
+    const auto& pyramid = map.getHeightPyramid();
+
+    if (pyramid.Empty())
+    {
+        aabb.Center.y = DefaultBoundsCenter;
+        aabb.Extents.y = DefaultBoundsExtents;
+        return;
+    }
+
+    const glm::vec2 center{ aabb.Center.x, aabb.Center.z };
+    const glm::vec2 extents{ aabb.Extents.x + margin_xz, aabb.Extents.z + margin_xz };
+
+    const glm::vec2 uv_min = map.RenderToUV(offset + center - extents);
+    const glm::vec2 uv_max = map.RenderToUV(offset + center + extents);
+
+    const glm::vec2 range = pyramid.QueryRange(uv_min, uv_max);
+
+    //Vertex shaders place terrain at 0.5 * scale_y * height
+    aabb.Center.y = 0.25f * (range.x + range.y);
+    aabb.Extents.y = 0.25f * (range.y - range.x) + margin_y;
+}
+
+//Reads result of the batch frustum test
+static bool IsVisible(const std::vector<uint32_t>& visible, size_t id)
+{
+    return ((visible[id / 32] >> (id % 32)) & 1u) != 0;
+}
+
 //We will only store information about a vertex being on
 //vertical/horizontal edge, or not being at an edge at all.
 //This doesn't describe corners well, but that's not a problem,
@@ -38,13 +87,19 @@ enum EdgeData {
     NoEdge = 0, Horizontal = 1, Vertical = 2
 };
 
-static uint32_t PackAuxData(bool is_trim, EdgeData edge_data, uint32_t lvl)
+static uint16_t PackAuxData(bool is_trim, EdgeData edge_data, uint32_t lvl)
 {
     const uint32_t trim = static_cast<uint32_t>(is_trim);
     const uint32_t edge = static_cast<uint32_t>(edge_data) << 1;
     const uint32_t level = lvl << 3;
 
-    return trim | edge | level;
+    return static_cast<uint16_t>(trim | edge | level);
+}
+
+//By construction all vertices of a given level lie on a grid with spacing equal to its quad size
+static int16_t PackPosition(float pos, float quad_size)
+{
+    return static_cast<int16_t>(std::round(pos / quad_size));
 }
 
 //Denotes position of the current grid in its ring of the clipmap
@@ -60,6 +115,24 @@ enum GridPosFlag {
     RightTop = Right | Top
 };
 
+//Describes on which borders of a canonical mesh of the instanced clipmap
+//a vertex lies. Grids use Left/Right/Top/Bottom from GridPosFlag.
+//Needs to match clipmap_instanced.glsl
+enum BorderFlags {
+    BorderStart    = (1 << 4),
+    BorderEnd      = (1 << 5),
+    BorderVertical = (1 << 6),
+    BorderStrip    = (1 << 7)
+};
+
+//Type of a canonical mesh reconstructed by vertex pulling
+//Needs to match clipmap_pulled.glsl
+enum class PulledMeshType {
+    Grid       = 0,
+    Horizontal = 1,
+    Vertical   = 2
+};
+
 struct GridInfo{
     uint32_t VertsPerLine;
     float SideLength;
@@ -68,6 +141,28 @@ struct GridInfo{
     uint32_t Level;
 };
 
+static void PushGridIndices(std::vector<uint32_t>& elements, uint32_t verts_per_line)
+{
+    const auto n = verts_per_line;
+
+    for (uint32_t i=0; i<n*n; i++)
+    {
+        uint32_t ix = i % n;
+        uint32_t iy = i / n;
+
+        if (ix == n - 1) continue;
+        if (iy == n - 1) continue;
+
+        elements.push_back(i);
+        elements.push_back(i+1);
+        elements.push_back(i+n);
+
+        elements.push_back(i+1);
+        elements.push_back(i+1+n);
+        elements.push_back(i+n);
+    }
+}
+
 static void GenerateGrid(std::vector<ClipmapVertex>& verts,
         std::vector<uint32_t>& elements,
         Drawable& drawable,
@@ -129,37 +224,57 @@ static void GenerateGrid(std::vector<ClipmapVertex>& verts,
         const glm::vec2 offset = GetOffset(i);
 
         verts.push_back(ClipmapVertex{
-            origin.x + offset.x, 0.0f, origin.y + offset.y, //position
+            PackPosition(origin.x + offset.x, quad_size), //position
+            PackPosition(origin.y + offset.y, quad_size),
+            0, //height
             PackAuxData(false, GetEdgeData(i), info.Level)
         });
 
     }
 
     //Index data:
-    for (uint32_t i=0; i<vert_count; i++)
+    PushGridIndices(elements, info.VertsPerLine);
+}
+
+enum class StripOrientation {
+    Horizontal, Vertical
+};
+
+static void PushStripIndices(std::vector<uint32_t>& elements, uint32_t start_id,
+        uint32_t verts_per_line, StripOrientation orientation)
+{
+    for (uint32_t i=0; i<verts_per_line-1; i++)
     {
-        const auto n = info.VertsPerLine;
+        switch (orientation)
+        {
+            case StripOrientation::Horizontal:
+            {
+                elements.push_back(start_id + 2 * i);
+                elements.push_back(start_id + 2 * i + 2);
+                elements.push_back(start_id + 2 * i + 1);
 
-        uint32_t ix = i % n;
-        uint32_t iy = i / n;
+                elements.push_back(start_id + 2 * i + 1);
+                elements.push_back(start_id + 2 * i + 2);
+                elements.push_back(start_id + 2 * i + 3);
 
-        if (ix == n - 1) continue;
-        if (iy == n - 1) continue;
+                break;
+            }
+            case StripOrientation::Vertical:
+            {
+                elements.push_back(start_id + 2*i);
+                elements.push_back(start_id + 2*i + 1);
+                elements.push_back(start_id + 2*i + 2);
 
-        elements.push_back(i);
-        elements.push_back(i+1);
-        elements.push_back(i+n);
+                elements.push_back(start_id + 2*i + 1);
+                elements.push_back(start_id + 2*i + 3);
+                elements.push_back(start_id + 2*i + 2);
 
-        elements.push_back(i+1);
-        elements.push_back(i+1+n);
-        elements.push_back(i+n);
+                break;
+            }
+        }
     }
 }
 
-enum class StripOrientation {
-    Horizontal, Vertical
-};
-
 struct StripInfo{
     uint32_t VertsPerLine;
     float QuadSize;
@@ -260,42 +375,15 @@ static void GenerateStrip(std::vector<ClipmapVertex>& verts,
         const glm::vec2 offset = GenOffset(i);
 
         verts.push_back(ClipmapVertex{
-            origin.x + offset.x, 0.0f, origin.y + offset.y, //position
+            PackPosition(origin.x + offset.x, info.QuadSize), //position
+            PackPosition(origin.y + offset.y, info.QuadSize),
+            0, //height
             PackAuxData(info.IsTrim, GetEdgeData(i), info.Level)
         });
     }
 
     //Index data:
-    for (uint32_t i=0; i<info.VertsPerLine-1; i++)
-    {
-        switch (info.Orientation)
-        {
-            case StripOrientation::Horizontal:
-            {
-                elements.push_back(start_id + 2 * i);
-                elements.push_back(start_id + 2 * i + 2);
-                elements.push_back(start_id + 2 * i + 1);
-
-                elements.push_back(start_id + 2 * i + 1);
-                elements.push_back(start_id + 2 * i + 2);
-                elements.push_back(start_id + 2 * i + 3);
-
-                break;
-            }
-            case StripOrientation::Vertical:
-            {
-                elements.push_back(start_id + 2*i);
-                elements.push_back(start_id + 2*i + 1);
-                elements.push_back(start_id + 2*i + 2);
-
-                elements.push_back(start_id + 2*i + 1);
-                elements.push_back(start_id + 2*i + 3);
-                elements.push_back(start_id + 2*i + 2);
-
-                break;
-            }
-        }
-    }
+    PushStripIndices(elements, start_id, info.VertsPerLine, info.Orientation);
 }
 
 Clipmap::~Clipmap()
@@ -305,6 +393,11 @@ Clipmap::~Clipmap()
     glDeleteBuffers(1, &m_EBO);
 
     glDeleteBuffers(1, &m_UBO);
+    glDeleteBuffers(1, &m_IndirectBuffer);
+
+    glDeleteTextures(1, &m_HeightCache);
+    glDeleteBuffers(1, &m_RectBuffer);
+    glDeleteBuffers(1, &m_DispatchBuffer);
 }
 
 void Clipmap::Init(uint32_t subdivisions, uint32_t levels)
@@ -312,6 +405,8 @@ void Clipmap::Init(uint32_t subdivisions, uint32_t levels)
     if (subdivisions == 0 || levels == 0)
         return;
 
+    levels = std::min(levels, ClipmapMaxLevels);
+
     m_BaseQuadSize = m_BaseGridSize / static_cast<float>(subdivisions);
     m_VertsPerLine = subdivisions + 1;
     m_Levels = levels;
@@ -352,6 +447,9 @@ void Clipmap::Init(uint32_t subdivisions, uint32_t levels)
         GenerateTrims(lvl, getGridSize(lvl), getQuadSize(lvl));
     }
 
+    ResetOcclusion();
+    SyncGridBatch();
+
     //Setup UBO data. Store only quad sizes for each level:
     for (uint32_t lvl = 0; lvl < levels; lvl++)
     {
@@ -375,14 +473,19 @@ void Clipmap::Init(uint32_t subdivisions, uint32_t levels)
     std::vector<float>().swap(m_UBOData);
 }
 
-void Clipmap::GenerateGrids(uint32_t level, float grid_size, float quad_size)
-{
-    //Center positions of particular grids within a level (single ring of the clipmap)
-    std::vector<glm::vec2> centers;
+//Layout of grids within a single ring of the clipmap
+struct RingLayout {
+    //Center positions of particular grids within a level
+    std::vector<glm::vec2> Centers;
     //Additional offsets
-    std::vector<glm::vec2> offsets;
+    std::vector<glm::vec2> Offsets;
     //Edge flags
-    std::vector<GridPosFlag> pos_flags;
+    std::vector<GridPosFlag> PosFlags;
+};
+
+static RingLayout GetRingLayout(uint32_t level)
+{
+    RingLayout layout;
 
     const glm::vec2 top_left{ 0.0f, 1.0f };
     const glm::vec2 top_right{ 1.0f, 1.0f };
@@ -391,33 +494,40 @@ void Clipmap::GenerateGrids(uint32_t level, float grid_size, float quad_size)
 
     if (level == 0)
     {
-        centers = { {-0.5f, 0.5f}, {0.5f, 0.5f},
-                    {-0.5f,-0.5f}, {0.5f,-0.5f} };
+        layout.Centers = { {-0.5f, 0.5f}, {0.5f, 0.5f},
+                           {-0.5f,-0.5f}, {0.5f,-0.5f} };
 
-        offsets = { top_left, top_right,
-                   bot_left, bot_right };
+        layout.Offsets = { top_left, top_right,
+                           bot_left, bot_right };
 
-        pos_flags = {LeftTop, RightTop,
-                      LeftBot, RightBot};
+        layout.PosFlags = { LeftTop, RightTop,
+                            LeftBot, RightBot };
     }
 
     else
     {
-        centers = { {-1.5f, 1.5f}, {-0.5f, 1.5f}, { 0.5f, 1.5f}, { 1.5f, 1.5f},
-                    {-1.5f, 0.5f},                               { 1.5f, 0.5f},
-                    {-1.5f,-0.5f},                               { 1.5f,-0.5f},
-                    {-1.5f,-1.5f}, {-0.5f,-1.5f}, { 0.5f,-1.5f}, { 1.5f,-1.5f} };
+        layout.Centers = { {-1.5f, 1.5f}, {-0.5f, 1.5f}, { 0.5f, 1.5f}, { 1.5f, 1.5f},
+                           {-1.5f, 0.5f},                               { 1.5f, 0.5f},
+                           {-1.5f,-0.5f},                               { 1.5f,-0.5f},
+                           {-1.5f,-1.5f}, {-0.5f,-1.5f}, { 0.5f,-1.5f}, { 1.5f,-1.5f} };
+
+        layout.Offsets = { top_left, top_left, top_right, top_right,
+                           top_left,                      top_right,
+                           bot_left,                      bot_right,
+                           bot_left, bot_left, bot_right, bot_right };
+
+        layout.PosFlags = { LeftTop, Top,    Top,    RightTop,
+                            Left,                    Right,
+                            Left,                    Right,
+                            LeftBot, Bottom, Bottom, RightBot };
+    }
 
-        offsets = { top_left, top_left, top_right, top_right,
-                    top_left,                      top_right,
-                    bot_left,                      bot_right,
-                    bot_left, bot_left, bot_right, bot_right };
+    return layout;
+}
 
-        pos_flags = { LeftTop, Top,    Top,    RightTop,
-                      Left,                    Right,
-                      Left,                    Right,
-                      LeftBot, Bottom, Bottom, RightBot};
-    }
+void Clipmap::GenerateGrids(uint32_t level, float grid_size, float quad_size)
+{
+    const auto [centers, offsets, pos_flags] = GetRingLayout(level);
 
     for (size_t i = 0; i < centers.size(); i++)
     {
@@ -431,12 +541,9 @@ void Clipmap::GenerateGrids(uint32_t level, float grid_size, float quad_size)
         m_Grids.emplace_back();
         GenerateGrid(m_VertexData, m_IndexData, m_Grids.back(), grid_info);
 
-        //Bounding box parameters
-        const float bb_center_height = 0.45f;
-        const float bb_vertical_extents = 0.55f;
-
-        const glm::vec3 center{ center_pos.x, bb_center_height, center_pos.y };
-        const glm::vec3 extents{ 0.5f * grid_size, bb_vertical_extents, 0.5f * grid_size };
+        //Vertical extents are refined in UpdateBounds
+        const glm::vec3 center{ center_pos.x, DefaultBoundsCenter, center_pos.y };
+        const glm::vec3 extents{ 0.5f * grid_size, DefaultBoundsExtents, 0.5f * grid_size };
 
         m_Grids.back().BoundingBox.Center = center;
         m_Grids.back().BoundingBox.Extents = extents;
@@ -519,10 +626,10 @@ void Clipmap::GenGLBuffers()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * m_IndexData.size(),
                  &m_IndexData[0], GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ClipmapVertex), (void*)(offsetof(ClipmapVertex, PosX)));
+    glVertexAttribIPointer(0, 2, GL_SHORT, sizeof(ClipmapVertex), (void*)(offsetof(ClipmapVertex, PosX)));
     glEnableVertexAttribArray(0);
 
-    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(ClipmapVertex), (void*)(offsetof(ClipmapVertex, AuxData)));
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(ClipmapVertex), (void*)(offsetof(ClipmapVertex, AuxData)));
     glEnableVertexAttribArray(1);
 
     //Generate the UBO
@@ -531,6 +638,64 @@ void Clipmap::GenGLBuffers()
     glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
     glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * m_UBOData.size(), &m_UBOData[0], GL_STATIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    //Generate the indirect command buffer, big enough to hold commands for all drawables
+    const size_t max_commands = m_Grids.size() + m_Fills.size() + m_Trims.size();
+
+    m_Commands.reserve(max_commands);
+
+    glGenBuffers(1, &m_IndirectBuffer);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * max_commands,
+                 nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    //Generate the toroidal height cache. It needs to cover all vertices of a level
+    //(up to 2*subdivisions + 2 quads from the camera in each direction),
+    //their seam correction samples and a small margin for rounding
+    m_CacheRes = 4 * static_cast<int>(m_VertsPerLine - 1) + 12;
+
+    glGenTextures(1, &m_HeightCache);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_HeightCache);
+
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32F, m_CacheRes, m_CacheRes, m_Levels);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    m_CachedCenters.resize(m_Levels);
+
+    //Generate buffers used by batched compute dispatches
+    //Rect buffer holds a 2 int header and 6 ints per rect,
+    //there are at most 2 rects per level (new rows and new columns)
+    const size_t max_rects = 2 * m_Levels;
+
+    m_Rects.reserve(max_rects);
+    m_RectData.reserve(2 + 6 * max_rects);
+
+    glGenBuffers(1, &m_RectBuffer);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_RectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(int32_t) * (2 + 6 * max_rects),
+                 nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &m_DispatchBuffer);
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_DispatchBuffer);
+    glBufferData(GL_DISPATCH_INDIRECT_BUFFER, 3 * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    const size_t cache_texels = static_cast<size_t>(m_CacheRes) * m_CacheRes * m_Levels;
+
+    m_GeometryMemory = sizeof(ClipmapVertex) * m_VertexData.size()
+                     + sizeof(uint32_t) * m_IndexData.size()
+                     + sizeof(float) * m_UBOData.size()
+                     + sizeof(DrawElementsIndirectCommand) * max_commands
+                     + sizeof(float) * cache_texels
+                     + sizeof(int32_t) * (2 + 6 * max_rects)
+                     + 3 * sizeof(uint32_t);
 }
 
 uint32_t Clipmap::NumGridsPerLevel(uint32_t level)
@@ -543,70 +708,215 @@ uint32_t Clipmap::MaxGridIDUpTo(uint32_t level)
     return (level == 0) ? 0 : 4 + (level-1) * 12;
 }
 
-bool Clipmap::LevelShouldUpdate(uint32_t level, glm::vec2 curr, glm::vec2 prev) const
+float Clipmap::getQuadSize(uint32_t level) const
 {
-    const float scale = static_cast<float>(std::pow(2, level)) * m_BaseQuadSize;
-
-    glm::vec2 p_offset = prev - glm::mod(prev, scale);
-    glm::vec2 c_offset = curr - glm::mod(curr, scale);
-
-    return (p_offset.x != c_offset.x) || (p_offset.y != c_offset.y);
+    return static_cast<float>(std::pow(2, level)) * m_BaseQuadSize;
 }
 
-void Clipmap::RunCompute(const std::shared_ptr<ComputeShader>& shader, uint32_t binding)
+void Clipmap::UpdateHeights(const std::shared_ptr<ComputeShader>& shader, uint32_t rects_binding,
+                            glm::vec2 camera_pos, bool full_update)
 {
-    glBindVertexArray(m_VAO);
+    const int res = m_CacheRes;
 
-    for (const auto& grid : m_Grids)
+    for (uint32_t level = 0; level < m_Levels; level++)
     {
-        grid.BindBufferRange(m_VBO, binding);
-        shader->Dispatch(grid.VertexCount, 1, 1);
+        //Same snapping as in GetClipmapPos
+        const glm::vec2 scaled = camera_pos / getQuadSize(level);
+        const glm::ivec2 center{ static_cast<int>(std::floor(scaled.x)), static_cast<int>(std::floor(scaled.y)) };
+
+        const glm::ivec2 prev = m_CachedCenters[level];
+        const glm::ivec2 delta = center - prev;
+
+        //Cache window starts here (in world quad coordinates of the level)
+        const glm::ivec2 start = center - res / 2;
+        const glm::ivec2 prev_start = prev - res / 2;
+
+        m_CachedCenters[level] = center;
+
+        if (full_update || !m_CacheValid || std::abs(delta.x) >= res || std::abs(delta.y) >= res)
+        {
+            PushRect(level, start, glm::ivec2(res, res));
+            continue;
+        }
+
+        //Newly exposed columns
+        if (delta.x > 0)
+            PushRect(level, glm::ivec2(prev_start.x + res, start.y), glm::ivec2(delta.x, res));
+        else if (delta.x < 0)
+            PushRect(level, start, glm::ivec2(-delta.x, res));
+
+        //Newly exposed rows
+        if (delta.y > 0)
+            PushRect(level, glm::ivec2(start.x, prev_start.y + res), glm::ivec2(res, delta.y));
+        else if (delta.y < 0)
+            PushRect(level, start, glm::ivec2(res, -delta.y));
     }
 
-    for (const auto& fill : m_Fills)
+    m_CacheValid = true;
+
+    DispatchRects(shader, rects_binding);
+}
+
+void Clipmap::PushRect(uint32_t level, glm::ivec2 origin, glm::ivec2 size)
+{
+    m_Rects.push_back(CacheRect{origin, size, level});
+}
+
+void Clipmap::DispatchRects(const std::shared_ptr<ComputeShader>& shader, uint32_t rects_binding)
+{
+    if (m_Rects.empty())
+        return;
+
+    //Header: number of rects and total number of texels,
+    //then for each rect: origin, width, level, number of texels in preceding rects and padding
+    m_RectData.clear();
+    m_RectData.push_back(static_cast<int32_t>(m_Rects.size()));
+    m_RectData.push_back(0);
+
+    int32_t total = 0;
+
+    for (const auto& rect : m_Rects)
     {
-        fill.BindBufferRange(m_VBO, binding);
-        shader->Dispatch(fill.VertexCount, 1, 1);
+        m_RectData.push_back(rect.Origin.x);
+        m_RectData.push_back(rect.Origin.y);
+        m_RectData.push_back(rect.Size.x);
+        m_RectData.push_back(static_cast<int32_t>(rect.Level));
+        m_RectData.push_back(total);
+        m_RectData.push_back(0);
+
+        total += rect.Size.x * rect.Size.y;
     }
 
-    for (const auto& trim : m_Trims)
+    m_RectData[1] = total;
+
+    const auto size = sizeof(int32_t) * m_RectData.size();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_RectBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, m_RectData.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    const uint32_t local_size = shader->getLocalSizeX();
+    const uint32_t num_texels = static_cast<uint32_t>(total);
+    const uint32_t dispatch[3] = { (num_texels + local_size - 1) / local_size, 1, 1 };
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_DispatchBuffer);
+    glBufferSubData(GL_DISPATCH_INDIRECT_BUFFER, 0, sizeof(dispatch), dispatch);
+
+    glBindImageTexture(0, m_HeightCache, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, rects_binding, m_RectBuffer, 0, size);
+
+    shader->DispatchIndirect();
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    m_Rects.clear();
+}
+
+void Clipmap::BindHeightCache(int id) const
+{
+    glActiveTexture(GL_TEXTURE0 + id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_HeightCache);
+}
+
+void Clipmap::UpdateBounds(const MapGenerator& map, glm::vec2 camera_pos, float margin_y)
+{
+    for (uint32_t level = 0; level < m_Levels; level++)
     {
-        trim.BindBufferRange(m_VBO, binding);
-        shader->Dispatch(trim.VertexCount, 1, 1);
+        const float quad_size = getQuadSize(level);
+        //Same snapping as in GetClipmapPos
+        const glm::vec2 offset = camera_pos - glm::mod(camera_pos, quad_size);
+
+        const uint32_t first = MaxGridIDUpTo(level);
+
+        for (uint32_t i = first; i < first + NumGridsPerLevel(level); i++)
+            FitBoundsToTerrain(m_Grids[i].BoundingBox, map, offset, quad_size, margin_y);
     }
 
-    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    SyncGridBatch();
 }
 
-void Clipmap::RunCompute(const std::shared_ptr<ComputeShader>& shader, uint32_t binding, glm::vec2 curr, glm::vec2 prev)
+void Clipmap::SyncGridBatch()
 {
-    glBindVertexArray(m_VAO);
+    m_GridBatch.Clear();
+
+    for (const auto& grid : m_Grids)
+        m_GridBatch.Push(grid.BoundingBox);
+}
+
+void Clipmap::UpdateOcclusion(const MapGenerator& map, glm::vec3 camera_pos)
+{
+    ResetOcclusion();
+
+    const auto& pyramid = map.getHeightPyramid();
+
+    if (pyramid.Empty())
+        return;
+
+    const float scale_y = map.getScaleY();
+
+    const glm::vec2 camera_xz{ camera_pos.x, camera_pos.z };
+
+    //Horizon culling assumes that the camera is above the terrain
+    const glm::vec2 camera_uv = map.RenderToUV(camera_xz);
+
+    if (camera_pos.y < 0.5f * scale_y * pyramid.QueryRange(camera_uv, camera_uv).y)
+        return;
+
+    m_HorizonCuller.Reset(camera_pos);
 
     for (uint32_t level = 0; level < m_Levels; level++)
     {
-        if (!LevelShouldUpdate(level, curr, prev))
-            continue;
+        const float quad_size = getQuadSize(level);
+        const glm::vec2 offset = camera_xz - glm::mod(camera_xz, quad_size);
 
-        for (uint32_t i = 0; i < NumGridsPerLevel(level); i++)
+        const uint32_t first = MaxGridIDUpTo(level);
+
+        for (uint32_t i = first; i < first + NumGridsPerLevel(level); i++)
         {
-            auto& grid = m_Grids[MaxGridIDUpTo(level) + i];
+            const auto& aabb = m_Grids[i].BoundingBox;
 
-            grid.BindBufferRange(m_VBO, binding);
-            shader->Dispatch(grid.VertexCount, 1, 1);
-        }
+            const glm::vec2 center = offset + glm::vec2(aabb.Center.x, aabb.Center.z);
+            const glm::vec2 extents{ aabb.Extents.x, aabb.Extents.z };
+
+            const glm::vec2 rect_min = center - extents;
+            const glm::vec2 rect_max = center + extents;
+
+            //Vertices may be shifted by up to one quad (trims, camera snapping)
+            const glm::vec2 margin{ quad_size };
+            const float top = scale_y * (aabb.Center.y + aabb.Extents.y);
 
-        auto& fill = m_Fills[level];
+            m_HorizonCuller.AddOccludee(rect_min - margin, rect_max + margin, top);
 
-        fill.BindBufferRange(m_VBO, binding);
-        shader->Dispatch(fill.VertexCount, 1, 1);
+            //Terrain drawn over each cell is above the minimal height within one quad from it
+            const glm::vec2 cell = (rect_max - rect_min) / static_cast<float>(OccluderCells);
 
-        auto& trim = m_Trims[level];
+            for (uint32_t cy = 0; cy < OccluderCells; cy++)
+            {
+                for (uint32_t cx = 0; cx < OccluderCells; cx++)
+                {
+                    const glm::vec2 cell_min = rect_min + cell * glm::vec2(cx, cy);
+                    const glm::vec2 cell_max = cell_min + cell;
+
+                    const glm::vec2 range = pyramid.QueryRange(map.RenderToUV(cell_min - margin), map.RenderToUV(cell_max + margin));
 
-        trim.BindBufferRange(m_VBO, binding);
-        shader->Dispatch(trim.VertexCount, 1, 1);
+                    m_HorizonCuller.AddOccluder(cell_min, cell_max, 0.5f * scale_y * range.x);
+                }
+            }
+        }
     }
 
-    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    m_HorizonCuller.Resolve();
+
+    //Occludees were added in grid order
+    for (size_t i = 0; i < m_Grids.size(); i++)
+        m_Occluded[i] = static_cast<uint8_t>(m_HorizonCuller.IsOccluded(i));
+}
+
+void Clipmap::ResetOcclusion()
+{
+    m_Occluded.assign(m_Grids.size(), 0);
 }
 
 void Clipmap::BindUBO(uint32_t binding)
@@ -623,56 +933,192 @@ void Clipmap::BindBuffers(uint32_t ubo_binding)
 
 void Clipmap::Draw(const Camera& cam, float scale_y)
 {
-    for (const auto& grid : m_Grids)
-    {
-        if (cam.IsInFrustum(grid.BoundingBox, scale_y))
-            grid.Draw();
-    }
+    Draw(cam, scale_y, m_Levels);
+}
 
-    for (const auto& fill : m_Fills)
-        fill.Draw();
+void Clipmap::Draw(const Camera& cam, float scale_y, uint32_t max_level)
+{
+    PushGrids(cam, scale_y, max_level);
+    PushFills(max_level);
+    PushTrims(max_level);
 
-    for (const auto& trim : m_Trims)
-        trim.Draw();
+    SubmitCommands();
 }
 
-void Clipmap::ImGuiDebugCulling(const Camera& cam, float scale_y, bool& open)
+void Clipmap::PushGrids(const Camera& cam, float scale_y, uint32_t max_level)
 {
-    ImGui::Begin("Frustum culling debug", &open);
+    const uint32_t max_id = MaxGridIDUpTo(std::min(max_level, m_Levels));
 
-    static int max_lvl = m_Levels;
-    ImGui::Columns(2, "###col");
-    ImGuiUtils::ColSliderInt("Max level", &max_lvl, 1, m_Levels);
-	ImGui::Columns(1, "###col");
+    cam.IsInFrustum(m_GridBatch, scale_y, m_VisibleGrids);
 
-    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (uint32_t i = 0; i < max_id; i++)
+    {
+        if (IsVisible(m_VisibleGrids, i) && !IsOccluded(i))
+            m_Commands.push_back(m_Grids[i].getCommand());
+    }
+}
 
-    auto ImToGlm = [](ImVec2 v) {return glm::vec2(v.x, v.y);};
+void Clipmap::PushFills(uint32_t max_level)
+{
+    const uint32_t num_levels = std::min(max_level, m_Levels);
 
-	const glm::vec2 draw_start = ImToGlm(ImGui::GetCursorScreenPos());
-	const glm::vec2 draw_size  = ImToGlm(ImGui::GetContentRegionAvail());
+    for (uint32_t lvl = 0; lvl < num_levels; lvl++)
+        m_Commands.push_back(m_Fills[lvl].getCommand());
+}
 
-    const float clipmap_size = m_BaseGridSize * static_cast<float>(std::pow(2, max_lvl + 1));
+void Clipmap::PushTrims(uint32_t max_level)
+{
+    const uint32_t num_levels = std::min(max_level, m_Levels);
 
-    auto WorldToWindow = [&](glm::vec3 pos){
-        const glm::vec2 pos2{pos.x, pos.z};
-        const glm::vec2 normalized = pos2/clipmap_size + 0.5f;
+    for (uint32_t lvl = 0; lvl < num_levels; lvl++)
+        m_Commands.push_back(m_Trims[lvl].getCommand());
+}
 
-        return draw_start + std::min(draw_size.x, draw_size.y) * normalized;
-    };
+void Clipmap::SubmitCommands()
+{
+    if (m_Commands.empty())
+        return;
 
-    ImGui::BeginChild("CPU Timing", ImVec2(draw_size.x, draw_size.y), true);
+    const auto size = sizeof(DrawElementsIndirectCommand) * m_Commands.size();
 
-    for (int lvl=0; lvl<max_lvl; lvl++)
-    {
-        for (uint32_t i=0; i<NumGridsPerLevel(lvl); i++)
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+    //Orphan the previous contents, so that we don't stall on draws still reading them
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, m_Commands.data());
+
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES,
+        GL_UNSIGNED_INT,
+        nullptr,
+        static_cast<GLsizei>(m_Commands.size()),
+        0
+    );
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    m_Commands.clear();
+}
+
+void Clipmap::BenchmarkCulling(const Camera& cam, float scale_y)
+{
+    //Synthetic boxes scattered around the camera, many more than the clipmap has
+    const size_t num_boxes = 4096;
+    const int iterations = 1000;
+
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> pos_dist(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size_dist(1.0f, 20.0f);
+    std::uniform_real_distribution<float> height_dist(0.0f, 1.0f);
+
+    std::vector<AABB> boxes;
+    AABBBatch batch;
+
+    for (size_t i = 0; i < num_boxes; i++)
+    {
+        const float size = size_dist(gen);
+
+        boxes.push_back(AABB{
+            glm::vec3(pos_dist(gen), height_dist(gen), pos_dist(gen)),
+            glm::vec3(size, 0.5f * height_dist(gen), size)
+        });
+
+        batch.Push(boxes.back());
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    //Visible counts are accumulated, so that the loops can't be optimized away
+    size_t scalar_visible = 0, batch_visible = 0;
+    std::vector<uint32_t> visible;
+
+    const auto scalar_start = Clock::now();
+
+    for (int it = 0; it < iterations; it++)
+        for (const auto& box : boxes)
+            scalar_visible += static_cast<size_t>(cam.IsInFrustum(box, scale_y));
+
+    const auto batch_start = Clock::now();
+
+    for (int it = 0; it < iterations; it++)
+    {
+        cam.IsInFrustum(batch, scale_y, visible);
+
+        for (auto bits : visible)
+            batch_visible += std::bitset<32>(bits).count();
+    }
+
+    const auto batch_end = Clock::now();
+
+    size_t mismatches = 0;
+
+    for (size_t i = 0; i < num_boxes; i++)
+        if (cam.IsInFrustum(boxes[i], scale_y) != IsVisible(visible, i))
+            mismatches++;
+
+    auto ToMicroseconds = [iterations](Clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count() / iterations;
+    };
+
+    const double scalar_time = ToMicroseconds(batch_start - scalar_start);
+    const double batch_time = ToMicroseconds(batch_end - batch_start);
+
+    m_CullingBenchmark = std::to_string(num_boxes) + " boxes, scalar: " + std::to_string(scalar_time)
+                       + "us, batch: " + std::to_string(batch_time)
+                       + "us, speedup: " + std::to_string(scalar_time / std::max(batch_time, 1e-6))
+                       + "x, visible: " + std::to_string(scalar_visible / iterations)
+                       + "/" + std::to_string(batch_visible / iterations)
+                       + ", mismatches: " + std::to_string(mismatches);
+}
+
+void Clipmap::ImGuiDebugCulling(const Camera& cam, float scale_y, bool& open)
+{
+    ImGui::Begin("Frustum culling debug", &open);
+
+    static int max_lvl = m_Levels;
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColSliderInt("Max level", &max_lvl, 1, m_Levels);
+	ImGui::Columns(1, "###col");
+
+    ImGui::TextWrapped("Green - drawn, red - in frustum but occluded by terrain, gray - outside frustum");
+
+    if (ImGuiUtils::ButtonCentered("Benchmark frustum culling"))
+        BenchmarkCulling(cam, scale_y);
+
+    if (!m_CullingBenchmark.empty())
+        ImGui::TextWrapped("%s", m_CullingBenchmark.c_str());
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+    auto ImToGlm = [](ImVec2 v) {return glm::vec2(v.x, v.y);};
+
+	const glm::vec2 draw_start = ImToGlm(ImGui::GetCursorScreenPos());
+	const glm::vec2 draw_size  = ImToGlm(ImGui::GetContentRegionAvail());
+
+    const float clipmap_size = m_BaseGridSize * static_cast<float>(std::pow(2, max_lvl + 1));
+
+    auto WorldToWindow = [&](glm::vec3 pos){
+        const glm::vec2 pos2{pos.x, pos.z};
+        const glm::vec2 normalized = pos2/clipmap_size + 0.5f;
+
+        return draw_start + std::min(draw_size.x, draw_size.y) * normalized;
+    };
+
+    ImGui::BeginChild("CPU Timing", ImVec2(draw_size.x, draw_size.y), true);
+
+    for (int lvl=0; lvl<max_lvl; lvl++)
+    {
+        for (uint32_t i=0; i<NumGridsPerLevel(lvl); i++)
         {
             const auto& grid = m_Grids[MaxGridIDUpTo(lvl) + i];
             const auto& aabb = grid.BoundingBox;
 
             const bool in_frustum = cam.IsInFrustum(aabb, scale_y);
+            const bool occluded = IsOccluded(MaxGridIDUpTo(lvl) + i);
+
+            ImU32 fill_color = IM_COL32(64, 64, 64, 255);
 
-            const ImU32 fill_color = in_frustum ? IM_COL32(100, 250, 100, 255) : IM_COL32(64, 64, 64, 255);
+            if (in_frustum)
+                fill_color = occluded ? IM_COL32(250, 100, 100, 255) : IM_COL32(100, 250, 100, 255);
             const ImU32 border_color = IM_COL32(0,0,0,255);
 
             const glm::vec2 min_pos = WorldToWindow(aabb.Center - aabb.Extents);
@@ -686,4 +1132,538 @@ void Clipmap::ImGuiDebugCulling(const Camera& cam, float scale_y, bool& open)
     ImGui::EndChild();
 
     ImGui::End();
-}
\ No newline at end of file
+}
+static void GenerateGridMesh(std::vector<InstancedClipmapVertex>& verts,
+        std::vector<uint32_t>& elements,
+        Drawable& drawable,
+        uint32_t verts_per_line)
+{
+    const auto n = verts_per_line;
+
+    drawable.IndexCount = 6 * (n - 1) * (n - 1);
+    drawable.InstanceCount = 1;
+    drawable.BaseVertex = static_cast<int>(verts.size());
+    drawable.FirstIndex = static_cast<uint32_t>(elements.size());
+    drawable.BaseInstance = 0;
+    drawable.VertexCount = n * n;
+
+    for (uint32_t i=0; i<n*n; i++)
+    {
+        const uint32_t ix = i % n;
+        const uint32_t iy = i / n;
+
+        uint32_t border = None;
+
+        if (ix == 0)     border |= Left;
+        if (ix == n - 1) border |= Right;
+        if (iy == 0)     border |= Bottom;
+        if (iy == n - 1) border |= Top;
+
+        verts.push_back(InstancedClipmapVertex{
+            static_cast<int16_t>(ix), static_cast<int16_t>(iy),
+            static_cast<uint16_t>(border), 0
+        });
+    }
+
+    PushGridIndices(elements, n);
+}
+
+static void GenerateStripMesh(std::vector<InstancedClipmapVertex>& verts,
+        std::vector<uint32_t>& elements,
+        Drawable& drawable,
+        uint32_t verts_per_line,
+        StripOrientation orientation)
+{
+    const auto vert_count = 2 * verts_per_line;
+    const bool vertical = (orientation == StripOrientation::Vertical);
+
+    drawable.IndexCount = 6 * (verts_per_line - 1);
+    drawable.InstanceCount = 1;
+    drawable.BaseVertex = static_cast<int>(verts.size());
+    drawable.FirstIndex = static_cast<uint32_t>(elements.size());
+    drawable.BaseInstance = 0;
+    drawable.VertexCount = vert_count;
+
+    for (uint32_t i=0; i<vert_count; i++)
+    {
+        int16_t x = static_cast<int16_t>(i/2);
+        int16_t z = static_cast<int16_t>(i%2);
+
+        if (vertical)
+            std::swap(x, z);
+
+        uint32_t border = BorderStrip;
+
+        if (vertical)               border |= BorderVertical;
+        if (i < 2)                  border |= BorderStart;
+        if (i >= vert_count - 2)    border |= BorderEnd;
+
+        verts.push_back(InstancedClipmapVertex{
+            x, z, static_cast<uint16_t>(border), 0
+        });
+    }
+
+    PushStripIndices(elements, 0, verts_per_line, orientation);
+}
+
+InstancedClipmap::~InstancedClipmap()
+{
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_VBO);
+    glDeleteBuffers(1, &m_EBO);
+    glDeleteBuffers(1, &m_InstanceBuffer);
+
+    glDeleteBuffers(1, &m_UBO);
+    glDeleteBuffers(1, &m_IndirectBuffer);
+}
+
+void InstancedClipmap::Init(uint32_t subdivisions, uint32_t levels, bool vertex_pulling)
+{
+    if (subdivisions == 0 || levels == 0)
+        return;
+
+    levels = std::min(levels, ClipmapMaxLevels);
+
+    m_VertexPulling = vertex_pulling;
+    m_BaseQuadSize = m_BaseGridSize / static_cast<float>(subdivisions);
+    m_VertsPerLine = subdivisions + 1;
+    m_Levels = levels;
+
+    auto getGridSize = [this](uint32_t lvl){
+        const float scale = (lvl == 0) ? 2.0f : static_cast<float>(std::pow(2.0f, lvl));
+
+        return scale * m_BaseGridSize;
+    };
+
+    GenerateMeshes();
+
+    for (uint32_t lvl = 0; lvl < levels; lvl++)
+    {
+        GenerateInstances(lvl, getGridSize(lvl), getQuadSize(lvl));
+    }
+
+    //Same ubo layout as in Clipmap
+    for (uint32_t lvl = 0; lvl < levels; lvl++)
+    {
+        m_UBOData.push_back(getQuadSize(lvl));
+        m_UBOData.push_back(0.0f);
+        m_UBOData.push_back(0.0f);
+        m_UBOData.push_back(0.0f);
+    }
+
+    SyncGridBatch();
+
+    GenGLBuffers();
+
+    //Free buffer memory on cpu side
+    std::vector<InstancedClipmapVertex>().swap(m_VertexData);
+    std::vector<uint32_t>().swap(m_IndexData);
+    std::vector<float>().swap(m_UBOData);
+}
+
+float InstancedClipmap::getQuadSize(uint32_t level) const
+{
+    return static_cast<float>(std::pow(2, level)) * m_BaseQuadSize;
+}
+
+void InstancedClipmap::GenerateMeshes()
+{
+    const auto n = m_VertsPerLine;
+
+    //Order of mesh ids used by vertex pulling: grid, fills, trims
+    m_Grids.Id = 0;
+
+    for (uint32_t i = 0; i < 4; i++)
+        m_Fills[i].Id = 1 + i;
+
+    for (uint32_t i = 0; i < 2; i++)
+        m_Trims[i].Id = 5 + i;
+
+    GenerateGridMesh(m_VertexData, m_IndexData, m_Grids.Mesh, n);
+
+    //Fill lengths: 4 grids with 2 overlaps on level zero, single grid otherwise
+    GenerateStripMesh(m_VertexData, m_IndexData, m_Fills[0].Mesh, 4 * n - 2, StripOrientation::Horizontal);
+    GenerateStripMesh(m_VertexData, m_IndexData, m_Fills[1].Mesh, 4 * n - 2, StripOrientation::Vertical);
+    GenerateStripMesh(m_VertexData, m_IndexData, m_Fills[2].Mesh, n, StripOrientation::Horizontal);
+    GenerateStripMesh(m_VertexData, m_IndexData, m_Fills[3].Mesh, n, StripOrientation::Vertical);
+
+    //Trim length: 4 grids -3 because of overlap +1 because corner sticks out +1 because of fill meshes
+    GenerateStripMesh(m_VertexData, m_IndexData, m_Trims[0].Mesh, 4 * n - 1, StripOrientation::Horizontal);
+    GenerateStripMesh(m_VertexData, m_IndexData, m_Trims[1].Mesh, 4 * n - 1, StripOrientation::Vertical);
+}
+
+void InstancedClipmap::GenerateInstances(uint32_t level, float grid_size, float quad_size)
+{
+    auto Instance = [level, quad_size](glm::vec2 origin, bool is_trim, uint32_t flags)
+    {
+        return ClipmapInstance{
+            PackPosition(origin.x, quad_size),
+            PackPosition(origin.y, quad_size),
+            PackAuxData(is_trim, NoEdge, level),
+            static_cast<uint16_t>(flags)
+        };
+    };
+
+    //Grids, level zero grids are twice as large, so they are split into 2x2 canonical grids
+    const auto [centers, offsets, pos_flags] = GetRingLayout(level);
+
+    const uint32_t split = (level == 0) ? 2 : 1;
+    const float sub_size = grid_size / static_cast<float>(split);
+
+    for (size_t i = 0; i < centers.size(); i++)
+    {
+        const glm::vec2 center_pos = grid_size * centers[i] + quad_size * offsets[i];
+        const glm::vec2 origin = center_pos - 0.5f * grid_size;
+
+        for (uint32_t sy = 0; sy < split; sy++)
+        {
+            for (uint32_t sx = 0; sx < split; sx++)
+            {
+                const glm::vec2 sub_origin = origin + sub_size * glm::vec2(sx, sy);
+
+                //Only outer borders of the original grid keep their flags
+                uint32_t flags = None;
+
+                if (sx == 0)         flags |= (pos_flags[i] & Left);
+                if (sx == split - 1) flags |= (pos_flags[i] & Right);
+                if (sy == 0)         flags |= (pos_flags[i] & Bottom);
+                if (sy == split - 1) flags |= (pos_flags[i] & Top);
+
+                m_Grids.Instances.push_back(Instance(sub_origin, false, flags));
+
+                //Vertical extents are refined in UpdateBounds
+                const glm::vec2 center2 = sub_origin + 0.5f * sub_size;
+
+                m_GridBounds.push_back(AABB{
+                    glm::vec3(center2.x, DefaultBoundsCenter, center2.y),
+                    glm::vec3(0.5f * sub_size, DefaultBoundsExtents, 0.5f * sub_size)
+                });
+            }
+        }
+    }
+
+    //Fills, edge flags are set at the end facing the coarser level
+    if (level == 0)
+    {
+        const uint32_t both = BorderStart | BorderEnd;
+
+        m_Fills[0].Instances.push_back(Instance({ -grid_size, 0.0f }, false, both));
+        m_Fills[1].Instances.push_back(Instance({ 0.0f, -grid_size }, false, both));
+    }
+
+    else
+    {
+        const glm::vec2 top{ 0.0f, grid_size + quad_size };
+        const glm::vec2 bottom{ 0.0f, -2.0f * grid_size };
+        const glm::vec2 left{ -2.0f * grid_size, 0.0f };
+        const glm::vec2 right{ grid_size + quad_size, 0.0f };
+
+        m_Fills[2].Instances.push_back(Instance(left, false, BorderStart));
+        m_Fills[2].Instances.push_back(Instance(right, false, BorderEnd));
+        m_Fills[3].Instances.push_back(Instance(top, false, BorderEnd));
+        m_Fills[3].Instances.push_back(Instance(bottom, false, BorderStart));
+    }
+
+    //Trims
+    const float grid_corner = (level == 0) ? grid_size : 2.0f * grid_size;
+
+    const glm::vec2 origin_x{ grid_corner, -grid_corner - quad_size };
+    const glm::vec2 origin_y{ -grid_corner - quad_size, grid_corner };
+
+    m_Trims[0].Instances.push_back(Instance(origin_y, true, None));
+    m_Trims[1].Instances.push_back(Instance(origin_x, true, None));
+}
+
+void InstancedClipmap::FillPulledHeader()
+{
+    auto SetMesh = [this](const InstancedMesh& mesh, PulledMeshType type)
+    {
+        const auto& drawable = mesh.Mesh;
+
+        //Strips have one quad per pair of vertices along their length
+        const uint32_t verts_per_line = (type == PulledMeshType::Grid)
+                                      ? m_VertsPerLine : drawable.IndexCount / 6 + 1;
+
+        m_PulledHeader.Meshes[mesh.Id] = PulledMeshInfo{
+            drawable.FirstIndex, drawable.IndexCount,
+            verts_per_line, static_cast<uint32_t>(type)
+        };
+    };
+
+    SetMesh(m_Grids, PulledMeshType::Grid);
+
+    //Even fills/trims are horizontal, odd ones vertical (see GenerateMeshes)
+    for (uint32_t i = 0; i < 4; i++)
+        SetMesh(m_Fills[i], (i % 2 == 0) ? PulledMeshType::Horizontal : PulledMeshType::Vertical);
+
+    for (uint32_t i = 0; i < 2; i++)
+        SetMesh(m_Trims[i], (i % 2 == 0) ? PulledMeshType::Horizontal : PulledMeshType::Vertical);
+}
+
+void InstancedClipmap::GenGLBuffers()
+{
+    //Instance buffer, big enough to hold all instances, contents are streamed every frame
+    size_t max_instances = m_Grids.Instances.size();
+
+    for (const auto& fill : m_Fills)
+        max_instances += fill.Instances.size();
+
+    for (const auto& trim : m_Trims)
+        max_instances += trim.Instances.size();
+
+    m_FrameInstances.reserve(max_instances);
+
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_InstanceBuffer);
+
+    glBindVertexArray(m_VAO);
+
+    if (m_VertexPulling)
+    {
+        //Vertex array stays empty, everything is fetched from the storage buffer
+        FillPulledHeader();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_InstanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PulledHeader) + sizeof(ClipmapInstance) * max_instances,
+                     nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        m_GeometryMemory = sizeof(PulledHeader) + sizeof(ClipmapInstance) * max_instances;
+    }
+
+    else
+    {
+        //Generate Vertex Buffer + Element Buffer
+        glGenBuffers(1, &m_VBO);
+        glGenBuffers(1, &m_EBO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(InstancedClipmapVertex) * m_VertexData.size(),
+                     &m_VertexData[0], GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * m_IndexData.size(),
+                     &m_IndexData[0], GL_STATIC_DRAW);
+
+        glVertexAttribIPointer(0, 2, GL_SHORT, sizeof(InstancedClipmapVertex), (void*)(offsetof(InstancedClipmapVertex, PosX)));
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(InstancedClipmapVertex), (void*)(offsetof(InstancedClipmapVertex, Border)));
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(ClipmapInstance) * max_instances, nullptr, GL_STREAM_DRAW);
+
+        glVertexAttribIPointer(2, 2, GL_SHORT, sizeof(ClipmapInstance), (void*)(offsetof(ClipmapInstance, OffsetX)));
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(2);
+
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, sizeof(ClipmapInstance), (void*)(offsetof(ClipmapInstance, AuxData)));
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(3);
+
+        glVertexAttribIPointer(4, 1, GL_UNSIGNED_SHORT, sizeof(ClipmapInstance), (void*)(offsetof(ClipmapInstance, Flags)));
+        glVertexAttribDivisor(4, 1);
+        glEnableVertexAttribArray(4);
+
+        m_GeometryMemory = sizeof(InstancedClipmapVertex) * m_VertexData.size()
+                         + sizeof(uint32_t) * m_IndexData.size()
+                         + sizeof(ClipmapInstance) * max_instances;
+    }
+
+    //Generate the UBO
+    glGenBuffers(1, &m_UBO);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * m_UBOData.size(), &m_UBOData[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    //One command per canonical mesh at most
+    const size_t max_commands = 1 + 4 + 2;
+
+    const size_t command_size = m_VertexPulling ? sizeof(DrawArraysIndirectCommand)
+                                                : sizeof(DrawElementsIndirectCommand);
+
+    m_Commands.reserve(max_commands);
+    m_ArrayCommands.reserve(max_commands);
+
+    glGenBuffers(1, &m_IndirectBuffer);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, command_size * max_commands, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    m_GeometryMemory += sizeof(float) * m_UBOData.size() + command_size * max_commands;
+}
+
+void InstancedClipmap::BindBuffers(uint32_t ubo_binding, uint32_t instance_binding)
+{
+    glBindVertexArray(m_VAO);
+
+    if (m_VertexPulling)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, instance_binding, m_InstanceBuffer);
+    else
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, ubo_binding, m_UBO);
+}
+
+void InstancedClipmap::Draw(const Camera& cam, float scale_y)
+{
+    PushGrids(cam, scale_y);
+    PushFills();
+    PushTrims();
+
+    SubmitCommands();
+}
+
+void InstancedClipmap::PushCommand(const InstancedMesh& mesh, size_t first_instance)
+{
+    const size_t count = m_FrameInstances.size() - first_instance;
+
+    if (count == 0)
+        return;
+
+    //gl_InstanceID ignores the base instance, so pulled vertices look up their offset in the header
+    m_PulledHeader.FirstInstances[mesh.Id] = static_cast<uint32_t>(first_instance);
+
+    auto cmd = mesh.Mesh.getCommand();
+    cmd.InstanceCount = static_cast<uint32_t>(count);
+    cmd.BaseInstance = static_cast<uint32_t>(first_instance);
+
+    m_Commands.push_back(cmd);
+}
+
+void InstancedClipmap::UpdateBounds(const MapGenerator& map, glm::vec2 camera_pos, float margin_y)
+{
+    for (size_t i = 0; i < m_Grids.Instances.size(); i++)
+    {
+        const uint32_t level = m_Grids.Instances[i].AuxData >> 3;
+        const float quad_size = getQuadSize(level);
+
+        const glm::vec2 offset = camera_pos - glm::mod(camera_pos, quad_size);
+
+        FitBoundsToTerrain(m_GridBounds[i], map, offset, quad_size, margin_y);
+    }
+
+    SyncGridBatch();
+}
+
+void InstancedClipmap::SyncGridBatch()
+{
+    m_GridBatch.Clear();
+
+    for (const auto& aabb : m_GridBounds)
+        m_GridBatch.Push(aabb);
+}
+
+void InstancedClipmap::PushGrids(const Camera& cam, float scale_y)
+{
+    const size_t first = m_FrameInstances.size();
+
+    cam.IsInFrustum(m_GridBatch, scale_y, m_VisibleGrids);
+
+    for (size_t i = 0; i < m_Grids.Instances.size(); i++)
+    {
+        if (IsVisible(m_VisibleGrids, i))
+            m_FrameInstances.push_back(m_Grids.Instances[i]);
+    }
+
+    PushCommand(m_Grids, first);
+}
+
+void InstancedClipmap::PushFills()
+{
+    for (const auto& fill : m_Fills)
+    {
+        const size_t first = m_FrameInstances.size();
+
+        m_FrameInstances.insert(m_FrameInstances.end(), fill.Instances.begin(), fill.Instances.end());
+        PushCommand(fill, first);
+    }
+}
+
+void InstancedClipmap::PushTrims()
+{
+    for (const auto& trim : m_Trims)
+    {
+        const size_t first = m_FrameInstances.size();
+
+        m_FrameInstances.insert(m_FrameInstances.end(), trim.Instances.begin(), trim.Instances.end());
+        PushCommand(trim, first);
+    }
+}
+
+void InstancedClipmap::SubmitCommands()
+{
+    if (m_Commands.empty())
+    {
+        m_FrameInstances.clear();
+        return;
+    }
+
+    if (m_VertexPulling)
+    {
+        SubmitPulledCommands();
+        return;
+    }
+
+    const auto instance_size = sizeof(ClipmapInstance) * m_FrameInstances.size();
+    const auto command_size = sizeof(DrawElementsIndirectCommand) * m_Commands.size();
+
+    //Orphan the previous contents, so that we don't stall on draws still reading them
+    glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instance_size, m_FrameInstances.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, command_size, m_Commands.data(), GL_STREAM_DRAW);
+
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES,
+        GL_UNSIGNED_INT,
+        nullptr,
+        static_cast<GLsizei>(m_Commands.size()),
+        0
+    );
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    m_Commands.clear();
+    m_FrameInstances.clear();
+}
+
+void InstancedClipmap::SubmitPulledCommands()
+{
+    const auto header_size = sizeof(PulledHeader);
+    const auto instance_size = sizeof(ClipmapInstance) * m_FrameInstances.size();
+
+    //Index ranges of the canonical meshes become ranges of gl_VertexID
+    for (const auto& cmd : m_Commands)
+        m_ArrayCommands.push_back(DrawArraysIndirectCommand{cmd.Count, cmd.InstanceCount, cmd.FirstIndex, 0});
+
+    const auto command_size = sizeof(DrawArraysIndirectCommand) * m_ArrayCommands.size();
+
+    //Orphan the previous contents, the indexed binding refers to the buffer object so it stays valid
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_InstanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, header_size + instance_size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, header_size, &m_PulledHeader);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, header_size, instance_size, m_FrameInstances.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, command_size, m_ArrayCommands.data(), GL_STREAM_DRAW);
+
+    glMultiDrawArraysIndirect(
+        GL_TRIANGLES,
+        nullptr,
+        static_cast<GLsizei>(m_ArrayCommands.size()),
+        0
+    );
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    m_Commands.clear();
+    m_ArrayCommands.clear();
+    m_FrameInstances.clear();
+}
@@ -8,16 +8,44 @@
 #include "Camera.h"
 #include "ResourceManager.h"
 #include "MapGenerator.h"
+#include "HorizonCuller.h"
 
 #include <cstdint>
+#include <string>
 
+//Needs to match MAX_LEVELS in the clipmap shaders
+static constexpr uint32_t ClipmapMaxLevels = 16;
+
+//Packed 8 byte vertex
 struct ClipmapVertex {
-    float PosX, PosY, PosZ;
+    //Position in units of the quad size of vertex's lod level
+    int16_t PosX, PosZ;
+    //Heights are fetched from the toroidal height cache, see Clipmap::UpdateHeights
+    uint16_t Padding;
     //Aux Data contains:
     //trim flag - 1 bit
     //edge flag - 2 bits
     //lod level - the rest
-    uint32_t AuxData;
+    uint16_t AuxData;
+};
+
+static_assert(sizeof(ClipmapVertex) == 8, "Clipmap vertex is expected to be tightly packed");
+
+//Layout mandated by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    uint32_t Count;
+    uint32_t InstanceCount;
+    uint32_t FirstIndex;
+    int      BaseVertex;
+    uint32_t BaseInstance;
+};
+
+//Layout mandated by glMultiDrawArraysIndirect
+struct DrawArraysIndirectCommand {
+    uint32_t Count;
+    uint32_t InstanceCount;
+    uint32_t First;
+    uint32_t BaseInstance;
 };
 
 class Drawable{
@@ -33,6 +61,8 @@ public:
     void Draw() const;
 
     void BindBufferRange(uint32_t vertex_buffer, uint32_t binding) const;
+
+    DrawElementsIndirectCommand getCommand() const;
 };
 
 class DrawableWithBounding : public Drawable{
@@ -50,29 +80,59 @@ public:
     const std::vector<Drawable>& getTrims() const { return m_Trims; }
     const std::vector<Drawable>& getFills() const { return m_Fills; }
 
+    uint32_t getLevels() const { return m_Levels; }
+    float getQuadSize(uint32_t level) const;
+
+    //Bytes of gpu memory taken by vertices, indices, the height cache and draw buffers
+    size_t getGeometryMemory() const { return m_GeometryMemory; }
+
     //Binds Uniform Buffer Object with data needed for drawing
     void BindUBO(uint32_t binding);
 
     //Binds both vertex/element buffers and the ubo
     void BindBuffers(uint32_t ubo_binding);
 
-    //Dispatches the compute shader for all grids/fills of the clipmap
-    //Each time the shader is dispatched with (VertexCount, 1, 1) invocations
-    //Binding is forwarded as glBindBufferBase argument for vertex buffer
-    void RunCompute(const std::shared_ptr<ComputeShader>& shader, uint32_t binding);
+    //Updates the toroidal height cache, which stores unscaled heights at all vertices
+    //of each level's quad grid, addressed by world quad coordinates modulo cache resolution.
+    //Only texels that became visible since the last update are resampled by the compute shader,
+    //so the cost scales with camera speed. Full update resamples every level.
+    //All work is batched into a single indirect dispatch over a list of texel rectangles,
+    //rects_binding is forwarded as glBindBufferBase argument for that list.
+    void UpdateHeights(const std::shared_ptr<ComputeShader>& shader, uint32_t rects_binding,
+                       glm::vec2 camera_pos, bool full_update);
+
+    void BindHeightCache(int id) const;
 
-    //Conditionally runs the compute shader, for those grids/fill that should be updated
-    //afted a change in the camera position.
-    //Each time the shader is dispatched with (VertexCount, 1, 1) invocations
-    //Binding is forwarded as glBindBufferBase argument for vertex buffer
-    void RunCompute(const std::shared_ptr<ComputeShader>& shader, uint32_t binding, glm::vec2 curr, glm::vec2 prev);
+    //Fits vertical extents of grid bounding boxes to the terrain currently under them,
+    //using the min/max height pyramid. Meant to be called every frame before culling.
+    //Margin_y is added on both sides, in the same units as the bounding boxes (before scale_y)
+    void UpdateBounds(const MapGenerator& map, glm::vec2 camera_pos, float margin_y = 0.0f);
 
-    //Calls draw function on all grids/fills, using frustum culling
+    //Culls grids hidden behind terrain closer to the camera (see HorizonCuller).
+    //Uses bounding boxes from UpdateBounds, so it needs to be called after it.
+    void UpdateOcclusion(const MapGenerator& map, glm::vec3 camera_pos);
+    //Marks all grids as not occluded
+    void ResetOcclusion();
+
+    bool IsOccluded(uint32_t grid_id) const { return m_Occluded[grid_id] != 0; }
+
+    //Draws all grids/fills/trims, using frustum and occlusion culling
+    //Everything is submitted with a single multi draw indirect call
     void Draw(const Camera& cam, float scale_y);
 
-    void ImGuiDebugCulling(const Camera& cam, float scale_y, bool& open);
+    //Same as above, but only draws levels below max_level
+    void Draw(const Camera& cam, float scale_y, uint32_t max_level);
 
-    bool LevelShouldUpdate(uint32_t level, glm::vec2 curr, glm::vec2 prev) const;
+    //Lower level interface for building the indirect command list
+    //Push functions only append commands for levels below max_level,
+    //SubmitCommands issues them in one draw call and clears the list.
+    //Assumes buffers are already bound with BindBuffers
+    void PushGrids(const Camera& cam, float scale_y, uint32_t max_level);
+    void PushFills(uint32_t max_level);
+    void PushTrims(uint32_t max_level);
+    void SubmitCommands();
+
+    void ImGuiDebugCulling(const Camera& cam, float scale_y, bool& open);
 
     static uint32_t NumGridsPerLevel(uint32_t level);
     static uint32_t MaxGridIDUpTo(uint32_t level);
@@ -84,7 +144,18 @@ private:
 
     void GenGLBuffers();
 
-    uint32_t m_Levels;
+    //Copies grid bounding boxes into m_GridBatch
+    void SyncGridBatch();
+
+    void BenchmarkCulling(const Camera& cam, float scale_y);
+
+    //Appends a rectangle of cache texels (in world quad coordinates of the level) to be resampled
+    void PushRect(uint32_t level, glm::ivec2 origin, glm::ivec2 size);
+
+    //Uploads the rectangle list and processes all rectangles with a single indirect dispatch
+    void DispatchRects(const std::shared_ptr<ComputeShader>& shader, uint32_t rects_binding);
+
+    uint32_t m_Levels = 0;
     uint32_t m_VertsPerLine;
     float m_BaseGridSize = 4.0f;
     float m_BaseQuadSize;
@@ -95,9 +166,179 @@ private:
     //GL handles:
     uint32_t m_VAO = 0, m_VBO = 0, m_EBO = 0;
     uint32_t m_UBO = 0;
+    uint32_t m_IndirectBuffer = 0;
+
+    //Draw commands collected for the next submission
+    std::vector<DrawElementsIndirectCommand> m_Commands;
+
+    //Grid bounding boxes in soa layout for batch frustum culling, and culling results
+    AABBBatch m_GridBatch;
+    std::vector<uint32_t> m_VisibleGrids;
+
+    //Benchmark of scalar vs batch frustum culling, displayed in the debug window
+    std::string m_CullingBenchmark;
+
+    //Occlusion culling results, one entry per grid
+    HorizonCuller m_HorizonCuller;
+    std::vector<uint8_t> m_Occluded;
+
+    //Each grid is split into OccluderCells x OccluderCells occluders
+    static constexpr uint32_t OccluderCells = 4;
+
+    //Toroidal height cache, one layer per level
+    uint32_t m_HeightCache = 0;
+    int m_CacheRes = 0;
+
+    //Camera position (in quads of each level) at the last cache update
+    std::vector<glm::ivec2> m_CachedCenters;
+    bool m_CacheValid = false;
+
+    //Cache rectangles collected for the next compute dispatch
+    struct CacheRect {
+        glm::ivec2 Origin, Size;
+        uint32_t Level;
+    };
+
+    std::vector<CacheRect> m_Rects;
+    std::vector<int32_t> m_RectData;
+
+    uint32_t m_RectBuffer = 0, m_DispatchBuffer = 0;
+
+    size_t m_GeometryMemory = 0;
 
     //Temp GL Buffer data:
     std::vector<ClipmapVertex> m_VertexData;
     std::vector<uint32_t> m_IndexData;
     std::vector<float> m_UBOData;
 };
+
+//Vertex of one of the canonical meshes used by the instanced clipmap
+struct InstancedClipmapVertex {
+    //Position in quads, local to the mesh
+    int16_t PosX, PosZ;
+    //Which borders of the mesh the vertex lies on (BorderFlags in Clipmap.cpp)
+    uint16_t Border;
+    uint16_t Padding;
+};
+
+//Per-instance data of the instanced clipmap
+struct ClipmapInstance {
+    //Offset in units of the quad size of instance's lod level
+    int16_t OffsetX, OffsetZ;
+    //Same layout as ClipmapVertex::AuxData, edge bits are unused
+    uint16_t AuxData;
+    //GridPosFlag for grids, edge start/end flags for strips
+    uint16_t Flags;
+};
+
+//Describes one canonical mesh for vertex pulling, mirrors PulledMesh in clipmap_pulled.glsl
+struct PulledMeshInfo {
+    //Range of gl_VertexID covered by the mesh, 6 vertices per quad
+    uint32_t First, Count;
+    uint32_t VertsPerLine;
+    //0 - grid, 1 - horizontal strip, 2 - vertical strip
+    uint32_t Type;
+};
+
+//Header of the vertex pulling storage buffer, followed by the instance array
+struct PulledHeader {
+    PulledMeshInfo Meshes[7];
+    //Index of the first instance of each mesh in the current submission
+    uint32_t FirstInstances[7];
+    uint32_t Padding;
+};
+
+static_assert(sizeof(PulledHeader) == 144, "Pulled header needs to match the std430 layout");
+
+//Clipmap variant where all grids share one canonical mesh and all strips
+//share a few canonical strip meshes. They are drawn instanced, with heights
+//sampled from the heightmap in the vertex shader, so no displacement pass is needed.
+//With vertex pulling there are no vertex/index buffers at all. Vertices of the canonical
+//meshes are reconstructed from gl_VertexID and instances are read from a storage buffer.
+class InstancedClipmap {
+public:
+    ~InstancedClipmap();
+
+    void Init(uint32_t subdivisions, uint32_t levels, bool vertex_pulling = false);
+
+    uint32_t getLevels() const { return m_Levels; }
+    float getQuadSize(uint32_t level) const;
+    bool UsesVertexPulling() const { return m_VertexPulling; }
+
+    //Bytes of gpu memory taken by vertices, indices, instances and draw buffers
+    size_t getGeometryMemory() const { return m_GeometryMemory; }
+
+    //Binds vertex array, element buffer and the ubo
+    //With vertex pulling the instance buffer is bound to instance_binding instead
+    void BindBuffers(uint32_t ubo_binding, uint32_t instance_binding = 0);
+
+    //Draws all grids/fills/trims, using frustum culling
+    //Everything is submitted with a single multi draw indirect call
+    void Draw(const Camera& cam, float scale_y);
+
+    //Same as in Clipmap
+    void UpdateBounds(const MapGenerator& map, glm::vec2 camera_pos, float margin_y = 0.0f);
+
+    //Same interface as in Clipmap, each push appends one command per canonical mesh
+    void PushGrids(const Camera& cam, float scale_y);
+    void PushFills();
+    void PushTrims();
+    void SubmitCommands();
+
+private:
+    struct InstancedMesh {
+        //Index into PulledHeader::Meshes
+        uint32_t Id;
+        Drawable Mesh;
+        std::vector<ClipmapInstance> Instances;
+    };
+
+    void GenerateMeshes();
+    void SyncGridBatch();
+    void GenerateInstances(uint32_t level, float grid_size, float quad_size);
+
+    //Appends a command drawing all instances added since first_instance with the given mesh
+    void PushCommand(const InstancedMesh& mesh, size_t first_instance);
+
+    void GenGLBuffers();
+    void FillPulledHeader();
+
+    void SubmitPulledCommands();
+
+    uint32_t m_Levels = 0;
+    uint32_t m_VertsPerLine;
+    float m_BaseGridSize = 4.0f;
+    float m_BaseQuadSize;
+
+    //Grid instances are frustum culled every frame, bounds are stored in the same order
+    InstancedMesh m_Grids;
+    std::vector<AABB> m_GridBounds;
+    AABBBatch m_GridBatch;
+    std::vector<uint32_t> m_VisibleGrids;
+
+    //Fills: level zero horizontal/vertical, other levels horizontal/vertical
+    //Trims: horizontal/vertical
+    InstancedMesh m_Fills[4], m_Trims[2];
+
+    //GL handles:
+    uint32_t m_VAO = 0, m_VBO = 0, m_EBO = 0;
+    uint32_t m_InstanceBuffer = 0;
+    uint32_t m_UBO = 0;
+    uint32_t m_IndirectBuffer = 0;
+
+    //Data collected for the next submission
+    std::vector<DrawElementsIndirectCommand> m_Commands;
+    std::vector<ClipmapInstance> m_FrameInstances;
+
+    //Vertex pulling, commands reuse index ranges of the canonical meshes as vertex ranges
+    bool m_VertexPulling = false;
+    PulledHeader m_PulledHeader{};
+    std::vector<DrawArraysIndirectCommand> m_ArrayCommands;
+
+    size_t m_GeometryMemory = 0;
+
+    //Temp GL Buffer data:
+    std::vector<InstancedClipmapVertex> m_VertexData;
+    std::vector<uint32_t> m_IndexData;
+    std::vector<float> m_UBOData;
+};
@@ -18,6 +18,8 @@ public:
 
     virtual void ProvideDefaultData(std::vector<InstanceData>& data) = 0;
     virtual void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) = 0;
+
+    virtual const std::string& getUniformName() const = 0;
 };
 
 class ConstIntTask : public EditorTask {
@@ -30,6 +32,8 @@ public:
     void ProvideDefaultData(std::vector<InstanceData>& data) override;
     void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) override;
 
+    const std::string& getUniformName() const override { return UniformName; }
+
     std::string UniformName;
     const int Value;
 };
@@ -44,6 +48,8 @@ public:
     void ProvideDefaultData(std::vector<InstanceData>& data) override;
     void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) override;
 
+    const std::string& getUniformName() const override { return UniformName; }
+
     std::string UniformName;
     const float Value;
 };
@@ -61,6 +67,8 @@ public:
     void ProvideDefaultData(std::vector<InstanceData>& data) override;
     void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) override;
 
+    const std::string& getUniformName() const override { return UniformName; }
+
     std::string UniformName, UiName;
     int Min, Max, Def;
 };
@@ -78,6 +86,8 @@ public:
     void ProvideDefaultData(std::vector<InstanceData>& data) override;
     void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) override;
 
+    const std::string& getUniformName() const override { return UniformName; }
+
     std::string UniformName, UiName;
     float Min, Max, Def;
 };
@@ -95,6 +105,8 @@ public:
     void ProvideDefaultData(std::vector<InstanceData>& data) override;
     void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) override;
 
+    const std::string& getUniformName() const override { return UniformName; }
+
     std::string UniformName, UiName;
     glm::vec3 Def;
 };
@@ -112,6 +124,8 @@ public:
     void ProvideDefaultData(std::vector<InstanceData>& data) override;
     void ProvideData(std::vector<InstanceData>& data, nlohmann::ordered_json& input) override;
 
+    const std::string& getUniformName() const override { return UniformName; }
+
     std::string UniformName, UiName;
     std::vector<std::string> Labels;
 };
\ No newline at end of file
@@ -33,7 +33,7 @@ GrassRenderer::GrassRenderer(ResourceManager& manager, const PerspectiveCamera&
 
 void GrassRenderer::Init()
 {
-	m_Clipmap.Init(32, 5);
+	m_Clipmap.Init(m_ClipmapSubdivisions, m_ClipmapLevels);
 
 	m_RaycastResult->Initialize(Texture3DSpec{
 		128, 128, 16,
@@ -127,23 +127,19 @@ void GrassRenderer::UpdateGeometry()
 	const glm::vec2 curr{ m_Camera.getPos().x, m_Camera.getPos().z };
 
 	m_DisplaceShader->Bind();
-	m_DisplaceShader->setUniform2f("uPos", curr);
 	m_DisplaceShader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
-	m_DisplaceShader->setUniform1f("uScaleY", m_Map.getScaleY());
+	m_DisplaceShader->setUniform2f("uOriginUV", m_Map.getOriginUV());
+	m_Map.BindVirtualHeightmap(*m_DisplaceShader, 1, 2);
 
     m_Clipmap.BindUBO(m_UBOBinding);
+	m_Clipmap.UpdateHeights(m_DisplaceShader, m_RectBinding, curr, m_UpdateAllLevels);
 
-	if (m_UpdateAllLevels)
-	{
-		m_Clipmap.RunCompute(m_DisplaceShader, m_VertBinding);
-	}
-
-	else
-	{
-		const glm::vec2 prev{ m_Camera.getPrevPos().x, m_Camera.getPrevPos().z };
+	//Blades stick out of the terrain by grass height, bounds are scaled by scale_y during culling
+	const float scale_y = m_Map.getScaleY();
+	const float margin_y = (scale_y > 0.0f) ? m_GrassHeight / scale_y : 0.0f;
 
-		m_Clipmap.RunCompute(m_DisplaceShader, m_VertBinding, curr, prev);
-	}
+	m_Clipmap.UpdateBounds(m_Map, curr, margin_y);
+	m_Clipmap.UpdateOcclusion(m_Map, m_Camera.getPos());
 
 	m_UpdateAllLevels = false;
 }
@@ -153,6 +149,20 @@ void GrassRenderer::RequestGeometryUpdate()
 	m_UpdateAllLevels = true;
 }
 
+double GrassRenderer::getOriginGranularity() const
+{
+	//Trims are mirrored depending on parity of the snapped position, hence the factor of two
+	return 2.0 * static_cast<double>(m_Clipmap.getQuadSize(m_ClipmapLevels - 1));
+}
+
+//Fractional part of tiling * origin, evaluated in double since the origin may be far away
+static glm::vec2 TilingPhase(float tiling, glm::dvec3 origin)
+{
+	const glm::dvec2 scaled = static_cast<double>(tiling) * glm::dvec2(origin.x, origin.z);
+
+	return glm::vec2(scaled - glm::floor(scaled));
+}
+
 void GrassRenderer::OnImGui(bool& open)
 {
 	ImGui::SetNextWindowSize(ImVec2(300.0f, 600.0f), ImGuiCond_FirstUseEver);
@@ -243,6 +253,8 @@ void GrassRenderer::Render()
 
 	m_PresentShader->Bind();
 	m_PresentShader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
+	m_PresentShader->setUniform2f("uOriginUV", m_Map.getOriginUV());
+	m_PresentShader->setUniform1f("uScaleY", m_Map.getScaleY());
 	m_PresentShader->setUniform3f("uPos", m_Camera.getPos());
 	m_PresentShader->setUniformMatrix4fv("uMVP", mvp);
 
@@ -256,6 +268,8 @@ void GrassRenderer::Render()
 
 	m_PresentShader->setUniform1f("uGrassHeight", m_GrassHeight);
 	m_PresentShader->setUniform1f("uTilingFactor", m_Tiling);
+	m_PresentShader->setUniform2f("uTilingOffset", TilingPhase(m_Tiling, m_Camera.getOrigin()));
+	m_PresentShader->setUniform2f("uNoiseOffset", TilingPhase(m_NoiseTiling, m_Camera.getOrigin()));
 	m_PresentShader->setUniform1f("uTime", m_Time);
 	m_PresentShader->setUniform2f("uScrollVel", m_ScrollingVelocity.x, m_ScrollingVelocity.y);
 	m_PresentShader->setUniform1f("uNoiseTiling", m_NoiseTiling);
@@ -274,8 +288,7 @@ void GrassRenderer::Render()
 	m_PresentShader->setUniformSampler2D("noise", 1);
 
 
-	m_Map.BindNormalmap(2);
-	m_PresentShader->setUniformSampler2D("normalmap", 2);
+	m_Map.BindNormalmap(*m_PresentShader, 2, 7);
 	m_Map.BindShadowmap(3);
 	m_PresentShader->setUniformSampler2D("shadowmap", 3);
 
@@ -284,27 +297,12 @@ void GrassRenderer::Render()
 	m_Sky.BindPrefiltered(5);
 	m_PresentShader->setUniformSamplerCube("prefiltered", 5);
 
+	m_Clipmap.BindHeightCache(6);
+	m_PresentShader->setUniformSampler2DArray("heightCache", 6);
+
 	auto scale_y = m_Map.getScaleY();
 
     m_Clipmap.BindBuffers(m_UBOBinding);
 
-	for (uint32_t i=0; i<m_Clipmap.MaxGridIDUpTo(m_LodLevels); i++)
-	{
-		const auto& grid = m_Clipmap.getGrids()[i];
-
-		if (m_Camera.IsInFrustum(grid.BoundingBox, scale_y))
-			grid.Draw();
-	}
-
-	for (int i = 0; i < m_LodLevels; i++)
-	{
-		const auto& fill = m_Clipmap.getFills()[i];
-		fill.Draw();
-	}
-
-	for (int i = 0; i < m_LodLevels; i++)
-	{
-		const auto& trim = m_Clipmap.getTrims()[i];
-		trim.Draw();
-	}
+	m_Clipmap.Draw(m_Camera, scale_y, static_cast<uint32_t>(m_LodLevels));
 }
\ No newline at end of file
@@ -25,6 +25,10 @@ public:
 	void Render();
 	void RequestGeometryUpdate();
 
+	//Shifting the render origin by multiples of this keeps all grass clipmap levels
+	//snapped to the same world positions
+	double getOriginGranularity() const;
+
 private:
 	void UpdateRaycast();
 	void UpdateNoise();
@@ -91,9 +95,11 @@ private:
 	std::shared_ptr<VertFragShader> m_PresentShader;
 
 	//Binding ids for shader buffers
-	static constexpr uint32_t m_VertBinding = 1;
     //static constexpr uint32_t m_SSBOBinding = 2;
     static constexpr uint32_t m_UBOBinding = 2;
+    static constexpr uint32_t m_RectBinding = 3;
+
+	static constexpr uint32_t m_ClipmapSubdivisions = 32, m_ClipmapLevels = 5;
 
 	Clipmap m_Clipmap;
 	bool m_UpdateAllLevels = true;
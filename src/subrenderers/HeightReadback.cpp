@@ -0,0 +1,262 @@
+#include "HeightReadback.h"
+
+#include "Profiler.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+static int WrapIndex(int a, int res)
+{
+    const int m = a % res;
+    return (m < 0) ? m + res : m;
+}
+
+HeightReadback::~HeightReadback()
+{
+    Release();
+}
+
+void HeightReadback::Release()
+{
+    for (auto& slot : m_Slots)
+    {
+        if (slot.Fence)
+            glDeleteSync(slot.Fence);
+
+        if (slot.Buffer)
+            glDeleteBuffers(1, &slot.Buffer);
+
+        slot = Slot{};
+    }
+
+    m_InFlight.clear();
+    m_FreeSlots.clear();
+    m_Pending.clear();
+}
+
+void HeightReadback::Init(int res, bool repeat)
+{
+    Release();
+
+    const int chunk_res = std::min(ChunkTexels, res);
+    const int chunks_x = res / chunk_res;
+
+    const size_t chunk_bytes = size_t(chunk_res) * size_t(chunk_res) * sizeof(float);
+
+    for (int i = 0; i < RingSize; i++)
+    {
+        glGenBuffers(1, &m_Slots[i].Buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_Slots[i].Buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, chunk_bytes, nullptr, GL_STREAM_READ);
+
+        m_FreeSlots.push_back(i);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    //Samplers read the layout under the shared lock
+    {
+        std::unique_lock lock(m_Mutex);
+
+        m_Res = res;
+        m_Repeat = repeat;
+        m_ChunkRes = chunk_res;
+        m_ChunksX = chunks_x;
+
+        m_Heights.assign(size_t(res) * size_t(res), 0.0f);
+        m_Resident.assign(size_t(chunks_x) * size_t(chunks_x), 0);
+        m_NumResident = 0;
+    }
+
+    Invalidate();
+}
+
+void HeightReadback::Invalidate()
+{
+    const int num_chunks = m_ChunksX * m_ChunksX;
+
+    m_Pending.resize(num_chunks);
+    m_Version++;
+
+    for (int i = 0; i < num_chunks; i++)
+        m_Pending[i] = i;
+}
+
+void HeightReadback::Update(const Texture2D& heightmap, glm::vec2 focus_uv)
+{
+    if (!IsInitialized())
+        return;
+
+    ProfilerCPUEvent we("Map::HeightReadback");
+
+    m_LastCompleted = 0;
+
+    //Fences signal in issue order, so the first unfinished copy ends the search
+    while (!m_InFlight.empty())
+    {
+        Slot& slot = m_Slots[m_InFlight.front()];
+
+        const GLenum status = glClientWaitSync(slot.Fence, 0, 0);
+
+        if (status == GL_TIMEOUT_EXPIRED)
+            break;
+
+        //Failed copies are issued again
+        if (status == GL_WAIT_FAILED)
+            m_Pending.push_back(slot.Chunk);
+        else
+            StoreChunk(slot);
+
+        glDeleteSync(slot.Fence);
+        slot.Fence = nullptr;
+        slot.Chunk = -1;
+
+        m_FreeSlots.push_back(m_InFlight.front());
+        m_InFlight.pop_front();
+    }
+
+    //Heights are written by imageStore, texture reads into buffers need to see them
+    if (!m_FreeSlots.empty() && !m_Pending.empty())
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    //Only a few chunks are issued per frame, picking the closest ones is cheap enough
+    while (!m_FreeSlots.empty() && !m_Pending.empty())
+    {
+        auto it = std::min_element(m_Pending.begin(), m_Pending.end(), [&](int lhs, int rhs) {
+            return ChunkDistance(lhs, focus_uv) < ChunkDistance(rhs, focus_uv);
+        });
+
+        const int chunk = *it;
+        *it = m_Pending.back();
+        m_Pending.pop_back();
+
+        const int idx = m_FreeSlots.back();
+        m_FreeSlots.pop_back();
+
+        Slot& slot = m_Slots[idx];
+        slot.Chunk = chunk;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+        heightmap.ReadToPackBuffer(m_ChunkRes * (chunk % m_ChunksX), m_ChunkRes * (chunk / m_ChunksX),
+                                   m_ChunkRes, m_ChunkRes);
+
+        slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        m_InFlight.push_back(idx);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void HeightReadback::StoreChunk(const Slot& slot)
+{
+    const size_t chunk_bytes = size_t(m_ChunkRes) * size_t(m_ChunkRes) * sizeof(float);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+    const auto* data = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, chunk_bytes,
+                                                                  GL_MAP_READ_BIT));
+
+    if (!data)
+    {
+        m_Pending.push_back(slot.Chunk);
+        return;
+    }
+
+    const int x0 = m_ChunkRes * (slot.Chunk % m_ChunksX);
+    const int y0 = m_ChunkRes * (slot.Chunk / m_ChunksX);
+
+    {
+        std::unique_lock lock(m_Mutex);
+
+        for (int y = 0; y < m_ChunkRes; y++)
+            std::memcpy(&m_Heights[size_t(y0 + y) * size_t(m_Res) + size_t(x0)],
+                        data + size_t(y) * size_t(m_ChunkRes), size_t(m_ChunkRes) * sizeof(float));
+
+        if (!m_Resident[slot.Chunk])
+        {
+            m_Resident[slot.Chunk] = 1;
+            m_NumResident++;
+        }
+    }
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+    m_LastCompleted++;
+}
+
+float HeightReadback::ChunkDistance(int chunk, glm::vec2 focus_uv) const
+{
+    const glm::vec2 center = (glm::vec2(chunk % m_ChunksX, chunk / m_ChunksX) + 0.5f) / float(m_ChunksX);
+    glm::vec2 d = glm::abs(center - focus_uv);
+
+    if (m_Repeat)
+    {
+        d = glm::fract(d);
+        d = glm::min(d, 1.0f - d);
+    }
+
+    d *= float(m_ChunksX);
+
+    return glm::dot(d, d);
+}
+
+bool HeightReadback::Sample(glm::vec2 uv, float& height) const
+{
+    std::shared_lock lock(m_Mutex);
+
+    if (m_Res == 0)
+        return false;
+
+    //Same texel centers as gpu bilinear filtering
+    const glm::vec2 t = uv * float(m_Res) - 0.5f;
+    const glm::ivec2 t0{ static_cast<int>(std::floor(t.x)), static_cast<int>(std::floor(t.y)) };
+    const glm::vec2 f = t - glm::vec2(t0);
+
+    float h[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        glm::ivec2 coord = t0 + glm::ivec2(i & 1, i >> 1);
+
+        if (m_Repeat)
+            coord = glm::ivec2(WrapIndex(coord.x, m_Res), WrapIndex(coord.y, m_Res));
+
+        else if (coord.x < 0 || coord.y < 0 || coord.x >= m_Res || coord.y >= m_Res)
+        {
+            h[i] = 0.0f;
+            continue;
+        }
+
+        const glm::ivec2 chunk = coord / m_ChunkRes;
+
+        if (!m_Resident[size_t(chunk.y) * size_t(m_ChunksX) + size_t(chunk.x)])
+            return false;
+
+        h[i] = m_Heights[size_t(coord.y) * size_t(m_Res) + size_t(coord.x)];
+    }
+
+    height = glm::mix(glm::mix(h[0], h[1], f.x), glm::mix(h[2], h[3], f.x), f.y);
+
+    return true;
+}
+
+void HeightReadback::CopyHeights(std::vector<float>& output) const
+{
+    std::shared_lock lock(m_Mutex);
+
+    output = m_Heights;
+}
+
+void HeightReadback::OnImGui()
+{
+    const int num_chunks = m_ChunksX * m_ChunksX;
+
+    ImGui::Text("Resident chunks: %d/%d, pending: %d", m_NumResident, num_chunks,
+                static_cast<int>(m_Pending.size()));
+    ImGui::Text("Copies in flight: %d/%d, completed last frame: %d",
+                static_cast<int>(m_InFlight.size()), RingSize, m_LastCompleted);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Texture.h"
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <vector>
+
+//Cpu copy of the heightmap, read back in square chunks through a ring of pixel buffer objects.
+//Every frame finished copies are collected and new ones issued into the free buffers, each with
+//a fence. Buffers are only mapped once their fence has signaled, so the render thread never
+//waits for the gpu. Chunks closest to the focus point (e.g. the camera) are read first.
+//Sampling is thread-safe and can run concurrently with Update.
+class HeightReadback {
+public:
+    ~HeightReadback();
+
+    //Repeat selects wrapping of out-of-range texels, otherwise the heightmap is
+    //assumed to be surrounded by zero height (clamp to border)
+    void Init(int res, bool repeat);
+
+    //Queues all chunks again, needs to be called after the heightmap changed.
+    //Chunks keep their previous heights until they are read again.
+    void Invalidate();
+
+    //Heightmap needs to stay unchanged until the next Invalidate
+    void Update(const Texture2D& heightmap, glm::vec2 focus_uv);
+
+    //Bilinearly filtered, unscaled height. Returns false if some of the
+    //texels involved haven't been read back yet.
+    bool Sample(glm::vec2 uv, float& height) const;
+
+    //Copies the whole res x res heightmap, row-major
+    void CopyHeights(std::vector<float>& output) const;
+
+    void OnImGui();
+
+    bool IsInitialized() const { return m_Res > 0; }
+    int getResolution() const { return m_Res; }
+    bool getRepeat() const { return m_Repeat; }
+
+    //Set once every chunk queued by the last Invalidate has been read back
+    bool IsComplete() const { return m_Pending.empty() && m_InFlight.empty(); }
+    //Incremented by Invalidate, tells cpu structures derived from the heights when to rebuild
+    uint32_t getVersion() const { return m_Version; }
+
+    static constexpr int ChunkTexels = 256;
+    //Maximal number of copies in flight, each in its own buffer
+    static constexpr int RingSize = 8;
+
+private:
+    struct Slot {
+        uint32_t Buffer = 0;
+        GLsync Fence = nullptr;
+        int Chunk = -1;
+    };
+
+    void Release();
+    void StoreChunk(const Slot& slot);
+
+    //Squared distance in chunks from the focus point, toroidal with repeat
+    float ChunkDistance(int chunk, glm::vec2 focus_uv) const;
+
+    int m_Res = 0, m_ChunkRes = 0, m_ChunksX = 0;
+    bool m_Repeat = false;
+
+    Slot m_Slots[RingSize];
+    //Slots of issued copies, in issue order
+    std::deque<int> m_InFlight;
+    std::vector<int> m_FreeSlots;
+    //Chunks waiting to be copied
+    std::vector<int> m_Pending;
+
+    //Guards the heights, residency flags and the layout above, written only by Init and Update
+    mutable std::shared_mutex m_Mutex;
+    std::vector<float> m_Heights;
+    std::vector<uint8_t> m_Resident;
+
+    int m_NumResident = 0;
+    int m_LastCompleted = 0;
+    uint32_t m_Version = 0;
+};
@@ -0,0 +1,169 @@
+#include "HorizonCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+static constexpr float Pi = 3.14159265358979f;
+
+static int WrapBin(int bin)
+{
+    const int m = bin % HorizonCuller::NumBins;
+    return (m < 0) ? m + HorizonCuller::NumBins : m;
+}
+
+void HorizonCuller::Reset(glm::vec3 camera_pos)
+{
+    m_CameraPos = camera_pos;
+
+    m_Occluders.clear();
+    m_Occludees.clear();
+    m_Valid.clear();
+    m_Occluded.clear();
+}
+
+bool HorizonCuller::ComputeFootprint(glm::vec2 rect_min, glm::vec2 rect_max, float top, Footprint& footprint) const
+{
+    const glm::vec2 cam{ m_CameraPos.x, m_CameraPos.z };
+
+    const glm::vec2 rel_min = rect_min - cam;
+    const glm::vec2 rel_max = rect_max - cam;
+
+    //Camera above the rectangle, it spans all azimuths
+    if (rel_min.x <= 0.0f && rel_max.x >= 0.0f && rel_min.y <= 0.0f && rel_max.y >= 0.0f)
+        return false;
+
+    const glm::vec2 nearest = glm::clamp(glm::vec2(0.0f), rel_min, rel_max);
+
+    const glm::vec2 corners[4] = {
+        rel_min, { rel_max.x, rel_min.y }, { rel_min.x, rel_max.y }, rel_max
+    };
+
+    //Rectangle doesn't contain the camera, so it spans less than half a turn
+    //and we can measure corner azimuths relative to the center
+    const glm::vec2 center = 0.5f * (rel_min + rel_max);
+    const float center_angle = std::atan2(center.y, center.x);
+
+    float min_delta = 0.0f, max_delta = 0.0f, max_dist = 0.0f;
+
+    for (const auto& corner : corners)
+    {
+        float delta = std::atan2(corner.y, corner.x) - center_angle;
+
+        if (delta > Pi)  delta -= 2.0f * Pi;
+        if (delta < -Pi) delta += 2.0f * Pi;
+
+        min_delta = std::min(min_delta, delta);
+        max_delta = std::max(max_delta, delta);
+        max_dist = std::max(max_dist, glm::length(corner));
+    }
+
+    const float bins_per_radian = static_cast<float>(NumBins) / (2.0f * Pi);
+
+    footprint.MinDist = glm::length(nearest);
+    footprint.MaxDist = max_dist;
+    footprint.MinBin = (center_angle + min_delta + Pi) * bins_per_radian;
+    footprint.MaxBin = (center_angle + max_delta + Pi) * bins_per_radian;
+    footprint.Top = top;
+
+    return true;
+}
+
+void HorizonCuller::AddOccluder(glm::vec2 rect_min, glm::vec2 rect_max, float top)
+{
+    Footprint footprint;
+
+    if (ComputeFootprint(rect_min, rect_max, top, footprint))
+        m_Occluders.push_back(footprint);
+}
+
+size_t HorizonCuller::AddOccludee(glm::vec2 rect_min, glm::vec2 rect_max, float top)
+{
+    Footprint footprint{};
+
+    const bool valid = ComputeFootprint(rect_min, rect_max, top, footprint);
+
+    m_Occludees.push_back(footprint);
+    m_Valid.push_back(static_cast<uint8_t>(valid));
+    m_Occluded.push_back(0);
+
+    return m_Occludees.size() - 1;
+}
+
+void HorizonCuller::InsertOccluder(const Footprint& occluder)
+{
+    //Every ray passing over the rectangle does so at a distance in [MinDist, MaxDist],
+    //it is blocked if it is below the top there. This gives the smallest blocked slope.
+    const float dy = occluder.Top - m_CameraPos.y;
+    const float slope = dy / ((dy >= 0.0f) ? occluder.MaxDist : occluder.MinDist);
+
+    //Only bins fully inside the azimuth range
+    const int first = static_cast<int>(std::ceil(occluder.MinBin));
+    const int last = static_cast<int>(std::floor(occluder.MaxBin)) - 1;
+
+    for (int bin = first; bin <= last; bin++)
+    {
+        float& horizon = m_Horizon[WrapBin(bin)];
+        horizon = std::max(horizon, slope);
+    }
+}
+
+bool HorizonCuller::TestOccludee(const Footprint& occludee) const
+{
+    //Steepest slope at which some point of the box may be seen
+    const float dy = occludee.Top - m_CameraPos.y;
+    const float slope = dy / ((dy >= 0.0f) ? occludee.MinDist : occludee.MaxDist);
+
+    //All bins touched by the azimuth range
+    const int first = static_cast<int>(std::floor(occludee.MinBin));
+    const int last = std::min(static_cast<int>(std::floor(occludee.MaxBin)), first + NumBins - 1);
+
+    for (int bin = first; bin <= last; bin++)
+    {
+        if (m_Horizon[WrapBin(bin)] <= slope)
+            return false;
+    }
+
+    return true;
+}
+
+void HorizonCuller::Resolve()
+{
+    m_Horizon.assign(NumBins, std::numeric_limits<float>::lowest());
+
+    m_OccluderOrder.resize(m_Occluders.size());
+    std::iota(m_OccluderOrder.begin(), m_OccluderOrder.end(), 0);
+
+    std::sort(m_OccluderOrder.begin(), m_OccluderOrder.end(), [this](size_t lhs, size_t rhs) {
+        return m_Occluders[lhs].MaxDist < m_Occluders[rhs].MaxDist;
+    });
+
+    m_OccludeeOrder.resize(m_Occludees.size());
+    std::iota(m_OccludeeOrder.begin(), m_OccludeeOrder.end(), 0);
+
+    std::sort(m_OccludeeOrder.begin(), m_OccludeeOrder.end(), [this](size_t lhs, size_t rhs) {
+        return m_Occludees[lhs].MinDist < m_Occludees[rhs].MinDist;
+    });
+
+    //Sweep front to back, an occludee is tested only against occluders
+    //that lie entirely closer to the camera than its nearest point
+    size_t next_occluder = 0;
+
+    for (size_t id : m_OccludeeOrder)
+    {
+        if (!m_Valid[id])
+            continue;
+
+        const auto& occludee = m_Occludees[id];
+
+        while (next_occluder < m_OccluderOrder.size()
+            && m_Occluders[m_OccluderOrder[next_occluder]].MaxDist <= occludee.MinDist)
+        {
+            InsertOccluder(m_Occluders[m_OccluderOrder[next_occluder]]);
+            next_occluder++;
+        }
+
+        m_Occluded[id] = static_cast<uint8_t>(TestOccludee(occludee));
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//Conservative occlusion culling against the terrain horizon, as seen from the camera.
+//Terrain is described by occluders - solid columns over xz rectangles, reaching up to some height.
+//For each azimuth bin around the camera we keep the steepest elevation slope (dy / horizontal distance)
+//below which all rays are blocked by terrain. Occludees are boxes over xz rectangles, hidden
+//if their top is below the horizon built from occluders that are strictly closer to the camera.
+//Doesn't depend on the view direction, so there is no frame latency and no popping.
+//Assumes that the camera is above the terrain.
+class HorizonCuller {
+public:
+    void Reset(glm::vec3 camera_pos);
+
+    //Terrain over the rectangle is at least at height top (world units)
+    void AddOccluder(glm::vec2 rect_min, glm::vec2 rect_max, float top);
+
+    //Returns index used to query the result after Resolve()
+    size_t AddOccludee(glm::vec2 rect_min, glm::vec2 rect_max, float top);
+
+    //Tests all occludees, front to back
+    void Resolve();
+
+    bool IsOccluded(size_t occludee) const { return m_Occluded[occludee] != 0; }
+
+    static constexpr int NumBins = 512;
+
+private:
+    struct Footprint {
+        float MinDist, MaxDist;
+        //Azimuth range in units of bins, may exceed [0, NumBins), wrapped on access
+        float MinBin, MaxBin;
+        float Top;
+    };
+
+    //Returns false if the camera lies over the rectangle
+    bool ComputeFootprint(glm::vec2 rect_min, glm::vec2 rect_max, float top, Footprint& footprint) const;
+
+    void InsertOccluder(const Footprint& occluder);
+    bool TestOccludee(const Footprint& occludee) const;
+
+    glm::vec3 m_CameraPos{ 0.0f };
+
+    std::vector<Footprint> m_Occluders, m_Occludees;
+    //Occludees that contain the camera are never culled
+    std::vector<uint8_t> m_Valid;
+    std::vector<uint8_t> m_Occluded;
+
+    std::vector<size_t> m_OccluderOrder, m_OccludeeOrder;
+
+    std::vector<float> m_Horizon;
+};
@@ -9,43 +9,137 @@
 #include "ImGuiIcons.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <functional>
+#include <random>
 
 MapGenerator::MapGenerator(ResourceManager& manager)
     : m_ResourceManager(manager)
     , m_HeightEditor(m_ResourceManager, "Height")
+    , m_VirtualHeightmap(m_ResourceManager)
 {
     m_NormalmapShader = m_ResourceManager.RequestComputeShader("res/shaders/map/normal.glsl");
     m_ShadowmapShader = m_ResourceManager.RequestComputeShader("res/shaders/map/shadow.glsl");
-    m_MipShader       = m_ResourceManager.RequestComputeShader("res/shaders/map/maximal_mip.glsl");
+    m_MinMaxShader    = m_ResourceManager.RequestComputeShader("res/shaders/map/min_max_pyramid.glsl");
+
+    m_HorizonShader       = m_ResourceManager.RequestComputeShader("res/shaders/map/horizon.glsl");
+    m_HorizonShadowShader = m_ResourceManager.RequestComputeShader("res/shaders/map/horizon_shadow.glsl");
+    m_ShadowSweepShader   = m_ResourceManager.RequestComputeShader("res/shaders/map/shadow_sweep.glsl");
 
     m_Heightmap   = m_ResourceManager.RequestTexture2D("Heightmap");
     m_Normalmap   = m_ResourceManager.RequestTexture2D("Normalmap");
     m_Shadowmap   = m_ResourceManager.RequestTexture2D("Shadowmap");
+
+    m_AOmap     = m_ResourceManager.RequestTexture2D("AO map");
+    m_AOmapBack = m_ResourceManager.RequestTexture2D("AO map (double buffer)");
+
+    m_PreviewHeightmap = m_ResourceManager.RequestTexture2D("Preview heightmap");
+    m_PreviewNormalmap = m_ResourceManager.RequestTexture2D("Preview normalmap");
+
+    m_HeightTilemap = m_ResourceManager.RequestTexture2D("Height tile");
+    m_GradientTilemap = m_ResourceManager.RequestTexture2D("Height gradient tile");
+    m_HeightmapBack = m_ResourceManager.RequestTexture2D("Heightmap (double buffer)");
+    m_NormalmapBack = m_ResourceManager.RequestTexture2D("Normalmap (double buffer)");
+    m_ShadowmapBack = m_ResourceManager.RequestTexture2D("Shadowmap (double buffer)");
+
+    m_Gradientmap     = m_ResourceManager.RequestTexture2D("Height gradient");
+    m_GradientmapBack = m_ResourceManager.RequestTexture2D("Height gradient (double buffer)");
+
+    m_Horizonmap = m_ResourceManager.RequestTextureArray("Horizon map");
+}
+
+//Internal format, pixel format and type of the storage formats
+static Texture2DSpec HeightSpec(int res, HeightFormat format, int wrap_type)
+{
+    if (format == HeightFormat::R16)
+        return Texture2DSpec{ res, res, GL_R16, GL_RED, GL_UNSIGNED_SHORT, GL_LINEAR, GL_LINEAR,
+                              wrap_type, {0.0f, 0.0f, 0.0f, 0.0f} };
+
+    return Texture2DSpec{ res, res, GL_R32F, GL_RGBA, GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR,
+                          wrap_type, {0.0f, 0.0f, 0.0f, 0.0f} };
+}
+
+//Image format qualifier matching HeightSpec, for the generated height kernels
+static const char* HeightImageFormat(HeightFormat format)
+{
+    return (format == HeightFormat::R16) ? "r16" : "r32f";
+}
+
+static size_t HeightBytes(HeightFormat format)
+{
+    return (format == HeightFormat::R16) ? 2 : 4;
 }
 
-void MapGenerator::Init(int height_res, int shadow_res, int wrap_type)
+static size_t NormalBytes(NormalFormat format)
 {
+    switch (format)
+    {
+        case NormalFormat::OctRG8:  return 2;
+        case NormalFormat::OctRG16: return 4;
+        default:                    return 4;
+    }
+}
+
+void MapGenerator::Init(int height_res, int shadow_res, int wrap_type,
+                        HeightFormat height_format, NormalFormat normal_format)
+{
+    m_HeightFormat = height_format;
+    m_NormalFormat = normal_format;
+
+    const bool oct_normals = (m_NormalFormat != NormalFormat::RGBA8);
+
     //-----Initialize Textures
     //-----Heightmap
 
-    m_Heightmap->Initialize(Texture2DSpec{
-        height_res, height_res, GL_R32F, GL_RGBA,
-        GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR,
+    m_Heightmap->Initialize(HeightSpec(height_res, m_HeightFormat, wrap_type));
+
+    //Heightmap has no mips, coarser heights are stored in the min/max pyramid
+
+    //-----Height gradient, height difference per texel, written together with the heightmap
+    m_Gradientmap->Initialize(Texture2DSpec{
+        height_res, height_res, GL_RG16F, GL_RG,
+        GL_FLOAT, GL_LINEAR, GL_LINEAR,
         wrap_type,
         {0.0f, 0.0f, 0.0f, 0.0f}
     });
 
-    m_Heightmap->Bind();
-    glGenerateMipmap(GL_TEXTURE_2D);
-
     //-----Normal map:
-    m_Normalmap->Initialize(Texture2DSpec{
-        height_res, height_res, GL_RGBA8, GL_RGBA,
-        GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR,
-        wrap_type,
-        //Pointing up (0,1,0), after compression -> (0.5, 1.0, 0.5):
-        {0.5f, 1.0f, 0.5f, 1.0f}
-    });
+    if (!oct_normals)
+    {
+        m_Normalmap->Initialize(Texture2DSpec{
+            height_res, height_res, GL_RGBA8, GL_RGBA,
+            GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR,
+            wrap_type,
+            //Pointing up (0,1,0), after compression -> (0.5, 1.0, 0.5):
+            {0.5f, 1.0f, 0.5f, 1.0f}
+        });
+    }
+
+    else
+    {
+        const bool rg16 = (m_NormalFormat == NormalFormat::OctRG16);
+
+        m_Normalmap->Initialize(Texture2DSpec{
+            height_res, height_res, rg16 ? GL_RG16 : GL_RG8, GL_RG,
+            rg16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR,
+            wrap_type,
+            //Pointing up, octahedral (0,0) after compression -> (0.5, 0.5):
+            {0.5f, 0.5f, 0.0f, 0.0f}
+        });
+
+        m_AOmap->Initialize(Texture2DSpec{
+            height_res, height_res, GL_R8, GL_RED,
+            GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR,
+            wrap_type,
+            {1.0f, 1.0f, 1.0f, 1.0f}
+        });
+
+        m_AOmap->Bind();
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
     m_Normalmap->Bind();
     glGenerateMipmap(GL_TEXTURE_2D);
@@ -61,8 +155,72 @@ void MapGenerator::Init(int height_res, int shadow_res, int wrap_type)
     m_Shadowmap->Bind();
     glGenerateMipmap(GL_TEXTURE_2D);
 
+    //-----Progressive preview
+    const int preview_res = std::min(m_PreviewRes, height_res);
+
+    //Same format as the heightmap, since both are written by the same kernels.
+    //Normals of the preview always use the rgba8 format.
+    m_PreviewHeightmap->Initialize(HeightSpec(preview_res, m_HeightFormat, wrap_type));
+
+    m_PreviewHeightmap->Bind();
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    m_PreviewNormalmap->Initialize(Texture2DSpec{
+        preview_res, preview_res, GL_RGBA8, GL_RGBA,
+        GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR,
+        wrap_type,
+        {0.5f, 1.0f, 0.5f, 1.0f}
+    });
+
+    m_PreviewNormalmap->Bind();
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    //-----Back buffers, regenerated over several frames while the front ones are displayed
+    for (auto [front, back] : { std::pair(m_Heightmap, m_HeightmapBack),
+                                std::pair(m_Gradientmap, m_GradientmapBack),
+                                std::pair(m_Normalmap, m_NormalmapBack),
+                                std::pair(m_AOmap, m_AOmapBack),
+                                std::pair(m_Shadowmap, m_ShadowmapBack) })
+    {
+        if (front == m_AOmap && !oct_normals)
+            continue;
+
+        back->Initialize(front->getSpec());
+
+        if (front->getSpec().MinFilter == GL_LINEAR)
+            continue;
+
+        back->Bind();
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    //-----Horizon map, 4 azimuths per layer
+    const int horizon_res = std::min(m_MaxHorizonRes, shadow_res);
+
+    m_Horizonmap->Initialize(Texture2DSpec{
+        horizon_res, horizon_res, GL_RGBA16F, GL_RGBA,
+        GL_FLOAT, GL_LINEAR, GL_LINEAR,
+        wrap_type,
+        {0.0f, 0.0f, 0.0f, 0.0f}
+    }, m_HorizonDirections / 4, 1);
+
+    //Same format as the heightmap, tiles are copied into it
+    const int tile_res = std::min(m_TileRes, height_res);
+
+    m_HeightTilemap->Initialize(HeightSpec(tile_res, m_HeightFormat, GL_CLAMP_TO_EDGE));
+
+    m_GradientTilemap->Initialize(Texture2DSpec{
+        tile_res, tile_res, GL_RG16F, GL_RG,
+        GL_FLOAT, GL_LINEAR, GL_LINEAR,
+        GL_CLAMP_TO_EDGE,
+        {0.0f, 0.0f, 0.0f, 0.0f}
+    });
+
+    m_GradientValid = false;
 
     //-----Setup heightmap editor:
+    m_HeightEditor.setImageFormat(HeightImageFormat(m_HeightFormat));
+
     std::vector<std::string> labels{ "Average", "Add", "Subtract" };
 
     m_HeightEditor.RegisterShader("Const Value", "res/shaders/map/const_val.glsl");
@@ -112,6 +270,27 @@ void MapGenerator::Init(int height_res, int shadow_res, int wrap_type)
     m_HeightEditor.Attach<SliderFloatTask>("Radial cutoff", "uBias", "Bias", 0.0f, 1.0f, 0.5f);
     m_HeightEditor.Attach<SliderFloatTask>("Radial cutoff", "uSlope", "Slope", 0.0f, 10.0f, 4.0f);
 
+    //Step functions of the same procedures, consecutive ones are fused into one kernel.
+    //Derivative steps let the fused kernel output the height gradient for analytic normals.
+    m_HeightEditor.RegisterStep("Const Value", "res/shaders/map/steps/const_val.glsl",
+                                "ConstValueStep", "ConstValueStepD");
+    m_HeightEditor.RegisterStep("FBM", "res/shaders/map/steps/fbm.glsl",
+                                "FBMStep", "FBMStepD");
+    //Slope and concave erosion terms aren't differentiated, normals use central differences with them
+    m_HeightEditor.RegisterStep("Advanced FBM", "res/shaders/map/steps/advanced_fbm.glsl",
+                                "AdvancedFBMStep", "AdvancedFBMStepD", {"uSlopeErosion", "uConcaveErosion"});
+    m_HeightEditor.RegisterStep("Voronoi", "res/shaders/map/steps/voronoi.glsl",
+                                "VoronoiStep", "VoronoiStepD");
+    m_HeightEditor.RegisterStep("Curves", "res/shaders/map/steps/curves.glsl",
+                                "CurvesStep", "CurvesStepD");
+    m_HeightEditor.RegisterStep("Terrace", "res/shaders/map/steps/terrace.glsl",
+                                "TerraceStep", "TerraceStepD");
+    m_HeightEditor.RegisterStep("Radial cutoff", "res/shaders/map/steps/radial_cutoff.glsl",
+                                "RadialCutoffStep", "RadialCutoffStepD");
+
+    //Editing one procedure only regenerates it and the ones after it
+    m_HeightEditor.EnableCache(m_ProcedureCacheBudget);
+
     //Initial procedures:
     m_HeightEditor.AddProcedureInstance("Const Value");
     m_HeightEditor.AddProcedureInstance("FBM");
@@ -145,239 +324,1676 @@ void MapGenerator::Init(int height_res, int shadow_res, int wrap_type)
         std::cerr << "Shadowmap res is not a power of 2!" << '\n';
 
 
+    m_HeightReadback.Init(height_res, wrap_type == GL_REPEAT);
+
     m_MipLevels = log2(height_res);
     m_ShadowSettings.MipOffset = log2(height_res / shadow_res);
-}
 
-void MapGenerator::UpdateHeight()
-{
-    ProfilerGPUEvent we("Map::UpdateHeight");
+    //-----Min/max height pyramid, all levels packed in one storage buffer
+    if (m_MinMaxBuffer == 0)
+    {
+        glGenBuffers(1, &m_MinMaxBuffer);
+        glGenBuffers(1, &m_MinMaxCounter);
+    }
 
-    const int res = m_Heightmap->getResolutionX();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_MinMaxBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, PyramidOffset(height_res, m_MipLevels) * sizeof(glm::vec2),
+                 nullptr, GL_DYNAMIC_COPY);
 
-    m_Heightmap->BindImage(0, 0);
-    m_HeightEditor.OnDispatch(res);
+    //Reset by the last workgroup of each pass, so it only needs to be zeroed once
+    const uint32_t zero = 0;
 
-    m_Heightmap->Bind();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_MinMaxCounter);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), &zero, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    //Staging copy of the levels read back to the cpu
+    if (m_MinMaxReadBuffer == 0)
+        glGenBuffers(1, &m_MinMaxReadBuffer);
+
+    const int first_level = FirstReadbackLevel(height_res, m_MipLevels);
+    const size_t read_texels = PyramidOffset(height_res, m_MipLevels) - PyramidOffset(height_res, first_level);
 
-    GenMaxMips();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_MinMaxReadBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, std::max(read_texels, size_t(1)) * sizeof(glm::vec2),
+                 nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
-    m_ResourceManager.RequestPreviewUpdate(m_Heightmap);
+    CancelMinMaxReadback();
 }
 
-void MapGenerator::UpdateNormal()
+void MapGenerator::InitVirtualHeightmap(int height_res, int lods)
 {
-    ProfilerGPUEvent we("Map::UpdateNormal");
+    m_VirtualHeightmap.Init(1.0f / static_cast<float>(height_res), lods);
+    m_VirtualFlush = true;
+}
 
-    const int res = m_Normalmap->getResolutionX();
+bool MapGenerator::UpdateVirtualHeightmap(glm::vec3 camera_pos)
+{
+    if (!UsesVirtualHeightmap())
+        return false;
 
-    m_Heightmap->Bind();
-    m_Normalmap->BindImage(0, 0);
+    //Same mapping as RenderToUV, but kept in double precision
+    const glm::dvec2 camera_uv = (m_RenderOrigin + glm::dvec2(camera_pos.x, camera_pos.z))
+                               / static_cast<double>(m_ScaleXZ) + 0.5;
 
-    m_NormalmapShader->Bind();
-    m_NormalmapShader->setUniform1f("uScaleXZ", m_ScaleXZ);
-    m_NormalmapShader->setUniform1f("uScaleY" , m_ScaleY );
+    const bool changed = m_VirtualHeightmap.Update(m_HeightEditor, camera_uv, m_VirtualFlush);
 
-    m_NormalmapShader->setUniform1i("uAOSamples", m_AOSettings.Samples);
-    m_NormalmapShader->setUniform1f("uAOR", m_AOSettings.R);
+    m_VirtualFlush = false;
 
-    m_NormalmapShader->Dispatch(res, res, 1);
+    return changed;
+}
 
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+void MapGenerator::UpdateHeightReadback(glm::vec3 camera_pos)
+{
+    //Readback would only describe the base tile
+    if (UsesVirtualHeightmap())
+        return;
 
-    m_Normalmap->Bind();
-    glGenerateMipmap(GL_TEXTURE_2D);
+    m_CameraUV = RenderToUV(glm::vec2(camera_pos.x, camera_pos.z));
+    m_HeightReadback.Update(*m_Heightmap, m_CameraUV);
+}
+
+bool MapGenerator::SampleHeight(glm::vec2 uv, float& height) const
+{
+    if (UsesVirtualHeightmap())
+        return false;
 
-    m_ResourceManager.RequestPreviewUpdate(m_Normalmap);
+    return m_HeightReadback.Sample(uv, height);
 }
 
-void MapGenerator::UpdateShadow(const glm::vec3& sun_dir)
+bool MapGenerator::UpdateHeightQuadtree()
 {
-    ProfilerGPUEvent we("Map::UpdateShadow");
+    if (UsesVirtualHeightmap())
+        return false;
 
-    const int res = m_Shadowmap->getResolutionX();
+    const bool stale = m_QuadtreeVersion != m_HeightReadback.getVersion();
 
-    m_Heightmap->Bind();
-    m_Shadowmap->BindImage(0, 0);
+    if (stale && m_HeightReadback.IsComplete())
+    {
+        if (!m_HeightQuadtree)
+            m_HeightQuadtree = std::make_unique<HeightQuadtree>();
 
-    m_ShadowmapShader->Bind();
-    m_ShadowmapShader->setUniform1i("uResolution", res);
-    m_ShadowmapShader->setUniform3f("uSunDir", sun_dir);
-    m_ShadowmapShader->setUniform1f("uScaleXZ", m_ScaleXZ);
-    m_ShadowmapShader->setUniform1f("uScaleY", m_ScaleY);
+        using Clock = std::chrono::high_resolution_clock;
 
-    m_ShadowmapShader->setUniform1i("uMipOffset", m_ShadowSettings.MipOffset);
-    m_ShadowmapShader->setUniform1i("uMinLvl", m_ShadowSettings.MinLevel);
-    m_ShadowmapShader->setUniform1i("uStartCell", m_ShadowSettings.StartCell);
-    m_ShadowmapShader->setUniform1f("uNudgeFactor", m_ShadowSettings.NudgeFac);
-    m_ShadowmapShader->setUniformBool("uSoftShadows", m_ShadowSettings.Soft);
-    m_ShadowmapShader->setUniform1f("uSharpness", m_ShadowSettings.Sharpness);
+        const auto start = Clock::now();
 
-    m_ShadowmapShader->Dispatch(res, res, 1);
+        std::vector<float> heights;
+        m_HeightReadback.CopyHeights(heights);
 
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        m_HeightQuadtree->Build(heights, m_HeightReadback.getResolution(), m_HeightReadback.getRepeat());
+        m_QuadtreeVersion = m_HeightReadback.getVersion();
 
-    m_Shadowmap->Bind();
-    glGenerateMipmap(GL_TEXTURE_2D);
+        m_QuadtreeBuildTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
 
-    m_ResourceManager.RequestPreviewUpdate(m_Shadowmap);
+    return m_HeightQuadtree && !m_HeightQuadtree->Empty();
 }
 
-
-void MapGenerator::GenMaxMips()
+TerrainRay MapGenerator::RenderToHeightmap(const TerrainRay& ray) const
 {
-    if (m_MipLevels == 0) return;
-
-    const int res = m_Heightmap->getResolutionX();
+    //Terrain is displaced by 0.5 * scale_y * height, same as in the shaders
+    const glm::vec3 scale(1.0f / m_ScaleXZ, 2.0f / m_ScaleY, 1.0f / m_ScaleXZ);
 
-    for (int i = 0; i < m_MipLevels; i++) {
-        m_MipShader->Bind();
+    const glm::vec2 uv = RenderToUV(glm::vec2(ray.Origin.x, ray.Origin.z));
 
-        //Higher res - read from this
-        m_Heightmap->BindImage(1, i);
-        //Lower res - modify this
-        m_Heightmap->BindImage(0, i+1);
-
-        //We don't set uniforms for binding ids since they are set in shader code
-
-        //Number of work groups for compute shader
-        const int size = std::max((res / int(pow(2, i + 1))) / 32, 1);
-
-        glDispatchCompute(size, size, 1);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
-    }
+    return TerrainRay{glm::vec3(uv.x, scale.y * ray.Origin.y, uv.y), scale * ray.Dir, ray.MaxT};
 }
 
-void MapGenerator::Update(const glm::vec3& sun_dir)
+bool MapGenerator::Raycast(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits)
 {
-    if ((m_UpdateFlags & Height) != None)
-        UpdateHeight();
+    if (!UpdateHeightQuadtree())
+        return false;
 
-    if ((m_UpdateFlags & Normal) != None)
-        UpdateNormal();
+    m_RaycastScratch.resize(rays.size());
 
-    if ((m_UpdateFlags & Shadow) != None)
-        UpdateShadow(sun_dir);
+    for (size_t i = 0; i < rays.size(); i++)
+        m_RaycastScratch[i] = RenderToHeightmap(rays[i]);
 
-    m_UpdateFlags = None;
-}
+    m_HeightQuadtree->Raycast(m_RaycastScratch, hits);
 
-void MapGenerator::BindHeightmap(int id) const
-{
-    m_Heightmap->Bind(id);
+    return true;
 }
 
-void MapGenerator::BindNormalmap(int id) const
+void MapGenerator::DispatchHeightGPU(Texture2D& target)
 {
-    m_Normalmap->Bind(id);
+    m_HeightEditor.OnDispatch(target);
 }
 
-void MapGenerator::BindShadowmap(int id) const
+bool MapGenerator::GenerateHeightCPU(Texture2D& target)
 {
-    m_Shadowmap->Bind(id);
+    if (!m_CpuHeightmap)
+        m_CpuHeightmap = std::make_unique<CpuHeightmapGenerator>();
+
+    const auto stack = m_HeightEditor.getProcedureStack();
+
+    if (!m_CpuHeightmap->Supports(stack))
+    {
+        std::cerr << "Procedure stack not supported by the cpu backend, using gpu instead" << '\n';
+        return false;
+    }
+
+    const int res = target.getResolutionX();
+
+    m_CpuHeightmap->Generate(res, stack, m_CpuHeightData);
+
+    target.Bind();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, res, res, GL_RED, GL_FLOAT, m_CpuHeightData.data());
+
+    return true;
 }
 
-void MapGenerator::ImGuiTerrain(bool &open, bool update_shadows)
+bool MapGenerator::CrossCheckHeight()
 {
-    float scale_xz = m_ScaleXZ;
-    float scale_y = m_ScaleY;
+    ProfilerCPUEvent we("Map::CrossCheckHeight");
 
-    ImGui::SetNextWindowSize(ImVec2(300.0f, 600.0f), ImGuiCond_FirstUseEver);
+    if (!m_CpuHeightmap)
+        m_CpuHeightmap = std::make_unique<CpuHeightmapGenerator>();
 
-    ImGui::Begin(LOFI_ICONS_TERRAIN "Terrain editor", &open, ImGuiWindowFlags_NoFocusOnAppearing);
+    const auto stack = m_HeightEditor.getProcedureStack();
 
-    ImGuiUtils::BeginGroupPanel("Scale");
-    ImGui::Columns(2, "###col");
-    ImGuiUtils::ColSliderFloat("Scale xz", &(scale_xz), 0.0f, 400.0f);
-    ImGuiUtils::ColSliderFloat("Scale y" , &(scale_y), 0.0f, 100.0f);
-    ImGui::Columns(1, "###col");
-    ImGuiUtils::EndGroupPanel();
+    if (!m_CpuHeightmap->Supports(stack))
+    {
+        m_CrossCheckResult = "Stack not supported by the cpu backend";
+        return false;
+    }
 
-    bool scale_changed = (scale_xz != m_ScaleXZ) || (scale_y != m_ScaleY);
+    const int res = m_Heightmap->getResolutionX();
 
-    ImGuiUtils::BeginGroupPanel("Heightmap procedures");
+    //Gpu reference
+    DispatchHeightGPU(*m_Heightmap);
 
-    bool height_changed = m_HeightEditor.OnImGui();
+    std::vector<float> gpu_data(size_t(res) * size_t(res));
 
-    ImGuiUtils::EndGroupPanel();
+    m_Heightmap->Bind();
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, gpu_data.data());
 
-    ImGui::End();
+    m_CpuHeightmap->Generate(res, stack, m_CpuHeightData);
 
-    if (height_changed)
+    float max_error = 0.0f;
+    size_t num_mismatched = 0;
+
+    for (size_t i = 0; i < gpu_data.size(); i++)
     {
-        m_UpdateFlags = m_UpdateFlags | Height | Normal;
+        const float error = std::abs(gpu_data[i] - m_CpuHeightData[i]);
 
-        if (update_shadows)
-            m_UpdateFlags = m_UpdateFlags | Shadow;
+        max_error = std::max(max_error, error);
+
+        if (error > m_CrossCheckTolerance)
+            num_mismatched++;
     }
 
-    else if (scale_changed)
+    m_CrossCheckResult = "Max error: " + std::to_string(max_error)
+                       + ", above tolerance: " + std::to_string(num_mismatched)
+                       + "/" + std::to_string(gpu_data.size());
+
+    //Regenerate with the currently selected backend
+    m_UpdateFlags = m_UpdateFlags | Height;
+
+    return num_mismatched == 0;
+}
+
+//Bilinear lookup at uv = texel / res, same as texture() in map/shadow.glsl.
+//Texels outside of a non-repeating heightmap have zero height (clamp to border).
+static std::vector<float> SampleHeights(const std::vector<float>& heights, int height_res, bool repeat, int res)
+{
+    auto Fetch = [&](int x, int y) {
+        if (repeat)
+        {
+            x = ((x % height_res) + height_res) % height_res;
+            y = ((y % height_res) + height_res) % height_res;
+        }
+
+        else if (x < 0 || y < 0 || x >= height_res || y >= height_res)
+            return 0.0f;
+
+        return heights[size_t(y) * size_t(height_res) + size_t(x)];
+    };
+
+    std::vector<float> output(size_t(res) * size_t(res));
+
+    const float scale = float(height_res) / float(res);
+
+    for (int y = 0; y < res; y++)
     {
-        m_ScaleXZ = scale_xz;
-        m_ScaleY = scale_y;
+        for (int x = 0; x < res; x++)
+        {
+            const float px = scale * float(x) - 0.5f;
+            const float py = scale * float(y) - 0.5f;
 
-        m_UpdateFlags = m_UpdateFlags | Normal;
+            const int x0 = static_cast<int>(std::floor(px));
+            const int y0 = static_cast<int>(std::floor(py));
 
-        if (update_shadows)
-            m_UpdateFlags = m_UpdateFlags | Shadow;
+            const float fx = px - float(x0);
+            const float fy = py - float(y0);
+
+            const float top    = (1.0f - fx) * Fetch(x0, y0)     + fx * Fetch(x0 + 1, y0);
+            const float bottom = (1.0f - fx) * Fetch(x0, y0 + 1) + fx * Fetch(x0 + 1, y0 + 1);
+
+            output[size_t(y) * size_t(res) + size_t(x)] = (1.0f - fy) * top + fy * bottom;
+        }
     }
 
+    return output;
 }
 
-void MapGenerator::ImGuiShadowmap(bool &open, bool update_shadows)
+void MapGenerator::BenchmarkShadows()
 {
-    ShadowmapSettings temp = m_ShadowSettings;
-    AOSettings temp2 = m_AOSettings;
+    ProfilerCPUEvent we("Map::BenchmarkShadows");
 
-    ImGui::SetNextWindowSize(ImVec2(300.0f, 600.0f), ImGuiCond_FirstUseEver);
+    if (!m_CpuShadowSweep)
+        m_CpuShadowSweep = std::make_unique<CpuShadowSweep>();
 
-    ImGui::Begin(LOFI_ICONS_SHADOW "Shadow/AO settings", &open, ImGuiWindowFlags_NoFocusOnAppearing);
+    using Clock = std::chrono::high_resolution_clock;
 
-    ImGuiUtils::BeginGroupPanel("Shadowmap settings:");
-    ImGui::Columns(2, "###col");
-    ImGuiUtils::ColSliderInt("Min level", &temp.MinLevel, 0, 12);
-    ImGuiUtils::ColSliderFloat("Nudge fac", &temp.NudgeFac, 1.005f, 1.1f);
-    ImGuiUtils::ColCheckbox("Soft Shadows", &temp.Soft);
-    ImGuiUtils::ColSliderFloat("Sharpness", &temp.Sharpness, 0.1f, 3.0f);
-    ImGui::Columns(1, "###col");
-    ImGuiUtils::EndGroupPanel();
+    auto ToMilliseconds = [](Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
 
-    ImGuiUtils::BeginGroupPanel("AO settings:");
-    ImGui::Columns(2, "###col");
-    ImGuiUtils::ColSliderInt("AO Samples", &temp2.Samples, 1, 64);
-    ImGuiUtils::ColSliderFloat("AO Radius", &temp2.R, 0.0f, 0.1f);
-    ImGui::Columns(1, "###col");
-    ImGuiUtils::EndGroupPanel();
+    //Sun direction of the displayed shadowmap, the job's one is cleared when it finishes
+    const glm::vec3 sun_dir = m_ShadowSunDir;
 
-    ImGui::End();
+    const int height_res = m_Heightmap->getResolutionX();
+    const bool repeat = m_Heightmap->getSpec().Wrap == GL_REPEAT;
 
-    if (temp2 != m_AOSettings)
-    {
-        m_AOSettings = temp2;
-        m_UpdateFlags = m_UpdateFlags | Normal;
-    }
+    std::vector<float> height_data(size_t(height_res) * size_t(height_res));
 
-    if (temp != m_ShadowSettings)
+    m_Heightmap->Bind();
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, height_data.data());
+
+    m_ShadowBenchmark.clear();
+
+    for (int res : {2048, 4096})
     {
-        temp.StartCell = static_cast<int>(std::pow(2, temp.MinLevel));
+        Texture2D target("Shadow benchmark");
 
-        m_ShadowSettings = temp;
+        target.Initialize(Texture2DSpec{
+            res, res, GL_R8, GL_RED,
+            GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR,
+            GL_CLAMP_TO_EDGE,
+            {1.0f, 1.0f, 1.0f, 1.0f}
+        });
 
-        if (update_shadows)
-            m_UpdateFlags = m_UpdateFlags | Shadow;
+        const size_t num_texels = size_t(res) * size_t(res);
+
+        std::vector<float> raymarched(num_texels), swept(num_texels), cpu_swept;
+
+        //Gpu work is timed on the cpu, with the queue drained before and after
+        auto TimeGPU = [&](const std::function<void()>& dispatch, std::vector<float>& result) {
+            glFinish();
+            const auto start = Clock::now();
+
+            dispatch();
+
+            glFinish();
+            const auto end = Clock::now();
+
+            target.Bind();
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, result.data());
+
+            return ToMilliseconds(end - start);
+        };
+
+        const auto lines = SweepLines::Setup(res, sun_dir, m_ScaleXZ, m_ScaleY);
+
+        const double raymarch_time = TimeGPU([&]() {
+            DispatchShadowRaymarch(*m_Heightmap, target, sun_dir, glm::ivec2(0), res);
+        }, raymarched);
+
+        const double sweep_time = TimeGPU([&]() {
+            DispatchShadowSweep(*m_Heightmap, target, lines, 0, lines.NumLines);
+        }, swept);
+
+        target.Release();
+
+        //Resampling is excluded, the gpu versions get it from the texture units
+        const auto heights = SampleHeights(height_data, height_res, repeat, res);
+
+        const auto cpu_start = Clock::now();
+        m_CpuShadowSweep->Generate(lines, heights, m_ShadowSettings.Soft, m_ShadowSettings.Sharpness, cpu_swept);
+        const double cpu_time = ToMilliseconds(Clock::now() - cpu_start);
+
+        //Lit/shadowed disagreements are counted separately, since they dominate visually
+        double mean_error = 0.0;
+        size_t mismatches = 0;
+        float cpu_error = 0.0f;
+
+        for (size_t i = 0; i < num_texels; i++)
+        {
+            mean_error += std::abs(swept[i] - raymarched[i]);
+
+            if ((swept[i] > 0.5f) != (raymarched[i] > 0.5f))
+                mismatches++;
+
+            cpu_error = std::max(cpu_error, std::abs(cpu_swept[i] - swept[i]));
+        }
+
+        mean_error /= static_cast<double>(num_texels);
+
+        m_ShadowBenchmark += std::to_string(res) + "^2, raymarch: " + std::to_string(raymarch_time)
+                           + "ms, gpu sweep: " + std::to_string(sweep_time)
+                           + "ms, cpu sweep (" + std::to_string(m_CpuShadowSweep->getNumWorkers())
+                           + " threads): " + std::to_string(cpu_time)
+                           + "ms, mean difference: " + std::to_string(mean_error)
+                           + ", lit/shadowed mismatches: " + std::to_string(mismatches)
+                           + "/" + std::to_string(num_texels)
+                           + ", max cpu/gpu sweep difference: " + std::to_string(cpu_error) + "\n";
     }
 }
 
-void MapGenerator::RequestShadowUpdate() const
+void MapGenerator::BenchmarkAO()
 {
-    m_UpdateFlags = m_UpdateFlags | Shadow;
+    ProfilerCPUEvent we("Map::BenchmarkAO");
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    const int res = m_Heightmap->getResolutionX();
+    const size_t num_texels = size_t(res) * size_t(res);
+
+    Texture2D target("AO benchmark");
+
+    target.Initialize(Texture2DSpec{
+        res, res, GL_RGBA8, GL_RGBA,
+        GL_UNSIGNED_BYTE, GL_LINEAR, GL_LINEAR,
+        GL_CLAMP_TO_EDGE,
+        {0.0f, 0.0f, 0.0f, 0.0f}
+    });
+
+    //Ao is stored in the alpha channel of the normalmap
+    auto TimeMethod = [&](AOMethod method, std::vector<float>& result) {
+        const AOMethod prev = m_AOSettings.Method;
+        m_AOSettings.Method = method;
+
+        glFinish();
+        const auto start = Clock::now();
+
+        DispatchNormal(*m_Heightmap, nullptr, target, nullptr, glm::ivec2(0), res);
+
+        glFinish();
+        const auto end = Clock::now();
+
+        m_AOSettings.Method = prev;
+
+        result.resize(4 * num_texels);
+        target.Bind();
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, result.data());
+
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    std::vector<float> sampled, horizon;
+
+    const double sampled_time = TimeMethod(AOMethod::Sampled, sampled);
+    const double horizon_time = TimeMethod(AOMethod::Horizon, horizon);
+
+    target.Release();
+
+    double mean_error = 0.0;
+    float max_error = 0.0f;
+
+    for (size_t i = 0; i < num_texels; i++)
+    {
+        const float error = std::abs(horizon[4 * i + 3] - sampled[4 * i + 3]);
+
+        mean_error += error;
+        max_error = std::max(max_error, error);
+    }
+
+    mean_error /= static_cast<double>(num_texels);
+
+    m_AOBenchmark = std::to_string(res) + "^2, sampled (" + std::to_string(m_AOSettings.Samples)
+                  + " samples): " + std::to_string(sampled_time)
+                  + "ms, horizon (" + std::to_string(m_AOSettings.Directions) + "x"
+                  + std::to_string(m_AOSettings.Steps) + " taps): " + std::to_string(horizon_time)
+                  + "ms, mean difference: " + std::to_string(mean_error)
+                  + ", max difference: " + std::to_string(max_error);
 }
 
-bool MapGenerator::GeometryShouldUpdate()
+void MapGenerator::BenchmarkRaycast()
 {
-    //If height changed, then normal must also change, but it is possible
-    //to change normals without height by changing the scale
-    return (m_UpdateFlags & Normal) != None;
+    ProfilerCPUEvent we("Map::BenchmarkRaycast");
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    auto ToMilliseconds = [](Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    if (!UpdateHeightQuadtree())
+    {
+        m_RaycastBenchmark = "Heights aren't read back yet";
+        return;
+    }
+
+    //Picking-like rays from above the terrain, looking down at shallow to steep angles
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+    const glm::vec2 origin_uv = getOriginUV();
+
+    std::vector<TerrainRay> rays(m_RaycastBenchmarkRays);
+
+    for (auto& ray : rays)
+    {
+        const glm::vec2 uv(dist(gen), dist(gen));
+        const glm::vec2 pos = m_ScaleXZ * (uv - 0.5f - origin_uv);
+
+        const float azimuth = 6.2831853f * dist(gen);
+        const float pitch = glm::radians(2.0f + 58.0f * dist(gen));
+
+        const glm::vec3 origin(pos.x, 0.5f * m_ScaleY * (1.0f + dist(gen)), pos.y);
+        const glm::vec3 dir(std::cos(pitch) * std::cos(azimuth), -std::sin(pitch), std::cos(pitch) * std::sin(azimuth));
+
+        ray = RenderToHeightmap(TerrainRay{origin, dir, 2.0f * m_ScaleXZ});
+    }
+
+    std::vector<TerrainHit> quadtree, marched;
+
+    const auto quadtree_start = Clock::now();
+    m_HeightQuadtree->Raycast(rays, quadtree);
+    const double quadtree_time = ToMilliseconds(Clock::now() - quadtree_start);
+
+    const auto march_start = Clock::now();
+    m_HeightQuadtree->RaycastBruteForce(rays, marched);
+    const double march_time = ToMilliseconds(Clock::now() - march_start);
+
+    //Marching can step over thin features, so a few disagreements are expected
+    size_t num_hits = 0, mismatches = 0;
+    double mean_error = 0.0;
+
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (quadtree[i].Hit != marched[i].Hit)
+        {
+            mismatches++;
+            continue;
+        }
+
+        if (quadtree[i].Hit)
+        {
+            num_hits++;
+            mean_error += std::abs(quadtree[i].T - marched[i].T);
+        }
+    }
+
+    mean_error /= static_cast<double>(std::max(num_hits, size_t(1)));
+
+    const double num_rays = static_cast<double>(rays.size());
+
+    m_RaycastBenchmark = std::to_string(rays.size()) + " rays, quadtree build: " + std::to_string(m_QuadtreeBuildTime)
+                       + "ms, quadtree (" + std::to_string(m_HeightQuadtree->getNumWorkers())
+                       + " threads): " + std::to_string(quadtree_time)
+                       + "ms (" + std::to_string(num_rays / quadtree_time)
+                       + " rays/ms), brute-force march: " + std::to_string(march_time)
+                       + "ms (" + std::to_string(num_rays / march_time)
+                       + " rays/ms), hits: " + std::to_string(num_hits)
+                       + ", hit/miss mismatches: " + std::to_string(mismatches)
+                       + ", mean distance difference: " + std::to_string(mean_error);
+}
+
+void MapGenerator::DispatchNormal(const Texture2D& heightmap, const Texture2D* gradientmap, Texture2D& normalmap,
+                                  Texture2D* aomap, glm::ivec2 offset, int size)
+{
+    heightmap.Bind(0);
+    normalmap.BindImage(0, 0);
+
+    if (aomap)
+        aomap->BindImage(1, 0);
+
+    if (gradientmap)
+        gradientmap->Bind(1);
+
+    m_NormalmapShader->Bind();
+    m_NormalmapShader->setUniformSampler2D("gradientmap", 1);
+    m_NormalmapShader->setUniformBool("uAnalyticNormals", gradientmap != nullptr);
+    m_NormalmapShader->setUniformBool("uOctNormals", aomap != nullptr);
+    m_NormalmapShader->setUniform2i("uTileOffset", offset);
+    m_NormalmapShader->setUniform1f("uScaleXZ", m_ScaleXZ);
+    m_NormalmapShader->setUniform1f("uScaleY" , m_ScaleY );
+
+    m_NormalmapShader->setUniform1i("uAOSamples", m_AOSettings.Samples);
+    m_NormalmapShader->setUniform1f("uAOR", m_AOSettings.R);
+
+    //Pyramid is only built for the full resolution heightmap, the preview uses the sampled AO
+    const bool horizon_ao = m_AOSettings.Method == AOMethod::Horizon && m_MipLevels > 0
+                         && &heightmap != m_PreviewHeightmap.get();
+
+    m_NormalmapShader->setUniformBool("uHorizonAO", horizon_ao);
+    m_NormalmapShader->setUniform1i("uAODirections", m_AOSettings.Directions);
+    m_NormalmapShader->setUniform1i("uAOSteps", m_AOSettings.Steps);
+    m_NormalmapShader->setUniform1i("uMaxLod", m_MipLevels);
+    m_NormalmapShader->setUniformBool("uWrap", heightmap.getSpec().Wrap == GL_REPEAT);
+    BindMinMaxPyramid(*m_NormalmapShader, heightmap.getResolutionX());
+
+    m_NormalmapShader->Dispatch(size, size, 1);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void MapGenerator::DispatchShadow(const Texture2D& heightmap, Texture2D& shadowmap, const glm::vec3& sun_dir,
+                                  glm::ivec2 offset, int size)
+{
+    //Raymarching is used until the horizon map is computed
+    const bool horizon = m_ShadowSettings.Method == ShadowMethod::HorizonMap
+                      && (m_HorizonValid || (m_Job.Flags & Horizon) != None);
+
+    if (horizon)
+    {
+        m_Horizonmap->Bind();
+        shadowmap.BindImage(0, 0);
+
+        m_HorizonShadowShader->Bind();
+        m_HorizonShadowShader->setUniform2i("uTileOffset", offset);
+        m_HorizonShadowShader->setUniform3f("uSunDir", sun_dir);
+        m_HorizonShadowShader->setUniform1f("uScaleXZ", m_ScaleXZ);
+        m_HorizonShadowShader->setUniform1f("uScaleY", m_ScaleY);
+        m_HorizonShadowShader->setUniformBool("uSoftShadows", m_ShadowSettings.Soft);
+        m_HorizonShadowShader->setUniform1f("uSharpness", m_ShadowSettings.Sharpness);
+
+        m_HorizonShadowShader->Dispatch(size, size, 1);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        return;
+    }
+
+    DispatchShadowRaymarch(heightmap, shadowmap, sun_dir, offset, size);
+}
+
+void MapGenerator::DispatchShadowRaymarch(const Texture2D& heightmap, Texture2D& shadowmap, const glm::vec3& sun_dir,
+                                          glm::ivec2 offset, int size)
+{
+    const int res = shadowmap.getResolutionX();
+
+    heightmap.Bind();
+    shadowmap.BindImage(0, 0);
+
+    m_ShadowmapShader->Bind();
+    m_ShadowmapShader->setUniform2i("uTileOffset", offset);
+    m_ShadowmapShader->setUniform1i("uResolution", res);
+    m_ShadowmapShader->setUniform3f("uSunDir", sun_dir);
+    m_ShadowmapShader->setUniform1f("uScaleXZ", m_ScaleXZ);
+    m_ShadowmapShader->setUniform1f("uScaleY", m_ScaleY);
+
+    //Differs from the settings only for benchmark targets
+    const int mip_offset = static_cast<int>(std::round(std::log2(float(heightmap.getResolutionX()) / float(res))));
+
+    m_ShadowmapShader->setUniform1i("uMipOffset", mip_offset);
+    BindMinMaxPyramid(*m_ShadowmapShader, heightmap.getResolutionX());
+    m_ShadowmapShader->setUniform1i("uMinLvl", m_ShadowSettings.MinLevel);
+    m_ShadowmapShader->setUniform1i("uStartCell", m_ShadowSettings.StartCell);
+    m_ShadowmapShader->setUniform1f("uNudgeFactor", m_ShadowSettings.NudgeFac);
+    m_ShadowmapShader->setUniformBool("uSoftShadows", m_ShadowSettings.Soft);
+    m_ShadowmapShader->setUniform1f("uSharpness", m_ShadowSettings.Sharpness);
+
+    m_ShadowmapShader->Dispatch(size, size, 1);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void MapGenerator::DispatchShadowSweep(const Texture2D& heightmap, Texture2D& shadowmap, const SweepLines& lines,
+                                       int first_line, int num_lines)
+{
+    heightmap.Bind();
+    shadowmap.BindImage(0, 0);
+
+    m_ShadowSweepShader->Bind();
+    m_ShadowSweepShader->setUniform1i("uResolution", lines.Res);
+    m_ShadowSweepShader->setUniformBool("uMajorX", lines.MajorX);
+    m_ShadowSweepShader->setUniform1i("uMajorStart", lines.MajorStart);
+    m_ShadowSweepShader->setUniform1i("uMajorStep", lines.MajorStep);
+    m_ShadowSweepShader->setUniform1f("uMinorStep", lines.MinorStep);
+    m_ShadowSweepShader->setUniform1i("uFirstMinor", lines.FirstMinor);
+    m_ShadowSweepShader->setUniform1f("uStepLength", lines.StepLength);
+    m_ShadowSweepShader->setUniform1f("uSlope", lines.Slope);
+
+    m_ShadowSweepShader->setUniform1i("uFirstLine", first_line);
+    m_ShadowSweepShader->setUniform1i("uNumLines", num_lines);
+    m_ShadowSweepShader->setUniformBool("uSoftShadows", m_ShadowSettings.Soft);
+    m_ShadowSweepShader->setUniform1f("uSharpness", m_ShadowSettings.Sharpness);
+
+    m_ShadowSweepShader->Dispatch(num_lines, 1, 1);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void MapGenerator::DispatchHorizon(const Texture2D& heightmap, glm::ivec2 offset, int size)
+{
+    heightmap.Bind();
+    m_Horizonmap->BindImageLayered(0, 0);
+
+    m_HorizonShader->Bind();
+    m_HorizonShader->setUniform2i("uTileOffset", offset);
+    m_HorizonShader->setUniform1i("uSteps", m_HorizonSteps);
+    m_HorizonShader->setUniform1i("uMaxLod", m_MipLevels);
+    m_HorizonShader->setUniformBool("uWrap", heightmap.getSpec().Wrap == GL_REPEAT);
+    BindMinMaxPyramid(*m_HorizonShader, heightmap.getResolutionX());
+
+    m_HorizonShader->Dispatch(size, size, 1);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+size_t MapGenerator::EstimateMemory(int height_res, int shadow_res, HeightFormat height_format,
+                                    NormalFormat normal_format)
+{
+    auto Texels = [](int res) { return size_t(res) * size_t(res); };
+    //Full mip chain adds a third
+    auto Chain = [](size_t bytes) { return bytes + bytes / 3; };
+
+    const int tile_res = std::min(m_TileRes, height_res);
+    const int preview_res = std::min(m_PreviewRes, height_res);
+    const int horizon_res = std::min(m_MaxHorizonRes, shadow_res);
+    const int levels = static_cast<int>(std::log2(height_res));
+
+    //Maps with a back buffer are counted twice. The procedure cache is excluded,
+    //it only grows up to its budget while editing.
+    size_t bytes = 0;
+
+    bytes += (2 * Texels(height_res) + Texels(tile_res)) * HeightBytes(height_format);
+    //Gradient, rg16f
+    bytes += (2 * Texels(height_res) + Texels(tile_res)) * 4;
+    bytes += 2 * Chain(Texels(height_res) * NormalBytes(normal_format));
+
+    if (normal_format != NormalFormat::RGBA8)
+        bytes += 2 * Chain(Texels(height_res));
+
+    bytes += 2 * Chain(Texels(shadow_res));
+    //Rgba16f, 4 azimuths per layer
+    bytes += Texels(horizon_res) * 8 * (m_HorizonDirections / 4);
+
+    bytes += Chain(Texels(preview_res) * HeightBytes(height_format)) + Chain(Texels(preview_res) * 4);
+    bytes += PyramidOffset(height_res, levels) * sizeof(glm::vec2);
+
+    return bytes;
+}
+
+size_t MapGenerator::PyramidOffset(int res, int level)
+{
+    //Sum of (res >> (k+1))^2 over k < level, same as in common/min_max.glsl
+    const size_t fine = size_t(res);
+    const size_t coarse = size_t(res >> level);
+
+    return (fine * fine - coarse * coarse) / 3;
+}
+
+void MapGenerator::BindMinMaxPyramid(Shader& shader, int res) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_MinMaxBinding, m_MinMaxBuffer);
+    shader.setUniform1i("uPyramidRes", res);
+}
+
+void MapGenerator::GenMinMaxPyramid(const Texture2D& heightmap)
+{
+    if (m_MipLevels == 0) return;
+
+    const int res = heightmap.getResolutionX();
+
+    heightmap.Bind(0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_MinMaxCounterBinding, m_MinMaxCounter);
+
+    m_MinMaxShader->Bind();
+    m_MinMaxShader->setUniformSampler2D("heightmap", 0);
+    m_MinMaxShader->setUniform1i("uLevels", m_MipLevels);
+    BindMinMaxPyramid(*m_MinMaxShader, res);
+
+    //Each pass reduces 6 levels in its workgroups and up to 6 more in the last group
+    //if they fit in one block, so maps up to 4096^2 take a single dispatch
+    constexpr int block = 64, levels_per_pass = 6;
+
+    for (int source = -1; source + 1 < m_MipLevels;)
+    {
+        const int size = (source < 0) ? res : (res >> (source + 1));
+        const int groups = (size + block - 1) / block;
+
+        m_MinMaxShader->setUniform1i("uSourceLevel", source);
+        m_MinMaxShader->Dispatch(16 * groups, 16 * groups, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        const bool tail = (groups > 1) && (size / block <= block);
+        source += tail ? 2 * levels_per_pass : levels_per_pass;
+    }
+}
+
+int MapGenerator::FirstReadbackLevel(int res, int levels)
+{
+    int level = 0;
+
+    while (level < levels && (res >> (level + 1)) > m_MaxReadbackRes)
+        level++;
+
+    return level;
+}
+
+void MapGenerator::IssueMinMaxReadback()
+{
+    const int res = m_Heightmap->getResolutionX();
+
+    CancelMinMaxReadback();
+
+    //Pyramid would only describe the base tile, culling uses default bounds instead
+    if (UsesVirtualHeightmap())
+    {
+        m_HeightPyramid.Reset(res, m_Heightmap->getSpec().Wrap == GL_REPEAT);
+        return;
+    }
+
+    //Coarse levels are packed at the end of the buffer
+    const int first_level = FirstReadbackLevel(res, m_MipLevels);
+    const size_t offset = PyramidOffset(res, first_level) * sizeof(glm::vec2);
+    const size_t size = PyramidOffset(res, m_MipLevels) * sizeof(glm::vec2) - offset;
+
+    if (size == 0)
+    {
+        m_HeightPyramid.Reset(res, m_Heightmap->getSpec().Wrap == GL_REPEAT);
+        return;
+    }
+
+    //Pyramid passes end with a buffer update barrier
+    glBindBuffer(GL_COPY_READ_BUFFER, m_MinMaxBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_MinMaxReadBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    m_MinMaxFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_MinMaxReadRes = res;
+    m_MinMaxReadRepeat = (m_Heightmap->getSpec().Wrap == GL_REPEAT);
+}
+
+void MapGenerator::PollMinMaxReadback(bool wait)
+{
+    if (!m_MinMaxFence)
+        return;
+
+    ProfilerCPUEvent we("Map::PollMinMaxReadback");
+
+    //Headless waits, since no later frame would pick the result up
+    const GLbitfield flags = wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+    const GLuint64 timeout = wait ? std::numeric_limits<GLuint64>::max() : 0;
+
+    const GLenum status = glClientWaitSync(m_MinMaxFence, flags, timeout);
+
+    if (status == GL_TIMEOUT_EXPIRED)
+        return;
+
+    glDeleteSync(m_MinMaxFence);
+    m_MinMaxFence = nullptr;
+
+    const int res = m_MinMaxReadRes;
+
+    m_HeightPyramid.Reset(res, m_MinMaxReadRepeat);
+
+    if (status == GL_WAIT_FAILED)
+        return;
+
+    const int first_level = FirstReadbackLevel(res, m_MipLevels);
+    const size_t base = PyramidOffset(res, first_level);
+    const size_t size = (PyramidOffset(res, m_MipLevels) - base) * sizeof(glm::vec2);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, m_MinMaxReadBuffer);
+    const auto* data = static_cast<const glm::vec2*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, size,
+                                                                       GL_MAP_READ_BIT));
+
+    if (data)
+    {
+        for (int i = first_level; i < m_MipLevels; i++)
+        {
+            const size_t level_size = size_t(res >> (i + 1));
+            const auto* level = data + (PyramidOffset(res, i) - base);
+
+            m_HeightPyramid.PushLevel(std::vector<glm::vec2>(level, level + level_size * level_size));
+        }
+
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void MapGenerator::CancelMinMaxReadback()
+{
+    if (m_MinMaxFence)
+        glDeleteSync(m_MinMaxFence);
+
+    m_MinMaxFence = nullptr;
+}
+
+void MapGenerator::UpdatePreview()
+{
+    ProfilerGPUEvent we("Map::UpdatePreview");
+
+    const int res = m_PreviewHeightmap->getResolutionX();
+
+    m_PreviewHeightmap->BindImage(0, 0);
+    m_HeightEditor.OnDispatch(res);
+
+    m_PreviewHeightmap->Bind();
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    DispatchNormal(*m_PreviewHeightmap, nullptr, *m_PreviewNormalmap, nullptr, glm::ivec2(0), res);
+
+    m_PreviewNormalmap->Bind();
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    //Pyramid no longer matches, culling uses default bounds until the height job is done
+    CancelMinMaxReadback();
+    m_HeightPyramid.Reset(m_Heightmap->getResolutionX(), m_Heightmap->getSpec().Wrap == GL_REPEAT);
+
+    m_ShowPreview = true;
+}
+
+void MapGenerator::Update(const glm::vec3& sun_dir)
+{
+    const bool interacting = m_Interacting;
+    m_Interacting = false;
+
+    UpdateStageTimings();
+    PollMinMaxReadback(false);
+
+    if ((m_UpdateFlags & Preview) != None)
+        UpdatePreview();
+
+    //E.g. scale changed while previewing
+    else if (m_ShowPreview && (m_UpdateFlags & Normal) != None)
+    {
+        DispatchNormal(*m_PreviewHeightmap, nullptr, *m_PreviewNormalmap, nullptr, glm::ivec2(0),
+                       m_PreviewNormalmap->getResolutionX());
+
+        m_PreviewNormalmap->Bind();
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    QueueJob(m_UpdateFlags, sun_dir);
+    m_UpdateFlags = None;
+
+    //Preview is refined once the slider is released
+    if (m_ShowPreview && interacting)
+        return;
+
+    ProcessJob(m_TimeSliced ? m_FrameBudget : std::numeric_limits<float>::infinity());
+}
+
+void MapGenerator::FinishUpdates(const glm::vec3& sun_dir)
+{
+    QueueJob(m_UpdateFlags, sun_dir);
+    m_UpdateFlags = None;
+
+    //Pending requests form another job
+    while (m_Job.Flags != None)
+    {
+        ProcessJob(std::numeric_limits<float>::infinity());
+        FinishJob();
+
+        QueueJob(None, sun_dir);
+    }
+
+    PollMinMaxReadback(true);
+}
+
+void MapGenerator::QueueJob(int flags, const glm::vec3& sun_dir)
+{
+    if ((flags & Preview) != None)
+        flags = flags | Height;
+
+    //Normals depend on the heightmap
+    if ((flags & Height) != None)
+        flags = flags | Normal;
+
+    flags = flags & (Height | Normal | Shadow);
+
+    if (m_Job.Flags == None)
+    {
+        flags = flags | m_PendingFlags;
+        m_PendingFlags = None;
+
+        if (flags != None)
+            StartJob(flags, sun_dir);
+
+        return;
+    }
+
+    //New heights invalidate all work done so far
+    if ((flags & Height) != None && !JobDone())
+    {
+        StartJob(m_Job.Flags | flags, sun_dir);
+        return;
+    }
+
+    //Stages which haven't started yet pick up the new settings,
+    //the rest waits for the next job
+    int not_started = None;
+
+    for (int stage = m_Job.Stage; stage < NumStages; stage++)
+    {
+        if (stage > m_Job.Stage || m_Job.Tile == 0)
+            not_started = not_started | StageFlag(stage);
+    }
+
+    int covered = flags & m_Job.Flags & not_started;
+
+    //Shadows need a job which also computes the horizon map
+    if (m_ShadowSettings.Method == ShadowMethod::HorizonMap && !m_HorizonValid && (m_Job.Flags & Horizon) == None)
+        covered = covered & ~Shadow;
+
+    if ((covered & Shadow) != None)
+        m_Job.SunDir = sun_dir;
+
+    m_PendingFlags = m_PendingFlags | (flags & ~covered);
+}
+
+void MapGenerator::StartJob(int flags, const glm::vec3& sun_dir)
+{
+    //Horizon map is overwritten by height jobs
+    if ((flags & Height) != None)
+        m_HorizonValid = false;
+
+    if (m_ShadowSettings.Method == ShadowMethod::HorizonMap && (flags & Shadow) != None && !m_HorizonValid)
+        flags = flags | Horizon;
+
+    m_Job.Flags = flags;
+    m_Job.Stage = HeightStage;
+    m_Job.Tile = 0;
+    m_Job.SunDir = sun_dir;
+}
+
+void MapGenerator::ProcessJob(float budget)
+{
+    bool first = true;
+
+    while (m_Job.Flags != None && m_Job.Stage < NumStages)
+    {
+        if ((m_Job.Flags & StageFlag(m_Job.Stage)) == None)
+        {
+            m_Job.Stage++;
+            continue;
+        }
+
+        const int num_tiles = getNumTiles(m_Job.Stage);
+        const float measured = m_StageTimings[m_Job.Stage].CostPerTile;
+
+        //Stages never measured (e.g. with the profiler paused) are scheduled with a conservative estimate,
+        //measured costs are kept while no new timings arrive
+        const float cost = (measured < 0.0f) ? m_DefaultTileCost : measured;
+
+        int count = num_tiles - m_Job.Tile;
+
+        if (std::isfinite(budget))
+            count = std::min(count, std::max(0, static_cast<int>(budget / std::max(cost, 1e-3f))));
+
+        //Something is always processed, otherwise an expensive stage would never finish
+        if (first)
+            count = std::max(count, 1);
+
+        if (count == 0)
+            break;
+
+        RunStage(m_Job.Stage, m_Job.Tile, count);
+
+        m_StageTimings[m_Job.Stage].LastTiles += count;
+        m_Job.Tile += count;
+
+        budget -= static_cast<float>(count) * cost;
+        first = false;
+
+        if (m_Job.Tile < num_tiles)
+            break;
+
+        m_Job.Stage++;
+        m_Job.Tile = 0;
+    }
+}
+
+void MapGenerator::RunStage(int stage, int first, int count)
+{
+    ProfilerGPUEvent we(StageEvent(stage));
+
+    const int num_tiles = getNumTiles(stage);
+    const bool whole = (first == 0 && count == num_tiles);
+
+    //Normal and shadow stages read the new heightmap if it is part of the job
+    const Texture2D& heightmap = ((m_Job.Flags & Height) != None) ? *m_HeightmapBack : *m_Heightmap;
+
+    switch (stage)
+    {
+        case HeightStage:
+        {
+            const int res = m_HeightmapBack->getResolutionX();
+
+            //Whole map at once can reuse cached procedure results
+            if (whole)
+            {
+                m_GradientBackValid = false;
+
+                //Falls back to gpu if some procedure has no cpu implementation
+                if (m_HeightBackend == HeightBackend::CPU && GenerateHeightCPU(*m_HeightmapBack))
+                    break;
+
+                //Gradient needs the whole stack in one kernel, so cached results can't be used
+                if (m_AnalyticNormals)
+                {
+                    m_HeightmapBack->BindImage(0, 0);
+                    m_GradientmapBack->BindImage(1, 0);
+
+                    m_GradientBackValid = m_HeightEditor.OnDispatchGradient(res, glm::vec2(0.0f), 1.0f / float(res));
+                }
+
+                if (!m_GradientBackValid)
+                    DispatchHeightGPU(*m_HeightmapBack);
+
+                break;
+            }
+
+            const int tile_res = m_HeightTilemap->getResolutionX();
+            const int tiles_x = res / tile_res;
+
+            //Gradient is valid only if every tile has one
+            if (first == 0)
+                m_GradientBackValid = m_AnalyticNormals;
+
+            for (int tile = first; tile < first + count; tile++)
+            {
+                const glm::ivec2 offset = tile_res * glm::ivec2(tile % tiles_x, tile / tiles_x);
+                const glm::vec2 origin = glm::vec2(offset) / float(res);
+
+                m_HeightTilemap->BindImage(0, 0);
+
+                if (m_GradientBackValid)
+                {
+                    m_GradientTilemap->BindImage(1, 0);
+                    m_GradientBackValid = m_HeightEditor.OnDispatchGradient(tile_res, origin, 1.0f / float(res));
+                }
+
+                if (!m_GradientBackValid)
+                    m_HeightEditor.OnDispatch(tile_res, origin, 1.0f / float(res));
+
+                glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+                m_HeightmapBack->CopyFrom(*m_HeightTilemap, offset.x, offset.y);
+
+                if (m_GradientBackValid)
+                    m_GradientmapBack->CopyFrom(*m_GradientTilemap, offset.x, offset.y);
+            }
+
+            break;
+        }
+
+        case MipStage:
+            GenMinMaxPyramid(*m_HeightmapBack);
+            break;
+
+        case HorizonStage:
+        {
+            const int res = m_Horizonmap->getResolutionX();
+            const int tile_res = whole ? res : std::min(m_TileRes, res);
+            const int tiles_x = res / tile_res;
+
+            for (int tile = first; tile < first + count; tile++)
+            {
+                const glm::ivec2 offset = tile_res * glm::ivec2(tile % tiles_x, tile / tiles_x);
+                DispatchHorizon(heightmap, offset, tile_res);
+
+                if (whole) break;
+            }
+
+            break;
+        }
+
+        case NormalStage:
+        case ShadowStage:
+        {
+            Texture2D& target = (stage == NormalStage) ? *m_NormalmapBack : *m_ShadowmapBack;
+
+            const int res = target.getResolutionX();
+
+            //Sweep tiles are bundles of whole lines, each line depends on all texels before it
+            if (stage == ShadowStage && m_ShadowSettings.Method == ShadowMethod::Sweep)
+            {
+                const auto lines = SweepLines::Setup(res, m_Job.SunDir, m_ScaleXZ, m_ScaleY);
+                const int per_tile = (lines.NumLines + num_tiles - 1) / num_tiles;
+
+                const int first_line = first * per_tile;
+                const int last_line = std::min((first + count) * per_tile, lines.NumLines);
+
+                if (last_line > first_line)
+                    DispatchShadowSweep(heightmap, target, lines, first_line, last_line - first_line);
+            }
+
+            else
+            {
+                //Analytic gradient from the height stage, if the whole stack had derivatives
+                const bool new_height = (m_Job.Flags & Height) != None;
+                const bool gradient_valid = new_height ? m_GradientBackValid : m_GradientValid;
+
+                const Texture2D* gradientmap = (m_AnalyticNormals && gradient_valid)
+                                             ? (new_height ? m_GradientmapBack.get() : m_Gradientmap.get())
+                                             : nullptr;
+
+                Texture2D* aomap = (m_NormalFormat != NormalFormat::RGBA8) ? m_AOmapBack.get() : nullptr;
+
+                const int tile_res = whole ? res : std::min(m_TileRes, res);
+                const int tiles_x = res / tile_res;
+
+                for (int tile = first; tile < first + count; tile++)
+                {
+                    const glm::ivec2 offset = whole ? glm::ivec2(0)
+                                                    : tile_res * glm::ivec2(tile % tiles_x, tile / tiles_x);
+
+                    if (stage == NormalStage)
+                        DispatchNormal(heightmap, gradientmap, target, aomap, offset, tile_res);
+                    else
+                        DispatchShadow(heightmap, target, m_Job.SunDir, offset, tile_res);
+
+                    if (whole) break;
+                }
+            }
+
+            if (first + count == num_tiles)
+            {
+                target.Bind();
+                glGenerateMipmap(GL_TEXTURE_2D);
+
+                if (stage == NormalStage && m_NormalFormat != NormalFormat::RGBA8)
+                {
+                    m_AOmapBack->Bind();
+                    glGenerateMipmap(GL_TEXTURE_2D);
+                }
+            }
+
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void MapGenerator::FinishJob()
+{
+    if (!JobDone())
+        return;
+
+    if ((m_Job.Flags & Height) != None)
+    {
+        std::swap(m_Heightmap, m_HeightmapBack);
+        std::swap(m_Gradientmap, m_GradientmapBack);
+        std::swap(m_GradientValid, m_GradientBackValid);
+
+        m_HeightReadback.Invalidate();
+
+        IssueMinMaxReadback();
+
+        if (UsesVirtualHeightmap())
+        {
+            m_VirtualHeightmap.Invalidate();
+            m_VirtualFlush = true;
+        }
+
+        m_ShowPreview = false;
+        m_ResourceManager.RequestPreviewUpdate(m_Heightmap);
+    }
+
+    if ((m_Job.Flags & Normal) != None)
+    {
+        std::swap(m_Normalmap, m_NormalmapBack);
+        std::swap(m_AOmap, m_AOmapBack);
+        m_ResourceManager.RequestPreviewUpdate(m_Normalmap);
+    }
+
+    if ((m_Job.Flags & Shadow) != None)
+    {
+        m_ShadowSunDir = m_Job.SunDir;
+
+        std::swap(m_Shadowmap, m_ShadowmapBack);
+        m_ResourceManager.RequestPreviewUpdate(m_Shadowmap);
+    }
+
+    if ((m_Job.Flags & Horizon) != None)
+        m_HorizonValid = true;
+
+    m_GeometryChanged = m_GeometryChanged || ((m_Job.Flags & (Height | Normal)) != None);
+
+    m_Job = MapJob{};
+}
+
+int MapGenerator::getNumTiles(int stage) const
+{
+    switch (stage)
+    {
+        case HeightStage:
+        {
+            //Cpu backend generates the whole map at once
+            if (m_HeightBackend == HeightBackend::CPU)
+                return 1;
+
+            const int tiles_x = m_Heightmap->getResolutionX() / m_HeightTilemap->getResolutionX();
+            return tiles_x * tiles_x;
+        }
+
+        case HorizonStage:
+        case NormalStage:
+        case ShadowStage:
+        {
+            const int res = (stage == HorizonStage) ? m_Horizonmap->getResolutionX()
+                          : (stage == NormalStage) ? m_Normalmap->getResolutionX()
+                                                   : m_Shadowmap->getResolutionX();
+
+            const int tiles_x = res / std::min(m_TileRes, res);
+
+            //Sweep lines span the whole map, so there are only as many bundles as tile rows
+            if (stage == ShadowStage && m_ShadowSettings.Method == ShadowMethod::Sweep)
+                return tiles_x;
+
+            return tiles_x * tiles_x;
+        }
+
+        default:
+            return 1;
+    }
+}
+
+void MapGenerator::UpdateStageTimings()
+{
+    for (int stage = 0; stage < NumStages; stage++)
+    {
+        auto& timing = m_StageTimings[stage];
+
+        if (timing.LastTiles == 0)
+            continue;
+
+        //Gpu timings of the previous frame
+        const float time = Profiler::GetLastGPUTime(StageEvent(stage));
+
+        if (time >= 0.0f)
+        {
+            const float cost = time / static_cast<float>(timing.LastTiles);
+
+            timing.CostPerTile = (timing.CostPerTile < 0.0f) ? cost
+                                                             : 0.5f * (timing.CostPerTile + cost);
+        }
+
+        timing.LastTiles = 0;
+    }
+}
+
+int MapGenerator::StageFlag(int stage)
+{
+    switch (stage)
+    {
+        case HeightStage:  return Height;
+        case MipStage:     return Height;
+        case HorizonStage: return Horizon;
+        case NormalStage:  return Normal;
+        case ShadowStage:  return Shadow;
+        default:           return None;
+    }
+}
+
+const char* MapGenerator::StageEvent(int stage)
+{
+    switch (stage)
+    {
+        case HeightStage:  return "Map::UpdateHeight";
+        case MipStage:     return "Map::GenMinMaxPyramid";
+        case HorizonStage: return "Map::UpdateHorizon";
+        case NormalStage:  return "Map::UpdateNormal";
+        case ShadowStage:  return "Map::UpdateShadow";
+        default:           return "Map::Unknown";
+    }
+}
+
+void MapGenerator::BindHeightmap(int id) const
+{
+    if (m_ShowPreview)
+        m_PreviewHeightmap->Bind(id);
+    else
+        m_Heightmap->Bind(id);
+}
+
+void MapGenerator::BindNormalmap(Shader& shader, int normal_id, int ao_id) const
+{
+    //Preview normals are always rgba8
+    const bool oct_normals = !m_ShowPreview && m_NormalFormat != NormalFormat::RGBA8;
+
+    if (m_ShowPreview)
+        m_PreviewNormalmap->Bind(normal_id);
+    else
+        m_Normalmap->Bind(normal_id);
+
+    if (oct_normals)
+        m_AOmap->Bind(ao_id);
+
+    shader.setUniformSampler2D("normalmap", normal_id);
+    shader.setUniformSampler2D("aomap", ao_id);
+    shader.setUniformBool("uOctNormals", oct_normals);
+}
+
+void MapGenerator::BindShadowmap(int id) const
+{
+    m_Shadowmap->Bind(id);
+}
+
+void MapGenerator::BindVirtualHeightmap(Shader& shader, int atlas_id, int table_id) const
+{
+    shader.setUniform1i("uVirtualHeight", int(UsesVirtualHeightmap()));
+    m_VirtualHeightmap.Bind(shader, atlas_id, table_id);
+}
+
+void MapGenerator::ImGuiTerrain(bool &open, bool update_shadows)
+{
+    float scale_xz = m_ScaleXZ;
+    float scale_y = m_ScaleY;
+
+    ImGui::SetNextWindowSize(ImVec2(300.0f, 600.0f), ImGuiCond_FirstUseEver);
+
+    ImGui::Begin(LOFI_ICONS_TERRAIN "Terrain editor", &open, ImGuiWindowFlags_NoFocusOnAppearing);
+
+    ImGuiUtils::BeginGroupPanel("Scale");
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColSliderFloat("Scale xz", &(scale_xz), 0.0f, 400.0f);
+    ImGuiUtils::ColSliderFloat("Scale y" , &(scale_y), 0.0f, 100.0f);
+    ImGui::Columns(1, "###col");
+    ImGuiUtils::EndGroupPanel();
+
+    bool scale_changed = (scale_xz != m_ScaleXZ) || (scale_y != m_ScaleY);
+
+    ImGuiUtils::BeginGroupPanel("Heightmap procedures");
+
+    bool height_changed = m_HeightEditor.OnImGui();
+
+    ImGuiUtils::EndGroupPanel();
+
+    if (auto cache = m_HeightEditor.getCache())
+    {
+        ImGuiUtils::BeginGroupPanel("Procedure cache");
+        cache->OnImGui();
+        ImGuiUtils::EndGroupPanel();
+    }
+
+    ImGuiUtils::BeginGroupPanel("Generation backend");
+
+    const std::vector<std::string> backends{ "GPU", "CPU" };
+    size_t backend = static_cast<size_t>(m_HeightBackend);
+    bool fuse = m_HeightEditor.getFuseProcedures();
+    bool analytic = m_AnalyticNormals;
+
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColCombo("Backend", backends, backend);
+
+    //Standalone procedure shaders only write r32f heightmaps
+    if (!m_HeightEditor.RequiresFusion())
+        ImGuiUtils::ColCheckbox("Fuse procedures", &fuse);
+
+    ImGuiUtils::ColCheckbox("Analytic normals", &analytic);
+    ImGuiUtils::ColInputFloat("Cross-check tolerance", &m_CrossCheckTolerance);
+    ImGui::Columns(1, "###col");
+
+    if (fuse != m_HeightEditor.getFuseProcedures())
+    {
+        m_HeightEditor.setFuseProcedures(fuse);
+        height_changed = true;
+    }
+
+    if (backend != static_cast<size_t>(m_HeightBackend))
+    {
+        m_HeightBackend = static_cast<HeightBackend>(backend);
+        height_changed = true;
+    }
+
+    //Gradient is only written by the height stage
+    if (analytic != m_AnalyticNormals)
+    {
+        m_AnalyticNormals = analytic;
+
+        if (m_AnalyticNormals && !m_GradientValid)
+            height_changed = true;
+        else
+            m_UpdateFlags = m_UpdateFlags | Normal;
+    }
+
+    if (m_CpuHeightmap)
+        ImGui::Text("Cpu workers: %d", static_cast<int>(m_CpuHeightmap->getNumWorkers()));
+
+    ImGui::Text("Fused kernels: %d", static_cast<int>(m_HeightEditor.getNumFusedKernels()));
+
+    if (ImGuiUtils::ButtonCentered("Cross-check CPU/GPU"))
+        CrossCheckHeight();
+
+    if (!m_CrossCheckResult.empty())
+        ImGui::TextWrapped("%s", m_CrossCheckResult.c_str());
+
+    ImGuiUtils::EndGroupPanel();
+
+    if (!UsesVirtualHeightmap())
+    {
+        ImGuiUtils::BeginGroupPanel("Cpu height readback");
+
+        m_HeightReadback.OnImGui();
+
+        float height = 0.0f;
+
+        if (SampleHeight(m_CameraUV, height))
+            ImGui::Text("Terrain height at camera: %.3f", 0.5f * m_ScaleY * height);
+        else
+            ImGui::Text("Terrain height at camera: not resident");
+
+        if (ImGuiUtils::ButtonCentered("Benchmark raycast"))
+            BenchmarkRaycast();
+
+        if (!m_RaycastBenchmark.empty())
+            ImGui::TextWrapped("%s", m_RaycastBenchmark.c_str());
+
+        ImGuiUtils::EndGroupPanel();
+    }
+
+    else
+    {
+        ImGuiUtils::BeginGroupPanel("Virtual heightmap");
+        m_VirtualHeightmap.OnImGui();
+        ImGuiUtils::EndGroupPanel();
+    }
+
+    ImGuiUtils::BeginGroupPanel("Background regeneration");
+
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColCheckbox("Time-sliced", &m_TimeSliced);
+    ImGuiUtils::ColSliderFloat("Gpu budget (ms)", &m_FrameBudget, 0.25f, 16.0f);
+
+    if (!UsesVirtualHeightmap())
+        ImGuiUtils::ColCheckbox("Preview while dragging", &m_Progressive);
+
+    ImGui::Columns(1, "###col");
+
+    if (m_Job.Flags != None && !JobDone())
+    {
+        const char* stage_names[] = { "height", "mips", "horizon", "normals", "shadows" };
+
+        ImGui::Text("Regenerating %s: %d/%d tiles", stage_names[m_Job.Stage],
+                    m_Job.Tile, getNumTiles(m_Job.Stage));
+    }
+
+    else
+        ImGui::Text("Idle");
+
+    ImGui::Text("Tile cost (ms): %.3f, %.3f, %.3f, %.3f, %.3f",
+                m_StageTimings[HeightStage].CostPerTile, m_StageTimings[MipStage].CostPerTile,
+                m_StageTimings[HorizonStage].CostPerTile, m_StageTimings[NormalStage].CostPerTile,
+                m_StageTimings[ShadowStage].CostPerTile);
+
+    ImGuiUtils::EndGroupPanel();
+
+    m_Interacting = m_Interacting || ImGui::IsAnyItemActive();
+
+    ImGui::End();
+
+    //Slider is still held, full resolution maps are regenerated after release
+    if (height_changed && m_Progressive && !UsesVirtualHeightmap() && ImGui::IsAnyItemActive())
+    {
+        m_UpdateFlags = m_UpdateFlags | Preview;
+
+        if (update_shadows)
+            m_UpdateFlags = m_UpdateFlags | Shadow;
+    }
+
+    else if (height_changed)
+    {
+        m_UpdateFlags = m_UpdateFlags | Height | Normal;
+
+        if (update_shadows)
+            m_UpdateFlags = m_UpdateFlags | Shadow;
+    }
+
+    else if (scale_changed)
+    {
+        m_ScaleXZ = scale_xz;
+        m_ScaleY = scale_y;
+
+        m_UpdateFlags = m_UpdateFlags | Normal;
+
+        if (update_shadows)
+            m_UpdateFlags = m_UpdateFlags | Shadow;
+    }
+
+}
+
+void MapGenerator::ImGuiShadowmap(bool &open, bool update_shadows)
+{
+    ShadowmapSettings temp = m_ShadowSettings;
+    AOSettings temp2 = m_AOSettings;
+
+    ImGui::SetNextWindowSize(ImVec2(300.0f, 600.0f), ImGuiCond_FirstUseEver);
+
+    ImGui::Begin(LOFI_ICONS_SHADOW "Shadow/AO settings", &open, ImGuiWindowFlags_NoFocusOnAppearing);
+
+    const std::vector<std::string> methods{ "Raymarch", "Sweep", "Horizon map" };
+    size_t method = static_cast<size_t>(temp.Method);
+
+    ImGuiUtils::BeginGroupPanel("Shadowmap settings:");
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColCombo("Method", methods, method);
+    ImGuiUtils::ColSliderInt("Min level", &temp.MinLevel, 0, 12);
+    ImGuiUtils::ColSliderFloat("Nudge fac", &temp.NudgeFac, 1.005f, 1.1f);
+    ImGuiUtils::ColCheckbox("Soft Shadows", &temp.Soft);
+    ImGuiUtils::ColSliderFloat("Sharpness", &temp.Sharpness, 0.1f, 3.0f);
+    ImGui::Columns(1, "###col");
+
+    temp.Method = static_cast<ShadowMethod>(method);
+
+    //Horizon angles are precomputed once per heightmap for 16 sun azimuths,
+    //sun movement then only needs a cheap lookup pass
+    if (temp.Method == ShadowMethod::HorizonMap)
+    {
+        int steps = m_HorizonSteps;
+
+        ImGui::Columns(2, "###col");
+        ImGuiUtils::ColSliderInt("Horizon steps", &steps, 8, 96);
+        ImGui::Columns(1, "###col");
+
+        if (steps != m_HorizonSteps)
+        {
+            m_HorizonSteps = steps;
+            m_HorizonValid = false;
+
+            if (update_shadows)
+                m_UpdateFlags = m_UpdateFlags | Shadow;
+        }
+    }
+
+    //Raymarcher against both sweeps, at 2048^2 and 4096^2 with the sun of the displayed shadowmap
+    if (ImGuiUtils::ButtonCentered("Benchmark shadows"))
+        BenchmarkShadows();
+
+    if (!m_ShadowBenchmark.empty())
+        ImGui::TextWrapped("%s", m_ShadowBenchmark.c_str());
+
+    ImGuiUtils::EndGroupPanel();
+
+    const std::vector<std::string> ao_methods{ "Sampled", "Horizon" };
+    size_t ao_method = static_cast<size_t>(temp2.Method);
+
+    ImGuiUtils::BeginGroupPanel("AO settings:");
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColCombo("AO Method", ao_methods, ao_method);
+
+    if (temp2.Method == AOMethod::Sampled)
+        ImGuiUtils::ColSliderInt("AO Samples", &temp2.Samples, 1, 64);
+
+    else
+    {
+        ImGuiUtils::ColSliderInt("AO Directions", &temp2.Directions, 1, 16);
+        ImGuiUtils::ColSliderInt("AO Steps", &temp2.Steps, 1, 16);
+    }
+
+    ImGuiUtils::ColSliderFloat("AO Radius", &temp2.R, 0.0f, 0.1f);
+    ImGui::Columns(1, "###col");
+
+    temp2.Method = static_cast<AOMethod>(ao_method);
+
+    //Both methods on the current heightmap, horizon AO is compared against the sampled one
+    if (ImGuiUtils::ButtonCentered("Benchmark AO"))
+        BenchmarkAO();
+
+    if (!m_AOBenchmark.empty())
+        ImGui::TextWrapped("%s", m_AOBenchmark.c_str());
+
+    ImGuiUtils::EndGroupPanel();
+
+    ImGui::End();
+
+    if (temp2 != m_AOSettings)
+    {
+        m_AOSettings = temp2;
+        m_UpdateFlags = m_UpdateFlags | Normal;
+    }
+
+    if (temp != m_ShadowSettings)
+    {
+        temp.StartCell = static_cast<int>(std::pow(2, temp.MinLevel));
+
+        m_ShadowSettings = temp;
+
+        if (update_shadows)
+            m_UpdateFlags = m_UpdateFlags | Shadow;
+    }
+}
+
+void MapGenerator::setHeightBackend(HeightBackend backend)
+{
+    if (backend == m_HeightBackend) return;
+
+    m_HeightBackend = backend;
+    m_UpdateFlags = m_UpdateFlags | Height | Normal | Shadow;
+}
+
+void MapGenerator::RequestShadowUpdate() const
+{
+    m_UpdateFlags = m_UpdateFlags | Shadow;
+}
+
+glm::vec2 MapGenerator::getOriginUV() const
+{
+    glm::dvec2 uv = m_RenderOrigin / static_cast<double>(m_ScaleXZ);
+
+    //Virtual heightmap doesn't repeat, pages are addressed by unwrapped uv
+    if (!UsesVirtualHeightmap() && m_Heightmap && m_Heightmap->getSpec().Wrap == GL_REPEAT)
+        uv -= glm::dvec2(std::floor(uv.x), std::floor(uv.y));
+
+    return glm::vec2(uv);
+}
+
+glm::vec2 MapGenerator::RenderToUV(glm::vec2 render_pos) const
+{
+    return render_pos / m_ScaleXZ + 0.5f + getOriginUV();
+}
+
+bool MapGenerator::GeometryShouldUpdate()
+{
+    //Finished maps replace the displayed ones, geometry is updated in the same frame
+    FinishJob();
+
+    const bool changed = m_GeometryChanged || (m_UpdateFlags & Preview) != None;
+    m_GeometryChanged = false;
+
+    return changed;
 }
 
 void MapGenerator::OnSerialize(nlohmann::ordered_json& output)
@@ -404,7 +2020,7 @@ bool operator==(const ShadowmapSettings& lhs, const ShadowmapSettings& rhs)
 {
     return (lhs.MinLevel == rhs.MinLevel) && (lhs.StartCell == rhs.StartCell)
         && (lhs.NudgeFac == rhs.NudgeFac) && (lhs.Soft == rhs.Soft)
-        && (lhs.Sharpness == rhs.Sharpness);
+        && (lhs.Sharpness == rhs.Sharpness) && (lhs.Method == rhs.Method);
 }
 
 bool operator!=(const ShadowmapSettings& lhs, const ShadowmapSettings& rhs)
@@ -414,7 +2030,8 @@ bool operator!=(const ShadowmapSettings& lhs, const ShadowmapSettings& rhs)
 
 bool operator==(const AOSettings& lhs, const AOSettings& rhs)
 {
-    return (lhs.Samples == rhs.Samples) && (lhs.R == rhs.R);
+    return (lhs.Method == rhs.Method) && (lhs.Samples == rhs.Samples) && (lhs.R == rhs.R)
+        && (lhs.Directions == rhs.Directions) && (lhs.Steps == rhs.Steps);
 }
 
 bool operator!=(const AOSettings& lhs, const AOSettings& rhs)
@@ -4,12 +4,42 @@
 #include "Texture.h"
 #include "TextureEditor.h"
 #include "ResourceManager.h"
+#include "VirtualHeightmap.h"
+#include "HeightReadback.h"
+
+#include "cpu/CpuHeightmap.h"
+#include "cpu/CpuShadowSweep.h"
+#include "cpu/HeightPyramid.h"
+#include "cpu/HeightQuadtree.h"
 
 #include "nlohmann/json.hpp"
 
+#include <memory>
+
+enum class AOMethod {
+    //Random heightmap taps on a disk around the texel
+    Sampled = 0,
+    //Horizons along a few directions, marched through the min/max pyramid
+    Horizon = 1
+};
+
 struct AOSettings{
+    AOMethod Method = AOMethod::Horizon;
+
     int Samples = 16;
     float R = 0.005f;
+
+    int Directions = 8;
+    int Steps = 8;
+};
+
+enum class ShadowMethod {
+    //Ray per texel through the max mip pyramid
+    Raymarch = 0,
+    //Running horizon along lines parallel to the sun azimuth, O(1) per texel
+    Sweep = 1,
+    //Lookup from horizon angles precomputed for a fixed set of azimuths
+    HorizonMap = 2
 };
 
 struct ShadowmapSettings{
@@ -21,18 +51,57 @@ struct ShadowmapSettings{
 
     bool Soft = true;
     float Sharpness = 1.0f;
+
+    ShadowMethod Method = ShadowMethod::Raymarch;
+};
+
+enum class HeightBackend {
+    GPU = 0,
+    CPU = 1
+};
+
+//Storage of the generated maps, fixed at startup
+enum class HeightFormat {
+    R32F = 0,
+    //Unsigned normalized, heights are clamped to [0,1]
+    R16 = 1
+};
+
+enum class NormalFormat {
+    //Normal in rgb, ao in alpha
+    RGBA8 = 0,
+    //Hemi-octahedral normal in rg, ao in a separate r8 map (see common/normal_map.glsl)
+    OctRG8 = 1,
+    OctRG16 = 2
 };
 
 class MapGenerator {
 public:
     MapGenerator(ResourceManager& manager);
 
-    void Init(int height_res, int shadow_res, int wrap_type);
+    void Init(int height_res, int shadow_res, int wrap_type,
+              HeightFormat height_format = HeightFormat::R32F, NormalFormat normal_format = NormalFormat::RGBA8);
+    //Vram in bytes allocated by Init with the same arguments
+    static size_t EstimateMemory(int height_res, int shadow_res, HeightFormat height_format,
+                                 NormalFormat normal_format);
+    //Regeneration is time-sliced, results replace the displayed maps in GeometryShouldUpdate
     void Update(const glm::vec3& sun_dir);
+    //Completes all pending regeneration within this call, e.g. at startup
+    void FinishUpdates(const glm::vec3& sun_dir);
+
+    //Heightmap pages are streamed around the camera, with lod 0 texel density of a height_res map.
+    //Normal, shadow and material maps still cover only the base tile.
+    void InitVirtualHeightmap(int height_res, int lods);
+    //Returns true if resident heights changed
+    bool UpdateVirtualHeightmap(glm::vec3 camera_pos);
+    bool UsesVirtualHeightmap() const { return m_VirtualHeightmap.IsInitialized(); }
 
     void BindHeightmap(int id=0) const;
-    void BindNormalmap(int id=0) const;
+    //Also sets the samplers and format switch used by common/normal_map.glsl
+    void BindNormalmap(Shader& shader, int normal_id, int ao_id) const;
     void BindShadowmap(int id=0) const;
+    //Also needed when virtual heightmap is unused, sets the uVirtualHeight switch and sampler units
+    void BindVirtualHeightmap(Shader& shader, int atlas_id, int table_id) const;
 
     void RequestShadowUpdate() const;
 
@@ -41,29 +110,144 @@ public:
 
     bool GeometryShouldUpdate();
 
+    //Generates the height stack on both backends and compares them texel by texel.
+    //Returns false if the cpu backend doesn't support the stack or some texel exceeds the tolerance.
+    bool CrossCheckHeight();
+    const std::string& getCrossCheckResult() const { return m_CrossCheckResult; }
+
+    void setHeightBackend(HeightBackend backend);
+
+    //Cpu copy of the min/max height pyramid, updated together with the heightmap
+    const HeightPyramid& getHeightPyramid() const { return m_HeightPyramid; }
+
+    //Streams the displayed heightmap back to the cpu, chunks around the camera first
+    void UpdateHeightReadback(glm::vec3 camera_pos);
+    //Thread-safe, unscaled height at heightmap uv from the cpu copy, which lags a few frames
+    //behind regeneration. Returns false if the texels aren't read back yet, or the heightmap is virtual.
+    bool SampleHeight(glm::vec2 uv, float& height) const;
+    //First terrain intersections of rays given in render space, hit parameters refer to the input rays.
+    //Uses a quadtree over the cpu copy, so it lags behind regeneration like SampleHeight.
+    //Render thread only, returns false until the heights have been read back once.
+    bool Raycast(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits);
+
     float getScaleXZ() const {return m_ScaleXZ;}
     float getScaleY() const {return m_ScaleY;}
 
+    //Render space is world space shifted by the floating origin (see Camera::RebaseOrigin)
+    void setRenderOrigin(glm::dvec3 origin) { m_RenderOrigin = glm::dvec2(origin.x, origin.z); }
+
+    //Heightmap uv of the render origin, computed in double precision.
+    //Wrapped to [0,1) for tiling worlds, so it stays exact arbitrarily far from the world origin.
+    glm::vec2 getOriginUV() const;
+
+    //Same mapping as in the shaders: uv = render_pos / scale_xz + 0.5 + origin_uv
+    glm::vec2 RenderToUV(glm::vec2 render_pos) const;
+
     void OnSerialize(nlohmann::ordered_json& output);
     void OnDeserialize(nlohmann::ordered_json& input);
 
 private:
-    void UpdateHeight();
-    void UpdateNormal();
-    void UpdateShadow(const glm::vec3& sun_dir);
+    //Offset and size in texels of the target map, dispatches cover only that tile
+    //Gradientmap may be null, normals then use central differences of the heightmap.
+    //Aomap is null for the rgba8 format, ao is then stored in alpha of the normalmap.
+    void DispatchNormal(const Texture2D& heightmap, const Texture2D* gradientmap, Texture2D& normalmap,
+                        Texture2D* aomap, glm::ivec2 offset, int size);
+    void DispatchShadow(const Texture2D& heightmap, Texture2D& shadowmap, const glm::vec3& sun_dir,
+                        glm::ivec2 offset, int size);
+    void DispatchHorizon(const Texture2D& heightmap, glm::ivec2 offset, int size);
+    void DispatchShadowRaymarch(const Texture2D& heightmap, Texture2D& shadowmap, const glm::vec3& sun_dir,
+                                glm::ivec2 offset, int size);
+    //Covers lines [first_line, first_line + num_lines) of the sweep
+    void DispatchShadowSweep(const Texture2D& heightmap, Texture2D& shadowmap, const SweepLines& lines,
+                             int first_line, int num_lines);
 
-    void GenMaxMips();
+    //Times raymarched shadows against the gpu and cpu sweeps at a few resolutions
+    void BenchmarkShadows();
+    void BenchmarkAO();
+    //Times quadtree traversal against brute-force marching on random picking rays
+    void BenchmarkRaycast();
+
+    //Rebuilds the quadtree once the readback of a newer heightmap is complete, returns false if there's none yet
+    bool UpdateHeightQuadtree();
+    //Render space ray to heightmap uv and unscaled height, linear so ray parameters are kept
+    TerrainRay RenderToHeightmap(const TerrainRay& ray) const;
+
+    //Low resolution height and normal maps, bound instead of the full ones until a height job is done
+    void UpdatePreview();
+
+    void DispatchHeightGPU(Texture2D& target);
+    bool GenerateHeightCPU(Texture2D& target);
+
+    //Min/max pyramid of the heightmap in one storage buffer, see common/min_max.glsl
+    void GenMinMaxPyramid(const Texture2D& heightmap);
+    void BindMinMaxPyramid(Shader& shader, int res) const;
+    //Copies the coarse levels to a staging buffer, the cpu pyramid keeps the previous
+    //bounds until the copy's fence is polled as signaled (a frame or two later)
+    void IssueMinMaxReadback();
+    //Wait blocks until the copy is done, used when no later frame would poll it
+    void PollMinMaxReadback(bool wait);
+    void CancelMinMaxReadback();
+    //Finest level small enough to be read back
+    static int FirstReadbackLevel(int res, int levels);
+    //First texel of the given level in the packed pyramid
+    static size_t PyramidOffset(int res, int level);
 
     enum UpdateFlags {
         None     =  0,
         Height   = (1 << 0),
         Normal   = (1 << 1),
         Shadow   = (1 << 2),
+        Preview  = (1 << 3),
+        Horizon  = (1 << 4),
+    };
+
+    //-----Time-sliced regeneration
+    //Height, normal and shadow maps are regenerated into back buffers tile by tile, stages
+    //run in this order and each only starts once the previous one is complete.
+    //Back buffers are swapped with the displayed maps when the whole job is done.
+    enum Stage {
+        HeightStage  = 0,
+        MipStage     = 1,
+        HorizonStage = 2,
+        NormalStage  = 3,
+        ShadowStage  = 4,
+        NumStages    = 5
+    };
+
+    struct MapJob {
+        //Update flags of regenerated maps, None when idle
+        int Flags = 0;
+        int Stage = HeightStage;
+        int Tile = 0;
+        glm::vec3 SunDir{ 0.0f };
+    };
+
+    struct StageTiming {
+        //Estimated from profiler timings, negative until first measured (m_DefaultTileCost is used until then)
+        float CostPerTile = -1.0f;
+        //Tiles processed in the last frame, timed by one gpu event
+        int LastTiles = 0;
     };
 
+    void QueueJob(int flags, const glm::vec3& sun_dir);
+    void StartJob(int flags, const glm::vec3& sun_dir);
+    //Processes tiles until the gpu time budget (in ms) is used up
+    void ProcessJob(float budget);
+    void FinishJob();
+    bool JobDone() const { return m_Job.Flags != None && m_Job.Stage == NumStages; }
+
+    void RunStage(int stage, int first, int count);
+    int getNumTiles(int stage) const;
+    void UpdateStageTimings();
+
+    static int StageFlag(int stage);
+    static const char* StageEvent(int stage);
+
     float m_ScaleXZ = 100.0f;
     float m_ScaleY = 20.0f;
 
+    glm::dvec2 m_RenderOrigin{ 0.0 };
+
     ShadowmapSettings m_ShadowSettings;
     AOSettings        m_AOSettings;
 
@@ -72,11 +256,115 @@ private:
 
     ResourceManager& m_ResourceManager;
 
+    HeightBackend m_HeightBackend = HeightBackend::GPU;
+    //Created on first use, since it spawns worker threads
+    std::unique_ptr<CpuHeightmapGenerator> m_CpuHeightmap;
+    std::vector<float> m_CpuHeightData;
+
+    float m_CrossCheckTolerance = 1e-3f;
+    std::string m_CrossCheckResult;
+
+    //Created on first use, since it spawns worker threads
+    std::unique_ptr<CpuShadowSweep> m_CpuShadowSweep;
+    std::string m_ShadowBenchmark, m_AOBenchmark;
+
     TextureEditor m_HeightEditor;
+    static constexpr size_t m_ProcedureCacheBudget = 256 * 1024 * 1024;
+
+    VirtualHeightmap m_VirtualHeightmap;
+    //Set when pages were dropped, they are then all regenerated at once
+    bool m_VirtualFlush = true;
     std::shared_ptr<Texture2D> m_Heightmap, m_Normalmap, m_Shadowmap;
 
+    HeightFormat m_HeightFormat = HeightFormat::R32F;
+    NormalFormat m_NormalFormat = NormalFormat::RGBA8;
+    //Only initialized for octahedral normals
+    std::shared_ptr<Texture2D> m_AOmap, m_AOmapBack;
+
+    //Level i has (height_res >> (i+1))^2 texels, (min, max) of heights in each texel's footprint
+    uint32_t m_MinMaxBuffer = 0;
+    //Counts finished workgroups, so that the last one can reduce the tail levels
+    uint32_t m_MinMaxCounter = 0;
+
+    //Staging buffer of the readback in flight, with the heightmap layout it was issued for
+    uint32_t m_MinMaxReadBuffer = 0;
+    GLsync m_MinMaxFence = nullptr;
+    int m_MinMaxReadRes = 0;
+    bool m_MinMaxReadRepeat = false;
+
+    //Need to match the bindings in common/min_max.glsl and map/min_max_pyramid.glsl
+    static constexpr int s_MinMaxBinding = 6;
+    static constexpr int s_MinMaxCounterBinding = 7;
+
+    //-----Progressive preview, used while dragging height procedure sliders
+    bool m_Progressive = true;
+    bool m_ShowPreview = false;
+    //Set by ImGui when some widget is held, preview is refined after release
+    bool m_Interacting = false;
+
+    static constexpr int m_PreviewRes = 512;
+
+    std::shared_ptr<Texture2D> m_PreviewHeightmap, m_PreviewNormalmap;
+
+    //-----Time-sliced regeneration
+    MapJob m_Job;
+    //Requests which came after their stage started, they form the next job
+    int m_PendingFlags = None;
+    //Set when a finished job changed height or normals
+    bool m_GeometryChanged = false;
+
+    bool m_TimeSliced = true;
+    float m_FrameBudget = 2.0f;
+    StageTiming m_StageTimings[NumStages];
+    //Gpu time in ms assumed per tile of an unmeasured stage
+    static constexpr float m_DefaultTileCost = 0.5f;
+
+    //Sun direction the displayed shadowmap was generated with
+    glm::vec3 m_ShadowSunDir{ 0.0f, 1.0f, 0.0f };
+
+    static constexpr int m_TileRes = 256;
+
+    //Heights are generated into this tile and copied to the heightmap
+    std::shared_ptr<Texture2D> m_HeightTilemap, m_GradientTilemap;
+    std::shared_ptr<Texture2D> m_HeightmapBack, m_NormalmapBack, m_ShadowmapBack;
+
+    //Height derivative per texel from the fused kernels, see TextureEditor::OnDispatchGradient
+    std::shared_ptr<Texture2D> m_Gradientmap, m_GradientmapBack;
+    bool m_AnalyticNormals = true;
+    bool m_GradientValid = false, m_GradientBackValid = false;
+
+    //-----Horizon map
+    //Only read by shadow stages, which never run concurrently with the horizon stage,
+    //so it isn't double buffered. Valid when it matches the displayed heightmap.
+    std::shared_ptr<TextureArray> m_Horizonmap;
+    bool m_HorizonValid = false;
+
+    static constexpr int m_HorizonDirections = 16;
+    static constexpr int m_MaxHorizonRes = 1024;
+    int m_HorizonSteps = 32;
+
+    HeightPyramid m_HeightPyramid;
+
+    HeightReadback m_HeightReadback;
+    //Last camera position passed to UpdateHeightReadback
+    glm::vec2 m_CameraUV{ 0.5f };
+    //Levels above this resolution stay on the gpu
+    static constexpr int m_MaxReadbackRes = 512;
+
+    //Created on first use, since it spawns worker threads
+    std::unique_ptr<HeightQuadtree> m_HeightQuadtree;
+    //Readback version the quadtree was built from
+    uint32_t m_QuadtreeVersion = 0;
+    double m_QuadtreeBuildTime = 0.0;
+    std::vector<TerrainRay> m_RaycastScratch;
+
+    static constexpr int m_RaycastBenchmarkRays = 100000;
+    std::string m_RaycastBenchmark;
+
     std::shared_ptr<ComputeShader> m_NormalmapShader, m_ShadowmapShader;
-    std::shared_ptr<ComputeShader> m_MipShader;
+    std::shared_ptr<ComputeShader> m_HorizonShader, m_HorizonShadowShader;
+    std::shared_ptr<ComputeShader> m_ShadowSweepShader;
+    std::shared_ptr<ComputeShader> m_MinMaxShader;
 };
 
 bool operator==(const ShadowmapSettings& lhs, const ShadowmapSettings& rhs);
@@ -0,0 +1,118 @@
+#include "ProcedureCache.h"
+
+#include "glad/glad.h"
+
+#include "imgui.h"
+#include "ImGuiUtils.h"
+
+static size_t BytesPerTexel(int internal_format)
+{
+    switch (internal_format)
+    {
+        case GL_R8:      return 1;
+        case GL_RG8:     return 2;
+        case GL_R16:     return 2;
+        case GL_R16F:    return 2;
+        case GL_RGBA8:   return 4;
+        case GL_R32F:    return 4;
+        case GL_RG16F:   return 4;
+        case GL_RG32F:   return 8;
+        case GL_RGBA16F: return 8;
+        case GL_RGBA32F: return 16;
+        default:         return 16;
+    }
+}
+
+ProcedureCache::ProcedureCache(size_t budget)
+    : m_Budget(budget)
+{}
+
+bool ProcedureCache::Load(uint64_t key, Texture2D& target)
+{
+    auto it = m_Lookup.find(key);
+
+    if (it == m_Lookup.end())
+        return false;
+
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+    m_Reused++;
+
+    target.CopyFrom(*(it->second->Texture));
+
+    return true;
+}
+
+void ProcedureCache::Store(uint64_t key, const Texture2D& source)
+{
+    m_Recomputed++;
+
+    const auto& spec = source.getSpec();
+
+    const size_t bytes = size_t(spec.ResolutionX) * size_t(spec.ResolutionY)
+                       * BytesPerTexel(spec.InternalFormat);
+
+    if (bytes > m_Budget || m_Lookup.count(key))
+        return;
+
+    while (m_Usage + bytes > m_Budget)
+        EvictLRU();
+
+    auto texture = std::make_unique<Texture2D>("Procedure cache entry");
+    texture->Initialize(spec);
+
+    //Procedures write with imageStore
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    texture->CopyFrom(source);
+
+    m_Entries.push_front(Entry{ key, bytes, std::move(texture) });
+    m_Lookup[key] = m_Entries.begin();
+
+    m_Usage += bytes;
+}
+
+void ProcedureCache::EvictLRU()
+{
+    auto& entry = m_Entries.back();
+
+    entry.Texture->Release();
+    m_Usage -= entry.Bytes;
+
+    m_Lookup.erase(entry.Key);
+    m_Entries.pop_back();
+}
+
+void ProcedureCache::Clear()
+{
+    while (!m_Entries.empty())
+        EvictLRU();
+}
+
+void ProcedureCache::setBudget(size_t budget)
+{
+    m_Budget = budget;
+
+    while (m_Usage > m_Budget)
+        EvictLRU();
+}
+
+void ProcedureCache::OnImGui()
+{
+    constexpr size_t mib = 1024 * 1024;
+
+    int budget = static_cast<int>(m_Budget / mib);
+
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColSliderInt("Budget (MiB)", &budget, 0, 2048);
+    ImGui::Columns(1, "###col");
+
+    if (static_cast<size_t>(budget) * mib != m_Budget)
+        setBudget(static_cast<size_t>(budget) * mib);
+
+    ImGui::Text("Entries: %d, usage: %.1f MiB", static_cast<int>(m_Entries.size()),
+                static_cast<float>(m_Usage) / static_cast<float>(mib));
+    ImGui::Text("Reused results: %d, recomputed steps: %d",
+                static_cast<int>(m_Reused), static_cast<int>(m_Recomputed));
+
+    if (ImGuiUtils::ButtonCentered("Clear cache"))
+        Clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+//Copies of intermediate results of a procedure stack, keyed by a hash of the instance
+//parameters chained with all instances before it. Editing instance k then only recomputes k..n.
+//Entries are evicted in LRU order once the vram budget is exceeded.
+class ProcedureCache {
+public:
+    ProcedureCache(size_t budget);
+
+    //Copies cached result into target, returns false on a miss
+    bool Load(uint64_t key, Texture2D& target);
+    //Called after each recomputed step
+    void Store(uint64_t key, const Texture2D& source);
+
+    void Clear();
+
+    void OnImGui();
+
+    void setBudget(size_t budget);
+
+    size_t getBudget() const { return m_Budget; }
+    size_t getUsage() const { return m_Usage; }
+
+private:
+    struct Entry {
+        uint64_t Key;
+        size_t Bytes;
+        std::unique_ptr<Texture2D> Texture;
+    };
+
+    void EvictLRU();
+
+    //Front is the most recently used entry
+    std::list<Entry> m_Entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_Lookup;
+
+    size_t m_Budget, m_Usage = 0;
+    size_t m_Reused = 0, m_Recomputed = 0;
+};
@@ -382,6 +382,7 @@ void SkyRenderer::UpdateAerialWithShadows()
     m_AShadowShader->setUniform3f("uTopRight", extents.TopRight);
     m_AShadowShader->setUniform1f("uScaleY", m_Map.getScaleY());
     m_AShadowShader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
+    m_AShadowShader->setUniform2f("uOriginUV", m_Map.getOriginUV());
 
     m_AShadowShader->Dispatch(res_x, res_y, res_z);
 
@@ -24,6 +24,18 @@ TerrainRenderer::TerrainRenderer(ResourceManager& manager, const PerspectiveCame
     m_WireframeShader = m_ResourceManager.RequestVertFragShader(
         "res/shaders/terrain/wireframe.vert", "res/shaders/terrain/wireframe.frag"
     );
+    m_ShadedInstancedShader    = m_ResourceManager.RequestVertFragShader(
+        "res/shaders/terrain/shaded_instanced.vert", "res/shaders/terrain/shaded.frag"
+    );
+    m_WireframeInstancedShader = m_ResourceManager.RequestVertFragShader(
+        "res/shaders/terrain/wireframe_instanced.vert", "res/shaders/terrain/wireframe.frag"
+    );
+    m_ShadedPulledShader    = m_ResourceManager.RequestVertFragShader(
+        "res/shaders/terrain/shaded_pulled.vert", "res/shaders/terrain/shaded.frag"
+    );
+    m_WireframePulledShader = m_ResourceManager.RequestVertFragShader(
+        "res/shaders/terrain/wireframe_pulled.vert", "res/shaders/terrain/wireframe.frag"
+    );
     m_DisplaceShader = m_ResourceManager.RequestComputeShader(
         "res/shaders/terrain/displace.glsl"
     );
@@ -33,36 +45,123 @@ TerrainRenderer::~TerrainRenderer() {}
 
 void TerrainRenderer::Init(uint32_t subdivisions, uint32_t levels)
 {
-    m_Clipmap.Init(subdivisions, levels);
+    m_Subdivisions = subdivisions;
+    m_Levels = levels;
+
+    InitGeometry();
 }
 
-void TerrainRenderer::Update()
+void TerrainRenderer::InitGeometry()
 {
-    ProfilerGPUEvent we("Terrain::Update (Displace)");
+    switch (m_GeometryMode)
+    {
+        case GeometryMode::Displaced:
+        {
+            if (m_Clipmap.getLevels() == 0)
+                m_Clipmap.Init(m_Subdivisions, m_Levels);
+            break;
+        }
+        case GeometryMode::Instanced:
+        {
+            if (m_InstancedClipmap.getLevels() == 0)
+                m_InstancedClipmap.Init(m_Subdivisions, m_Levels);
+            break;
+        }
+        case GeometryMode::Pulled:
+        {
+            if (m_PulledClipmap.getLevels() == 0)
+                m_PulledClipmap.Init(m_Subdivisions, m_Levels, true);
+            break;
+        }
+    }
+}
 
-    m_Map.BindHeightmap();
+InstancedClipmap* TerrainRenderer::getInstancedClipmap()
+{
+    switch (m_GeometryMode)
+    {
+        case GeometryMode::Instanced: return &m_InstancedClipmap;
+        case GeometryMode::Pulled:    return &m_PulledClipmap;
+        default:                      return nullptr;
+    }
+}
 
-    const glm::vec2 curr{ m_Camera.getPos().x, m_Camera.getPos().z };
+void TerrainRenderer::setGeometryMode(GeometryMode mode)
+{
+    //Instanced modes sample the heightmap directly, only the height cache can read virtual pages
+    if (m_Map.UsesVirtualHeightmap())
+        mode = GeometryMode::Displaced;
 
-    m_DisplaceShader->Bind();
-    m_DisplaceShader->setUniform2f("uPos", curr);
-    m_DisplaceShader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
-    m_DisplaceShader->setUniform1f("uScaleY", m_Map.getScaleY());
+    //Displaced vertices may be stale after running in other modes
+    if (mode != m_GeometryMode)
+        m_UpdateAll = true;
 
-    m_Clipmap.BindUBO(m_UBOBinding);
+    m_GeometryMode = mode;
 
-    if (m_UpdateAll)
+    InitGeometry();
+}
+
+size_t TerrainRenderer::getGeometryMemory() const
+{
+    switch (m_GeometryMode)
     {
-        m_Clipmap.RunCompute(m_DisplaceShader, m_VertBinding);
+        case GeometryMode::Instanced: return m_InstancedClipmap.getGeometryMemory();
+        case GeometryMode::Pulled:    return m_PulledClipmap.getGeometryMemory();
+        default:                      return m_Clipmap.getGeometryMemory();
+    }
+}
+
+double TerrainRenderer::getOriginGranularity() const
+{
+    if (m_Levels == 0)
+        return 1.0;
+
+    const uint32_t coarsest = std::min(m_Levels, ClipmapMaxLevels) - 1;
+
+    const float quad_size = (m_GeometryMode == GeometryMode::Instanced) ? m_InstancedClipmap.getQuadSize(coarsest)
+                          : (m_GeometryMode == GeometryMode::Pulled)    ? m_PulledClipmap.getQuadSize(coarsest)
+                                                                        : m_Clipmap.getQuadSize(coarsest);
+
+    //Trims are mirrored depending on parity of the snapped position, hence the factor of two
+    return 2.0 * static_cast<double>(quad_size);
+}
+
+void TerrainRenderer::Update()
+{
+    const glm::vec2 curr{ m_Camera.getPos().x, m_Camera.getPos().z };
+
+    //Tight culling bounds for the current camera position
+    if (auto instanced = getInstancedClipmap())
+    {
+        instanced->UpdateBounds(m_Map, curr);
     }
 
     else
     {
-        const glm::vec2 prev{ m_Camera.getPrevPos().x, m_Camera.getPrevPos().z };
+        m_Clipmap.UpdateBounds(m_Map, curr);
 
-        m_Clipmap.RunCompute(m_DisplaceShader, m_VertBinding, curr, prev);
+        if (m_OcclusionCulling)
+            m_Clipmap.UpdateOcclusion(m_Map, m_Camera.getPos());
+        else
+            m_Clipmap.ResetOcclusion();
     }
 
+    //Only the displaced clipmap keeps its own height cache
+    if (m_GeometryMode != GeometryMode::Displaced)
+        return;
+
+    ProfilerGPUEvent we("Terrain::Update (Displace)");
+
+    m_Map.BindHeightmap();
+
+    m_DisplaceShader->Bind();
+    m_DisplaceShader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
+    m_DisplaceShader->setUniform2f("uOriginUV", m_Map.getOriginUV());
+    m_Map.BindVirtualHeightmap(*m_DisplaceShader, 1, 2);
+
+    m_Clipmap.BindUBO(m_UBOBinding);
+    m_Clipmap.UpdateHeights(m_DisplaceShader, m_RectBinding, curr, m_UpdateAll);
+
     m_UpdateAll = false;
 }
 
@@ -74,11 +173,32 @@ void TerrainRenderer::RequestFullUpdate()
 void TerrainRenderer::RenderWireframe() {
     ProfilerGPUEvent we("Terrain::Draw");
 
+    auto instanced = getInstancedClipmap();
+
+    auto& shader = (m_GeometryMode == GeometryMode::Pulled)    ? m_WireframePulledShader
+                 : (m_GeometryMode == GeometryMode::Instanced) ? m_WireframeInstancedShader
+                                                               : m_WireframeShader;
+
     const glm::mat4 mvp = m_Camera.getViewProjMatrix();
 
-    m_WireframeShader->Bind();
-    m_WireframeShader->setUniform2f("uPos", m_Camera.getPos().x, m_Camera.getPos().z);
-    m_WireframeShader->setUniformMatrix4fv("uMVP", mvp);
+    shader->Bind();
+    shader->setUniform2f("uPos", m_Camera.getPos().x, m_Camera.getPos().z);
+    shader->setUniformMatrix4fv("uMVP", mvp);
+    shader->setUniform1f("uScaleY", m_Map.getScaleY());
+
+    if (instanced)
+    {
+        shader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
+        shader->setUniform2f("uOriginUV", m_Map.getOriginUV());
+        m_Map.BindHeightmap(0);
+        shader->setUniformSampler2D("heightmap", 0);
+    }
+
+    else
+    {
+        m_Clipmap.BindHeightCache(0);
+        shader->setUniformSampler2DArray("heightCache", 0);
+    }
 
     auto scale_y = m_Map.getScaleY();
 
@@ -86,77 +206,119 @@ void TerrainRenderer::RenderWireframe() {
     const glm::vec3 trim_color{ 1.0f, 0.6f, 0.0f };
     const glm::vec3 fill_color{ 1.0f, 0.0f, 0.6f };
 
-    m_WireframeShader->setUniform3f("uCol", grid_color);
+    shader->setUniform3f("uCol", grid_color);
 
-    m_Clipmap.BindBuffers(m_UBOBinding);
-
-    for (const auto& grid : m_Clipmap.getGrids())
+    if (instanced)
     {
-        if (m_Camera.IsInFrustum(grid.BoundingBox, scale_y))
-            grid.Draw();
+        instanced->BindBuffers(m_UBOBinding, m_InstanceBinding);
+
+        instanced->PushGrids(m_Camera, scale_y);
+        instanced->SubmitCommands();
+
+        shader->setUniform3f("uCol", fill_color);
+
+        instanced->PushFills();
+        instanced->SubmitCommands();
+
+        shader->setUniform3f("uCol", trim_color);
+
+        instanced->PushTrims();
+        instanced->SubmitCommands();
+
+        return;
     }
 
-    m_WireframeShader->setUniform3f("uCol", fill_color);
+    m_Clipmap.BindBuffers(m_UBOBinding);
+
+    const uint32_t levels = m_Clipmap.getLevels();
+
+    m_Clipmap.PushGrids(m_Camera, scale_y, levels);
+    m_Clipmap.SubmitCommands();
 
-    for (const auto& fill : m_Clipmap.getFills())
-        fill.Draw();
+    shader->setUniform3f("uCol", fill_color);
 
-    m_WireframeShader->setUniform3f("uCol", trim_color);
+    m_Clipmap.PushFills(levels);
+    m_Clipmap.SubmitCommands();
 
-    for (const auto& trim : m_Clipmap.getTrims())
-        trim.Draw();
+    shader->setUniform3f("uCol", trim_color);
+
+    m_Clipmap.PushTrims(levels);
+    m_Clipmap.SubmitCommands();
 }
 
 void TerrainRenderer::RenderShaded()
 {
     ProfilerGPUEvent we("Terrain::Draw");
 
+    auto instanced = getInstancedClipmap();
+
+    auto& shader = (m_GeometryMode == GeometryMode::Pulled)    ? m_ShadedPulledShader
+                 : (m_GeometryMode == GeometryMode::Instanced) ? m_ShadedInstancedShader
+                                                               : m_ShadedShader;
+
     const glm::mat4 mvp = m_Camera.getViewProjMatrix();
 
-    m_ShadedShader->Bind();
-    m_ShadedShader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
-    m_ShadedShader->setUniform3f("uLightDir", m_Sky.getSunDir());
-    m_ShadedShader->setUniform3f("uPos", m_Camera.getPos());
-    m_ShadedShader->setUniformMatrix4fv("uMVP", mvp);
-    m_ShadedShader->setUniform1i("uShadow", int(m_Shadows));
-    m_ShadedShader->setUniform1i("uMaterial", int(m_Materials));
-    m_ShadedShader->setUniform1i("uFixTiling", int(m_FixTiling));
-    m_ShadedShader->setUniform1i("uFog", int(m_Fog));
-    m_ShadedShader->setUniform3f("uSunCol", m_Sky.getSunCol());
-    //m_ShadedShader->setUniform1f("uSunCol", 1.0f);
-    m_ShadedShader->setUniform1f("uSunStr", m_SunStr);
-    m_ShadedShader->setUniform1f("uSkyDiff", m_SkyDiff);
-    m_ShadedShader->setUniform1f("uSkySpec", m_SkySpec);
-    m_ShadedShader->setUniform1f("uRefStr", m_RefStr);
-    m_ShadedShader->setUniform1f("uTilingFactor", m_TilingFactor);
-    m_ShadedShader->setUniform1f("uNormalStrength", m_NormalStrength);
-
-    m_ShadedShader->setUniform1f("uAerialDist", m_Sky.getAerialDistScale());
-
-    m_Map.BindNormalmap(0);
-    m_ShadedShader->setUniformSampler2D("normalmap", 0);
+    shader->Bind();
+    shader->setUniform1f("uScaleXZ", m_Map.getScaleXZ());
+    shader->setUniform2f("uOriginUV", m_Map.getOriginUV());
+    shader->setUniform1f("uScaleY", m_Map.getScaleY());
+    shader->setUniform3f("uLightDir", m_Sky.getSunDir());
+    shader->setUniform3f("uPos", m_Camera.getPos());
+    shader->setUniformMatrix4fv("uMVP", mvp);
+    shader->setUniform1i("uShadow", int(m_Shadows));
+    shader->setUniform1i("uMaterial", int(m_Materials));
+    shader->setUniform1i("uFixTiling", int(m_FixTiling));
+    shader->setUniform1i("uFog", int(m_Fog));
+    shader->setUniform3f("uSunCol", m_Sky.getSunCol());
+    //shader->setUniform1f("uSunCol", 1.0f);
+    shader->setUniform1f("uSunStr", m_SunStr);
+    shader->setUniform1f("uSkyDiff", m_SkyDiff);
+    shader->setUniform1f("uSkySpec", m_SkySpec);
+    shader->setUniform1f("uRefStr", m_RefStr);
+    shader->setUniform1f("uTilingFactor", m_TilingFactor);
+    shader->setUniform1f("uNormalStrength", m_NormalStrength);
+
+    shader->setUniform1f("uAerialDist", m_Sky.getAerialDistScale());
+
+    m_Map.BindNormalmap(*shader, 0, 11);
     m_Map.BindShadowmap(1);
-    m_ShadedShader->setUniformSampler2D("shadowmap", 1);
+    shader->setUniformSampler2D("shadowmap", 1);
     m_MaterialMap.BindMaterialmap(2);
-    m_ShadedShader->setUniformSampler2D("materialmap", 2);
+    shader->setUniformSampler2D("materialmap", 2);
 
     m_Material.BindAlbedo(3);
-    m_ShadedShader->setUniformSampler2DArray("albedo", 3);
+    shader->setUniformSampler2DArray("albedo", 3);
     m_Material.BindNormal(4);
-    m_ShadedShader->setUniformSampler2DArray("normal", 4);
+    shader->setUniformSampler2DArray("normal", 4);
 
     m_Sky.BindIrradiance(5);
-    m_ShadedShader->setUniformSamplerCube("irradiance", 5);
+    shader->setUniformSamplerCube("irradiance", 5);
     m_Sky.BindPrefiltered(6);
-    m_ShadedShader->setUniformSamplerCube("prefiltered", 6);
+    shader->setUniformSamplerCube("prefiltered", 6);
     m_Sky.BindAerial(7);
-    m_ShadedShader->setUniformSampler3D("aerial", 7);
+    shader->setUniformSampler3D("aerial", 7);
+
+    m_Map.BindVirtualHeightmap(*shader, 9, 10);
 
     auto scale_y = m_Map.getScaleY();
 
-    m_Clipmap.BindBuffers(m_UBOBinding);
+    if (instanced)
+    {
+        m_Map.BindHeightmap(8);
+        shader->setUniformSampler2D("heightmap", 8);
+
+        instanced->BindBuffers(m_UBOBinding, m_InstanceBinding);
+        instanced->Draw(m_Camera, scale_y);
+    }
+
+    else
+    {
+        m_Clipmap.BindHeightCache(8);
+        shader->setUniformSampler2DArray("heightCache", 8);
 
-    m_Clipmap.Draw(m_Camera, scale_y);
+        m_Clipmap.BindBuffers(m_UBOBinding);
+        m_Clipmap.Draw(m_Camera, scale_y);
+    }
 }
 
 void TerrainRenderer::OnImGui(bool& open)
@@ -190,6 +352,22 @@ void TerrainRenderer::OnImGui(bool& open)
     ImGui::Columns(1, "###col");
     ImGuiUtils::EndGroupPanel();
 
+    ImGuiUtils::BeginGroupPanel("Geometry:");
+    const std::vector<std::string> modes{ "Displaced", "Instanced", "Pulled" };
+    size_t mode = static_cast<size_t>(m_GeometryMode);
+
+    const size_t memory = getGeometryMemory();
+
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColCombo("Clipmap mode", modes, mode);
+    ImGuiUtils::ColCheckbox("Occlusion culling", &m_OcclusionCulling);
+    ImGui::Columns(1, "###col");
+    ImGui::Text("Geometry memory: %.1f KiB", static_cast<float>(memory) / 1024.0f);
+    ImGuiUtils::EndGroupPanel();
+
+    if (mode != static_cast<size_t>(m_GeometryMode))
+        setGeometryMode(static_cast<GeometryMode>(mode));
+
     ImGuiUtils::BeginGroupPanel("Background:");
     ImGui::Columns(2, "###col");
     ImGuiUtils::ColColorEdit3("ClearColor", &m_ClearColor);
@@ -201,5 +379,13 @@ void TerrainRenderer::OnImGui(bool& open)
 
 void TerrainRenderer::OnImGuiDebugCulling(bool& open)
 {
+    if (m_GeometryMode != GeometryMode::Displaced)
+    {
+        ImGui::Begin("Frustum culling debug", &open);
+        ImGui::Text("Only available for the displaced clipmap");
+        ImGui::End();
+        return;
+    }
+
     m_Clipmap.ImGuiDebugCulling(m_Camera, m_Map.getScaleY(), open);
 }
\ No newline at end of file
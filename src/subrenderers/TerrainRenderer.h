@@ -12,6 +12,15 @@
 
 #include "ResourceManager.h"
 
+//Displaced - separate geometry for every grid/strip, heights written by a compute pass
+//Instanced - canonical meshes drawn instanced, heights sampled in the vertex shader
+//Pulled    - same as instanced, but without vertex/index buffers (vertex pulling)
+enum class GeometryMode {
+    Displaced = 0,
+    Instanced = 1,
+    Pulled    = 2
+};
+
 class TerrainRenderer {
 public:
     TerrainRenderer(ResourceManager& manager, const PerspectiveCamera& cam,
@@ -24,6 +33,8 @@ public:
     void Update();
     void RequestFullUpdate();
 
+    void setGeometryMode(GeometryMode mode);
+
     void RenderWireframe();
     void RenderShaded();
 
@@ -35,7 +46,20 @@ public:
 
     glm::vec3 getClearColor() const { return m_ClearColor; }
 
+    //Gpu memory taken by clipmap geometry of the current mode
+    size_t getGeometryMemory() const;
+
+    //Shifting the render origin by multiples of this keeps all clipmap levels
+    //snapped to the same world positions
+    double getOriginGranularity() const;
+
 private:
+    //Initializes geometry needed by the current mode, if it wasn't already
+    void InitGeometry();
+
+    //Instanced clipmap used by the current mode, if any
+    InstancedClipmap* getInstancedClipmap();
+
     //Settings
     glm::vec3 m_ClearColor{ 0.0f, 0.0f, 0.0f };
 
@@ -58,14 +82,22 @@ private:
 
     //Private resources
     bool m_UpdateAll = true;
+    bool m_OcclusionCulling = true;
+
+    GeometryMode m_GeometryMode = GeometryMode::Displaced;
+    uint32_t m_Subdivisions = 0, m_Levels = 0;
 
     std::shared_ptr<VertFragShader> m_ShadedShader, m_WireframeShader;
+    std::shared_ptr<VertFragShader> m_ShadedInstancedShader, m_WireframeInstancedShader;
+    std::shared_ptr<VertFragShader> m_ShadedPulledShader, m_WireframePulledShader;
     std::shared_ptr<ComputeShader> m_DisplaceShader;
 
     //Binding ids for shader buffers
-    static constexpr uint32_t m_VertBinding = 1;
     //static constexpr uint32_t m_SSBOBinding = 2;
     static constexpr uint32_t m_UBOBinding = 2;
+    static constexpr uint32_t m_RectBinding = 3;
+    static constexpr uint32_t m_InstanceBinding = 4;
 
     Clipmap m_Clipmap;
+    InstancedClipmap m_InstancedClipmap, m_PulledClipmap;
 };
@@ -6,6 +6,7 @@
 #include "ImGuiUtils.h"
 
 #include <algorithm>
+#include <iostream>
 
 Procedure::Procedure(ResourceManager& manager)
     : m_ResourceManager(manager)
@@ -16,10 +17,17 @@ void Procedure::CompileShader(const std::string& filepath)
     m_Shader = m_ResourceManager.RequestComputeShader(filepath);
 }
 
-void Procedure::OnDispatch(int res, const std::vector<InstanceData>& v_data)
+void Procedure::OnDispatch(int res, const std::vector<InstanceData>& v_data,
+                           glm::vec2 texel_origin, float texel_size)
 {
     m_Shader->Bind();
 
+    if (m_Shader->HasUniform("uTexelOrigin"))
+    {
+        m_Shader->setUniform2f("uTexelOrigin", texel_origin);
+        m_Shader->setUniform1f("uTexelSize", texel_size);
+    }
+
     for (size_t i = 0; i < m_Tasks.size(); i++)
     {
         auto& task = m_Tasks[i];
@@ -77,6 +85,20 @@ void EditorBase::RegisterShader(const std::string& name,
     std::sort(m_ProcedureNames.begin(), m_ProcedureNames.end());
 }
 
+void EditorBase::RegisterStep(const std::string& name, const std::string& step_path,
+                              const std::string& step_function, const std::string& step_derivative,
+                              const std::vector<std::string>& derivative_zero_params)
+{
+    if (!m_Procedures.count(name)) return;
+
+    auto& procedure = m_Procedures.at(name);
+
+    procedure.m_StepPath = step_path;
+    procedure.m_StepFunction = step_function;
+    procedure.m_StepDerivative = step_derivative;
+    procedure.m_DerivativeZeroParams = derivative_zero_params;
+}
+
 //===========================================================================
 
 static void AddProcedureInstanceImpl(std::unordered_map<std::string, Procedure>& procedures,
@@ -117,13 +139,13 @@ static void AddProcedureInstanceImpl(std::unordered_map<std::string, Procedure>&
 
 static void OnDispatchImpl(std::unordered_map<std::string, Procedure>& procedures,
                            std::vector<ProcedureInstance>& instances,
-                           int res)
+                           int res, glm::vec2 texel_origin, float texel_size)
 {
     for (auto& instance : instances)
     {
         auto& data = instance.Data;
 
-        procedures.at(instance.Name).OnDispatch(res, data);
+        procedures.at(instance.Name).OnDispatch(res, data, texel_origin, texel_size);
     }
 
     glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
@@ -261,7 +283,377 @@ void TextureEditor::AddProcedureInstance(const std::string& name, nlohmann::orde
 
 void TextureEditor::OnDispatch(int res)
 {
-    OnDispatchImpl(m_Procedures, m_Instances, res);
+    OnDispatch(res, glm::vec2(0.0f), 1.0f / float(res));
+}
+
+void TextureEditor::OnDispatch(int res, glm::vec2 texel_origin, float texel_size)
+{
+    DispatchRange(0, m_Instances.size(), res, texel_origin, texel_size);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+bool TextureEditor::OnDispatchGradient(int res, glm::vec2 texel_origin, float texel_size)
+{
+    if (!getFuseProcedures() || m_Instances.empty())
+        return false;
+
+    auto kernel = RequestFusedKernel(0, m_Instances.size(), true);
+
+    if (!kernel)
+        return false;
+
+    DispatchFused(*kernel, 0, m_Instances.size(), res, texel_origin, texel_size);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    return true;
+}
+
+//FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static uint64_t HashInstance(uint64_t hash, const ProcedureInstance& instance)
+{
+    hash = HashBytes(hash, instance.Name.data(), instance.Name.size());
+
+    for (const auto& data : instance.Data)
+    {
+        std::visit([&hash](const auto& value) {
+            hash = HashBytes(hash, &value, sizeof(value));
+        }, data);
+
+        //Variant index separates e.g. int and float with the same bits
+        const size_t index = data.index();
+        hash = HashBytes(hash, &index, sizeof(index));
+    }
+
+    return hash;
+}
+
+void TextureEditor::OnDispatch(Texture2D& target)
+{
+    const int res = target.getResolutionX();
+
+    target.BindImage(0, 0);
+
+    if (!m_Cache)
+    {
+        OnDispatch(res);
+        return;
+    }
+
+    //Key of each instance covers all instances before it
+    std::vector<uint64_t> keys;
+
+    uint64_t key = HashBytes(14695981039346656037ull, &res, sizeof(res));
+
+    for (const auto& instance : m_Instances)
+    {
+        key = HashInstance(key, instance);
+        keys.push_back(key);
+    }
+
+    //Restart after the longest cached prefix
+    size_t start = 0;
+
+    for (size_t i = keys.size(); i > 0; i--)
+    {
+        if (m_Cache->Load(keys[i - 1], target))
+        {
+            start = i;
+            break;
+        }
+    }
+
+    const glm::vec2 texel_origin(0.0f);
+    const float texel_size = 1.0f / float(res);
+
+    const size_t count = m_Instances.size();
+    bool cacheable = true;
+
+    if (!m_FuseProcedures)
+    {
+        for (size_t i = start; i < count; i++)
+        {
+            //Results past a skipped instance don't match their keys
+            if (!DispatchRange(i, i + 1, res, texel_origin, texel_size))
+                cacheable = false;
+
+            if (cacheable)
+                m_Cache->Store(keys[i], target);
+        }
+    }
+
+    //Fused kernels don't expose intermediate results, so the stack is split only
+    //before the first instance changed since the last dispatch. The next edit
+    //of the same instance then starts from the cached result before it.
+    else
+    {
+        size_t split = 0;
+
+        while (split < count && split < m_LastKeys.size() && keys[split] == m_LastKeys[split])
+            split++;
+
+        if (split > start && split < count)
+        {
+            cacheable = DispatchRange(start, split, res, texel_origin, texel_size);
+
+            if (cacheable)
+                m_Cache->Store(keys[split - 1], target);
+
+            start = split;
+        }
+
+        if (start < count)
+        {
+            if (DispatchRange(start, count, res, texel_origin, texel_size) && cacheable)
+                m_Cache->Store(keys[count - 1], target);
+        }
+    }
+
+    m_LastKeys = keys;
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+bool TextureEditor::DispatchRange(size_t first, size_t last, int res, glm::vec2 texel_origin, float texel_size)
+{
+    if (first >= last)
+        return true;
+
+    //Single procedure gains nothing from fusion, unless the standalone shaders can't write the target
+    if ((m_FuseProcedures && last - first > 1) || RequiresFusion())
+    {
+        if (auto kernel = RequestFusedKernel(first, last))
+        {
+            DispatchFused(*kernel, first, last, res, texel_origin, texel_size);
+            return true;
+        }
+    }
+
+    //Standalone shaders would write the target as r32f, so ranges are split
+    //until they fit in a kernel (e.g. too many parameters), and instances
+    //without a step function are skipped
+    if (RequiresFusion())
+    {
+        if (last - first > 1)
+        {
+            const size_t mid = first + (last - first) / 2;
+
+            const bool lower = DispatchRange(first, mid, res, texel_origin, texel_size);
+            const bool upper = DispatchRange(mid, last, res, texel_origin, texel_size);
+
+            return lower && upper;
+        }
+
+        std::cerr << "TextureEditor Error: Procedure " << m_Instances[first].Name
+                  << " can't write " << m_ImageFormat << " images, skipping it\n";
+
+        return false;
+    }
+
+    for (size_t i = first; i < last; i++)
+    {
+        auto& instance = m_Instances[i];
+
+        m_Procedures.at(instance.Name).OnDispatch(res, instance.Data, texel_origin, texel_size);
+    }
+
+    return true;
+}
+
+void TextureEditor::DispatchFused(ComputeShader& kernel, size_t first, size_t last,
+                                  int res, glm::vec2 texel_origin, float texel_size)
+{
+    UploadFusedParams(first, last);
+
+    kernel.Bind();
+    kernel.setUniform2f("uTexelOrigin", texel_origin);
+    kernel.setUniform1f("uTexelSize", texel_size);
+    kernel.Dispatch(res, res, 1);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+//Parameters of all fused instances are stored in consecutive vec4 slots of a ubo, in task order
+static std::string FusedParamAccess(const InstanceData& data, size_t slot)
+{
+    const std::string param = "Params[" + std::to_string(slot) + "]";
+
+    if (std::holds_alternative<float>(data))
+        return param + ".x";
+
+    if (std::holds_alternative<glm::vec3>(data))
+        return param + ".xyz";
+
+    //Ints and enums
+    return "int(" + param + ".x)";
+}
+
+//Checks the instance values of parameters the derivative step doesn't account for
+static bool DerivativeApplies(const Procedure& procedure, const ProcedureInstance& instance)
+{
+    for (size_t task_idx = 0; task_idx < procedure.m_Tasks.size(); task_idx++)
+    {
+        const auto& params = procedure.m_DerivativeZeroParams;
+        const auto& name = procedure.m_Tasks[task_idx]->getUniformName();
+
+        if (std::find(params.begin(), params.end(), name) == params.end())
+            continue;
+
+        const auto& data = instance.Data[task_idx];
+
+        const bool zero = (std::holds_alternative<float>(data) && std::get<float>(data) == 0.0f)
+                       || (std::holds_alternative<int>(data) && std::get<int>(data) == 0);
+
+        if (!zero)
+            return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<ComputeShader> TextureEditor::RequestFusedKernel(size_t first, size_t last, bool gradient)
+{
+    std::string signature = m_ImageFormat + (gradient ? ", gradient: " : ": ");
+    size_t num_params = 0;
+
+    for (size_t i = first; i < last; i++)
+    {
+        const auto& instance = m_Instances[i];
+        const auto& procedure = m_Procedures.at(instance.Name);
+
+        if (procedure.m_StepFunction.empty() || (gradient && procedure.m_StepDerivative.empty()))
+            return nullptr;
+
+        if (gradient && !DerivativeApplies(procedure, instance))
+            return nullptr;
+
+        signature += instance.Name + ", ";
+        num_params += instance.Data.size();
+    }
+
+    if (num_params > s_MaxFusedParams)
+        return nullptr;
+
+    signature.resize(signature.size() - 2);
+
+    if (m_FusedKernels.count(signature))
+        return m_FusedKernels.at(signature);
+
+    //Every distinct step file is included once
+    std::vector<std::string> step_paths;
+
+    std::string calls;
+    size_t slot = 0;
+
+    for (size_t i = first; i < last; i++)
+    {
+        const auto& instance = m_Instances[i];
+        const auto& procedure = m_Procedures.at(instance.Name);
+
+        if (std::find(step_paths.begin(), step_paths.end(), procedure.m_StepPath) == step_paths.end())
+            step_paths.push_back(procedure.m_StepPath);
+
+        const auto& function = gradient ? procedure.m_StepDerivative : procedure.m_StepFunction;
+
+        calls += "    h = " + function + "(h, uv";
+
+        for (const auto& data : instance.Data)
+            calls += ", " + FusedParamAccess(data, slot++);
+
+        calls += ");\n";
+    }
+
+    std::string source = "#version 450 core\n\n"
+        "layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;\n\n"
+        "layout(" + m_ImageFormat + ", binding = 0) uniform image2D heightmap;\n";
+
+    if (gradient)
+        source += "layout(rg16f, binding = 1) uniform image2D gradientmap;\n";
+
+    source += "\n"
+        "layout(std140, binding = " + std::to_string(s_FusedParamsBinding) + ") uniform procedureParams\n"
+        "{\n    vec4 Params[" + std::to_string(s_MaxFusedParams) + "];\n};\n\n"
+        "uniform vec2 uTexelOrigin;\n"
+        "uniform float uTexelSize;\n\n";
+
+    for (const auto& path : step_paths)
+        source += "#include \"" + path + "\"\n";
+
+    source += "\nvoid main() {\n"
+        "    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);\n"
+        "    vec2 uv = uTexelOrigin + uTexelSize*vec2(texelCoord);\n\n";
+
+    //Gradients are stored per texel, which keeps them in half float range
+    if (gradient)
+    {
+        source += "    vec3 h = vec3(float(imageLoad(heightmap, texelCoord)),\n"
+            "                  imageLoad(gradientmap, texelCoord).xy / uTexelSize);\n\n"
+            + calls +
+            "\n    imageStore(heightmap, texelCoord, vec4(h.x));\n"
+            "    imageStore(gradientmap, texelCoord, vec4(uTexelSize*h.yz, 0.0, 0.0));\n}\n";
+    }
+
+    else
+    {
+        source += "    float h = float(imageLoad(heightmap, texelCoord));\n\n"
+            + calls +
+            "\n    imageStore(heightmap, texelCoord, vec4(h));\n}\n";
+    }
+
+    auto kernel = m_ResourceManager.RequestComputeShader("Fused procedures (" + signature + ")", source);
+    m_FusedKernels[signature] = kernel;
+
+    return kernel;
+}
+
+void TextureEditor::UploadFusedParams(size_t first, size_t last)
+{
+    std::vector<glm::vec4> params;
+
+    for (size_t i = first; i < last; i++)
+    {
+        for (const auto& data : m_Instances[i].Data)
+        {
+            std::visit([&params](const auto& value) {
+                using T = std::decay_t<decltype(value)>;
+
+                if constexpr (std::is_same_v<T, glm::vec3>)
+                    params.push_back(glm::vec4(value, 0.0f));
+                else
+                    params.push_back(glm::vec4(static_cast<float>(value)));
+            }, data);
+        }
+    }
+
+    if (m_FusedParamsBuffer == 0)
+    {
+        glGenBuffers(1, &m_FusedParamsBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_FusedParamsBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, s_MaxFusedParams * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_FusedParamsBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, params.size() * sizeof(glm::vec4), params.data());
+    glBindBufferBase(GL_UNIFORM_BUFFER, s_FusedParamsBinding, m_FusedParamsBuffer);
+}
+
+void TextureEditor::EnableCache(size_t budget)
+{
+    m_Cache = std::make_unique<ProcedureCache>(budget);
 }
 
 bool TextureEditor::OnImGui()
@@ -305,6 +697,31 @@ void TextureEditor::OnDeserialize(nlohmann::ordered_json& input)
     }
 }
 
+std::vector<ProcedureParams> TextureEditor::getProcedureStack() const
+{
+    std::vector<ProcedureParams> res;
+
+    for (auto& instance : m_Instances)
+    {
+        if (!m_Procedures.count(instance.Name))
+            continue;
+
+        const auto& procedure = m_Procedures.at(instance.Name);
+
+        ProcedureParams params{ instance.Name, {} };
+
+        for (size_t task_idx = 0; task_idx < procedure.m_Tasks.size(); task_idx++)
+        {
+            const auto& name = procedure.m_Tasks[task_idx]->getUniformName();
+            params.Values[name] = instance.Data[task_idx];
+        }
+
+        res.push_back(params);
+    }
+
+    return res;
+}
+
 //===========================================================================
 
 uint32_t TextureArrayEditor::s_InstanceCount = 0;
@@ -334,7 +751,7 @@ void TextureArrayEditor::OnDispatch(int layer, int res)
 {
     auto& instances = m_InstanceLists[layer];
 
-    OnDispatchImpl(m_Procedures, instances, res);
+    OnDispatchImpl(m_Procedures, instances, res, glm::vec2(0.0f), 1.0f / float(res));
 }
 
 bool TextureArrayEditor::OnImGui(int layer)
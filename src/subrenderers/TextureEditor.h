@@ -2,6 +2,7 @@
 
 #include "ResourceManager.h"
 #include "EditorTask.h"
+#include "ProcedureCache.h"
 
 #include <memory>
 #include <unordered_map>
@@ -22,15 +23,32 @@ public:
         m_Tasks.push_back(std::make_unique<T>(args...));
     }
 
-    void OnDispatch(int res, const std::vector<InstanceData>& v_data);
+    //Texel origin/size define the uv domain of the image, for procedures that sample by position
+    void OnDispatch(int res, const std::vector<InstanceData>& v_data,
+                    glm::vec2 texel_origin, float texel_size);
     bool OnImGui(std::vector<InstanceData>& v_data, uint32_t id);
 
     std::shared_ptr<ComputeShader> m_Shader;
     std::vector<std::unique_ptr<EditorTask>> m_Tasks;
 
+    //Pointwise procedures can be fused with others, the step function takes
+    //(prev height, uv) followed by parameters in the order of m_Tasks
+    std::string m_StepPath, m_StepFunction;
+    //Optional variant of the step on vec3 (height, d/du, d/dv), in the same file
+    std::string m_StepDerivative;
+    //Uniforms whose effect the derivative step leaves out, it's only used while they are all zero
+    std::vector<std::string> m_DerivativeZeroParams;
+
     ResourceManager& m_ResourceManager;
 };
 
+//Procedure name with its parameters keyed by uniform names,
+//lets backends other than compute shaders evaluate the same procedure stack
+struct ProcedureParams {
+    std::string Name;
+    std::unordered_map<std::string, InstanceData> Values;
+};
+
 class ProcedureInstance {
 public:
     ProcedureInstance(const std::string& name);
@@ -46,6 +64,10 @@ public:
     EditorBase(ResourceManager& manager);
 
     void RegisterShader(const std::string& name, const std::string& filepath);
+    //Path relative to the working directory, see Procedure::m_StepFunction
+    void RegisterStep(const std::string& name, const std::string& step_path,
+                      const std::string& step_function, const std::string& step_derivative = "",
+                      const std::vector<std::string>& derivative_zero_params = {});
 
     template<class T, typename ... Args>
     void Attach(const std::string& name, Args ... args)
@@ -73,17 +95,65 @@ public:
     void AddProcedureInstance(const std::string& name);
 
     void OnDispatch(int res);
+    //Generates a res x res window of the uv plane, starting at texel_origin
+    void OnDispatch(int res, glm::vec2 texel_origin, float texel_size);
+    //Generates the whole target, reusing cached intermediate results if the cache is enabled
+    void OnDispatch(Texture2D& target);
+    //Same as OnDispatch(res, texel_origin, texel_size), the whole stack runs in one fused kernel which
+    //also writes the gradient (height difference per texel along x and y) to the image on unit 1.
+    //Returns false without dispatching if fusion is off, some procedure has no derivative step,
+    //or has a non-zero parameter its derivative step leaves out.
+    bool OnDispatchGradient(int res, glm::vec2 texel_origin, float texel_size);
     bool OnImGui();
 
+    //Budget in bytes of vram for the intermediate results
+    void EnableCache(size_t budget);
+    ProcedureCache* getCache() { return m_Cache.get(); }
+
+    //Consecutive procedures with registered steps are evaluated in one generated kernel
+    void setFuseProcedures(bool fuse) { m_FuseProcedures = fuse; }
+    bool getFuseProcedures() const { return m_FuseProcedures || RequiresFusion(); }
+
+    //GLSL format qualifier of the target image. Standalone procedure shaders declare r32f,
+    //so any other format runs every procedure through a fused kernel.
+    void setImageFormat(const std::string& format) { m_ImageFormat = format; }
+    bool RequiresFusion() const { return m_ImageFormat != "r32f"; }
+    size_t getNumFusedKernels() const { return m_FusedKernels.size(); }
+
     void OnSerialize(nlohmann::ordered_json& output);
     void OnDeserialize(nlohmann::ordered_json& input);
 
+    std::vector<ProcedureParams> getProcedureStack() const;
+
     std::string getName() const { return m_Name; }
 private:
     void AddProcedureInstance(const std::string& name, nlohmann::ordered_json& input);
 
+    //Dispatches instances [first, last) on the image bound to unit 0.
+    //Returns false if some instance couldn't be dispatched in the target format
+    bool DispatchRange(size_t first, size_t last, int res, glm::vec2 texel_origin, float texel_size);
+
+    //Gradient kernels call the derivative steps and also read/write the image on unit 1
+    std::shared_ptr<ComputeShader> RequestFusedKernel(size_t first, size_t last, bool gradient = false);
+    void UploadFusedParams(size_t first, size_t last);
+    void DispatchFused(ComputeShader& kernel, size_t first, size_t last,
+                       int res, glm::vec2 texel_origin, float texel_size);
+
     std::vector<ProcedureInstance> m_Instances;
 
+    std::unique_ptr<ProcedureCache> m_Cache;
+    //Keys of the previous cached dispatch
+    std::vector<uint64_t> m_LastKeys;
+
+    bool m_FuseProcedures = true;
+    std::string m_ImageFormat = "r32f";
+    //Keyed by stack signature (image format and names of fused procedures, also marking gradient kernels)
+    std::unordered_map<std::string, std::shared_ptr<ComputeShader>> m_FusedKernels;
+    uint32_t m_FusedParamsBuffer = 0;
+
+    static constexpr size_t s_MaxFusedParams = 256;
+    static constexpr int s_FusedParamsBinding = 5;
+
     std::string m_Name;
 
     uint32_t m_InstanceID;
@@ -0,0 +1,275 @@
+#include "VirtualHeightmap.h"
+
+#include "Profiler.h"
+
+#include "glad/glad.h"
+
+#include "imgui.h"
+#include "ImGuiUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+static_assert((VirtualHeightmap::TableSize & (VirtualHeightmap::TableSize - 1)) == 0,
+              "Page table size needs to be a power of 2");
+
+//Otherwise pages of one window would overwrite each other in the page table
+static_assert(2 * VirtualHeightmap::WindowRadius + 1 <= VirtualHeightmap::TableSize,
+              "Page window doesn't fit in the page table");
+
+//Otherwise requested pages would evict each other
+static_assert((2 * VirtualHeightmap::WindowRadius + 1) * (2 * VirtualHeightmap::WindowRadius + 1)
+              <= VirtualHeightmap::SlotsPerLod, "Not enough atlas slots for the page window");
+
+VirtualHeightmap::VirtualHeightmap(ResourceManager& manager)
+    : m_PageTable("Virtual page table")
+{
+    m_Atlas = manager.RequestTextureArray("Virtual height atlas");
+}
+
+void VirtualHeightmap::Init(float texel_size, int lods)
+{
+    m_TexelSize = texel_size;
+    m_Lods = lods;
+    m_Slots = SlotsPerLod * lods;
+
+    //Single mip, pages are always sampled at their own resolution
+    m_Atlas->Initialize(Texture2DSpec{
+        SlotTexels, SlotTexels, GL_R32F, GL_RED,
+        GL_FLOAT, GL_LINEAR, GL_LINEAR,
+        GL_CLAMP_TO_EDGE,
+        {0.0f, 0.0f, 0.0f, 0.0f}
+    }, m_Slots, 1);
+
+    m_PageTable.Initialize(Texture2DSpec{
+        TableSize, TableSize, GL_RGBA32I, GL_RGBA_INTEGER,
+        GL_INT, GL_NEAREST, GL_NEAREST,
+        GL_REPEAT,
+        {0.0f, 0.0f, 0.0f, 0.0f}
+    }, m_Lods, 1);
+
+    m_Table.resize(size_t(TableSize) * size_t(TableSize) * size_t(m_Lods));
+
+    Invalidate();
+}
+
+void VirtualHeightmap::Invalidate()
+{
+    m_Imprecise = false;
+    m_Pages.clear();
+    m_PageLookup.clear();
+
+    m_FreeSlots.resize(m_Slots);
+
+    //Reversed, so that slots are handed out in increasing order
+    for (int i = 0; i < m_Slots; i++)
+        m_FreeSlots[i] = m_Slots - 1 - i;
+
+    std::fill(m_Table.begin(), m_Table.end(), glm::ivec4(-1, 0, 0, 0));
+    m_TableDirty = true;
+}
+
+bool VirtualHeightmap::Update(TextureEditor& editor, glm::dvec2 center_uv, bool generate_all)
+{
+    if (!IsInitialized())
+        return false;
+
+    struct Request {
+        int Lod;
+        glm::ivec2 Coord;
+        int Distance;
+    };
+
+    std::vector<Request> missing;
+
+    for (int lod = m_Lods - 1; lod >= 0; lod--)
+    {
+        const double page_uv = PageTexels * getTexelSize(lod);
+        const glm::ivec2 center = glm::ivec2(glm::floor(center_uv / page_uv));
+
+        for (int y = -WindowRadius; y <= WindowRadius; y++)
+        {
+            for (int x = -WindowRadius; x <= WindowRadius; x++)
+            {
+                const glm::ivec2 coord = center + glm::ivec2(x, y);
+
+                auto it = m_PageLookup.find(PageKey(lod, coord));
+
+                //Resident pages are moved to the front of the LRU list
+                if (it != m_PageLookup.end())
+                    m_Pages.splice(m_Pages.begin(), m_Pages, it->second);
+
+                else
+                    missing.push_back(Request{ lod, coord, std::max(std::abs(x), std::abs(y)) });
+            }
+        }
+    }
+
+    //Coarse lods first, closest pages first within each lod
+    std::stable_sort(missing.begin(), missing.end(), [](const Request& lhs, const Request& rhs) {
+        if (lhs.Lod != rhs.Lod)
+            return lhs.Lod > rhs.Lod;
+
+        return lhs.Distance < rhs.Distance;
+    });
+
+    const size_t count = generate_all ? missing.size()
+                                      : std::min(missing.size(), static_cast<size_t>(m_PageBudget));
+
+    if (count > 0)
+    {
+        ProfilerGPUEvent we("Map::UpdateVirtualHeightmap");
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto& request = missing[i];
+
+            const size_t idx = TableIndex(request.Lod, request.Coord);
+
+            //Toroidal addressing, some other page of this lod may use the same entry
+            if (m_Table[idx].x >= 0)
+            {
+                const glm::ivec2 old_coord{ m_Table[idx].y, m_Table[idx].z };
+                EvictPage(m_PageLookup.at(PageKey(request.Lod, old_coord)));
+            }
+
+            const Page page{ request.Lod, request.Coord, AcquireSlot() };
+
+            GeneratePage(editor, page);
+
+            m_Pages.push_front(page);
+            m_PageLookup[PageKey(page.Lod, page.Coord)] = m_Pages.begin();
+
+            m_Table[idx] = glm::ivec4(page.Slot, page.Coord.x, page.Coord.y, 0);
+            m_TableDirty = true;
+        }
+
+        //Procedures write with imageStore, pages are read with texture fetches
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    if (m_TableDirty)
+    {
+        m_PageTable.Bind();
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, TableSize, TableSize, m_Lods,
+                        GL_RGBA_INTEGER, GL_INT, m_Table.data());
+
+        m_TableDirty = false;
+    }
+
+    m_LastGenerated = static_cast<int>(count);
+    m_LastPending = static_cast<int>(missing.size() - count);
+
+    return count > 0;
+}
+
+int VirtualHeightmap::AcquireSlot()
+{
+    //Capacity exceeds the number of requested pages, so the least recently used
+    //page is never one requested in the current update
+    if (m_FreeSlots.empty())
+        EvictPage(std::prev(m_Pages.end()));
+
+    const int slot = m_FreeSlots.back();
+    m_FreeSlots.pop_back();
+
+    return slot;
+}
+
+void VirtualHeightmap::EvictPage(std::list<Page>::iterator it)
+{
+    const size_t idx = TableIndex(it->Lod, it->Coord);
+
+    if (m_Table[idx].x == it->Slot)
+    {
+        m_Table[idx] = glm::ivec4(-1, 0, 0, 0);
+        m_TableDirty = true;
+    }
+
+    m_FreeSlots.push_back(it->Slot);
+    m_PageLookup.erase(PageKey(it->Lod, it->Coord));
+    m_Pages.erase(it);
+}
+
+void VirtualHeightmap::GeneratePage(TextureEditor& editor, const Page& page)
+{
+    //Texel i of the slot lies at page origin + (i - border) texels,
+    //position is computed in double, since the page origin may be far away
+    const double texel_size = getTexelSize(page.Lod);
+    const glm::dvec2 origin = glm::dvec2(page.Coord) * (PageTexels * texel_size) - PageBorder * texel_size;
+
+    //Procedures still evaluate uv in float, so texel positions snap to the float spacing
+    //at the page, which becomes visible once it reaches a fraction of the texel size
+    const double extent = std::max(std::abs(origin.x), std::abs(origin.y)) + SlotTexels * texel_size;
+
+    if (!m_Imprecise && extent * std::numeric_limits<float>::epsilon() > MaxTexelError * texel_size)
+    {
+        std::cerr << "VirtualHeightmap Warning: Pages beyond uv " << MaxTexelError * texel_size
+                     / std::numeric_limits<float>::epsilon() << " lose texel precision\n";
+        m_Imprecise = true;
+    }
+
+    m_Atlas->BindImage(0, page.Slot, 0);
+    editor.OnDispatch(SlotTexels, glm::vec2(origin), static_cast<float>(texel_size));
+}
+
+void VirtualHeightmap::Bind(Shader& shader, int atlas_id, int table_id) const
+{
+    if (IsInitialized())
+    {
+        m_Atlas->Bind(atlas_id);
+        m_PageTable.Bind(table_id);
+    }
+
+    shader.setUniformSampler2DArray("virtualAtlas", atlas_id);
+    shader.setUniformISampler2DArray("virtualTable", table_id);
+    shader.setUniform1i("uVirtualLods", m_Lods);
+    shader.setUniform1f("uVirtualTexelSize", m_TexelSize);
+}
+
+void VirtualHeightmap::OnImGui()
+{
+    ImGui::Columns(2, "###col");
+    ImGuiUtils::ColSliderInt("Pages per frame", &m_PageBudget, 1, 64);
+    ImGui::Columns(1, "###col");
+
+    ImGui::Text("Resident pages: %d/%d", static_cast<int>(m_Pages.size()), m_Slots);
+    ImGui::Text("Generated: %d, pending: %d", m_LastGenerated, m_LastPending);
+    ImGui::Text("Atlas memory: %.1f MiB", static_cast<float>(getMemory()) / (1024.0f * 1024.0f));
+
+    if (m_Imprecise)
+        ImGui::TextUnformatted("Some pages lie beyond the float precision range");
+}
+
+size_t VirtualHeightmap::getMemory() const
+{
+    const size_t atlas = size_t(SlotTexels) * size_t(SlotTexels) * size_t(m_Slots) * sizeof(float);
+    const size_t table = m_Table.size() * sizeof(glm::ivec4);
+
+    return atlas + table;
+}
+
+uint64_t VirtualHeightmap::PageKey(int lod, glm::ivec2 coord)
+{
+    constexpr uint64_t mask = (uint64_t(1) << 28) - 1;
+
+    return (uint64_t(lod) << 56)
+         | ((uint64_t(uint32_t(coord.x)) & mask) << 28)
+         |  (uint64_t(uint32_t(coord.y)) & mask);
+}
+
+size_t VirtualHeightmap::TableIndex(int lod, glm::ivec2 coord) const
+{
+    //Same wrapping as in the shader, works for negative coords too
+    const glm::ivec2 wrapped{ coord.x & (TableSize - 1), coord.y & (TableSize - 1) };
+
+    return (size_t(lod) * TableSize + size_t(wrapped.y)) * TableSize + size_t(wrapped.x);
+}
+
+double VirtualHeightmap::getTexelSize(int lod) const
+{
+    return static_cast<double>(m_TexelSize) * static_cast<double>(1 << lod);
+}
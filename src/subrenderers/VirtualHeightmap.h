@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Shader.h"
+#include "Texture.h"
+#include "TextureEditor.h"
+#include "ResourceManager.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//Heightmap without bounds, split into square pages generated on demand by the height procedures.
+//Every lod keeps a window of pages around the camera. Pages of all lods share one physical atlas
+//(a texture array, one page per layer) with LRU eviction, shaders locate them through
+//a toroidal page table per lod (see common/virtual_height.glsl).
+class VirtualHeightmap {
+public:
+    VirtualHeightmap(ResourceManager& manager);
+
+    //Texel size is the heightmap uv distance between texels of the finest lod
+    void Init(float texel_size, int lods);
+
+    //Makes pages around center_uv resident, returns true if any page was generated.
+    //Coarse lods come first, so there is always something to fall back to.
+    //Unless generate_all is set, at most m_PageBudget pages are generated per call.
+    bool Update(TextureEditor& editor, glm::dvec2 center_uv, bool generate_all);
+
+    //Drops all pages, needed after the height procedures change
+    void Invalidate();
+
+    //Also sets sampler units when uninitialized, so that they never alias other samplers
+    void Bind(Shader& shader, int atlas_id, int table_id) const;
+
+    void OnImGui();
+
+    bool IsInitialized() const { return m_Lods > 0; }
+    size_t getMemory() const;
+
+    static constexpr int PageTexels = 128;
+    static constexpr int PageBorder = 1;
+    static constexpr int SlotTexels = PageTexels + 2 * PageBorder;
+
+    //Page table resolution per lod, needs to be a power of 2
+    static constexpr int TableSize = 8;
+    //Pages at most this far (in pages of given lod) from the camera are requested
+    static constexpr int WindowRadius = 2;
+    //Atlas capacity per lod, between the window size and table size
+    static constexpr int SlotsPerLod = 40;
+
+    //Page origins are computed in double, but procedures get them as float, so positions are
+    //only exact to the float spacing there. Pages whose spacing exceeds this fraction of
+    //their texel size are reported, i.e. beyond |uv| = 2^21 texels of their lod
+    //(512 uv for 4096 texels per uv at the finest lod, coarser lods reach further).
+    static constexpr double MaxTexelError = 0.25;
+
+private:
+    struct Page {
+        int Lod;
+        glm::ivec2 Coord;
+        int Slot;
+    };
+
+    static uint64_t PageKey(int lod, glm::ivec2 coord);
+    size_t TableIndex(int lod, glm::ivec2 coord) const;
+    double getTexelSize(int lod) const;
+
+    int AcquireSlot();
+    void EvictPage(std::list<Page>::iterator it);
+    void GeneratePage(TextureEditor& editor, const Page& page);
+
+    float m_TexelSize = 0.0f;
+    int m_Lods = 0;
+    int m_Slots = 0;
+
+    int m_PageBudget = 16;
+    int m_LastGenerated = 0, m_LastPending = 0;
+    //Set once some page was generated beyond the float precision range, until Invalidate
+    bool m_Imprecise = false;
+
+    //Front is the most recently used page
+    std::list<Page> m_Pages;
+    std::unordered_map<uint64_t, std::list<Page>::iterator> m_PageLookup;
+    std::vector<int> m_FreeSlots;
+
+    //Cpu copy of the page table, (slot, page x, page y, unused), slot is -1 for empty entries
+    std::vector<glm::ivec4> m_Table;
+    bool m_TableDirty = false;
+
+    std::shared_ptr<TextureArray> m_Atlas;
+    //Not registered in the resource manager, since the texture browser can't preview integer textures
+    TextureArray m_PageTable;
+};